@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Parsing of Annex B byte streams, the H.264 and H.265 format of the encoders and decoders: NAL
+// units each preceded by a 00 00 01 or 00 00 00 01 start code. Emulation prevention guarantees
+// that 00 00 01 never appears inside a NAL unit.
+// The start code search compares 16 (SSE2, NEON) or 32 (AVX2, picked at run time) positions at a
+// time, as memchr does, and only looks at single bytes near the end of the buffer.
+
+// Returns the 00 00 01 found first at or after begin, end if none.
+const uint8_t *AnnexBFindStartCode(const uint8_t *begin, const uint8_t *end);
+// Same, one byte at a time. Reference for the tests and the benchmark.
+const uint8_t *AnnexBFindStartCodeScalar(const uint8_t *begin, const uint8_t *end);
+// Instruction set AnnexBFindStartCode() uses on this CPU: "avx2", "sse2", "neon" or "scalar".
+const char *AnnexBSearchIsa();
+
+struct AnnexBNal {
+	// First byte of the start code, the leading zero of a 4 byte start code included.
+	const uint8_t *begin;
+	// Start of the next NAL unit, or end of the buffer.
+	const uint8_t *end;
+	// NAL unit type, in the numbering of the codec. -1 if the NAL unit has no header.
+	int type;
+};
+
+// Iterates over the NAL units of a buffer without copying it. Bytes before the first start code
+// are skipped.
+class AnnexBParser {
+public:
+	AnnexBParser(const uint8_t *data, size_t size, bool h265);
+
+	// Returns false after the last NAL unit.
+	bool Next(AnnexBNal &nal);
+
+private:
+	// Start code of the next NAL unit, m_end if none.
+	const uint8_t *m_code;
+	const uint8_t *m_begin;
+	const uint8_t *m_end;
+	bool m_h265;
+};
+
+// SEI and access unit delimiters: metadata the decoder does not need.
+bool AnnexBIsDroppable(int type, bool h265);
+// Coded slices of a picture.
+bool AnnexBIsSlice(int type, bool h265);
+// SPS, PPS, and VPS for H.265.
+bool AnnexBIsParameterSet(int type, bool h265);
+// Slices of a picture the decoder can start from: IDR (H.264) or IRAP (H.265).
+bool AnnexBIsKeyframeSlice(int type, bool h265);
+// Slice that starts a picture: first_mb_in_slice is 0 (H.264) or first_slice_segment_in_pic_flag
+// is set (H.265).
+bool AnnexBIsFirstSlice(const AnnexBNal &nal, bool h265);
+
+// With split encoding, a frame is the access units of independent streams back to back, one per
+// eye. Returns the offset of the NAL unit that starts the second one, its parameter sets or its
+// first slice, or size if the buffer holds a single picture.
+size_t AnnexBFindSecondPicture(const uint8_t *data, size_t size, bool h265);
+
+// Removes the droppable NAL units from data in place: the kept ones are moved to the front, runs
+// of kept NAL units with a single memmove. Bytes before the first start code are dropped too.
+// Returns the new size.
+size_t AnnexBFilterInPlace(uint8_t *data, size_t size, bool h265);
@@ -41,6 +41,20 @@
 #include <assert.h>
 #include "rs.h"
 
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define RS_SIMD_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define RS_TARGET(isa)
+#else
+#define RS_TARGET(isa) __attribute__((target(isa)))
+#endif
+#elif defined(__aarch64__)
+#define RS_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
 #ifdef _MSC_VER
 #define alloca(x) _alloca(x)
 #endif
@@ -80,6 +94,18 @@ static gf __declspec(align (256)) gf_mul_table[(GF_SIZE + 1)*(GF_SIZE + 1)];
 static gf gf_mul_table[(GF_SIZE + 1)*(GF_SIZE + 1)] __attribute__((aligned (256)));
 #endif
 
+/*
+ * Split nibble tables used by the SIMD kernels:
+ * gf_mul_lo[c][x] = c * x, gf_mul_hi[c][x] = c * (x << 4), for x in [0, 16)
+ */
+#ifdef _MSC_VER
+static gf __declspec(align (16)) gf_mul_lo[GF_SIZE + 1][16];
+static gf __declspec(align (16)) gf_mul_hi[GF_SIZE + 1][16];
+#else
+static gf gf_mul_lo[GF_SIZE + 1][16] __attribute__((aligned (16)));
+static gf gf_mul_hi[GF_SIZE + 1][16] __attribute__((aligned (16)));
+#endif
+
 /*
  * modnn(x) computes x % GF_SIZE, where GF_SIZE is 2**GF_BITS - 1,
  * without a slow divide.
@@ -92,28 +118,163 @@ static inline gf modnn(int x) {
     return x;
 }
 
-static void addmul(gf *dst1, gf *src1, gf c, int sz) {
+/*
+ * Region multiply kernels. dst[i] (^)= c * src[i] for i in [0, sz).
+ *
+ * The scalar kernel looks up gf_mul_table one byte at a time. The SIMD kernels split every source
+ * byte in two nibbles and use them as indices in two 16 entry tables (c * low nibble,
+ * c * high nibble) with a byte shuffle, then xor the two halves together. Since multiplication is
+ * linear over xor, the result is bit-identical to the table lookup.
+ * The kernel is selected once at runtime in reed_solomon_init().
+ */
+typedef void (*gf_region_fn)(gf *dst, gf *src, gf c, int sz, int accumulate);
+
+static void region_scalar(gf *dst1, gf *src1, gf c, int sz, int accumulate) {
     USE_GF_MULC;
-    if (c != 0) {
-        register gf *dst = dst1, *src = src1;
-        gf *lim = &dst[sz];
+    gf *dst = dst1, *src = src1;
+    gf *lim = &dst[sz];
 
-        GF_MULC0(c);
+    GF_MULC0(c);
+    if (accumulate) {
         for (; dst < lim; dst++, src++)
             GF_ADDMULC(*dst, *src);
+    } else {
+        for (; dst < lim; dst++, src++)
+            GF_MULC(*dst, *src);
+    }
+}
+
+#if defined(RS_SIMD_X86)
+RS_TARGET("ssse3")
+static void region_ssse3(gf *dst, gf *src, gf c, int sz, int accumulate) {
+    const __m128i lo = _mm_loadu_si128((const __m128i *)gf_mul_lo[c]);
+    const __m128i hi = _mm_loadu_si128((const __m128i *)gf_mul_hi[c]);
+    const __m128i mask = _mm_set1_epi8(0x0f);
+    int i = 0;
+
+    for (; i + 16 <= sz; i += 16) {
+        __m128i s = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i p = _mm_xor_si128(_mm_shuffle_epi8(lo, _mm_and_si128(s, mask)),
+                                  _mm_shuffle_epi8(hi, _mm_and_si128(_mm_srli_epi64(s, 4), mask)));
+        if (accumulate)
+            p = _mm_xor_si128(p, _mm_loadu_si128((const __m128i *)(dst + i)));
+        _mm_storeu_si128((__m128i *)(dst + i), p);
+    }
+    region_scalar(dst + i, src + i, c, sz - i, accumulate);
+}
+
+RS_TARGET("avx2")
+static void region_avx2(gf *dst, gf *src, gf c, int sz, int accumulate) {
+    const __m256i lo = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)gf_mul_lo[c]));
+    const __m256i hi = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)gf_mul_hi[c]));
+    const __m256i mask = _mm256_set1_epi8(0x0f);
+    int i = 0;
+
+    for (; i + 32 <= sz; i += 32) {
+        __m256i s = _mm256_loadu_si256((const __m256i *)(src + i));
+        __m256i p = _mm256_xor_si256(_mm256_shuffle_epi8(lo, _mm256_and_si256(s, mask)),
+                                     _mm256_shuffle_epi8(hi, _mm256_and_si256(_mm256_srli_epi64(s, 4), mask)));
+        if (accumulate)
+            p = _mm256_xor_si256(p, _mm256_loadu_si256((const __m256i *)(dst + i)));
+        _mm256_storeu_si256((__m256i *)(dst + i), p);
+    }
+    region_scalar(dst + i, src + i, c, sz - i, accumulate);
+}
+
+RS_TARGET("avx512f,avx512bw")
+static void region_avx512(gf *dst, gf *src, gf c, int sz, int accumulate) {
+    const __m512i lo = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i *)gf_mul_lo[c]));
+    const __m512i hi = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i *)gf_mul_hi[c]));
+    const __m512i mask = _mm512_set1_epi8(0x0f);
+    int i = 0;
+
+    for (; i + 64 <= sz; i += 64) {
+        __m512i s = _mm512_loadu_si512((const void *)(src + i));
+        __m512i p = _mm512_xor_si512(_mm512_shuffle_epi8(lo, _mm512_and_si512(s, mask)),
+                                     _mm512_shuffle_epi8(hi, _mm512_and_si512(_mm512_srli_epi64(s, 4), mask)));
+        if (accumulate)
+            p = _mm512_xor_si512(p, _mm512_loadu_si512((const void *)(dst + i)));
+        _mm512_storeu_si512((void *)(dst + i), p);
+    }
+    region_scalar(dst + i, src + i, c, sz - i, accumulate);
+}
+#endif
+
+#if defined(RS_SIMD_NEON)
+static void region_neon(gf *dst, gf *src, gf c, int sz, int accumulate) {
+    const uint8x16_t lo = vld1q_u8(gf_mul_lo[c]);
+    const uint8x16_t hi = vld1q_u8(gf_mul_hi[c]);
+    const uint8x16_t mask = vdupq_n_u8(0x0f);
+    int i = 0;
+
+    for (; i + 16 <= sz; i += 16) {
+        uint8x16_t s = vld1q_u8(src + i);
+        uint8x16_t p = veorq_u8(vqtbl1q_u8(lo, vandq_u8(s, mask)),
+                                vqtbl1q_u8(hi, vshrq_n_u8(s, 4)));
+        if (accumulate)
+            p = veorq_u8(p, vld1q_u8(dst + i));
+        vst1q_u8(dst + i, p);
+    }
+    region_scalar(dst + i, src + i, c, sz - i, accumulate);
+}
+#endif
+
+static gf_region_fn gf_region = region_scalar;
+
+static void select_region_kernel(void) {
+    gf_region = region_scalar;
+#if defined(RS_SIMD_X86)
+#ifdef _MSC_VER
+    {
+        int info[4];
+        int max_leaf, ssse3, os_ymm = 0, os_zmm = 0, avx2 = 0, avx512 = 0;
+
+        __cpuid(info, 0);
+        max_leaf = info[0];
+        __cpuid(info, 1);
+        ssse3 = (info[2] >> 9) & 1;
+        if (((info[2] >> 27) & 1) && ((info[2] >> 28) & 1)) {
+            /* OSXSAVE and AVX: check that the OS saves the vector registers */
+            unsigned long long xcr0 = _xgetbv(0);
+            os_ymm = (xcr0 & 0x06) == 0x06;
+            os_zmm = (xcr0 & 0xe6) == 0xe6;
+        }
+        if (max_leaf >= 7) {
+            __cpuidex(info, 7, 0);
+            avx2 = os_ymm && ((info[1] >> 5) & 1);
+            avx512 = os_zmm && ((info[1] >> 16) & 1) && ((info[1] >> 30) & 1);
+        }
+        if (avx512)
+            gf_region = region_avx512;
+        else if (avx2)
+            gf_region = region_avx2;
+        else if (ssse3)
+            gf_region = region_ssse3;
     }
+#else
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))
+        gf_region = region_avx512;
+    else if (__builtin_cpu_supports("avx2"))
+        gf_region = region_avx2;
+    else if (__builtin_cpu_supports("ssse3"))
+        gf_region = region_ssse3;
+#endif
+#elif defined(RS_SIMD_NEON)
+    gf_region = region_neon;
+#endif
+}
+
+static void addmul(gf *dst1, gf *src1, gf c, int sz) {
+    if (c != 0)
+        gf_region(dst1, src1, c, sz, 1);
 }
 
 static void mul(gf *dst1, gf *src1, gf c, int sz) {
-    USE_GF_MULC;
-    if (c != 0) {
-        register gf *dst = dst1, *src = src1;
-        gf *lim = &dst[sz];
-        GF_MULC0(c);
-        for (; dst < lim; dst++, src++)
-            GF_MULC(*dst , *src);
-    } else
-        memset(dst1, 0, c);
+    if (c != 0)
+        gf_region(dst1, src1, c, sz, 0);
+    else
+        memset(dst1, 0, sz);
 }
 
 /* y = a.dot(b) */
@@ -148,6 +309,12 @@ static void init_mul_table(void) {
 
     for (j=0; j< GF_SIZE+1; j++)
         gf_mul_table[j] = gf_mul_table[j<<8] = 0;
+
+    for (i=0; i< GF_SIZE+1; i++)
+    for (j=0; j< 16; j++) {
+        gf_mul_lo[i][j] = gf_mul_table[(i<<8)+j];
+        gf_mul_hi[i][j] = gf_mul_table[(i<<8)+(j<<4)];
+    }
 }
 
 /*
@@ -352,6 +519,8 @@ static gf* sub_matrix(gf* matrix, int rmin, int cmin, int rmax, int cmax, int nc
     return new_m;
 }
 
+static void decode_cache_release(reed_solomon* rs);
+
 /* copy from golang rs version */
 static inline int code_some_shards(gf* matrixRows, gf** inputs, gf** outputs, int dataShards, int outputCount, int byteCount) {
     gf* in;
@@ -372,6 +541,7 @@ static inline int code_some_shards(gf* matrixRows, gf** inputs, gf** outputs, in
 void reed_solomon_init(void) {
     generate_gf();
     init_mul_table();
+    select_region_kernel();
 }
 
 reed_solomon* reed_solomon_new(int data_shards, int parity_shards) {
@@ -390,6 +560,8 @@ reed_solomon* reed_solomon_new(int data_shards, int parity_shards) {
         rs->shards = (data_shards + parity_shards);
         rs->m = NULL;
         rs->parity = NULL;
+        rs->decode_cache = NULL;
+        rs->decode_clock = 0;
 
         if (rs->shards > DATA_SHARDS_MAX || data_shards <= 0 || parity_shards <= 0) {
             err = 1;
@@ -465,6 +637,8 @@ reed_solomon* reed_solomon_new(int data_shards, int parity_shards) {
 
 void reed_solomon_release(reed_solomon* rs) {
     if (NULL != rs) {
+        decode_cache_release(rs);
+
         if (NULL != rs->m)
             free(rs->m);
 
@@ -475,6 +649,67 @@ void reed_solomon_release(reed_solomon* rs) {
     }
 }
 
+/*
+ * Decode matrices are cached per instance, keyed by the set of shard rows used for decoding.
+ * For a given geometry only a few erasure patterns are common, so most reconstructions can skip
+ * building and inverting the sub matrix.
+ */
+#define DECODE_CACHE_SIZE 8
+#define DECODE_CACHE_KEY_SIZE ((DATA_SHARDS_MAX + 7) / 8)
+
+struct _rs_decode_entry {
+    unsigned char key[DECODE_CACHE_KEY_SIZE]; /* bitmap of the shard rows used for decoding */
+    unsigned int last_use; /* 0 if the entry is empty */
+    gf* matrix; /* one row per erased block, data_shards columns */
+};
+
+/*
+ * Find the entry matching key. On a miss, return the least recently used entry, emptied and ready
+ * to be filled by the caller.
+ */
+static struct _rs_decode_entry* decode_cache_find(reed_solomon* rs, const unsigned char* key, int* hit) {
+    struct _rs_decode_entry* victim;
+    int i;
+
+    *hit = 0;
+    if (NULL == rs->decode_cache) {
+        rs->decode_cache = (struct _rs_decode_entry*) calloc(DECODE_CACHE_SIZE, sizeof(struct _rs_decode_entry));
+        if (NULL == rs->decode_cache)
+            return NULL;
+    }
+
+    rs->decode_clock++;
+    victim = &rs->decode_cache[0];
+    for (i = 0; i < DECODE_CACHE_SIZE; i++) {
+        struct _rs_decode_entry* e = &rs->decode_cache[i];
+        if (e->last_use != 0 && memcmp(e->key, key, DECODE_CACHE_KEY_SIZE) == 0) {
+            e->last_use = rs->decode_clock;
+            *hit = 1;
+            return e;
+        }
+        if (e->last_use < victim->last_use)
+            victim = e;
+    }
+
+    if (NULL == victim->matrix) {
+        victim->matrix = (gf*) malloc(rs->data_shards * rs->data_shards);
+        if (NULL == victim->matrix)
+            return NULL;
+    }
+    victim->last_use = 0;
+    return victim;
+}
+
+static void decode_cache_release(reed_solomon* rs) {
+    int i;
+    if (NULL != rs->decode_cache) {
+        for (i = 0; i < DECODE_CACHE_SIZE; i++)
+            free(rs->decode_cache[i].matrix);
+        free(rs->decode_cache);
+        rs->decode_cache = NULL;
+    }
+}
+
 /**
  * decode one shard
  * input:
@@ -490,8 +725,12 @@ static int reed_solomon_decode(reed_solomon* rs, unsigned char **data_blocks, in
     gf dataDecodeMatrix[DATA_SHARDS_MAX*DATA_SHARDS_MAX];
     unsigned char* subShards[DATA_SHARDS_MAX];
     unsigned char* outputs[DATA_SHARDS_MAX];
+    int rows[DATA_SHARDS_MAX];
+    unsigned char key[DECODE_CACHE_KEY_SIZE];
+    struct _rs_decode_entry* entry;
     gf* m = rs->m;
-    int i, j, c, swap, subMatrixRow, dataShards, nos, nshards;
+    gf* decodeMatrix;
+    int i, j, c, swap, subMatrixRow, dataShards, hit;
 
     /* the erased_blocks should always sorted
      * if sorted, nr_fec_blocks times to check it
@@ -515,43 +754,58 @@ static int reed_solomon_decode(reed_solomon* rs, unsigned char **data_blocks, in
 
     j = 0;
     subMatrixRow = 0;
-    nos = 0;
-    nshards = 0;
     dataShards = rs->data_shards;
     for (i = 0; i < dataShards; i++) {
-        if (j < nr_fec_blocks && i == (int) erased_blocks[j])
+        if (j < nr_fec_blocks && i == (int)erased_blocks[j])
             j++;
         else {
             /* this row is ok */
-            for (c = 0; c < dataShards; c++)
-                dataDecodeMatrix[subMatrixRow*dataShards + c] = m[i*dataShards + c];
-
+            rows[subMatrixRow] = i;
             subShards[subMatrixRow] = data_blocks[i];
             subMatrixRow++;
         }
     }
 
     for (i = 0; i < nr_fec_blocks && subMatrixRow < dataShards; i++) {
+        rows[subMatrixRow] = dataShards + fec_block_nos[i];
         subShards[subMatrixRow] = dec_fec_blocks[i];
-        j = dataShards + fec_block_nos[i];
-        for (c = 0; c < dataShards; c++)
-            dataDecodeMatrix[subMatrixRow*dataShards + c] = m[j*dataShards + c];
-
         subMatrixRow++;
     }
 
     if (subMatrixRow < dataShards)
         return -1;
 
-    invert_mat(dataDecodeMatrix, dataShards);
+    memset(key, 0, sizeof(key));
+    for (i = 0; i < dataShards; i++)
+        key[rows[i] >> 3] |= 1 << (rows[i] & 7);
 
-    for (i = 0; i < nr_fec_blocks; i++) {
-        j = erased_blocks[i];
-        outputs[i] = data_blocks[j];
-        memmove(dataDecodeMatrix+i*dataShards, dataDecodeMatrix+j*dataShards, dataShards);
+    entry = decode_cache_find(rs, key, &hit);
+    if (hit) {
+        decodeMatrix = entry->matrix;
+    } else {
+        for (i = 0; i < dataShards; i++)
+            memcpy(dataDecodeMatrix + i*dataShards, m + rows[i]*dataShards, dataShards);
+
+        if (invert_mat(dataDecodeMatrix, dataShards) != 0)
+            entry = NULL;
+
+        for (i = 0; i < nr_fec_blocks; i++) {
+            j = erased_blocks[i];
+            memmove(dataDecodeMatrix+i*dataShards, dataDecodeMatrix+j*dataShards, dataShards);
+        }
+        decodeMatrix = dataDecodeMatrix;
+
+        if (NULL != entry) {
+            memcpy(entry->key, key, sizeof(key));
+            memcpy(entry->matrix, dataDecodeMatrix, nr_fec_blocks*dataShards);
+            entry->last_use = rs->decode_clock;
+        }
     }
 
-    return code_some_shards(dataDecodeMatrix, subShards, outputs, dataShards, nr_fec_blocks, block_size);
+    for (i = 0; i < nr_fec_blocks; i++)
+        outputs[i] = data_blocks[erased_blocks[i]];
+
+    return code_some_shards(decodeMatrix, subShards, outputs, dataShards, nr_fec_blocks, block_size);
 }
 
 /**
@@ -577,6 +831,14 @@ int reed_solomon_encode(reed_solomon* rs, unsigned char** shards, int nr_shards,
     return 0;
 }
 
+int reed_solomon_encode_parity(reed_solomon* rs, unsigned char** data_blocks, unsigned char** fec_blocks, int first_parity, int nr_parity, int block_size) {
+    if (first_parity < 0 || nr_parity < 0 || first_parity + nr_parity > rs->parity_shards)
+        return -1;
+
+    code_some_shards(&rs->parity[first_parity * rs->data_shards], data_blocks, fec_blocks, rs->data_shards, nr_parity, block_size);
+    return 0;
+}
+
 /**
  * reconstruct a big size of buffer
  * input:
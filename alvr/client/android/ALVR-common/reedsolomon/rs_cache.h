@@ -0,0 +1,35 @@
+#pragma once
+
+#include <list>
+#include <memory>
+#include <mutex>
+
+#include "rs.h"
+
+// Process wide cache of Reed-Solomon instances keyed by shard geometry.
+// Building the encoding matrix is expensive and most frames use one of a few geometries, so
+// instances are kept alive and shared instead of being created and released per frame.
+// Encoding with a shared instance is thread safe. reed_solomon_reconstruct caches decode
+// matrices inside the instance, so it must not be called concurrently on the same instance.
+class ReedSolomonCache {
+public:
+	static ReedSolomonCache &Instance();
+
+	// Returns NULL if the geometry is invalid or the allocation failed.
+	std::shared_ptr<reed_solomon> Get(int dataShards, int parityShards);
+
+private:
+	ReedSolomonCache();
+
+	struct Entry {
+		int dataShards;
+		int parityShards;
+		std::shared_ptr<reed_solomon> rs;
+	};
+
+	static const size_t MAX_ENTRIES = 32;
+
+	std::mutex m_mutex;
+	// Most recently used first.
+	std::list<Entry> m_entries;
+};
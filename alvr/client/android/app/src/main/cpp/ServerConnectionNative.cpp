@@ -7,6 +7,8 @@
 #include <jni.h>
 #include "packet_types.h"
 #include "nal.h"
+#include "arrival_report.h"
+#include "packet_loss.h"
 #include "latency_collector.h"
 
 class ServerConnectionNative {
@@ -17,8 +19,10 @@ public:
     uint64_t timeSyncSequence = (uint64_t) -1;
     uint64_t m_lastFrameIndex = 0;
 
-    uint32_t m_prevVideoSequence = 0;
+    PacketLossCounter m_packetLoss;
     std::shared_ptr<NALParser> m_nalParser;
+    // Only set when the server estimates the bandwidth.
+    std::unique_ptr<ArrivalReporter> m_arrivalReporter;
 
     JNIEnv *m_env;
     jobject m_instance;
@@ -28,10 +32,41 @@ public:
 
 namespace {
     ServerConnectionNative g_socket;
+
+    void sendFecRepairRequest(uint64_t videoFrameIndex, uint8_t sliceIndex, uint32_t parityShards) {
+        FecRepairRequest request{};
+        request.type = ALVR_PACKET_TYPE_FEC_REPAIR_REQUEST;
+        request.videoFrameIndex = videoFrameIndex;
+        request.sliceIndex = sliceIndex;
+        request.parityShards = parityShards;
+        legacySend((const unsigned char *) &request, sizeof(request));
+    }
+
+    void sendNack(uint32_t fromPacketCounter, uint32_t toPacketCounter) {
+        PacketErrorReport report{};
+        report.type = ALVR_PACKET_TYPE_PACKET_ERROR_REPORT;
+        report.lostFrameType = ALVR_LOST_FRAME_TYPE_VIDEO_NACK;
+        report.fromPacketCounter = fromPacketCounter;
+        report.toPacketCounter = toPacketCounter;
+        legacySend((const unsigned char *) &report, sizeof(report));
+    }
+
+    void sendFrameAck(uint64_t videoFrameIndex, uint64_t trackingFrameIndex) {
+        VideoFrameAck ack{};
+        ack.type = ALVR_PACKET_TYPE_VIDEO_FRAME_ACK;
+        ack.videoFrameIndex = videoFrameIndex;
+        ack.trackingFrameIndex = trackingFrameIndex;
+        legacySend((const unsigned char *) &ack, sizeof(ack));
+    }
+
+    void sendArrivalReport(const VideoArrivalReport &report, unsigned int size) {
+        legacySend((const unsigned char *) &report, size);
+    }
 }
 
 void initializeSocket(void *v_env, void *v_instance, void *v_nalClass, unsigned int codec,
-                      bool enableFEC) {
+                      bool enableFEC, unsigned long long fecMaxLatencyUs, bool reportArrivals,
+                      bool splitEyeStreams) {
     auto *env = (JNIEnv *) v_env;
     auto *instance = (jobject) v_instance;
     auto *nalClass = (jclass) v_nalClass;
@@ -39,7 +74,7 @@ void initializeSocket(void *v_env, void *v_instance, void *v_nalClass, unsigned
     g_socket.m_env = env;
     g_socket.m_instance = env->NewGlobalRef(instance);
 
-    g_socket.m_prevVideoSequence = 0;
+    g_socket.m_packetLoss.reset();
     g_socket.m_timeDiff = 0;
 
     jclass clazz = env->GetObjectClass(instance);
@@ -47,8 +82,19 @@ void initializeSocket(void *v_env, void *v_instance, void *v_nalClass, unsigned
     g_socket.mOnHapticsFeedbackID = env->GetMethodID(clazz, "onHapticsFeedback", "(JFFFZ)V");
     env->DeleteLocalRef(clazz);
 
-    g_socket.m_nalParser = std::make_shared<NALParser>(env, instance, nalClass, enableFEC);
+    g_socket.m_nalParser = std::make_shared<NALParser>(env, instance, nalClass, enableFEC,
+                                                       fecMaxLatencyUs);
     g_socket.m_nalParser->setCodec(codec);
+    g_socket.m_nalParser->setSplitEyeStreams(splitEyeStreams);
+    g_socket.m_nalParser->setFecRepairCallback(sendFecRepairRequest);
+    g_socket.m_nalParser->setNackCallback(sendNack);
+    g_socket.m_nalParser->setFrameAckCallback(sendFrameAck);
+
+    g_socket.m_arrivalReporter.reset();
+    if (reportArrivals) {
+        g_socket.m_arrivalReporter = std::make_unique<ArrivalReporter>();
+        g_socket.m_arrivalReporter->setSendCallback(sendArrivalReport);
+    }
 
     LatencyCollector::Instance().resetAll();
 }
@@ -67,52 +113,66 @@ void sendPacketLossReport(ALVR_LOST_FRAME_TYPE frameType,
 }
 
 void processVideoSequence(uint32_t sequence) {
-    if (g_socket.m_prevVideoSequence != 0 && g_socket.m_prevVideoSequence + 1 != sequence) {
-        int32_t lost = sequence - (g_socket.m_prevVideoSequence + 1);
-        if (lost < 0) {
-            // lost become negative on out-of-order packet.
-            // TODO: This is not accurate statistics.
-            lost = -lost;
-        }
+    uint32_t lost = g_socket.m_packetLoss.addVideoPacket(sequence);
+    if (lost > 0) {
         LatencyCollector::Instance().packetLoss(lost);
 
-        LOGE("VideoPacket loss %d (%d -> %d)", lost, g_socket.m_prevVideoSequence + 1,
-             sequence - 1);
+        LOGE("VideoPacket loss %u (%u -> %u)", lost, sequence - lost, sequence - 1);
     }
-    g_socket.m_prevVideoSequence = sequence;
 }
 
 void legacyReceive(const unsigned char *packet, unsigned int packetSize) {
     g_socket.m_connected = true;
 
-    uint32_t type = *(uint32_t *) packet;
-    if (type == ALVR_PACKET_TYPE_VIDEO_FRAME) {
-        auto *header = (VideoFrame *) packet;
+    // Only the first byte of compact video packets is their type, all the types fit in it.
+    uint32_t type = packet[0] == ALVR_PACKET_TYPE_VIDEO_FRAME_COMPACT
+                    ? ALVR_PACKET_TYPE_VIDEO_FRAME_COMPACT : *(uint32_t *) packet;
+    if (type == ALVR_PACKET_TYPE_VIDEO_FRAME || type == ALVR_PACKET_TYPE_VIDEO_FRAME_COMPACT) {
+        VideoFrame header;
+        int fullPayloadSize;
+        int payloadOffset = ParseVideoPacket(packet, packetSize,
+                                             getTimestampUs() + g_socket.m_timeDiff, header,
+                                             fullPayloadSize);
+        if (payloadOffset == 0) {
+            return;
+        }
+
+        if (g_socket.m_arrivalReporter) {
+            g_socket.m_arrivalReporter->addVideoPacket(header.packetCounter, getTimestampUs());
+        }
 
-        if (g_socket.m_lastFrameIndex != header->trackingFrameIndex) {
-            LatencyCollector::Instance().receivedFirst(header->trackingFrameIndex);
-            if ((int64_t) header->sentTime - g_socket.m_timeDiff > (int64_t) getTimestampUs()) {
-                LatencyCollector::Instance().estimatedSent(header->trackingFrameIndex, 0);
+        if (g_socket.m_lastFrameIndex != header.trackingFrameIndex) {
+            LatencyCollector::Instance().receivedFirst(header.trackingFrameIndex);
+            if ((int64_t) header.sentTime - g_socket.m_timeDiff > (int64_t) getTimestampUs()) {
+                LatencyCollector::Instance().estimatedSent(header.trackingFrameIndex, 0);
             } else {
-                LatencyCollector::Instance().estimatedSent(header->trackingFrameIndex,
-                                                           (int64_t) header->sentTime -
+                LatencyCollector::Instance().estimatedSent(header.trackingFrameIndex,
+                                                           (int64_t) header.sentTime -
                                                            g_socket.m_timeDiff - getTimestampUs());
             }
-            g_socket.m_lastFrameIndex = header->trackingFrameIndex;
+            g_socket.m_lastFrameIndex = header.trackingFrameIndex;
         }
 
-        processVideoSequence(header->packetCounter);
+        processVideoSequence(header.packetCounter);
 
         // Following packets of a video frame
         bool fecFailure = false;
-        bool ret2 = g_socket.m_nalParser->processPacket(header, packetSize, fecFailure);
-        if (ret2) {
-            LatencyCollector::Instance().receivedLast(header->trackingFrameIndex);
-        }
+        g_socket.m_nalParser->processPacket(&header,
+                                            reinterpret_cast<const std::byte *>(packet) +
+                                            payloadOffset, packetSize - payloadOffset,
+                                            fullPayloadSize, fecFailure);
         if (fecFailure) {
             LatencyCollector::Instance().fecFailure();
             sendPacketLossReport(ALVR_LOST_FRAME_TYPE_VIDEO, 0, 0);
         }
+    } else if (type == ALVR_PACKET_TYPE_MTU_PROBE) {
+        if (packetSize < sizeof(MtuProbe)) {
+            return;
+        }
+        MtuProbe ack = *(const MtuProbe *) packet;
+        ack.type = ALVR_PACKET_TYPE_MTU_PROBE_ACK;
+        ack.size = packetSize;
+        legacySend((const unsigned char *) &ack, sizeof(ack));
     } else if (type == ALVR_PACKET_TYPE_TIME_SYNC) {
         // Time sync packet
         if (packetSize < sizeof(TimeSync)) {
@@ -125,6 +185,7 @@ void legacyReceive(const unsigned char *packet, unsigned int packetSize) {
             g_socket.m_timeDiff =
                     ((int64_t) timeSync->serverTime + (int64_t) RTT / 2) - (int64_t) Current;
             LOGI("TimeSync: server - client = %ld us RTT = %lu us", g_socket.m_timeDiff, RTT);
+            g_socket.m_nalParser->setRoundTripTime(RTT);
 
             TimeSync sendBuf = *timeSync;
             sendBuf.mode = 2;
@@ -190,4 +251,5 @@ void closeSocket(void *v_env) {
     env->DeleteGlobalRef(g_socket.m_instance);
 
     g_socket.m_nalParser.reset();
+    g_socket.m_arrivalReporter.reset();
 }
\ No newline at end of file
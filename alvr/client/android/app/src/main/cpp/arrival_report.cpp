@@ -0,0 +1,69 @@
+#include <cstddef>
+#include "arrival_report.h"
+
+ArrivalReporter::ArrivalReporter() {
+    m_report = {};
+    m_report.type = ALVR_PACKET_TYPE_VIDEO_ARRIVAL_REPORT;
+}
+
+void ArrivalReporter::setSendCallback(
+        void (*callback)(const VideoArrivalReport &report, unsigned int size)) {
+    m_sendCallback = callback;
+}
+
+void ArrivalReporter::addVideoPacket(uint32_t packetCounter, uint64_t arrivalTime) {
+    if (m_report.packetCount > 0) {
+        uint32_t index = packetCounter - m_report.firstPacketCounter;
+        if ((int32_t) index < 0) {
+            // Its run was sent already.
+            return;
+        }
+        if (index < ALVR_ARRIVAL_REPORT_MAX_PACKETS &&
+            arrivalTime - m_report.baseArrivalTime < REPORT_INTERVAL_US) {
+            record(index, arrivalTime);
+            return;
+        }
+        send();
+    }
+
+    uint32_t first = packetCounter;
+    if (m_started) {
+        uint32_t gap = packetCounter - m_nextPacketCounter;
+        if ((int32_t) gap < 0) {
+            return;
+        }
+        if (gap < ALVR_ARRIVAL_REPORT_MAX_PACKETS) {
+            first = m_nextPacketCounter;
+        }
+    }
+    m_started = true;
+    m_report.firstPacketCounter = first;
+    m_report.baseArrivalTime = arrivalTime;
+    m_report.packetCount = 0;
+    record(packetCounter - first, arrivalTime);
+}
+
+void ArrivalReporter::record(uint32_t index, uint64_t arrivalTime) {
+    if (index < m_report.packetCount) {
+        // Reordered, or sent again.
+        if (m_report.arrivalTimes[index] == ALVR_PACKET_NOT_RECEIVED) {
+            m_report.arrivalTimes[index] = (uint32_t) (arrivalTime - m_report.baseArrivalTime);
+        }
+        return;
+    }
+    for (uint32_t i = m_report.packetCount; i < index; i++) {
+        m_report.arrivalTimes[i] = ALVR_PACKET_NOT_RECEIVED;
+    }
+    m_report.arrivalTimes[index] = (uint32_t) (arrivalTime - m_report.baseArrivalTime);
+    m_report.packetCount = (uint16_t) (index + 1);
+}
+
+void ArrivalReporter::send() {
+    if (m_sendCallback) {
+        unsigned int size = offsetof(VideoArrivalReport, arrivalTimes) +
+                            m_report.packetCount * sizeof(uint32_t);
+        m_sendCallback(m_report, size);
+    }
+    m_nextPacketCounter = m_report.firstPacketCounter + m_report.packetCount;
+    m_report.packetCount = 0;
+}
@@ -0,0 +1,32 @@
+#ifndef ALVRCLIENT_ARRIVAL_REPORT_H
+#define ALVRCLIENT_ARRIVAL_REPORT_H
+
+#include <cstdint>
+#include "packet_types.h"
+
+// Collects the arrival times of the video packets for the bandwidth estimation of the server.
+// Packets are reported by packetCounter in consecutive runs. A run is sent once it is
+// REPORT_INTERVAL_US old or full, and the next run starts where it ended, so the packets missing
+// in between are reported as lost. Packets arriving after their run was sent are not reported.
+// This file does not depend on Android and can be built on a desktop host.
+class ArrivalReporter {
+public:
+    static const uint64_t REPORT_INTERVAL_US = 20 * 1000;
+
+    ArrivalReporter();
+
+    // Called with each report and its size in bytes.
+    void setSendCallback(void (*callback)(const VideoArrivalReport &report, unsigned int size));
+    void addVideoPacket(uint32_t packetCounter, uint64_t arrivalTime);
+private:
+    void record(uint32_t index, uint64_t arrivalTime);
+    void send();
+
+    VideoArrivalReport m_report;
+    bool m_started = false;
+    // First packet of the next run.
+    uint32_t m_nextPacketCounter = 0;
+    void (*m_sendCallback)(const VideoArrivalReport &report, unsigned int size) = nullptr;
+};
+
+#endif //ALVRCLIENT_ARRIVAL_REPORT_H
@@ -2,6 +2,8 @@
 
 struct OnCreateResult {
     int streamSurfaceHandle;
+    // Right eye picture with split encoding.
+    int rightStreamSurfaceHandle;
     int loadingSurfaceHandle;
 };
 
@@ -47,7 +49,7 @@ extern "C" void decoderOutput(long long frameIndex);
 
 extern "C" OnCreateResult onCreate(void *env, void *activity, void *assetManager);
 extern "C" void destroyNative(void *env);
-extern "C" void renderNative(long long renderedFrameIndex);
+extern "C" void renderNative(long long renderedFrameIndex, bool splitEyeStreams);
 extern "C" void renderLoadingNative();
 extern "C" void onTrackingNative(bool clientsidePrediction);
 extern "C" OnResumeResult onResumeNative(void *surface, bool darkMode);
@@ -61,7 +63,8 @@ extern "C" void onBatteryChangedNative(int battery);
 extern "C" GuardianData getGuardianData();
 
 extern "C" void
-initializeSocket(void *env, void *instance, void *nalClass, unsigned int codec, bool enableFEC);
+initializeSocket(void *env, void *instance, void *nalClass, unsigned int codec, bool enableFEC,
+                 unsigned long long fecMaxLatencyUs, bool reportArrivals, bool splitEyeStreams);
 extern "C" void (*legacySend)(const unsigned char *buffer, unsigned int size);
 extern "C" void legacyReceive(const unsigned char *packet, unsigned int packetSize);
 extern "C" void sendTimeSync();
@@ -1,230 +1,529 @@
 #include <vector>
 #include <algorithm>
+#include <chrono>
 #include <stdlib.h>
+#include <string.h>
 #include <inttypes.h>
 #include "fec.h"
 #include "packet_types.h"
+
+#ifdef __ANDROID__
 #include "utils.h"
+#else
+#define LOGI(...) do {} while (false)
+#define LOGE(...) do {} while (false)
+#define FrameLog(...) do {} while (false)
+#endif
 
-bool FECQueue::reed_solomon_initialized = false;
+namespace {
+    uint64_t steadyClockUs() {
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+}
 
 FECQueue::FECQueue() {
-    m_currentFrame.videoFrameIndex = UINT64_MAX;
-    m_recovered = true;
     m_fecFailure = false;
+    m_maxLatencyUs = DEFAULT_MAX_LATENCY_US;
+    m_clock = steadyClockUs;
+    m_shards.reserve(ALVR_FEC_SHARDS_MAX_LARGE);
+}
 
-    if (!reed_solomon_initialized) {
-        reed_solomon_init();
-        reed_solomon_initialized = true;
-    }
+void FECQueue::setMaxLatency(uint64_t maxLatencyUs) {
+    m_maxLatencyUs = maxLatencyUs;
+}
+
+void FECQueue::setClock(uint64_t (*clock)()) {
+    m_clock = clock;
+}
+
+void FECQueue::setRepairRequestCallback(void (*callback)(uint64_t, uint8_t, uint32_t)) {
+    m_repairCallback = callback;
+}
+
+void FECQueue::setNackCallback(void (*callback)(uint32_t, uint32_t)) {
+    m_nackCallback = callback;
+}
+
+void FECQueue::setRoundTripTime(uint64_t rttUs) {
+    m_rttUs = rttUs;
 }
 
-FECQueue::~FECQueue() {
-    if (m_rs != NULL) {
-        reed_solomon_release(m_rs);
+FECQueue::Frame *FECQueue::findFrame(uint64_t videoFrameIndex, uint8_t sliceIndex) {
+    for (auto &frame : m_frames) {
+        if (frame.used && frame.header.videoFrameIndex == videoFrameIndex &&
+            frame.header.sliceIndex == sliceIndex) {
+            return &frame;
+        }
     }
+    return nullptr;
 }
 
-// Add packet to queue. packet must point to buffer whose size=ALVR_MAX_PACKET_SIZE.
-void FECQueue::addVideoPacket(const VideoFrame *packet, int packetSize, bool &fecFailure) {
-    if (m_recovered && m_currentFrame.videoFrameIndex == packet->videoFrameIndex) {
-        return;
+bool FECQueue::startFrame(Frame &frame, const VideoFrame *packet, int payloadSize) {
+    int codePercentage = GetFECCodePercentage(packet->fecPercentage);
+    size_t shardPackets = CalculateFECShardPackets(packet->frameByteSize, codePercentage,
+                                                   GetFECMaxShards(packet->fecPercentage),
+                                                   payloadSize);
+    size_t blockSize = shardPackets * payloadSize;
+    size_t totalDataShards = (packet->frameByteSize + blockSize - 1) / blockSize;
+    size_t totalParityShards = CalculateParityShards(totalDataShards, codePercentage);
+    size_t totalShards = totalDataShards + totalParityShards;
+
+    frame.rs = ReedSolomonCache::Instance().Get(totalDataShards, totalParityShards);
+    if (frame.rs == nullptr) {
+        return false;
     }
-    if (m_currentFrame.videoFrameIndex != packet->videoFrameIndex) {
-        // New frame
-        if (!m_recovered) {
-            FrameLog(m_currentFrame.trackingFrameIndex,
-                     "Previous frame cannot be recovered. videoFrame=%llu shards=%u:%u frameByteSize=%d"
-                     " fecPercentage=%d m_totalShards=%u m_shardPackets=%u m_blockSize=%u",
-                     m_currentFrame.videoFrameIndex,
-                     m_totalDataShards,
-                     m_totalParityShards,
-                     m_currentFrame.frameByteSize, m_currentFrame.fecPercentage, m_totalShards,
-                     m_shardPackets, m_blockSize);
-            for (size_t packet = 0; packet < m_shardPackets; packet++) {
-                FrameLog(m_currentFrame.trackingFrameIndex,
-                         "packetIndex=%d, shards=%u:%u",
-                         packet, m_receivedDataShards[packet], m_receivedParityShards[packet]);
-            }
-            fecFailure = m_fecFailure = true;
+
+    frame.used = true;
+    frame.header = *packet;
+    frame.startTime = m_clock();
+    frame.lastPacketTime = frame.startTime;
+    frame.recovered = false;
+    frame.rateless = (packet->fecPercentage & ALVR_FEC_FLAG_RATELESS) != 0;
+    frame.repairRequests = 0;
+    frame.payloadSize = payloadSize;
+    frame.shardPackets = shardPackets;
+    frame.blockSize = blockSize;
+    frame.totalDataShards = totalDataShards;
+    frame.totalParityShards = totalParityShards;
+    frame.totalShards = totalShards;
+    frame.baseCounterKnown = false;
+
+    // Vectors keep their capacity, so this only allocates for a larger geometry than before.
+    frame.recoveredPacket.assign(shardPackets, false);
+    frame.pendingPackets = shardPackets;
+    frame.receivedDataShards.assign(shardPackets, 0);
+    frame.receivedParityShards.assign(shardPackets, 0);
+    frame.marks.assign(shardPackets * totalShards, 1);
+
+    if (frame.buffer.size() < totalShards * blockSize) {
+        // Only expand buffer for performance reason.
+        frame.buffer.resize(totalShards * blockSize);
+    }
+
+    // Padding packets are not sent, so we can fill bitmap by default.
+    // Received packets are zero padded when copied and lost data packets are fully rewritten by
+    // the decoder, so the padding packets are the only region that must be cleared.
+    uint32_t fecDataPackets = (packet->frameByteSize + payloadSize - 1) / payloadSize;
+    frame.dataPackets = fecDataPackets;
+    size_t padding = (shardPackets - fecDataPackets % shardPackets) % shardPackets;
+    for (size_t i = 0; i < padding; i++) {
+        size_t paddingPacket = shardPackets - i - 1;
+        frame.marks[paddingPacket * totalShards + totalDataShards - 1] = 0;
+        frame.receivedDataShards[paddingPacket]++;
+        if (frame.receivedDataShards[paddingPacket] == totalDataShards) {
+            // Single data shard: the column holds nothing else.
+            frame.recoveredPacket[paddingPacket] = true;
+            frame.pendingPackets--;
+        }
+    }
+    memset(&frame.buffer[fecDataPackets * payloadSize], 0, padding * payloadSize);
+
+    FrameLog(frame.header.trackingFrameIndex,
+             "Start new frame. videoFrame=%llu slice=%d frameByteSize=%d fecPercentage=%d m_totalDataShards=%u m_totalParityShards=%u"
+             " m_totalShards=%u m_shardPackets=%u m_blockSize=%u",
+             frame.header.videoFrameIndex, frame.header.sliceIndex, frame.header.frameByteSize,
+             frame.header.fecPercentage, totalDataShards, totalParityShards, totalShards,
+             shardPackets, blockSize);
+    return true;
+}
+
+void FECQueue::skipNextFrame(bool &fecFailure) {
+    bool received = false;
+    for (auto &frame : m_frames) {
+        if (!frame.used || frame.header.videoFrameIndex != m_nextFrameIndex) {
+            continue;
+        }
+        received = true;
+        if (frame.recovered) {
+            continue;
         }
-        m_currentFrame = *packet;
-        m_recovered = false;
-        if (m_rs != NULL) {
-            reed_solomon_release(m_rs);
+        FrameLog(frame.header.trackingFrameIndex,
+                 "Frame cannot be recovered. videoFrame=%llu slice=%d shards=%u:%u frameByteSize=%d"
+                 " fecPercentage=%d m_totalShards=%u m_shardPackets=%u m_blockSize=%u",
+                 frame.header.videoFrameIndex, frame.header.sliceIndex, frame.totalDataShards,
+                 frame.totalParityShards, frame.header.frameByteSize, frame.header.fecPercentage,
+                 frame.totalShards, frame.shardPackets, frame.blockSize);
+        for (size_t packet = 0; packet < frame.shardPackets; packet++) {
+            FrameLog(frame.header.trackingFrameIndex,
+                     "packetIndex=%d, shards=%u:%u",
+                     packet, frame.receivedDataShards[packet], frame.receivedParityShards[packet]);
         }
+    }
+    if (received) {
+        releaseFrame(m_nextFrameIndex);
+    } else {
+        LOGI("Frame was completely lost. videoFrame=%" PRIu64, m_nextFrameIndex);
+    }
+    fecFailure = m_fecFailure = true;
+    m_nextFrameIndex++;
+}
 
-        uint32_t fecDataPackets = (packet->frameByteSize + ALVR_MAX_VIDEO_BUFFER_SIZE - 1) /
-                                  ALVR_MAX_VIDEO_BUFFER_SIZE;
-        m_shardPackets = CalculateFECShardPackets(m_currentFrame.frameByteSize,
-                                                  m_currentFrame.fecPercentage);
-        m_blockSize = m_shardPackets * ALVR_MAX_VIDEO_BUFFER_SIZE;
+void FECQueue::releaseFrame(uint64_t videoFrameIndex) {
+    for (auto &frame : m_frames) {
+        if (frame.used && frame.header.videoFrameIndex == videoFrameIndex) {
+            frame.used = false;
+        }
+    }
+}
 
-        m_totalDataShards = (m_currentFrame.frameByteSize + m_blockSize - 1) / m_blockSize;
-        m_totalParityShards = CalculateParityShards(m_totalDataShards,
-                                                    m_currentFrame.fecPercentage);
-        m_totalShards = m_totalDataShards + m_totalParityShards;
+void FECQueue::releaseOutput() {
+    if (m_outputFrameIndex != 0) {
+        releaseFrame(m_outputFrameIndex);
+        m_outputFrameIndex = 0;
+    }
+}
 
-        m_recoveredPacket.clear();
-        m_recoveredPacket.resize(m_shardPackets);
+// Add packet to queue.
+void FECQueue::addVideoPacket(const VideoFrame *packet, const std::byte *payload, int payloadSize,
+                              int fullPayloadSize, bool &fecFailure) {
+    releaseOutput();
 
-        m_receivedDataShards.clear();
-        m_receivedDataShards.resize(m_shardPackets);
-        m_receivedParityShards.clear();
-        m_receivedParityShards.resize(m_shardPackets);
+    uint64_t videoFrameIndex = packet->videoFrameIndex;
+    if (m_nextFrameIndex == 0) {
+        m_nextFrameIndex = videoFrameIndex;
+    }
+    if (videoFrameIndex < m_nextFrameIndex) {
+        // Late packet of a frame that was already emitted or given up.
+        return;
+    }
 
-        m_shards.resize(m_totalShards);
+    if (packet->sliceIndex >= ALVR_MAX_VIDEO_SLICES) {
+        LOGE("Invalid sliceIndex. sliceIndex=%d", packet->sliceIndex);
+        return;
+    }
+    if (fullPayloadSize <= 0 || payloadSize > fullPayloadSize) {
+        LOGE("Invalid payload size. payloadSize=%d fullPayloadSize=%d", payloadSize,
+             fullPayloadSize);
+        return;
+    }
 
-        m_rs = reed_solomon_new(m_totalDataShards, m_totalParityShards);
-        if (m_rs == NULL) {
-            return;
+    Frame *frame = findFrame(videoFrameIndex, packet->sliceIndex);
+    if (frame == nullptr) {
+        // Skipping WINDOW_SIZE frames releases every used slot. A far jump of the index (server
+        // restart, corrupt header) moves the window at once instead of one frame at a time.
+        for (int i = 0; i < WINDOW_SIZE && videoFrameIndex >= m_nextFrameIndex + WINDOW_SIZE; i++) {
+            skipNextFrame(fecFailure);
         }
-
-        m_marks.resize(m_shardPackets);
-        for (size_t i = 0; i < m_shardPackets; i++) {
-            m_marks[i].resize(m_totalShards);
-            memset(&m_marks[i][0], 1, m_totalShards);
-        }
-
-        if (m_frameBuffer.size() < m_totalShards * m_blockSize) {
-            // Only expand buffer for performance reason.
-            m_frameBuffer.resize(m_totalShards * m_blockSize);
-        }
-        memset(&m_frameBuffer[0], 0, m_totalShards * m_blockSize);
-
-        // Padding packets are not sent, so we can fill bitmap by default.
-        size_t padding = (m_shardPackets - fecDataPackets % m_shardPackets) % m_shardPackets;
-        for (size_t i = 0; i < padding; i++) {
-            m_marks[m_shardPackets - i - 1][m_totalDataShards - 1] = 0;
-            m_receivedDataShards[m_shardPackets - i - 1]++;
-        }
-
-        // Calculate last packet counter of current frame to detect whole frame packet loss.
-        uint32_t startPacket;
-        uint32_t nextStartPacket;
-        if(m_currentFrame.fecIndex / m_shardPackets < m_totalDataShards) {
-            // First seen packet was data packet
-            startPacket = m_currentFrame.packetCounter - m_currentFrame.fecIndex;
-            nextStartPacket = m_currentFrame.packetCounter - m_currentFrame.fecIndex + m_totalShards * m_shardPackets - padding;
-        }else{
-            // was parity packet
-            startPacket = m_currentFrame.packetCounter - (m_currentFrame.fecIndex - padding);
-            uint64_t m_startOfParityPacket = m_currentFrame.packetCounter - (m_currentFrame.fecIndex - m_totalDataShards * m_shardPackets);
-            nextStartPacket = m_startOfParityPacket + m_totalParityShards * m_shardPackets;
-        }
-        if(m_firstPacketOfNextFrame != 0 && m_firstPacketOfNextFrame != startPacket) {
-            // Whole frame packet loss
-            FrameLog(m_currentFrame.trackingFrameIndex,
-                     "Previous frame was completely lost. videoFrame=%llu shards=%u:%u frameByteSize=%d fecPercentage=%d m_totalShards=%u "
-                     "m_shardPackets=%u m_blockSize=%u m_firstPacketOfNextFrame=%u startPacket=%u currentPacket=%u",
-                     m_currentFrame.videoFrameIndex, m_totalDataShards, m_totalParityShards,
-                     m_currentFrame.frameByteSize, m_currentFrame.fecPercentage, m_totalShards,
-                     m_shardPackets, m_blockSize, m_firstPacketOfNextFrame, startPacket, m_currentFrame.packetCounter);
-            for (size_t packet = 0; packet < m_shardPackets; packet++) {
-                FrameLog(m_currentFrame.trackingFrameIndex,
-                         "packetIndex=%d, shards=%u:%u",
-                         packet, m_receivedDataShards[packet], m_receivedParityShards[packet]);
+        if (videoFrameIndex >= m_nextFrameIndex + WINDOW_SIZE) {
+            LOGI("Video frame index jumped. videoFrame=%" PRIu64 " expected=%" PRIu64,
+                 videoFrameIndex, m_nextFrameIndex);
+            m_nextFrameIndex = videoFrameIndex - WINDOW_SIZE + 1;
+        }
+        // All used slots now hold groups of frames inside the window, other than this one, and
+        // there is a slot for every group of these frames.
+        for (auto &slot : m_frames) {
+            if (!slot.used) {
+                frame = &slot;
+                break;
             }
-            fecFailure = m_fecFailure = true;
         }
-        m_firstPacketOfNextFrame = nextStartPacket;
+        if (!startFrame(*frame, packet, fullPayloadSize)) {
+            return;
+        }
+    }
+    if (frame->payloadSize != (size_t) fullPayloadSize) {
+        LOGE("Packet size changed within a frame. fullPayloadSize=%d", fullPayloadSize);
+        return;
+    }
+    if (frame->recovered) {
+        return;
+    }
+    frame->lastPacketTime = m_clock();
 
-        FrameLog(m_currentFrame.trackingFrameIndex,
-                 "Start new frame. videoFrame=%llu frameByteSize=%d fecPercentage=%d m_totalDataShards=%u m_totalParityShards=%u"
-                 " m_totalShards=%u m_shardPackets=%u m_blockSize=%u",
-                 m_currentFrame.videoFrameIndex, m_currentFrame.frameByteSize, m_currentFrame.fecPercentage, m_totalDataShards,
-                 m_totalParityShards, m_totalShards, m_shardPackets, m_blockSize);
+    size_t shardIndex = packet->fecIndex / frame->shardPackets;
+    size_t packetIndex = packet->fecIndex % frame->shardPackets;
+    if (shardIndex >= frame->totalShards) {
+        LOGE("Invalid fecIndex. fecIndex=%d totalShards=%zu", packet->fecIndex, frame->totalShards);
+        return;
+    }
+    if (frame->recoveredPacket[packetIndex]) {
+        // This column was already decoded, the packet carries nothing new.
+        return;
     }
-    size_t shardIndex = packet->fecIndex / m_shardPackets;
-    size_t packetIndex = packet->fecIndex % m_shardPackets;
-    if (m_marks[packetIndex][shardIndex] == 0) {
+    unsigned char &mark = frame->marks[packetIndex * frame->totalShards + shardIndex];
+    if (mark == 0) {
         // Duplicate packet.
         LOGI("Packet duplication. packetCounter=%d fecIndex=%d", packet->packetCounter,
              packet->fecIndex);
         return;
     }
-    m_marks[packetIndex][shardIndex] = 0;
-    if (shardIndex < m_totalDataShards) {
-        m_receivedDataShards[packetIndex]++;
+    mark = 0;
+    if (shardIndex < frame->totalDataShards) {
+        frame->receivedDataShards[packetIndex]++;
     } else {
-        m_receivedParityShards[packetIndex]++;
+        frame->receivedParityShards[packetIndex]++;
+    }
+    if (!frame->baseCounterKnown) {
+        // Parity packets sent on repair requests come later, their numbers do not tell.
+        size_t firstParity = frame->totalDataShards * frame->shardPackets;
+        if (packet->fecIndex < frame->dataPackets) {
+            frame->baseCounter = packet->packetCounter - packet->fecIndex;
+            frame->baseCounterKnown = true;
+        } else if (!frame->rateless && packet->fecIndex >= firstParity) {
+            frame->baseCounter = packet->packetCounter - (uint32_t) (frame->dataPackets +
+                                                                      packet->fecIndex -
+                                                                      firstParity);
+            frame->baseCounterKnown = true;
+        }
     }
 
-    std::byte *p = &m_frameBuffer[packet->fecIndex * ALVR_MAX_VIDEO_BUFFER_SIZE];
-    char *payload = ((char *) packet) + sizeof(VideoFrame);
-    int payloadSize = packetSize - sizeof(VideoFrame);
+    std::byte *p = &frame->buffer[packet->fecIndex * frame->payloadSize];
     memcpy(p, payload, payloadSize);
-    if (payloadSize != ALVR_MAX_VIDEO_BUFFER_SIZE) {
+    if (payloadSize != fullPayloadSize) {
         // Fill padding
-        memset(p + payloadSize, 0, ALVR_MAX_VIDEO_BUFFER_SIZE - payloadSize);
+        memset(p + payloadSize, 0, fullPayloadSize - payloadSize);
     }
+
+    recoverPacket(*frame, packetIndex);
 }
 
-bool FECQueue::reconstruct() {
-    if (m_recovered) {
-        return false;
+// Decode a packet column of the frame as soon as it has enough shards.
+// On server side, we encoded all buffer in one call of reed_solomon_encode.
+// But client side, we should split shards for more resilient recovery.
+void FECQueue::recoverPacket(Frame &frame, size_t packet) {
+    if (frame.receivedDataShards[packet] == frame.totalDataShards) {
+        // We've received a full packet with no need for FEC.
+        frame.recoveredPacket[packet] = true;
+        frame.pendingPackets--;
+        return;
+    }
+    if (frame.receivedDataShards[packet] + frame.receivedParityShards[packet] < frame.totalDataShards) {
+        // Not enough parity data yet
+        return;
     }
 
-    bool ret = true;
-    // On server side, we encoded all buffer in one call of reed_solomon_encode.
-    // But client side, we should split shards for more resilient recovery.
-    for (size_t packet = 0; packet < m_shardPackets; packet++) {
-        if (m_recoveredPacket[packet]) {
-            continue;
+    FrameLog(frame.header.trackingFrameIndex,
+             "Recovering. packetIndex=%d receivedDataShards=%d/%d receivedParityShards=%d/%d",
+             packet, frame.receivedDataShards[packet], frame.totalDataShards,
+             frame.receivedParityShards[packet], frame.totalParityShards);
+
+    m_shards.resize(frame.totalShards);
+    for (size_t i = 0; i < frame.totalShards; i++) {
+        m_shards[i] = &frame.buffer[(i * frame.shardPackets + packet) * frame.payloadSize];
+    }
+
+    // The instance is shared through ReedSolomonCache, so it must not be modified here.
+    int result = reed_solomon_reconstruct(frame.rs.get(), (unsigned char **) &m_shards[0],
+                                          &frame.marks[packet * frame.totalShards],
+                                          frame.totalShards, frame.payloadSize);
+    // We should always provide enough parity to recover the missing data successfully.
+    // If this fails, something is probably wrong with our FEC state. The column stays pending,
+    // later shards are still taken and decoding is tried again, else the frame is given up by the
+    // deadline.
+    if (result != 0) {
+        LOGE("reed_solomon_reconstruct failed.");
+        return;
+    }
+    frame.recoveredPacket[packet] = true;
+    frame.pendingPackets--;
+}
+
+bool FECQueue::recoverFrame(Frame &frame) {
+    if (!frame.recovered && frame.pendingPackets == 0) {
+        frame.recovered = true;
+        FrameLog(frame.header.trackingFrameIndex, "Frame was successfully recovered by FEC. slice=%d",
+                 frame.header.sliceIndex);
+    }
+    return frame.recovered;
+}
+
+int FECQueue::recoveredSlices(uint64_t videoFrameIndex) {
+    int slices = 0;
+    int recovered = 0;
+    for (auto &frame : m_frames) {
+        if (frame.used && frame.header.videoFrameIndex == videoFrameIndex) {
+            if (frame.header.lastSlice) {
+                slices = frame.header.sliceIndex + 1;
+            }
+            if (recoverFrame(frame)) {
+                recovered++;
+            }
         }
-        if (m_receivedDataShards[packet] == m_totalDataShards) {
-            // We've received a full packet with no need for FEC.
-            //FrameLog(m_currentFrame.frameIndex, "No need for FEC. packetIndex=%d", packet);
-            m_recoveredPacket[packet] = true;
-            continue;
+    }
+    // Groups have distinct slice indices and the last one has the highest.
+    return slices != 0 && recovered == slices ? slices : 0;
+}
+
+void FECQueue::requestRepair(Frame &frame, uint64_t now) {
+    if (frame.repairRequests >= MAX_REPAIR_REQUESTS ||
+        (frame.repairRequests > 0 && now - frame.lastRepairRequest <= m_maxLatencyUs / 2)) {
+        return;
+    }
+    if (!frame.rateless) {
+        // The retransmission must arrive before the frame is given up.
+        if (m_nackCallback == nullptr || m_rttUs == 0 || m_rttUs >= m_maxLatencyUs ||
+            !sendNacks(frame)) {
+            return;
         }
-        m_rs->shards = m_receivedDataShards[packet] +
-                       m_receivedParityShards[packet]; //Don't let RS complain about missing parity packets
+        frame.repairRequests++;
+        frame.lastRepairRequest = now;
+        frame.lastPacketTime = now;
+        return;
+    }
+    if (m_repairCallback == nullptr) {
+        return;
+    }
 
-        if (m_rs->shards < (int) m_totalDataShards) {
-            // Not enough parity data
-            ret = false;
-            continue;
+    // Every parity shard adds one packet to each column, so the column missing most decides.
+    uint32_t missing = 0;
+    for (size_t packet = 0; packet < frame.shardPackets; packet++) {
+        uint32_t received = frame.receivedDataShards[packet] + frame.receivedParityShards[packet];
+        if (!frame.recoveredPacket[packet] && received < frame.totalDataShards) {
+            missing = std::max(missing, (uint32_t) frame.totalDataShards - received);
         }
+    }
+    if (missing == 0) {
+        return;
+    }
 
-        FrameLog(m_currentFrame.trackingFrameIndex,
-                 "Recovering. packetIndex=%d receivedDataShards=%d/%d receivedParityShards=%d/%d",
-                 packet, m_receivedDataShards[packet], m_totalDataShards,
-                 m_receivedParityShards[packet], m_totalParityShards);
+    FrameLog(frame.header.trackingFrameIndex, "Requesting FEC repair. videoFrame=%llu slice=%d parityShards=%u",
+             frame.header.videoFrameIndex, frame.header.sliceIndex, missing + REPAIR_MARGIN);
+    m_repairCallback(frame.header.videoFrameIndex, frame.header.sliceIndex, missing + REPAIR_MARGIN);
+    frame.repairRequests++;
+    frame.lastRepairRequest = now;
+    // Give the repair packets a full timeout to arrive.
+    frame.lastPacketTime = now;
+}
 
-        for (size_t i = 0; i < m_totalShards; i++) {
-            m_shards[i] = &m_frameBuffer[(i * m_shardPackets + packet) * ALVR_MAX_VIDEO_BUFFER_SIZE];
+// NACKs the missing data packets of the columns that cannot be recovered yet, as ranges of
+// consecutive packets. Returns false if there is nothing to NACK.
+bool FECQueue::sendNacks(Frame &frame) {
+    if (!frame.baseCounterKnown) {
+        return false;
+    }
+    bool sent = false;
+    size_t rangeStart = 0;
+    bool inRange = false;
+    for (size_t fecIndex = 0; fecIndex <= frame.dataPackets; fecIndex++) {
+        bool missing = false;
+        if (fecIndex < frame.dataPackets) {
+            size_t packet = fecIndex % frame.shardPackets;
+            size_t shard = fecIndex / frame.shardPackets;
+            missing = !frame.recoveredPacket[packet] &&
+                      frame.marks[packet * frame.totalShards + shard] != 0;
+        }
+        if (missing && !inRange) {
+            rangeStart = fecIndex;
+            inRange = true;
+        } else if (!missing && inRange) {
+            FrameLog(frame.header.trackingFrameIndex, "Sending NACK. videoFrame=%llu slice=%d fecIndex=%zu-%zu",
+                     frame.header.videoFrameIndex, frame.header.sliceIndex, rangeStart, fecIndex - 1);
+            m_nackCallback(frame.baseCounter + (uint32_t) rangeStart,
+                           frame.baseCounter + (uint32_t) (fecIndex - 1));
+            inRange = false;
+            sent = true;
+        }
+    }
+    return sent;
+}
+
+bool FECQueue::reconstruct(bool &fecFailure) {
+    releaseOutput();
+
+    while (m_nextFrameIndex != 0) {
+        uint64_t now = m_clock();
+
+        // Oldest frame in flight after the one we are waiting for.
+        Frame *newer = nullptr;
+        for (auto &frame : m_frames) {
+            if (frame.used && frame.header.videoFrameIndex > m_nextFrameIndex &&
+                (newer == nullptr || frame.startTime < newer->startTime)) {
+                newer = &frame;
+            }
+        }
+
+        int slices = recoveredSlices(m_nextFrameIndex);
+        if (slices != 0) {
+            emitFrame(m_nextFrameIndex, slices);
+            m_nextFrameIndex++;
+            return true;
         }
 
-        int result = reed_solomon_reconstruct(m_rs, (unsigned char **) &m_shards[0],
-                                              &m_marks[packet][0],
-                                              m_totalShards, ALVR_MAX_VIDEO_BUFFER_SIZE);
-        m_recoveredPacket[packet] = true;
-        // We should always provide enough parity to recover the missing data successfully.
-        // If this fails, something is probably wrong with our FEC state.
-        if (result != 0) {
-            LOGE("reed_solomon_reconstruct failed.");
+        // The groups before the highest one received were sent in full.
+        int highestSlice = -1;
+        for (auto &frame : m_frames) {
+            if (frame.used && frame.header.videoFrameIndex == m_nextFrameIndex) {
+                highestSlice = std::max(highestSlice, (int) frame.header.sliceIndex);
+            }
+        }
+
+        // Group of the frame that received a packet last.
+        Frame *latest = nullptr;
+        for (auto &frame : m_frames) {
+            if (frame.used && frame.header.videoFrameIndex == m_nextFrameIndex) {
+                if (!frame.recovered &&
+                    (newer != nullptr || frame.header.sliceIndex < highestSlice)) {
+                    // The server has moved on to the next frame or group.
+                    requestRepair(frame, now);
+                }
+                if (latest == nullptr || frame.lastPacketTime > latest->lastPacketTime) {
+                    latest = &frame;
+                }
+            }
+        }
+        if (latest != nullptr) {
+            if (newer == nullptr || now - latest->lastPacketTime <= m_maxLatencyUs) {
+                return false;
+            }
+        } else if (newer == nullptr || now - newer->startTime <= m_maxLatencyUs) {
+            // The frame may still arrive after reordering.
             return false;
         }
-        /*
-        for(int i = 0; i < m_totalShards * m_shardPackets; i++) {
-            char *p = &frameBuffer[ALVR_MAX_VIDEO_BUFFER_SIZE * i];
-            LOGI("Reconstructed packets. i=%d shardIndex=%d buffer=[%02X %02X %02X %02X %02X ...]", i, i / m_shardPackets, p[0], p[1], p[2], p[3], p[4]);
-        }*/
+        skipNextFrame(fecFailure);
+    }
+    return false;
+}
+
+// The groups stay in use until the output is released.
+void FECQueue::emitFrame(uint64_t videoFrameIndex, int slices) {
+    m_outputFrameIndex = videoFrameIndex;
+    if (slices == 1) {
+        Frame *frame = findFrame(videoFrameIndex, 0);
+        m_outputBuffer = &frame->buffer[0];
+        m_outputByteSize = frame->header.frameByteSize;
+        m_outputTrackingFrameIndex = frame->header.trackingFrameIndex;
+        m_outputRecoveryFrame = frame->header.recoveryFrame != 0;
+        return;
+    }
+
+    size_t size = 0;
+    for (int slice = 0; slice < slices; slice++) {
+        size += findFrame(videoFrameIndex, slice)->header.frameByteSize;
     }
-    if (ret) {
-        m_recovered = true;
-        FrameLog(m_currentFrame.trackingFrameIndex, "Frame was successfully recovered by FEC.");
+    if (m_sliceBuffer.size() < size) {
+        m_sliceBuffer.resize(size);
     }
-    return ret;
+    size_t offset = 0;
+    for (int slice = 0; slice < slices; slice++) {
+        Frame *frame = findFrame(videoFrameIndex, slice);
+        memcpy(&m_sliceBuffer[offset], &frame->buffer[0], frame->header.frameByteSize);
+        offset += frame->header.frameByteSize;
+    }
+    m_outputBuffer = &m_sliceBuffer[0];
+    m_outputByteSize = (int) size;
+    m_outputTrackingFrameIndex = findFrame(videoFrameIndex, 0)->header.trackingFrameIndex;
+    m_outputRecoveryFrame = findFrame(videoFrameIndex, 0)->header.recoveryFrame != 0;
 }
 
 const std::byte *FECQueue::getFrameBuffer() {
-    return &m_frameBuffer[0];
+    return m_outputBuffer;
 }
 
 int FECQueue::getFrameByteSize() {
-    return m_currentFrame.frameByteSize;
+    return m_outputByteSize;
+}
+
+uint64_t FECQueue::getTrackingFrameIndex() {
+    return m_outputTrackingFrameIndex;
+}
+
+uint64_t FECQueue::getVideoFrameIndex() {
+    return m_outputFrameIndex;
+}
+
+bool FECQueue::isRecoveryFrame() {
+    return m_outputRecoveryFrame;
 }
 
 bool FECQueue::fecFailure() {
@@ -1,43 +1,131 @@
 #ifndef ALVRCLIENT_FEC_H
 #define ALVRCLIENT_FEC_H
 
+#include <cstddef>
 #include <list>
+#include <memory>
 #include <vector>
 #include "packet_types.h"
-#include "reedsolomon/rs.h"
+#include "reedsolomon/rs_cache.h"
 
+// Reassembles video frames from FEC protected packets.
+// Up to WINDOW_SIZE frames are reassembled concurrently, so that packets reordered across a frame
+// boundary do not cost the previous frame. Frames are emitted in videoFrameIndex order. A frame is
+// given up when a newer frame is in flight and it received no packet for the configured time, or
+// when it falls out of the window.
+// Each packet column is decoded as soon as it has enough shards, so the work is spread over the
+// packets of the frame and completion is checked in constant time.
+// Buffers are kept across frames and only grow, so the steady state does not allocate.
+// In the rateless FEC mode, a frame that is still incomplete when a newer frame arrives asks the
+// server for the parity it lacks through the repair request callback, and its deadline restarts.
+// In the other modes, the missing data packets of a frame that cannot be recovered are NACKed
+// instead, by their packetCounter, when the round trip time leaves room for the retransmission.
+// A frame can be sent as several FEC groups, one per encoder slice. Each group is decoded on its
+// own, and the frame is emitted once the groups up to the last one are all recovered.
+// This file does not depend on Android and can be built on a desktop host.
 class FECQueue {
 public:
+    static const int WINDOW_SIZE = 3;
+    static const uint64_t DEFAULT_MAX_LATENCY_US = 10 * 1000;
+    // Repair requests or NACKs per frame.
+    static const int MAX_REPAIR_REQUESTS = 2;
+    // Extra parity shards asked in each repair request, in case some repair packets are lost too.
+    static const uint32_t REPAIR_MARGIN = 1;
+
     FECQueue();
-    ~FECQueue();
 
-    void addVideoPacket(const VideoFrame *packet, int packetSize, bool &fecFailure);
-    bool reconstruct();
+    void setMaxLatency(uint64_t maxLatencyUs);
+    // Microsecond clock used for the deadlines. Defaults to std::chrono::steady_clock.
+    void setClock(uint64_t (*clock)());
+    // Called with the FEC group and the number of parity shards to ask the server for.
+    void setRepairRequestCallback(void (*callback)(uint64_t videoFrameIndex, uint8_t sliceIndex,
+                                                   uint32_t parityShards));
+    // Called with a range of lost packets (inclusive) to send again.
+    void setNackCallback(void (*callback)(uint32_t fromPacketCounter, uint32_t toPacketCounter));
+    // NACKs are only sent once the round trip time is known.
+    void setRoundTripTime(uint64_t rttUs);
+
+    // fullPayloadSize: payload of the full packets of the frame, the unit of its shards.
+    void addVideoPacket(const VideoFrame *packet, const std::byte *payload, int payloadSize,
+                        int fullPayloadSize, bool &fecFailure);
+    // Returns true if the next frame in order is complete. The getters then refer to that frame
+    // until the next call to addVideoPacket() or reconstruct(). Call it until it returns false.
+    bool reconstruct(bool &fecFailure);
     const std::byte *getFrameBuffer();
     int getFrameByteSize();
+    uint64_t getTrackingFrameIndex();
+    uint64_t getVideoFrameIndex();
+    bool isRecoveryFrame();
 
     bool fecFailure();
     void clearFecFailure();
 private:
+    // FEC group: one slice of a video frame, or the whole frame.
+    struct Frame {
+        bool used = false;
+        VideoFrame header;
+        uint64_t startTime;
+        uint64_t lastPacketTime;
+        size_t payloadSize;
+        size_t shardPackets;
+        size_t blockSize;
+        size_t totalDataShards;
+        // Parity rows of the code, more than were sent in the rateless mode.
+        size_t totalParityShards;
+        size_t totalShards;
+        size_t dataPackets;
+        // packetCounter of the first data packet. The data and parity packets are numbered in
+        // fecIndex order when the frame is first sent.
+        bool baseCounterKnown;
+        uint32_t baseCounter;
+        // [shardPackets][totalShards], 1 while the packet is missing.
+        std::vector<unsigned char> marks;
+        std::vector<std::byte> buffer;
+        std::vector<uint32_t> receivedDataShards;
+        std::vector<uint32_t> receivedParityShards;
+        std::vector<bool> recoveredPacket;
+        // Packet columns not recovered yet.
+        size_t pendingPackets;
+        bool recovered;
+        bool rateless;
+        int repairRequests;
+        uint64_t lastRepairRequest;
+        std::shared_ptr<reed_solomon> rs;
+    };
 
-    VideoFrame m_currentFrame;
-    size_t m_shardPackets;
-    size_t m_blockSize;
-    size_t m_totalDataShards;
-    size_t m_totalParityShards;
-    size_t m_totalShards;
-    uint32_t m_firstPacketOfNextFrame = 0;
-    std::vector<std::vector<unsigned char>> m_marks;
-    std::vector<std::byte> m_frameBuffer;
-    std::vector<uint32_t> m_receivedDataShards;
-    std::vector<uint32_t> m_receivedParityShards;
-    std::vector<bool> m_recoveredPacket;
+    Frame *findFrame(uint64_t videoFrameIndex, uint8_t sliceIndex);
+    bool startFrame(Frame &frame, const VideoFrame *packet, int payloadSize);
+    void recoverPacket(Frame &frame, size_t packet);
+    bool recoverFrame(Frame &frame);
+    // Number of groups of the frame if they are all recovered, 0 otherwise.
+    int recoveredSlices(uint64_t videoFrameIndex);
+    void requestRepair(Frame &frame, uint64_t now);
+    bool sendNacks(Frame &frame);
+    void skipNextFrame(bool &fecFailure);
+    void emitFrame(uint64_t videoFrameIndex, int slices);
+    void releaseFrame(uint64_t videoFrameIndex);
+    void releaseOutput();
+
+    Frame m_frames[WINDOW_SIZE * ALVR_MAX_VIDEO_SLICES];
+    // Frame returned by the getters, 0 if none.
+    uint64_t m_outputFrameIndex = 0;
+    const std::byte *m_outputBuffer;
+    int m_outputByteSize;
+    uint64_t m_outputTrackingFrameIndex;
+    bool m_outputRecoveryFrame;
+    // Frames sent as several groups are concatenated here.
+    std::vector<std::byte> m_sliceBuffer;
+    // Next frame to emit, 0 before the first packet.
+    uint64_t m_nextFrameIndex = 0;
     std::vector<std::byte *> m_shards;
-    bool m_recovered;
     bool m_fecFailure;
-    reed_solomon *m_rs = NULL;
-
-    static bool reed_solomon_initialized;
+    uint64_t m_maxLatencyUs;
+    uint64_t (*m_clock)();
+    void (*m_repairCallback)(uint64_t videoFrameIndex, uint8_t sliceIndex,
+                             uint32_t parityShards) = nullptr;
+    void (*m_nackCallback)(uint32_t fromPacketCounter, uint32_t toPacketCounter) = nullptr;
+    // 0 while unknown.
+    uint64_t m_rttUs = 0;
 };
 
 #endif //ALVRCLIENT_FEC_H
@@ -7,18 +7,23 @@
 #include <android/log.h>
 #include <pthread.h>
 #include "nal.h"
+#include "annexb.h"
 #include "packet_types.h"
+#include "latency_collector.h"
 
 static const std::byte NAL_TYPE_SPS = static_cast<const std::byte>(7);
 
 static const std::byte H265_NAL_TYPE_VPS = static_cast<const std::byte>(32);
 
 
-NALParser::NALParser(JNIEnv *env, jobject udpManager, jclass nalClass, bool enableFEC)
+NALParser::NALParser(JNIEnv *env, jobject udpManager, jclass nalClass, bool enableFEC,
+                     uint64_t fecMaxLatencyUs)
     : m_enableFEC(enableFEC)
 {
     LOGE("NALParser initialized %p", this);
 
+    m_queue.setMaxLatency(fecMaxLatencyUs);
+
     m_env = env;
     mUdpManager = env->NewGlobalRef(udpManager);
 
@@ -28,9 +33,9 @@ NALParser::NALParser(JNIEnv *env, jobject udpManager, jclass nalClass, bool enab
 
     jclass activityClass = env->GetObjectClass(udpManager);
     mObtainNALMethodID = env->GetMethodID(activityClass, "obtainNAL",
-                                          "(I)Lcom/polygraphene/alvr/NAL;");
+                                          "(II)Lcom/polygraphene/alvr/NAL;");
     mPushNALMethodID = env->GetMethodID(activityClass, "pushNAL",
-                                        "(Lcom/polygraphene/alvr/NAL;)V");
+                                        "(Lcom/polygraphene/alvr/NAL;I)V");
 }
 
 NALParser::~NALParser()
@@ -43,82 +48,147 @@ void NALParser::setCodec(int codec)
     m_codec = codec;
 }
 
-bool NALParser::processPacket(VideoFrame *packet, int packetSize, bool &fecFailure)
+void NALParser::setSplitEyeStreams(bool split)
+{
+    m_splitEyeStreams = split;
+}
+
+void NALParser::setFecRepairCallback(void (*callback)(uint64_t, uint8_t, uint32_t))
+{
+    m_queue.setRepairRequestCallback(callback);
+}
+
+void NALParser::setNackCallback(void (*callback)(uint32_t, uint32_t))
+{
+    m_queue.setNackCallback(callback);
+}
+
+void NALParser::setRoundTripTime(uint64_t rttUs)
+{
+    m_queue.setRoundTripTime(rttUs);
+}
+
+void NALParser::setFrameAckCallback(void (*callback)(uint64_t, uint64_t))
+{
+    m_frameAckCallback = callback;
+}
+
+bool NALParser::processPacket(const VideoFrame *packet, const std::byte *payload, int payloadSize,
+                              int fullPayloadSize, bool &fecFailure)
 {
     if (m_enableFEC) {
-        m_queue.addVideoPacket(packet, packetSize, fecFailure);
+        m_queue.addVideoPacket(packet, payload, payloadSize, fullPayloadSize, fecFailure);
     }
 
-    bool result = m_queue.reconstruct();
-    if (result)
+    bool pushed = false;
+    // A packet can complete several frames when it arrives after reordering.
+    while (m_queue.reconstruct(fecFailure))
     {
         const std::byte *frameBuffer;
         int frameByteSize;
+        uint64_t trackingFrameIndex;
         if (m_enableFEC) {
             // Reconstructed
             frameBuffer = m_queue.getFrameBuffer();
             frameByteSize = m_queue.getFrameByteSize();
+            trackingFrameIndex = m_queue.getTrackingFrameIndex();
         } else {
-            frameBuffer = reinterpret_cast<const std::byte *>(packet) + sizeof(VideoFrame);
-            frameByteSize = packetSize - sizeof(VideoFrame);
+            frameBuffer = payload;
+            frameByteSize = payloadSize;
+            trackingFrameIndex = packet->trackingFrameIndex;
+        }
+        LatencyCollector::Instance().receivedLast(trackingFrameIndex);
+
+        // With split encoding, the picture of the left eye is followed by the one of the right
+        // eye, each for its own decoder. The encoders make their keyframes on the same frames.
+        int leftSize = frameByteSize;
+        if (m_splitEyeStreams) {
+            leftSize = (int) AnnexBFindSecondPicture(reinterpret_cast<const uint8_t *>(frameBuffer),
+                                                     frameByteSize, m_codec == ALVR_CODEC_H265);
+        }
+        bool keyframe;
+        if (!pushPicture(frameBuffer, leftSize, trackingFrameIndex, 0, keyframe)) {
+            continue;
+        }
+        if (leftSize < frameByteSize) {
+            bool rightKeyframe;
+            pushPicture(&frameBuffer[leftSize], frameByteSize - leftSize, trackingFrameIndex, 1,
+                        rightKeyframe);
         }
 
-        std::byte NALType;
-        if (m_codec == ALVR_CODEC_H264)
-            NALType = frameBuffer[4] & std::byte(0x1F);
-        else
-            NALType = (frameBuffer[4] >> 1) & std::byte(0x3F);
+        if (keyframe) {
+            m_queue.clearFecFailure();
+        } else if (m_enableFEC && m_queue.isRecoveryFrame()) {
+            // Predicted from a frame we acknowledged, the lost frames are not referenced.
+            m_queue.clearFecFailure();
+        }
+        if (m_enableFEC && !m_queue.fecFailure() && m_frameAckCallback != nullptr) {
+            m_frameAckCallback(m_queue.getVideoFrameIndex(), trackingFrameIndex);
+        }
+        pushed = true;
+    }
+    return pushed;
+}
 
-        if ((m_codec == ALVR_CODEC_H264 && NALType == NAL_TYPE_SPS) ||
-            (m_codec == ALVR_CODEC_H265 && NALType == H265_NAL_TYPE_VPS))
-        {
-            // This frame contains (VPS + )SPS + PPS + IDR on NVENC H.264 (H.265) stream.
-            // (VPS + )SPS + PPS has short size (8bytes + 28bytes in some environment), so we can assume SPS + PPS is contained in first fragment.
-
-            int end = findVPSSPS(frameBuffer, frameByteSize);
-            if (end == -1)
-            {
-                // Invalid frame.
-                LOG("Got invalid frame. Too large SPS or PPS?");
-                return false;
-            }
-            LOGI("Got frame=%d %d, Codec=%d", (std::int32_t) NALType, end, m_codec);
-            push(&frameBuffer[0], end, packet->trackingFrameIndex);
-            push(&frameBuffer[end], frameByteSize - end, packet->trackingFrameIndex);
+bool NALParser::pushPicture(const std::byte *frameBuffer, int frameByteSize, uint64_t frameIndex,
+                            int stream, bool &keyframe)
+{
+    std::byte NALType;
+    if (m_codec == ALVR_CODEC_H264)
+        NALType = frameBuffer[4] & std::byte(0x1F);
+    else
+        NALType = (frameBuffer[4] >> 1) & std::byte(0x3F);
+
+    keyframe = (m_codec == ALVR_CODEC_H264 && NALType == NAL_TYPE_SPS) ||
+               (m_codec == ALVR_CODEC_H265 && NALType == H265_NAL_TYPE_VPS);
+    if (keyframe)
+    {
+        // This frame contains (VPS + )SPS + PPS + IDR on NVENC H.264 (H.265) stream.
+        // (VPS + )SPS + PPS has short size (8bytes + 28bytes in some environment), so we can assume SPS + PPS is contained in first fragment.
 
-            m_queue.clearFecFailure();
-        } else
+        int end = findVPSSPS(frameBuffer, frameByteSize);
+        if (end == -1)
         {
-            push(&frameBuffer[0], frameByteSize, packet->trackingFrameIndex);
+            // Invalid frame.
+            LOG("Got invalid frame. Too large SPS or PPS?");
+            return false;
         }
-        return true;
+        LOGI("Got frame=%d %d, Codec=%d, Stream=%d", (std::int32_t) NALType, end, m_codec, stream);
+        push(&frameBuffer[0], end, frameIndex, stream);
+        push(&frameBuffer[end], frameByteSize - end, frameIndex, stream);
+    } else
+    {
+        push(&frameBuffer[0], frameByteSize, frameIndex, stream);
     }
-    return false;
+    return true;
 }
 
-void NALParser::push(const std::byte *buffer, int length, uint64_t frameIndex)
+void NALParser::push(const std::byte *buffer, int length, uint64_t frameIndex, int stream)
 {
     jobject nal;
     jbyteArray buf;
 
-    nal = m_env->CallObjectMethod(mUdpManager, mObtainNALMethodID, static_cast<jint>(length));
+    nal = m_env->CallObjectMethod(mUdpManager, mObtainNALMethodID, static_cast<jint>(length),
+                                  static_cast<jint>(stream));
     if (nal == nullptr)
     {
         LOGE("NAL Queue is full.");
         return;
     }
 
-    m_env->SetIntField(nal, NAL_length, length);
-    m_env->SetLongField(nal, NAL_frameIndex, frameIndex);
-
     buf = (jbyteArray) m_env->GetObjectField(nal, NAL_buf);
     std::byte *cbuf = (std::byte *) m_env->GetByteArrayElements(buf, NULL);
 
     memcpy(cbuf, buffer, length);
+    // Only the Linux server drops SEI and access unit delimiters before sending.
+    length = AnnexBFilterInPlace((uint8_t *) cbuf, length, m_codec == ALVR_CODEC_H265);
     m_env->ReleaseByteArrayElements(buf, (jbyte *) cbuf, 0);
     m_env->DeleteLocalRef(buf);
 
-    m_env->CallVoidMethod(mUdpManager, mPushNALMethodID, nal);
+    m_env->SetIntField(nal, NAL_length, length);
+    m_env->SetLongField(nal, NAL_frameIndex, frameIndex);
+
+    m_env->CallVoidMethod(mUdpManager, mPushNALMethodID, nal, static_cast<jint>(stream));
 
     m_env->DeleteLocalRef(nal);
 }
@@ -130,33 +200,16 @@ bool NALParser::fecFailure()
 
 int NALParser::findVPSSPS(const std::byte *frameBuffer, int frameByteSize)
 {
-    int zeroes = 0;
-    int foundNals = 0;
-    for (int i = 0; i < frameByteSize; i++)
+    // End of (VPS + )SPS + PPS: start of the first NAL unit that is not a parameter set.
+    bool h265 = m_codec == ALVR_CODEC_H265;
+    auto data = reinterpret_cast<const uint8_t *>(frameBuffer);
+    AnnexBParser parser(data, frameByteSize, h265);
+    AnnexBNal nal;
+    while (parser.Next(nal))
     {
-        if (frameBuffer[i] == std::byte(0))
-        {
-            zeroes++;
-        }
-        else if (frameBuffer[i] == std::byte(1))
-        {
-            if (zeroes >= 2)
-            {
-                foundNals++;
-                if (m_codec == ALVR_CODEC_H264 && foundNals >= 3)
-                {
-                    // Find end of SPS+PPS on H.264.
-                    return i - 3;
-                } else if (m_codec == ALVR_CODEC_H265 && foundNals >= 4)
-                {
-                    // Find end of VPS+SPS+PPS on H.264.
-                    return i - 3;
-                }
-            }
-            zeroes = 0;
-        } else
+        if (!AnnexBIsParameterSet(nal.type, h265))
         {
-            zeroes = 0;
+            return nal.begin == data ? -1 : nal.begin - data;
         }
     }
     return -1;
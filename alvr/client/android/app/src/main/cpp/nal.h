@@ -9,22 +9,38 @@
 
 class NALParser {
 public:
-    NALParser(JNIEnv *env, jobject udpManager, jclass nalClass, bool enableFEC);
+    NALParser(JNIEnv *env, jobject udpManager, jclass nalClass, bool enableFEC,
+              uint64_t fecMaxLatencyUs);
     ~NALParser();
 
     void setCodec(int codec);
-    bool processPacket(VideoFrame *packet, int packetSize, bool &fecFailure);
+    // The frames hold one picture per eye, pushed to stream 0 and 1 (split encoding).
+    void setSplitEyeStreams(bool split);
+    void setFecRepairCallback(void (*callback)(uint64_t videoFrameIndex, uint8_t sliceIndex,
+                                               uint32_t parityShards));
+    void setNackCallback(void (*callback)(uint32_t fromPacketCounter, uint32_t toPacketCounter));
+    void setRoundTripTime(uint64_t rttUs);
+    // Called for each frame pushed to the decoder while no frame was lost since the last IDR or
+    // recovery frame, so the server can predict from it after a loss.
+    void setFrameAckCallback(void (*callback)(uint64_t videoFrameIndex, uint64_t trackingFrameIndex));
+    bool processPacket(const VideoFrame *packet, const std::byte *payload, int payloadSize,
+                       int fullPayloadSize, bool &fecFailure);
 
     bool fecFailure();
 private:
-    void push(const std::byte *buffer, int length, uint64_t frameIndex);
+    // Pushes the picture of one stream, its parameter sets apart. Returns false if it is invalid.
+    bool pushPicture(const std::byte *frameBuffer, int frameByteSize, uint64_t frameIndex,
+                     int stream, bool &keyframe);
+    void push(const std::byte *buffer, int length, uint64_t frameIndex, int stream);
     int findVPSSPS(const std::byte *frameBuffer, int frameByteSize);
 
     bool m_enableFEC;
 
     FECQueue m_queue;
+    void (*m_frameAckCallback)(uint64_t videoFrameIndex, uint64_t trackingFrameIndex) = nullptr;
 
     int m_codec = 1;
+    bool m_splitEyeStreams = false;
 
     JNIEnv *m_env;
     jobject mUdpManager;
@@ -51,6 +51,7 @@ public:
     JNIEnv *env{};
 
     unique_ptr<Texture> streamTexture;
+    unique_ptr<Texture> rightStreamTexture;
     GLuint loadingTexture = 0;
     int suspend = 0;
     std::function<void()> openDashboard;
@@ -143,6 +144,7 @@ OnCreateResult onCreate(void *v_env, void *v_activity, void *v_assetManager) {
     //
 
     g_ctx.streamTexture = make_unique<Texture>(true);
+    g_ctx.rightStreamTexture = make_unique<Texture>(true);
 
     glGenTextures(1, &g_ctx.loadingTexture);
 
@@ -166,7 +168,8 @@ OnCreateResult onCreate(void *v_env, void *v_activity, void *v_assetManager) {
     //req = ovr_User_GetLoggedInUser();
     //LOGI("Logged in user is %" PRIu64 "\n", req);
 
-    return {(int) g_ctx.streamTexture.get()->GetGLTexture(), (int) g_ctx.loadingTexture};
+    return {(int) g_ctx.streamTexture.get()->GetGLTexture(),
+            (int) g_ctx.rightStreamTexture.get()->GetGLTexture(), (int) g_ctx.loadingTexture};
 }
 
 void destroyNative(void *v_env) {
@@ -597,7 +600,7 @@ OnResumeResult onResumeNative(void *v_surface, bool darkMode) {
 #pragma clang diagnostic push
 #pragma clang diagnostic ignored "-Wmissing-field-initializers"
     ovrRenderer_Create(&g_ctx.Renderer, eyeWidth, eyeHeight, g_ctx.streamTexture.get(),
-                       g_ctx.loadingTexture, {false});
+                       g_ctx.rightStreamTexture.get(), g_ctx.loadingTexture, {false});
 #pragma clang diagnostic pop
 
     ovrRenderer_CreateScene(&g_ctx.Renderer, darkMode);
@@ -637,7 +640,8 @@ void setStreamConfig(StreamConfig config) {
 void onStreamStartNative() {
     ovrRenderer_Destroy(&g_ctx.Renderer);
     ovrRenderer_Create(&g_ctx.Renderer, g_ctx.streamConfig.eyeWidth, g_ctx.streamConfig.eyeHeight,
-                       g_ctx.streamTexture.get(), g_ctx.loadingTexture,
+                       g_ctx.streamTexture.get(), g_ctx.rightStreamTexture.get(),
+                       g_ctx.loadingTexture,
                        {g_ctx.streamConfig.enableFoveation, g_ctx.streamConfig.eyeWidth,
                         g_ctx.streamConfig.eyeHeight, EyeFov(),
                         g_ctx.streamConfig.foveationStrength, g_ctx.streamConfig.foveationShape,
@@ -799,7 +803,7 @@ void updateHapticsState() {
     }
 }
 
-void renderNative(long long renderedFrameIndex) {
+void renderNative(long long renderedFrameIndex, bool splitEyeStreams) {
     LatencyCollector::Instance().rendered1(renderedFrameIndex);
     FrameLog(renderedFrameIndex, "Got frame for render.");
 
@@ -832,7 +836,7 @@ void renderNative(long long renderedFrameIndex) {
 
 // Render eye images and setup the primary layer using ovrTracking2.
     const ovrLayerProjection2 worldLayer =
-            ovrRenderer_RenderFrame(&g_ctx.Renderer, &frame->tracking, false);
+            ovrRenderer_RenderFrame(&g_ctx.Renderer, &frame->tracking, false, splitEyeStreams);
 
     LatencyCollector::Instance().rendered2(renderedFrameIndex);
 
@@ -879,7 +883,7 @@ void renderLoadingNative() {
     ovrTracking2 headTracking = vrapi_GetPredictedTracking2(g_ctx.Ovr, displayTime);
 
     const ovrLayerProjection2 worldLayer = ovrRenderer_RenderFrame(&g_ctx.Renderer, &headTracking,
-                                                                   true);
+                                                                   true, false);
 
     const ovrLayerHeader2 *layers[] =
             {
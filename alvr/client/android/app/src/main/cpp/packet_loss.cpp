@@ -0,0 +1,21 @@
+#include "packet_loss.h"
+
+void PacketLossCounter::reset() {
+    m_started = false;
+    m_highestPacketCounter = 0;
+}
+
+uint32_t PacketLossCounter::addVideoPacket(uint32_t packetCounter) {
+    if (!m_started) {
+        m_started = true;
+        m_highestPacketCounter = packetCounter;
+        return 0;
+    }
+    int32_t ahead = (int32_t) (packetCounter - m_highestPacketCounter);
+    if (ahead <= 0) {
+        // Retransmitted or reordered, its loss was counted when the later packets arrived.
+        return 0;
+    }
+    m_highestPacketCounter = packetCounter;
+    return (uint32_t) ahead - 1;
+}
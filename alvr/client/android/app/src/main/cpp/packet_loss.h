@@ -0,0 +1,21 @@
+#ifndef ALVRCLIENT_PACKET_LOSS_H
+#define ALVRCLIENT_PACKET_LOSS_H
+
+#include <cstdint>
+
+// Counts the lost video packets from the gaps in their packetCounter. Packets retransmitted after
+// a NACK keep their original counter, so they arrive at or below the highest counter seen, as
+// reordered packets do. They are not counted and the highest counter does not move back: a packet
+// repaired by a NACK counts as lost once.
+// This file does not depend on Android and can be built on a desktop host.
+class PacketLossCounter {
+public:
+    void reset();
+    // Returns the packets skipped since the highest counter seen.
+    uint32_t addVideoPacket(uint32_t packetCounter);
+private:
+    bool m_started = false;
+    uint32_t m_highestPacketCounter = 0;
+};
+
+#endif //ALVRCLIENT_PACKET_LOSS_H
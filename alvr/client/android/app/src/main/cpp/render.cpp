@@ -109,6 +109,26 @@ void main()
 }
 )glsl";
 
+// Each eye is a whole picture of its own. uv covers the left half of the side by side frame for
+// the left eye and the right half for the right eye.
+static const char FRAGMENT_SHADER_SPLIT[] = R"glsl(
+#extension GL_OES_EGL_image_external_essl3 : enable
+#extension GL_OES_EGL_image_external : enable
+in lowp vec2 uv;
+in lowp vec4 fragmentColor;
+out lowp vec4 outColor;
+uniform samplerExternalOES Texture0;
+uniform samplerExternalOES Texture1;
+void main()
+{
+    if (uv.x < 0.5) {
+        outColor = texture(Texture0, vec2(uv.x * 2.0, uv.y));
+    } else {
+        outColor = texture(Texture1, vec2(uv.x * 2.0 - 1.0, uv.y));
+    }
+}
+)glsl";
+
 static const char VERTEX_SHADER_LOADING[] = R"glsl(
 #ifndef DISABLE_MULTIVIEW
     #define DISABLE_MULTIVIEW 0
@@ -642,7 +662,7 @@ void ovrProgram_Destroy(ovrProgram *program) {
 //
 
 void ovrRenderer_Create(ovrRenderer *renderer, int width, int height, Texture *streamTexture,
-                        int LoadingTexture, FFRData ffrData) {
+                        Texture *rightStreamTexture, int LoadingTexture, FFRData ffrData) {
     renderer->NumBuffers = VRAPI_FRAME_LAYER_EYE_MAX;
 
     renderer->enableFFR = ffrData.enabled;
@@ -660,6 +680,7 @@ void ovrRenderer_Create(ovrRenderer *renderer, int width, int height, Texture *s
 #endif
 
     renderer->streamTexture = streamTexture;
+    renderer->rightStreamTexture = rightStreamTexture;
     renderer->LoadingTexture = LoadingTexture;
     renderer->SceneCreated = false;
     renderer->loadingScene = new GltfModel();
@@ -676,6 +697,9 @@ void ovrRenderer_CreateScene(ovrRenderer *renderer, bool darkMode) {
     fragment_shader = string_format(FRAGMENT_SHADER,
                                     renderer->enableFFR ? "sampler2D" : "samplerExternalOES");
     ovrProgram_Create(&renderer->Program, VERTEX_SHADER, fragment_shader.c_str());
+    if (!renderer->enableFFR) {
+        ovrProgram_Create(&renderer->ProgramSplit, VERTEX_SHADER, FRAGMENT_SHADER_SPLIT);
+    }
 
     fragment_shader = string_format(FRAGMENT_SHADER_LOADING,
                                     darkMode ? "outColor.rgb = 1.0 - outColor.rgb;" : "");
@@ -691,6 +715,7 @@ void ovrRenderer_Destroy(ovrRenderer *renderer) {
 #if !defined(GVR_SDK)
     if (renderer->SceneCreated) {
         ovrProgram_Destroy(&renderer->Program);
+        ovrProgram_Destroy(&renderer->ProgramSplit);
         ovrProgram_Destroy(&renderer->ProgramLoading);
         ovrGeometry_DestroyVAO(&renderer->Panel);
         ovrGeometry_Destroy(&renderer->Panel);
@@ -707,7 +732,7 @@ void ovrRenderer_Destroy(ovrRenderer *renderer) {
 #ifdef OVR_SDK
 
 ovrLayerProjection2 ovrRenderer_RenderFrame(ovrRenderer *renderer, const ovrTracking2 *tracking,
-                                            bool loading) {
+                                            bool loading, bool splitEyeStreams) {
     if (renderer->enableFFR) {
         renderer->ffr->Render();
     }
@@ -751,7 +776,7 @@ ovrLayerProjection2 ovrRenderer_RenderFrame(ovrRenderer *renderer, const ovrTrac
         Recti viewport = {0, 0, (int) frameBuffer->renderTargets[0]->GetWidth(),
                           (int) frameBuffer->renderTargets[0]->GetHeight()};
 
-        renderEye(eye, mvpMatrix, &viewport, renderer, loading);
+        renderEye(eye, mvpMatrix, &viewport, renderer, loading, splitEyeStreams);
 
         ovrFramebuffer_Resolve();
         ovrFramebuffer_Advance(frameBuffer);
@@ -765,7 +790,9 @@ ovrLayerProjection2 ovrRenderer_RenderFrame(ovrRenderer *renderer, const ovrTrac
 #endif
 
 void renderEye(int eye, ovrMatrix4f mvpMatrix[2], Recti *viewport, ovrRenderer *renderer,
-               bool loading) {
+               bool loading, bool splitEyeStreams) {
+    splitEyeStreams = splitEyeStreams && !renderer->enableFFR;
+    ovrProgram *program = splitEyeStreams ? &renderer->ProgramSplit : &renderer->Program;
     if (loading) {
         GL(glUseProgram(renderer->ProgramLoading.Program));
         if (renderer->ProgramLoading.UniformLocation[UNIFORM_VIEW_ID] >=
@@ -774,11 +801,11 @@ void renderEye(int eye, ovrMatrix4f mvpMatrix[2], Recti *viewport, ovrRenderer *
             GL(glUniform1i(renderer->ProgramLoading.UniformLocation[UNIFORM_VIEW_ID], eye));
         }
     } else {
-        GL(glUseProgram(renderer->Program.Program));
-        if (renderer->Program.UniformLocation[UNIFORM_VIEW_ID] >=
+        GL(glUseProgram(program->Program));
+        if (program->UniformLocation[UNIFORM_VIEW_ID] >=
             0)  // NOTE: will not be present when multiview path is enabled.
         {
-            GL(glUniform1i(renderer->Program.UniformLocation[UNIFORM_VIEW_ID], eye));
+            GL(glUniform1i(program->UniformLocation[UNIFORM_VIEW_ID], eye));
         }
     }
     GL(glEnable(GL_SCISSOR_TEST));
@@ -822,10 +849,10 @@ void renderEye(int eye, ovrMatrix4f mvpMatrix[2], Recti *viewport, ovrRenderer *
 
         GL(glBindVertexArray(renderer->Panel.VertexArrayObject));
 
-        GL(glUniformMatrix4fv(renderer->Program.UniformLocation[UNIFORM_MVP_MATRIX], 2, true,
+        GL(glUniformMatrix4fv(program->UniformLocation[UNIFORM_MVP_MATRIX], 2, true,
                               (float *) mvpMatrix));
 
-        GL(glUniform1f(renderer->Program.UniformLocation[UNIFORM_ALPHA], 2.0f));
+        GL(glUniform1f(program->UniformLocation[UNIFORM_ALPHA], 2.0f));
         GL(glActiveTexture(GL_TEXTURE0));
         if (renderer->enableFFR) {
             GL(glBindTexture(GL_TEXTURE_2D,
@@ -833,6 +860,11 @@ void renderEye(int eye, ovrMatrix4f mvpMatrix[2], Recti *viewport, ovrRenderer *
         } else {
             GL(glBindTexture(GL_TEXTURE_EXTERNAL_OES, renderer->streamTexture->GetGLTexture()));
         }
+        if (splitEyeStreams) {
+            GL(glActiveTexture(GL_TEXTURE1));
+            GL(glBindTexture(GL_TEXTURE_EXTERNAL_OES,
+                             renderer->rightStreamTexture->GetGLTexture()));
+        }
 
         GL(glDrawElements(GL_TRIANGLES, renderer->Panel.IndexCount, GL_UNSIGNED_SHORT, NULL));
 
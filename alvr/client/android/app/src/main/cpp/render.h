@@ -132,9 +132,12 @@ typedef struct {
     int NumBuffers;
     bool SceneCreated;
     ovrProgram Program;
+    // Samples the picture of each eye from its own texture, with split encoding.
+    ovrProgram ProgramSplit;
     ovrProgram ProgramLoading;
     ovrGeometry Panel;
     gl_render_utils::Texture *streamTexture;
+    gl_render_utils::Texture *rightStreamTexture;
     GLuint LoadingTexture;
     GltfModel *loadingScene;
     std::unique_ptr<FFR> ffr;
@@ -143,19 +146,21 @@ typedef struct {
 } ovrRenderer;
 
 void ovrRenderer_Create(ovrRenderer *renderer, int width, int height,
-                        gl_render_utils::Texture *streamTexture, int LoadingTexture,
+                        gl_render_utils::Texture *streamTexture,
+                        gl_render_utils::Texture *rightStreamTexture, int LoadingTexture,
                         FFRData ffrData);
 
 void ovrRenderer_Destroy(ovrRenderer *renderer);
 
 void ovrRenderer_CreateScene(ovrRenderer *renderer, bool darkMode);
 
-// Set up an OVR frame, render it, and submit it.
+// Set up an OVR frame, render it, and submit it. With splitEyeStreams, the right eye is read from
+// rightStreamTexture. Split encoding is not combined with FFR.
 ovrLayerProjection2 ovrRenderer_RenderFrame(ovrRenderer *renderer, const ovrTracking2 *tracking,
-                                            bool loading);
+                                            bool loading, bool splitEyeStreams);
 
 // Render the contents of the frame in an SDK-neutral manner.
 void renderEye(int eye, ovrMatrix4f mvpMatrix[2], Recti *viewport, ovrRenderer *renderer,
-               bool loading);
+               bool loading, bool splitEyeStreams);
 
 #endif //ALVRCLIENT_RENDER_H
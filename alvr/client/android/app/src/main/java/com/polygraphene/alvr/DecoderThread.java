@@ -359,6 +359,10 @@ public class DecoderThread extends ThreadBase implements Handler.Callback {
         mQueue.onFrameAvailable();
     }
 
+    public long availableFrameIndex() {
+        return mQueue.availableFrameIndex();
+    }
+
     public long clearAvailable(SurfaceTexture surfaceTexture) {
         return mQueue.clearAvailable(surfaceTexture);
     }
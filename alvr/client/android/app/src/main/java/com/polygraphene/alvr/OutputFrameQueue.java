@@ -123,6 +123,15 @@ public class OutputFrameQueue {
         mState = SurfaceState.Available;
     }
 
+    // Frame index clearAvailable() would return, -1 if no frame is available.
+    synchronized public long availableFrameIndex()
+    {
+        if (mStopped || mState != SurfaceState.Available) {
+            return -1;
+        }
+        return mSurface.frameIndex;
+    }
+
     synchronized public long clearAvailable(SurfaceTexture surfaceTexture)
     {
         if (mStopped) {
@@ -54,6 +54,7 @@ public class OvrActivity extends Activity {
 
     public static class OnCreateResult {
         public int streamSurfaceHandle;
+        public int rightStreamSurfaceHandle;
         public int loadingSurfaceHandle;
     }
 
@@ -94,6 +95,14 @@ public class OvrActivity extends Activity {
     Surface mStreamSurface;
     final LoadingTexture mLoadingTexture = new LoadingTexture();
     DecoderThread mDecoderThread = null;
+    // With split encoding, the right eye is a stream of its own, decoded by mRightDecoderThread.
+    // The frames are rendered split once the right eye decoder has output one, so that a server
+    // that does not split still shows up.
+    SurfaceTexture mRightStreamSurfaceTexture;
+    Surface mRightStreamSurface;
+    DecoderThread mRightDecoderThread = null;
+    boolean mSplitEyeStreams = false;
+    volatile boolean mRightStreamStarted = false;
     EGLContext mEGLContext;
     boolean mVrMode = false;
     float mRefreshRate = 60f;
@@ -144,6 +153,16 @@ public class OvrActivity extends Activity {
         }, new Handler(Looper.getMainLooper()));
         mStreamSurface = new Surface(mStreamSurfaceTexture);
 
+        mRightStreamSurfaceTexture = new SurfaceTexture(deviceDescriptor.rightStreamSurfaceHandle);
+        mRightStreamSurfaceTexture.setOnFrameAvailableListener(surfaceTexture -> {
+            if (mRightDecoderThread != null) {
+                mRightDecoderThread.onFrameAvailable();
+            }
+            mRenderingHandler.removeCallbacks(mRenderRunnable);
+            mRenderingHandler.post(mRenderRunnable);
+        }, new Handler(Looper.getMainLooper()));
+        mRightStreamSurface = new Surface(mRightStreamSurfaceTexture);
+
         mLoadingTexture.initializeMessageCanvas(deviceDescriptor.loadingSurfaceHandle);
 
         mEGLContext = EGL14.eglGetCurrentContext();
@@ -188,11 +207,14 @@ public class OvrActivity extends Activity {
                 // and onFrameAvailable won't be called after next output.
                 // To avoid deadlock caused by it, we need to flush last output.
                 mStreamSurfaceTexture.updateTexImage();
+                mRightStreamSurfaceTexture.updateTexImage();
 
                 mDecoderThread = new DecoderThread(mStreamSurface, mDecoderCallback);
+                mRightDecoderThread = new DecoderThread(mRightStreamSurface, mRightDecoderCallback);
 
                 try {
                     mDecoderThread.start();
+                    mRightDecoderThread.start();
                 } catch (IllegalArgumentException | IllegalStateException | SecurityException e) {
                     Utils.loge(TAG, e::toString);
                 }
@@ -223,6 +245,9 @@ public class OvrActivity extends Activity {
                 if (mDecoderThread != null) {
                     mDecoderThread.stopAndWait();
                 }
+                if (mRightDecoderThread != null) {
+                    mRightDecoderThread.stopAndWait();
+                }
 
                 onVrModeChanged(false);
 
@@ -314,10 +339,16 @@ public class OvrActivity extends Activity {
     private void render() {
         if (mResumed && mScreenSurface != null) {
             if (isConnectedNative()) {
-                long renderedFrameIndex = mDecoderThread.clearAvailable(mStreamSurfaceTexture);
+                boolean split = mSplitEyeStreams && mRightStreamStarted;
+                long renderedFrameIndex;
+                if (split) {
+                    renderedFrameIndex = clearAvailableEyes();
+                } else {
+                    renderedFrameIndex = mDecoderThread.clearAvailable(mStreamSurfaceTexture);
+                }
 
                 if (renderedFrameIndex != -1) {
-                    renderNative(renderedFrameIndex);
+                    renderNative(renderedFrameIndex, split);
                 }
 
                 mRenderingHandler.removeCallbacks(mRenderRunnable);
@@ -332,6 +363,27 @@ public class OvrActivity extends Activity {
         }
     }
 
+    // Renders only once both decoders have output the same frame. The eye that is behind drops its
+    // frame and waits for the next one.
+    private long clearAvailableEyes() {
+        long left = mDecoderThread.availableFrameIndex();
+        long right = mRightDecoderThread.availableFrameIndex();
+        if (left == -1 || right == -1) {
+            return -1;
+        }
+        if (left < right) {
+            mDecoderThread.clearAvailable(mStreamSurfaceTexture);
+            return -1;
+        }
+        if (right < left) {
+            mRightDecoderThread.clearAvailable(mRightStreamSurfaceTexture);
+            return -1;
+        }
+        mDecoderThread.clearAvailable(mStreamSurfaceTexture);
+        mRightDecoderThread.clearAvailable(mRightStreamSurfaceTexture);
+        return left;
+    }
+
     public void onVrModeChanged(boolean enter) {
         mVrMode = enter;
         if (mVrMode) {
@@ -353,6 +405,21 @@ public class OvrActivity extends Activity {
         }
     };
 
+    private final DecoderThread.DecoderCallback mRightDecoderCallback = new DecoderThread.DecoderCallback() {
+        @Override
+        public void onPrepared() {
+            // The IDR requested for the left eye decoder starts both streams.
+        }
+
+        @Override
+        public void onFrameDecoded() {
+            mRightStreamStarted = true;
+            if (mRightDecoderThread != null) {
+                mRightDecoderThread.releaseBuffer();
+            }
+        }
+    };
+
     static native void initNativeLogging();
 
     static native void createIdentity(Preferences p); // id fields are reset
@@ -366,7 +433,7 @@ public class OvrActivity extends Activity {
 
     native void onPauseNative();
 
-    native void renderNative(long renderedFrameIndex);
+    native void renderNative(long renderedFrameIndex, boolean splitEyeStreams);
 
     native void renderLoadingNative();
 
@@ -396,12 +463,15 @@ public class OvrActivity extends Activity {
     }
 
     @SuppressWarnings("unused")
-    public void onServerConnected(float fps, int codec, boolean realtimeDecoder, String dashboardURL) {
+    public void onServerConnected(float fps, int codec, boolean realtimeDecoder, boolean splitEyeStreams, String dashboardURL) {
         mRefreshRate = fps;
         mDashboardURL = dashboardURL;
         mRenderingHandler.post(() -> {
             onStreamStartNative();
+            mSplitEyeStreams = splitEyeStreams;
+            mRightStreamStarted = false;
             mDecoderThread.onConnect(codec, realtimeDecoder);
+            mRightDecoderThread.onConnect(codec, realtimeDecoder);
         });
     }
 
@@ -411,6 +481,9 @@ public class OvrActivity extends Activity {
         if (mDecoderThread != null) {
             mDecoderThread.onDisconnect();
         }
+        if (mRightDecoderThread != null) {
+            mRightDecoderThread.onDisconnect();
+        }
     }
 
     @SuppressWarnings("unused")
@@ -422,10 +495,12 @@ public class OvrActivity extends Activity {
         });
     }
 
+    // stream: 0, or 1 for the right eye with split encoding.
     @SuppressWarnings("unused")
-    public NAL obtainNAL(int length) {
-        if (mDecoderThread != null) {
-            return mDecoderThread.obtainNAL(length);
+    public NAL obtainNAL(int length, int stream) {
+        DecoderThread decoderThread = stream == 0 ? mDecoderThread : mRightDecoderThread;
+        if (decoderThread != null) {
+            return decoderThread.obtainNAL(length);
         } else {
             NAL nal = new NAL();
             nal.length = length;
@@ -435,9 +510,10 @@ public class OvrActivity extends Activity {
     }
 
     @SuppressWarnings("unused")
-    public void pushNAL(NAL nal) {
-        if (mDecoderThread != null) {
-            mDecoderThread.pushNAL(nal);
+    public void pushNAL(NAL nal, int stream) {
+        DecoderThread decoderThread = stream == 0 ? mDecoderThread : mRightDecoderThread;
+        if (decoderThread != null) {
+            decoderThread.pushNAL(nal);
         }
     }
 
@@ -290,14 +290,20 @@ async fn connection_pipeline(
         });
     }
 
+    // The frames then hold one picture per eye, each decoded on its own. The right eye picture
+    // cannot go through the foveation decoding of the whole frame.
+    let split_eye_streams = settings.video.split_eye_encoding
+        && !matches!(settings.video.foveated_rendering, Switch::Enabled(_));
+
     trace_err!(trace_err!(java_vm.attach_current_thread())?.call_method(
         &*activity_ref,
         "onServerConnected",
-        "(FIZLjava/lang/String;)V",
+        "(FIZZLjava/lang/String;)V",
         &[
             config_packet.fps.into(),
             (matches!(settings.video.codec, CodecType::HEVC) as i32).into(),
             settings.video.client_request_realtime_decoder.into(),
+            split_eye_streams.into(),
             trace_err!(trace_err!(java_vm.attach_current_thread())?
                 .new_string(config_packet.dashboard_url))?
             .into()
@@ -364,6 +370,8 @@ async fn connection_pipeline(
         let nal_class_ref = Arc::clone(&nal_class_ref);
         let codec = settings.video.codec;
         let enable_fec = settings.connection.enable_fec;
+        let fec_reorder_timeout_us = settings.connection.fec_reorder_timeout_ms * 1000;
+        let report_arrivals = matches!(settings.video.adaptive_bitrate, Switch::Enabled(_));
         move || -> StrResult {
             let env = trace_err!(java_vm.attach_current_thread())?;
             let env_ptr = env.get_native_interface() as _;
@@ -377,6 +385,9 @@ async fn connection_pipeline(
                     **nal_class as _,
                     matches!(codec, CodecType::HEVC) as _,
                     enable_fec,
+                    fec_reorder_timeout_us,
+                    report_arrivals,
+                    split_eye_streams,
                 );
 
                 let mut idr_request_deadline = None;
@@ -128,6 +128,12 @@ pub unsafe extern "system" fn Java_com_polygraphene_alvr_OvrActivity_onCreateNat
             "I",
             result.streamSurfaceHandle.into()
         ))?;
+        trace_err!(env.set_field(
+            jout_result,
+            "rightStreamSurfaceHandle",
+            "I",
+            result.rightStreamSurfaceHandle.into()
+        ))?;
         trace_err!(env.set_field(
             jout_result,
             "loadingSurfaceHandle",
@@ -152,8 +158,9 @@ pub unsafe extern "system" fn Java_com_polygraphene_alvr_OvrActivity_renderNativ
     _: JNIEnv,
     _: JObject,
     rendered_frame_index: i64,
+    split_eye_streams: u8,
 ) {
-    renderNative(rendered_frame_index)
+    renderNative(rendered_frame_index, split_eye_streams == 1)
 }
 
 #[no_mangle]
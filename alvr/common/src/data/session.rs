@@ -53,11 +53,30 @@ pub struct OpenvrConfig {
     pub tracking_ref_only: bool,
     pub enable_vive_tracker_proxy: bool,
     pub aggressive_keyframe_resend: bool,
+    pub fec_large_blocks: bool,
+    pub fec_rateless: bool,
+    pub adaptive_fec: bool,
+    pub fec_inter_percentage: u32,
+    pub fec_idr_percentage: u32,
+    pub fec_parameter_sets_percentage: u32,
+    pub packet_pacing_percentage: u32,
+    pub compact_video_packets: bool,
+    pub max_video_packet_size: u32,
+    pub mtu_probing: bool,
     pub adapter_index: u32,
     pub codec: u32,
     pub refresh_rate: u32,
     pub use_10bit_encoder: bool,
     pub encode_bitrate_mbs: u64,
+    pub encoder_slices: u32,
+    pub split_eye_encoding: bool,
+    pub enable_intra_refresh: bool,
+    pub intra_refresh_frames: u32,
+    pub enable_adaptive_bitrate: bool,
+    pub adaptive_bitrate_min_mbs: u64,
+    pub convert_thread_cpu: i32,
+    pub encode_thread_cpu: i32,
+    pub send_thread_cpu: i32,
     pub controllers_tracking_system_name: String,
     pub controllers_manufacturer_name: String,
     pub controllers_model_number: String,
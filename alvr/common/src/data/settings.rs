@@ -43,6 +43,33 @@ pub struct FoveatedRenderingDesc {
     pub vertical_offset: f32,
 }
 
+#[derive(SettingsSchema, Serialize, Deserialize)]
+#[serde(rename_all = "camelCase")]
+pub struct IntraRefreshDesc {
+    #[schema(min = 2, max = 300)]
+    pub frames: u32,
+}
+
+#[derive(SettingsSchema, Serialize, Deserialize)]
+#[serde(rename_all = "camelCase")]
+pub struct AdaptiveBitrateDesc {
+    #[schema(min = 1, max = 500)]
+    pub min_bitrate_mbs: u64,
+}
+
+#[derive(SettingsSchema, Serialize, Deserialize)]
+#[serde(rename_all = "camelCase")]
+pub struct EncoderThreadAffinityDesc {
+    #[schema(min = 0, max = 255)]
+    pub convert_cpu: u32,
+
+    #[schema(min = 0, max = 255)]
+    pub encode_cpu: u32,
+
+    #[schema(min = 0, max = 255)]
+    pub send_cpu: u32,
+}
+
 #[derive(SettingsSchema, Serialize, Deserialize)]
 pub struct ColorCorrectionDesc {
     #[schema(min = -1., max = 1., step = 0.01)]
@@ -115,6 +142,21 @@ pub struct VideoDesc {
     #[schema(min = 1, max = 500)]
     pub encode_bitrate_mbs: u64,
 
+    #[schema(advanced, min = 1, max = 8)]
+    pub encoder_slices: u32,
+
+    #[schema(advanced)]
+    pub split_eye_encoding: bool,
+
+    #[schema(advanced)]
+    pub intra_refresh: Switch<IntraRefreshDesc>,
+
+    #[schema(advanced)]
+    pub adaptive_bitrate: Switch<AdaptiveBitrateDesc>,
+
+    #[schema(advanced)]
+    pub encoder_thread_affinity: Switch<EncoderThreadAffinityDesc>,
+
     #[schema(advanced)]
     pub seconds_from_vsync_to_photons: f32,
 
@@ -333,6 +375,75 @@ pub struct DiscoveryConfig {
     pub auto_trust_clients: bool,
 }
 
+#[derive(SettingsSchema, Serialize, Deserialize)]
+#[serde(rename_all = "camelCase", tag = "type", content = "content")]
+pub enum PacketLossModel {
+    #[serde(rename_all = "camelCase")]
+    Bernoulli {
+        #[schema(min = 0., max = 1., step = 0.001)]
+        loss_rate: f32,
+    },
+
+    // Two state Markov chain, losses come in bursts while in the bad state
+    #[serde(rename_all = "camelCase")]
+    GilbertElliott {
+        #[schema(min = 0., max = 1., step = 0.001)]
+        p_good_to_bad: f32,
+        #[schema(min = 0., max = 1., step = 0.001)]
+        p_bad_to_good: f32,
+        #[schema(min = 0., max = 1., step = 0.001)]
+        good_loss_rate: f32,
+        #[schema(min = 0., max = 1., step = 0.001)]
+        bad_loss_rate: f32,
+    },
+}
+
+#[derive(SettingsSchema, Serialize, Deserialize)]
+#[serde(rename_all = "camelCase")]
+pub struct BandwidthLimitDesc {
+    #[schema(min = 1, max = 1000)]
+    pub bitrate_mbs: u64,
+
+    #[schema(min = 1, max = 1000)]
+    pub queue_limit_ms: u64,
+}
+
+#[derive(SettingsSchema, Serialize, Deserialize)]
+#[serde(rename_all = "camelCase")]
+pub struct CompactVideoPacketsDesc {
+    #[schema(min = 600, max = 8943)]
+    pub max_packet_size: u32,
+
+    pub path_mtu_probing: bool,
+}
+
+#[derive(SettingsSchema, Serialize, Deserialize)]
+#[serde(rename_all = "camelCase")]
+pub struct NetworkImpairmentDesc {
+    pub packet_loss: Switch<PacketLossModel>,
+
+    #[schema(min = 0, max = 500)]
+    pub delay_ms: u64,
+
+    #[schema(min = 0, max = 100)]
+    pub jitter_ms: u64,
+
+    #[schema(min = 0, max = 100)]
+    pub reorder_percentage: u32,
+
+    #[schema(min = 0, max = 100)]
+    pub reorder_delay_ms: u64,
+
+    #[schema(min = 0, max = 100)]
+    pub duplicate_percentage: u32,
+
+    pub bandwidth_limit: Switch<BandwidthLimitDesc>,
+
+    pub trace_file: String,
+
+    pub seed: u64,
+}
+
 #[derive(SettingsSchema, Serialize, Deserialize)]
 #[serde(rename_all = "camelCase")]
 pub struct ConnectionDesc {
@@ -357,6 +468,36 @@ pub struct ConnectionDesc {
 
     #[schema(advanced)]
     pub enable_fec: bool,
+
+    #[schema(advanced)]
+    pub fec_large_blocks: bool,
+
+    #[schema(advanced)]
+    pub fec_rateless: bool,
+
+    #[schema(advanced)]
+    pub adaptive_fec: bool,
+
+    #[schema(advanced, min = 1, max = 50)]
+    pub fec_inter_percentage: u32,
+
+    #[schema(advanced, min = 1, max = 50)]
+    pub fec_idr_percentage: u32,
+
+    #[schema(advanced, min = 1, max = 50)]
+    pub fec_parameter_sets_percentage: u32,
+
+    #[schema(advanced, min = 1, max = 100)]
+    pub fec_reorder_timeout_ms: u64,
+
+    #[schema(advanced, min = 0, max = 100)]
+    pub packet_pacing_percentage: u32,
+
+    #[schema(advanced)]
+    pub compact_video_packets: Switch<CompactVideoPacketsDesc>,
+
+    #[schema(advanced)]
+    pub network_impairment: Switch<NetworkImpairmentDesc>,
 }
 
 #[derive(SettingsSchema, Serialize, Deserialize)]
@@ -457,6 +598,24 @@ pub fn session_settings_default() -> SettingsDefault {
             use_10bit_encoder: false,
             client_request_realtime_decoder: true,
             encode_bitrate_mbs: 30,
+            encoder_slices: 1,
+            split_eye_encoding: false,
+            intra_refresh: SwitchDefault {
+                enabled: false,
+                content: IntraRefreshDescDefault { frames: 36 },
+            },
+            adaptive_bitrate: SwitchDefault {
+                enabled: false,
+                content: AdaptiveBitrateDescDefault { min_bitrate_mbs: 5 },
+            },
+            encoder_thread_affinity: SwitchDefault {
+                enabled: false,
+                content: EncoderThreadAffinityDescDefault {
+                    convert_cpu: 1,
+                    encode_cpu: 2,
+                    send_cpu: 3,
+                },
+            },
         },
         audio: AudioSectionDefault {
             game_audio: SwitchDefault {
@@ -560,6 +719,53 @@ pub fn session_settings_default() -> SettingsDefault {
             on_connect_script: "".into(),
             on_disconnect_script: "".into(),
             enable_fec: true,
+            fec_large_blocks: false,
+            fec_rateless: false,
+            adaptive_fec: true,
+            fec_inter_percentage: 5,
+            fec_idr_percentage: 20,
+            fec_parameter_sets_percentage: 30,
+            fec_reorder_timeout_ms: 10,
+            packet_pacing_percentage: 0,
+            compact_video_packets: SwitchDefault {
+                enabled: false,
+                content: CompactVideoPacketsDescDefault {
+                    max_packet_size: 8943,
+                    path_mtu_probing: true,
+                },
+            },
+            network_impairment: SwitchDefault {
+                enabled: false,
+                content: NetworkImpairmentDescDefault {
+                    packet_loss: SwitchDefault {
+                        enabled: true,
+                        content: PacketLossModelDefault {
+                            variant: PacketLossModelDefaultVariant::Bernoulli,
+                            Bernoulli: PacketLossModelBernoulliDefault { loss_rate: 0.01 },
+                            GilbertElliott: PacketLossModelGilbertElliottDefault {
+                                p_good_to_bad: 0.005,
+                                p_bad_to_good: 0.2,
+                                good_loss_rate: 0.,
+                                bad_loss_rate: 0.5,
+                            },
+                        },
+                    },
+                    delay_ms: 0,
+                    jitter_ms: 0,
+                    reorder_percentage: 0,
+                    reorder_delay_ms: 5,
+                    duplicate_percentage: 0,
+                    bandwidth_limit: SwitchDefault {
+                        enabled: false,
+                        content: BandwidthLimitDescDefault {
+                            bitrate_mbs: 50,
+                            queue_limit_ms: 50,
+                        },
+                    },
+                    trace_file: "".into(),
+                    seed: 0,
+                },
+            },
         },
         extra: ExtraDescDefault {
             theme: ThemeDefault {
@@ -0,0 +1,477 @@
+// Network impairment emulation, to test the handling of bad networks on a clean one (or on
+// loopback). Packets go through a bottleneck of limited bandwidth with a drop-tail queue, a loss
+// model, a delay with jitter, and can be reordered or duplicated. Every random choice comes from a
+// seeded generator and all times are passed by the caller, so that a given sequence of packets is
+// always impaired the same way.
+//
+// The parameters can be changed over time with a trace file. Each line is a time in milliseconds
+// since the start of the stream followed by the parameters to change, for example:
+//     # drop the bandwidth to 20 Mbps for 5 s, with 2% loss
+//     10000 bandwidth_mbs=20 loss=0.02
+//     15000 bandwidth_mbs=0 loss=0
+// Parameters are loss (Bernoulli loss rate), delay_ms, jitter_ms, reorder_percentage,
+// duplicate_percentage and bandwidth_mbs (0 removes the limit).
+
+use crate::{
+    data::{NetworkImpairmentDesc, PacketLossModel},
+    prelude::*,
+};
+use rand::{rngs::StdRng, Rng, SeedableRng};
+use settings_schema::Switch;
+use std::{
+    cmp::Ordering,
+    collections::BinaryHeap,
+    fs,
+    time::{Duration, Instant},
+};
+
+#[derive(Clone, Copy, PartialEq, Debug)]
+enum LossModel {
+    Bernoulli {
+        loss_rate: f32,
+    },
+    GilbertElliott {
+        p_good_to_bad: f32,
+        p_bad_to_good: f32,
+        good_loss_rate: f32,
+        bad_loss_rate: f32,
+    },
+}
+
+#[derive(Clone, Copy, PartialEq, Debug)]
+enum TraceChange {
+    Loss(f32),
+    Delay(Duration),
+    Jitter(Duration),
+    ReorderPercentage(u32),
+    DuplicatePercentage(u32),
+    BandwidthMbs(u64),
+}
+
+fn parse_trace(trace: &str) -> StrResult<Vec<(Duration, TraceChange)>> {
+    let mut changes = vec![];
+    for (index, line) in trace.lines().enumerate() {
+        let line = line.split('#').next().unwrap().trim();
+        if line.is_empty() {
+            continue;
+        }
+
+        let mut tokens = line.split_whitespace();
+        let time_ms = tokens.next().unwrap();
+        let time = Duration::from_millis(
+            time_ms
+                .parse()
+                .map_err(|_| format!("Trace line {}: bad time {}", index + 1, time_ms))?,
+        );
+        if changes
+            .last()
+            .map(|(last_time, _)| time < *last_time)
+            .unwrap_or(false)
+        {
+            return fmt_e!("Trace line {}: times must not decrease", index + 1);
+        }
+
+        for token in tokens {
+            let mut key_value = token.splitn(2, '=');
+            let key = key_value.next().unwrap();
+            let value = key_value.next().unwrap_or("");
+            let bad_value = || format!("Trace line {}: bad value {}", index + 1, token);
+            let change = match key {
+                "loss" => TraceChange::Loss(value.parse().map_err(|_| bad_value())?),
+                "delay_ms" => TraceChange::Delay(Duration::from_millis(
+                    value.parse().map_err(|_| bad_value())?,
+                )),
+                "jitter_ms" => TraceChange::Jitter(Duration::from_millis(
+                    value.parse().map_err(|_| bad_value())?,
+                )),
+                "reorder_percentage" => {
+                    TraceChange::ReorderPercentage(value.parse().map_err(|_| bad_value())?)
+                }
+                "duplicate_percentage" => {
+                    TraceChange::DuplicatePercentage(value.parse().map_err(|_| bad_value())?)
+                }
+                "bandwidth_mbs" => {
+                    TraceChange::BandwidthMbs(value.parse().map_err(|_| bad_value())?)
+                }
+                _ => return fmt_e!("Trace line {}: unknown parameter {}", index + 1, key),
+            };
+            changes.push((time, change));
+        }
+    }
+
+    Ok(changes)
+}
+
+struct PendingPacket<T> {
+    delivery: Instant,
+    // Keeps packets with the same delivery time in order
+    sequence: u64,
+    packet: T,
+}
+
+impl<T> PartialEq for PendingPacket<T> {
+    fn eq(&self, other: &Self) -> bool {
+        self.cmp(other) == Ordering::Equal
+    }
+}
+
+impl<T> Eq for PendingPacket<T> {}
+
+impl<T> PartialOrd for PendingPacket<T> {
+    fn partial_cmp(&self, other: &Self) -> Option<Ordering> {
+        Some(self.cmp(other))
+    }
+}
+
+// Reversed, so that BinaryHeap pops the earliest packet
+impl<T> Ord for PendingPacket<T> {
+    fn cmp(&self, other: &Self) -> Ordering {
+        (other.delivery, other.sequence).cmp(&(self.delivery, self.sequence))
+    }
+}
+
+pub struct NetworkImpairment<T> {
+    loss_model: Option<LossModel>,
+    delay: Duration,
+    jitter: Duration,
+    reorder_percentage: u32,
+    reorder_delay: Duration,
+    duplicate_percentage: u32,
+    bandwidth_mbs: u64,
+    queue_limit: Duration,
+
+    trace: Vec<(Duration, TraceChange)>,
+    next_trace_change: usize,
+    start: Option<Instant>,
+
+    rng: StdRng,
+    bad_state: bool,
+    link_free_at: Option<Instant>,
+    // Latest delivery of a packet that was not reordered. Jitter alone does not reorder packets.
+    last_delivery: Option<Instant>,
+    pending: BinaryHeap<PendingPacket<T>>,
+    next_sequence: u64,
+}
+
+impl<T: Clone> NetworkImpairment<T> {
+    // Different directions should use different seeds, so that their losses are not correlated
+    pub fn new(desc: &NetworkImpairmentDesc, seed: u64) -> StrResult<Self> {
+        let trace = if !desc.trace_file.is_empty() {
+            parse_trace(&trace_err!(fs::read_to_string(&desc.trace_file))?)?
+        } else {
+            vec![]
+        };
+
+        let (bandwidth_mbs, queue_limit) = match &desc.bandwidth_limit {
+            Switch::Enabled(limit) => (
+                limit.bitrate_mbs,
+                Duration::from_millis(limit.queue_limit_ms),
+            ),
+            Switch::Disabled => (0, Duration::from_millis(100)),
+        };
+
+        Ok(Self {
+            loss_model: match &desc.packet_loss {
+                Switch::Enabled(PacketLossModel::Bernoulli { loss_rate }) => {
+                    Some(LossModel::Bernoulli {
+                        loss_rate: *loss_rate,
+                    })
+                }
+                Switch::Enabled(PacketLossModel::GilbertElliott {
+                    p_good_to_bad,
+                    p_bad_to_good,
+                    good_loss_rate,
+                    bad_loss_rate,
+                }) => Some(LossModel::GilbertElliott {
+                    p_good_to_bad: *p_good_to_bad,
+                    p_bad_to_good: *p_bad_to_good,
+                    good_loss_rate: *good_loss_rate,
+                    bad_loss_rate: *bad_loss_rate,
+                }),
+                Switch::Disabled => None,
+            },
+            delay: Duration::from_millis(desc.delay_ms),
+            jitter: Duration::from_millis(desc.jitter_ms),
+            reorder_percentage: desc.reorder_percentage,
+            reorder_delay: Duration::from_millis(desc.reorder_delay_ms),
+            duplicate_percentage: desc.duplicate_percentage,
+            bandwidth_mbs,
+            queue_limit,
+            trace,
+            next_trace_change: 0,
+            start: None,
+            rng: StdRng::seed_from_u64(seed),
+            bad_state: false,
+            link_free_at: None,
+            last_delivery: None,
+            pending: BinaryHeap::new(),
+            next_sequence: 0,
+        })
+    }
+
+    fn apply_trace(&mut self, now: Instant) {
+        let start = *self.start.get_or_insert(now);
+        while let Some(&(time, change)) = self.trace.get(self.next_trace_change) {
+            if start + time > now {
+                break;
+            }
+            match change {
+                TraceChange::Loss(loss_rate) => {
+                    self.loss_model = if loss_rate > 0. {
+                        Some(LossModel::Bernoulli { loss_rate })
+                    } else {
+                        None
+                    }
+                }
+                TraceChange::Delay(delay) => self.delay = delay,
+                TraceChange::Jitter(jitter) => self.jitter = jitter,
+                TraceChange::ReorderPercentage(percentage) => self.reorder_percentage = percentage,
+                TraceChange::DuplicatePercentage(percentage) => {
+                    self.duplicate_percentage = percentage
+                }
+                TraceChange::BandwidthMbs(bitrate_mbs) => self.bandwidth_mbs = bitrate_mbs,
+            }
+            self.next_trace_change += 1;
+        }
+    }
+
+    fn is_lost(&mut self) -> bool {
+        let loss_rate = match self.loss_model {
+            Some(LossModel::Bernoulli { loss_rate }) => loss_rate,
+            Some(LossModel::GilbertElliott {
+                p_good_to_bad,
+                p_bad_to_good,
+                good_loss_rate,
+                bad_loss_rate,
+            }) => {
+                let p_switch = if self.bad_state {
+                    p_bad_to_good
+                } else {
+                    p_good_to_bad
+                };
+                if self.rng.gen::<f32>() < p_switch {
+                    self.bad_state = !self.bad_state;
+                }
+                if self.bad_state {
+                    bad_loss_rate
+                } else {
+                    good_loss_rate
+                }
+            }
+            None => return false,
+        };
+
+        self.rng.gen::<f32>() < loss_rate
+    }
+
+    fn percent_chance(&mut self, percentage: u32) -> bool {
+        percentage > 0 && self.rng.gen_range(0..100) < percentage
+    }
+
+    // Returns false if the packet is dropped, by the queue of the bottleneck or by the loss model
+    pub fn push(&mut self, now: Instant, size: usize, packet: T) -> bool {
+        self.apply_trace(now);
+
+        let mut departure = now;
+        if self.bandwidth_mbs > 0 {
+            let link_free_at = self.link_free_at.unwrap_or(now).max(now);
+            if link_free_at - now > self.queue_limit {
+                return false;
+            }
+            departure = link_free_at
+                + Duration::from_secs_f64(
+                    (size * 8) as f64 / (self.bandwidth_mbs * 1024 * 1024) as f64,
+                );
+            self.link_free_at = Some(departure);
+        }
+
+        if self.is_lost() {
+            return false;
+        }
+
+        let mut delivery = departure + self.delay;
+        if self.jitter > Duration::from_secs(0) {
+            delivery += self.jitter.mul_f64(self.rng.gen::<f64>());
+        }
+        if self.percent_chance(self.reorder_percentage) {
+            // Later packets overtake this one
+            delivery += self.reorder_delay;
+        } else {
+            if let Some(last_delivery) = self.last_delivery {
+                delivery = delivery.max(last_delivery);
+            }
+            self.last_delivery = Some(delivery);
+        }
+
+        if self.percent_chance(self.duplicate_percentage) {
+            self.pending.push(PendingPacket {
+                delivery,
+                sequence: self.next_sequence,
+                packet: packet.clone(),
+            });
+            self.next_sequence += 1;
+        }
+        self.pending.push(PendingPacket {
+            delivery,
+            sequence: self.next_sequence,
+            packet,
+        });
+        self.next_sequence += 1;
+
+        true
+    }
+
+    // Next packet due at or before now
+    pub fn pop(&mut self, now: Instant) -> Option<T> {
+        if self
+            .pending
+            .peek()
+            .map(|pending| pending.delivery <= now)
+            .unwrap_or(false)
+        {
+            self.pending.pop().map(|pending| pending.packet)
+        } else {
+            None
+        }
+    }
+
+    pub fn next_delivery(&self) -> Option<Instant> {
+        self.pending.peek().map(|pending| pending.delivery)
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::data::{BandwidthLimitDesc, NetworkImpairmentDesc, PacketLossModel};
+
+    fn clean_desc() -> NetworkImpairmentDesc {
+        NetworkImpairmentDesc {
+            packet_loss: Switch::Disabled,
+            delay_ms: 0,
+            jitter_ms: 0,
+            reorder_percentage: 0,
+            reorder_delay_ms: 0,
+            duplicate_percentage: 0,
+            bandwidth_limit: Switch::Disabled,
+            trace_file: "".into(),
+            seed: 0,
+        }
+    }
+
+    fn run(desc: &NetworkImpairmentDesc, count: u32) -> Vec<(u32, Instant)> {
+        let start = Instant::now();
+        let mut impairment = NetworkImpairment::new(desc, 1).unwrap();
+        let mut delivered = vec![];
+        for i in 0..count {
+            let now = start + Duration::from_micros(100 * i as u64);
+            impairment.push(now, 1000, i);
+            while let Some(packet) = impairment.pop(now) {
+                delivered.push((packet, now));
+            }
+        }
+        while let Some(time) = impairment.next_delivery() {
+            delivered.push((impairment.pop(time).unwrap(), time));
+        }
+
+        delivered
+    }
+
+    #[test]
+    fn bernoulli_loss_rate() {
+        let mut desc = clean_desc();
+        desc.packet_loss = Switch::Enabled(PacketLossModel::Bernoulli { loss_rate: 0.1 });
+        let received = run(&desc, 100_000).len();
+        assert!((88_000..92_000).contains(&received), "{}", received);
+    }
+
+    #[test]
+    fn gilbert_elliott_bursts() {
+        let mut desc = clean_desc();
+        desc.packet_loss = Switch::Enabled(PacketLossModel::GilbertElliott {
+            p_good_to_bad: 0.01,
+            p_bad_to_good: 0.1,
+            good_loss_rate: 0.,
+            bad_loss_rate: 1.,
+        });
+        let received = run(&desc, 100_000)
+            .iter()
+            .map(|(i, _)| *i)
+            .collect::<Vec<_>>();
+
+        // Stationary loss rate is 0.01 / (0.01 + 0.1), with bursts of 10 packets on average
+        let lost = 100_000 - received.len();
+        assert!((7_000..11_000).contains(&lost), "{}", lost);
+        let gaps = received.windows(2).filter(|w| w[1] != w[0] + 1).count();
+        let mean_burst = lost as f32 / gaps as f32;
+        assert!(mean_burst > 5. && mean_burst < 15., "{}", mean_burst);
+    }
+
+    #[test]
+    fn bandwidth_limit() {
+        let mut desc = clean_desc();
+        desc.bandwidth_limit = Switch::Enabled(BandwidthLimitDesc {
+            bitrate_mbs: 40,
+            queue_limit_ms: 50,
+        });
+        // 80 Mbps are offered to a 40 Mbps link, about half of the packets are dropped by the queue
+        let delivered = run(&desc, 20_000);
+        assert!(
+            (10_000..11_000).contains(&delivered.len()),
+            "{}",
+            delivered.len()
+        );
+        assert!(delivered.windows(2).all(|w| w[1].0 > w[0].0));
+        let first = delivered.first().unwrap().1;
+        let last = delivered.last().unwrap().1;
+        let mbs =
+            (delivered.len() - 1) as f64 * 8000. / (last - first).as_secs_f64() / (1024. * 1024.);
+        assert!((mbs - 40.).abs() < 0.5, "{}", mbs);
+    }
+
+    #[test]
+    fn reorder_and_duplicate() {
+        let mut desc = clean_desc();
+        desc.delay_ms = 5;
+        desc.jitter_ms = 2;
+        desc.reorder_percentage = 10;
+        desc.reorder_delay_ms = 3;
+        desc.duplicate_percentage = 5;
+        let delivered = run(&desc, 10_000);
+        assert!(delivered.len() > 10_300 && delivered.len() < 10_700);
+        let reordered = delivered.windows(2).filter(|w| w[1].0 < w[0].0).count();
+        assert!(reordered > 500, "{}", reordered);
+
+        // Same seed, same impairment
+        assert_eq!(
+            delivered.iter().map(|(i, _)| *i).collect::<Vec<_>>(),
+            run(&desc, 10_000)
+                .iter()
+                .map(|(i, _)| *i)
+                .collect::<Vec<_>>()
+        );
+    }
+
+    #[test]
+    fn trace() {
+        let changes = parse_trace(
+            "# comment\n\n0 delay_ms=10\n1000 loss=0.5 bandwidth_mbs=20 # inline\n1000 loss=0\n",
+        )
+        .unwrap();
+        assert_eq!(
+            changes,
+            vec![
+                (
+                    Duration::from_millis(0),
+                    TraceChange::Delay(Duration::from_millis(10))
+                ),
+                (Duration::from_millis(1000), TraceChange::Loss(0.5)),
+                (Duration::from_millis(1000), TraceChange::BandwidthMbs(20)),
+                (Duration::from_millis(1000), TraceChange::Loss(0.)),
+            ]
+        );
+        assert!(parse_trace("1000 delay_ms=1\n500 delay_ms=2").is_err());
+        assert!(parse_trace("0 speed=1").is_err());
+        assert!(parse_trace("0 loss=a").is_err());
+    }
+}
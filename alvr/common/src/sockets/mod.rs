@@ -1,7 +1,9 @@
 mod control_socket;
+mod impairment;
 mod stream_socket;
 
 pub use control_socket::*;
+pub use impairment::*;
 pub use stream_socket::*;
 
 use std::net::{IpAddr, Ipv4Addr};
@@ -9,7 +9,7 @@ mod throttled_udp;
 mod udp;
 
 use crate::{data::SocketProtocol, prelude::*};
-use bytes::{Buf, BufMut, BytesMut};
+use bytes::{Buf, BufMut, Bytes, BytesMut};
 use futures::SinkExt;
 use serde::{de::DeserializeOwned, Serialize};
 use std::{
@@ -121,6 +121,54 @@ impl<T, const ID: StreamId> StreamSender<T, ID> {
     }
 }
 
+impl<const ID: StreamId> StreamSender<(), ID> {
+    // Send several packets in order. The socket is locked and flushed once for the whole batch.
+    // The throttled UDP socket sends the stream prefix and the packet from where they are, other
+    // sockets need a copy of each packet.
+    pub async fn send_slices(&mut self, packets: &[&[u8]]) -> StrResult {
+        // Same layout as new_buffer(): stream ID, packet index, and an empty header
+        let mut prefixes = Vec::with_capacity(packets.len());
+        for _ in packets {
+            let mut prefix = [ID, 0, 0, 0, 0];
+            prefix[1..5].copy_from_slice(&self.next_packet_index.to_be_bytes());
+            self.next_packet_index += 1;
+            prefixes.push(prefix);
+        }
+
+        match &self.socket {
+            StreamSendSocket::Udp(socket) => {
+                let mut sink = socket.inner.lock().await;
+                for (prefix, packet) in prefixes.iter().zip(packets) {
+                    trace_err!(sink.feed((concat(prefix, packet), socket.peer_addr)).await)?;
+                }
+                trace_err!(sink.flush().await)
+            }
+            StreamSendSocket::Tcp(socket) => {
+                let mut sink = socket.lock().await;
+                for (prefix, packet) in prefixes.iter().zip(packets) {
+                    trace_err!(sink.feed(concat(prefix, packet)).await)?;
+                }
+                trace_err!(sink.flush().await)
+            }
+            StreamSendSocket::ThrottledUdp(socket) => {
+                let parts = prefixes
+                    .iter()
+                    .zip(packets)
+                    .map(|(prefix, packet)| [&prefix[..], *packet])
+                    .collect::<Vec<_>>();
+                trace_err!(socket.send_batch(&parts).await)
+            }
+        }
+    }
+}
+
+fn concat(prefix: &[u8], packet: &[u8]) -> Bytes {
+    let mut buffer = BytesMut::with_capacity(prefix.len() + packet.len());
+    buffer.put_slice(prefix);
+    buffer.put_slice(packet);
+    buffer.freeze()
+}
+
 impl<T: Serialize, const ID: StreamId> StreamSender<T, ID> {
     pub fn new_buffer(
         &self,
@@ -251,11 +299,14 @@ impl StreamSocketBuilder {
         })
     }
 
+    // dont_fragment: packets larger than the path MTU are dropped instead of being fragmented, for
+    // path MTU probing. Only the throttled UDP socket supports it, TCP does not need it.
     pub async fn connect_to_client(
         client_ip: IpAddr,
         port: u16,
         protocol: SocketProtocol,
         video_byterate: u32,
+        dont_fragment: bool,
     ) -> StrResult<StreamSocket> {
         let (send_socket, receive_socket) = match protocol {
             SocketProtocol::Udp => {
@@ -279,6 +330,7 @@ impl StreamSocketBuilder {
                     port,
                     video_byterate,
                     bitrate_multiplier,
+                    dont_fragment,
                 )
                 .await?;
                 (
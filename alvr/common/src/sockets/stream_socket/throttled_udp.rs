@@ -14,7 +14,7 @@ use nonzero_ext::NonZero;
 use std::{
     collections::HashMap,
     io,
-    mem::MaybeUninit,
+    mem::{self, MaybeUninit},
     net::{IpAddr, SocketAddr},
     pin::Pin,
     sync::Arc,
@@ -33,6 +33,9 @@ const MINIMUM_BYTERATE: u32 = 30 * 1024 * 1024 * 3 / 2 / 8;
 // Reserve includes audio along with other small fluctuations.
 const RESERVE_BYTERATE: u32 = 5_000_000 / 8;
 
+// Maximum number of packets passed to a single sendmmsg call.
+const MAX_BATCH_SIZE: usize = 64;
+
 #[allow(clippy::type_complexity)]
 #[derive(Clone)]
 pub struct ThrottledUdpStreamSendSocket {
@@ -52,6 +55,99 @@ impl ThrottledUdpStreamSendSocket {
             Err(e) => Err(e),
         }
     }
+
+    // Each packet is made of two parts sent as one datagram, so that a prefix can be added without
+    // copying the packet. Packets that the rate limiter lets through right away are sent together.
+    // Packets are never held back to make a batch bigger.
+    pub async fn send_batch(&self, packets: &[[&[u8]; 2]]) -> io::Result<()> {
+        let mut sent = 0;
+        let mut released = 0;
+        while sent < packets.len() {
+            while released < packets.len() && released - sent < MAX_BATCH_SIZE {
+                let len = packets[released][0].len() + packets[released][1].len();
+                if let (Some(limiter), Some(len)) = (&*self.limiter, NonZero::new(len as u32)) {
+                    if limiter.check_n(len).is_err() {
+                        if released > sent {
+                            // Send what was released so far before waiting
+                            break;
+                        }
+                        limiter.until_n_ready(len).await.ok();
+                    }
+                }
+                released += 1;
+            }
+
+            // a partial send leaves the rest of the released packets for the next round
+            sent += self.send_many(&packets[sent..released]).await?;
+        }
+
+        Ok(())
+    }
+
+    // Returns the number of packets sent, at least one.
+    #[cfg(target_os = "linux")]
+    async fn send_many(&self, packets: &[[&[u8]; 2]]) -> io::Result<usize> {
+        loop {
+            self.inner.writable().await?;
+
+            match sendmmsg(&self.inner, packets) {
+                Err(e) if e.kind() == io::ErrorKind::WouldBlock => (),
+                res => return res,
+            }
+
+            // sendmmsg bypasses tokio, which would keep reporting the socket as writable. try_send
+            // clears the readiness when the socket buffer is still full.
+            match self.inner.try_send(&packets[0].concat()) {
+                Ok(_) => return Ok(1),
+                Err(e) if e.kind() == io::ErrorKind::WouldBlock => (),
+                Err(e) => return Err(e),
+            }
+        }
+    }
+
+    #[cfg(not(target_os = "linux"))]
+    async fn send_many(&self, packets: &[[&[u8]; 2]]) -> io::Result<usize> {
+        for packet in packets {
+            self.inner.send(&packet.concat()).await?;
+        }
+
+        Ok(packets.len())
+    }
+}
+
+// Sends up to MAX_BATCH_SIZE packets with a single syscall. Kept synchronous so that the raw
+// pointers of the message headers never live across an await point.
+#[cfg(target_os = "linux")]
+fn sendmmsg(socket: &UdpSocket, packets: &[[&[u8]; 2]]) -> io::Result<usize> {
+    use std::os::unix::io::AsRawFd;
+
+    let packets = &packets[..usize::min(packets.len(), MAX_BATCH_SIZE)];
+
+    let mut iovecs: [[libc::iovec; 2]; MAX_BATCH_SIZE] = unsafe { mem::zeroed() };
+    let mut messages: [libc::mmsghdr; MAX_BATCH_SIZE] = unsafe { mem::zeroed() };
+    for (i, packet) in packets.iter().enumerate() {
+        for (iovec, part) in iovecs[i].iter_mut().zip(packet) {
+            iovec.iov_base = part.as_ptr() as *mut _;
+            iovec.iov_len = part.len();
+        }
+        // The socket is connected, msg_name is not needed
+        messages[i].msg_hdr.msg_iov = iovecs[i].as_mut_ptr();
+        messages[i].msg_hdr.msg_iovlen = 2;
+    }
+
+    let res = unsafe {
+        libc::sendmmsg(
+            socket.as_raw_fd(),
+            messages.as_mut_ptr(),
+            packets.len() as _,
+            0,
+        )
+    };
+    if res < 0 {
+        Err(io::Error::last_os_error())
+    } else {
+        Ok(res as usize)
+    }
 }
 
 pub struct ThrottledUdpStreamReceiveSocket {
@@ -91,6 +187,7 @@ pub async fn connect_to_client(
     port: u16,
     video_byterate: u32,
     bitrate_multiplier: f32,
+    dont_fragment: bool,
 ) -> StrResult<(
     ThrottledUdpStreamSendSocket,
     ThrottledUdpStreamReceiveSocket,
@@ -98,6 +195,9 @@ pub async fn connect_to_client(
     let client_addr: SocketAddr = (client_ip, port).into();
     let socket = trace_err!(UdpSocket::bind((LOCAL_IP, port)).await)?;
     trace_err!(socket.connect(client_addr).await)?;
+    if dont_fragment {
+        set_dont_fragment(&socket)?;
+    }
 
     let rx = Arc::new(socket);
     let tx = Arc::clone(&rx);
@@ -125,6 +225,60 @@ pub async fn connect_to_client(
     ))
 }
 
+// Sending a packet larger than the MTU of the interface then fails, the caller must not treat it as
+// fatal.
+#[cfg(target_os = "linux")]
+fn set_dont_fragment(socket: &UdpSocket) -> StrResult {
+    use std::os::unix::io::AsRawFd;
+
+    // Unlike IP_PMTUDISC_DO, the path MTU cached by the kernel is ignored, the probes find it
+    let value: libc::c_int = libc::IP_PMTUDISC_PROBE;
+    let res = unsafe {
+        libc::setsockopt(
+            socket.as_raw_fd(),
+            libc::IPPROTO_IP,
+            libc::IP_MTU_DISCOVER,
+            &value as *const _ as *const libc::c_void,
+            mem::size_of::<libc::c_int>() as _,
+        )
+    };
+    if res < 0 {
+        fmt_e!("{}", io::Error::last_os_error())
+    } else {
+        Ok(())
+    }
+}
+
+#[cfg(windows)]
+fn set_dont_fragment(socket: &UdpSocket) -> StrResult {
+    use std::os::windows::io::AsRawSocket;
+    use winapi::{
+        shared::{ws2def::IPPROTO_IP, ws2ipdef::IP_DONTFRAGMENT},
+        um::winsock2,
+    };
+
+    let value: winapi::ctypes::c_int = 1;
+    let res = unsafe {
+        winsock2::setsockopt(
+            socket.as_raw_socket() as _,
+            IPPROTO_IP as _,
+            IP_DONTFRAGMENT,
+            &value as *const _ as *const _,
+            mem::size_of::<winapi::ctypes::c_int>() as _,
+        )
+    };
+    if res != 0 {
+        fmt_e!("{}", io::Error::last_os_error())
+    } else {
+        Ok(())
+    }
+}
+
+#[cfg(not(any(target_os = "linux", windows)))]
+fn set_dont_fragment(_: &UdpSocket) -> StrResult {
+    fmt_e!("Don't fragment is not supported on this platform")
+}
+
 pub async fn listen_for_server(port: u16) -> StrResult<UdpSocket> {
     trace_err!(UdpSocket::bind((LOCAL_IP, port)).await)
 }
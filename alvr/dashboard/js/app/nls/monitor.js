@@ -39,6 +39,13 @@ define({
         "transportLatency": "Transport latency",
         "decodeLatency": "Decoder latency",
         "fecPercentage": "Fec percentage",
+        "targetBitrate": "Target bitrate",
+        "queueingDelay": "Queueing delay",
+        "convertStageLatency": "Convert stage latency",
+        "encodeStageLatency": "Encode stage latency",
+        "sendStageLatency": "Send stage latency",
+        "encodeQueueDepth": "Encode queue depth",
+        "sendQueueDepth": "Send queue depth",
         "fecFailureTotal": "Fec failure total",
         "fecFailureInSecond": "Fec failure / s",
         "clientFPS": "Client FPS",
@@ -49,6 +49,26 @@ define({
         "_root_video_use10bitEncoder.description": "This increases visual quality by streaming 10 bit per color channel instead of 8",
         "_root_video_encodeBitrateMbs.name": "Video Bitrate",
         "_root_video_encodeBitrateMbs.description": "Bitrate of video streaming. 30Mbps is recommended. \nHigher bitrates result in better image but also higher latency and network traffic ",
+        "_root_video_encoderSlices.name": "Slices per frame", // adv
+        "_root_video_encoderSlices.description": "Splits each frame into this many slices, each protected and sent on its own as soon as it is ready. Lowers latency at high resolutions at the cost of some compression efficiency. Only used by the Linux encoders.", // adv
+        "_root_video_splitEyeEncoding.name": "Encode eyes in parallel", // adv
+        "_root_video_splitEyeEncoding.description": "Encodes each eye with its own software encoder, both at the same time, and decodes them with two decoders on the headset. Lowers the encode latency on CPUs with many cores, at the cost of some compression efficiency. Only used by the Linux server, which then always encodes in software. Requires foveated rendering to be disabled.", // adv
+        "_root_video_intraRefresh.name": "Intra refresh", // adv
+        // "_root_video_intraRefresh.description": use "_root_video_intraRefresh_enabled.description"
+        "_root_video_intraRefresh_enabled.description": "Refreshes the picture with a column of intra blocks that sweeps across it, instead of periodic keyframes. Packet loss is repaired by the next sweep rather than by a keyframe, which avoids the bitrate spikes keyframes cause. Only used by the Linux software encoder.", // adv
+        "_root_video_intraRefresh_content_frames.name": "Refresh period", // adv
+        "_root_video_intraRefresh_content_frames.description": "Number of frames a sweep takes. Lower values recover faster from packet loss, higher values keep frames smaller.", // adv
+        "_root_video_adaptiveBitrate.name": "Adaptive bitrate", // adv
+        // "_root_video_adaptiveBitrate.description": use "_root_video_adaptiveBitrate_enabled.description"
+        "_root_video_adaptiveBitrate_enabled.description": "Lower the video bitrate when the network cannot carry it, detected from the delay of the video packets, and raise it back up to the video bitrate when it can. Only used by the Linux encoders.", // adv
+        "_root_video_adaptiveBitrate_content_minBitrateMbs.name": "Minimum bitrate", // adv
+        "_root_video_adaptiveBitrate_content_minBitrateMbs.description": "The bitrate is never lowered below this value.", // adv
+        "_root_video_encoderThreadAffinity.name": "Encoder thread affinity", // adv
+        // "_root_video_encoderThreadAffinity.description": use "_root_video_encoderThreadAffinity_enabled.description"
+        "_root_video_encoderThreadAffinity_enabled.description": "Pin the threads of the encoding pipeline to CPU cores: the thread converting the frames for the encoder, the thread running the encoder and the thread sending the video packets. Only used by the Linux encoders.", // adv
+        "_root_video_encoderThreadAffinity_content_convertCpu.name": "Convert thread CPU", // adv
+        "_root_video_encoderThreadAffinity_content_encodeCpu.name": "Encode thread CPU", // adv
+        "_root_video_encoderThreadAffinity_content_sendCpu.name": "Send thread CPU", // adv
         // Audio tab
         "_root_audio_tab.name": "Audio",
         "_root_audio_gameAudio.name": "Stream game audio",
@@ -180,6 +200,58 @@ define({
         "_root_connection_onConnectScript.description": "This script/executable will be run asynchronously when headset connects.\nEnvironment variable ACTION will be set to &#34;connect&#34; (without quotes).",
         "_root_connection_onDisconnectScript.name": "On disconnect script",
         "_root_connection_onDisconnectScript.description": "This script/executable will be run asynchronously when headset disconnects and on SteamVR shutdown.\nEnvironment variable ACTION will be set to &#34;disconnect&#34; (without quotes).",
+        "_root_connection_fecLargeBlocks.name": "Large FEC blocks", // adv
+        "_root_connection_fecLargeBlocks.description": "Use up to 255 FEC shards per frame instead of 20, so that each packet is its own shard even for large keyframes. A single lost packet then costs only that shard. Uses more CPU on both ends.", // adv
+        "_root_connection_fecRateless.name": "Rateless FEC", // adv
+        "_root_connection_fecRateless.description": "Send the usual amount of FEC parity with each frame, and let the client ask for more when it cannot recover a frame, until the FEC reorder timeout. Handles loss bursts longer than the parity budget at the cost of a round trip. Overrides large FEC blocks.", // adv
+        "_root_connection_adaptiveFec.name": "Adaptive FEC", // adv
+        "_root_connection_adaptiveFec.description": "Choose the amount of FEC parity from the packet loss reported by the client, lowering it on clean links. When disabled, FEC starts at the inter frame percentage and is only raised by 5% after repeated failures.", // adv
+        "_root_connection_fecInterPercentage.name": "Inter frame FEC percentage", // adv
+        "_root_connection_fecInterPercentage.description": "Initial FEC parity for regular frames, in percent of the frame size.", // adv
+        "_root_connection_fecIdrPercentage.name": "Keyframe FEC percentage", // adv
+        "_root_connection_fecIdrPercentage.description": "Minimum FEC parity for keyframes. Losing a keyframe causes a freeze until the next one arrives.", // adv
+        "_root_connection_fecParameterSetsPercentage.name": "Parameter sets FEC percentage", // adv
+        "_root_connection_fecParameterSetsPercentage.description": "Minimum FEC parity for frames that carry codec parameter sets (VPS/SPS/PPS). The stream cannot be decoded without them.", // adv
+        "_root_connection_fecReorderTimeoutMs.name": "FEC reorder timeout (ms)", // adv
+        "_root_connection_fecReorderTimeoutMs.description": "How long the client waits for missing packets of a frame once the next frame has started arriving. Higher values tolerate more packet reordering but add latency when a frame is lost.", // adv
+        "_root_connection_packetPacingPercentage.name": "Packet pacing (% of frame interval)", // adv
+        "_root_connection_packetPacingPercentage.description": "Spreads the packets of each video frame over this part of the frame interval instead of sending them in one burst, which helps routers with small buffers. 0 disables pacing. Higher values add up to this much latency to the end of the frame.", // adv
+        "_root_connection_compactVideoPackets.name": "Compact video packets", // adv
+        // "_root_connection_compactVideoPackets.description": use "_root_connection_compactVideoPackets_enabled.description"
+        "_root_connection_compactVideoPackets_enabled.description": "Sends the video with a smaller packet header, and lets the packets grow past 1400 bytes. Fewer packets per frame lower the load of the server and of the headset.", // adv
+        "_root_connection_compactVideoPackets_content_maxPacketSize.name": "Maximum packet size", // adv
+        "_root_connection_compactVideoPackets_content_maxPacketSize.description": "Sizes above 1443 bytes need jumbo frames on the whole path between the server and the headset, which is usually only possible with a wired connection.", // adv
+        "_root_connection_compactVideoPackets_content_pathMtuProbing.name": "Path MTU probing", // adv
+        "_root_connection_compactVideoPackets_content_pathMtuProbing.description": "Regularly tests which packet sizes reach the headset, and uses the largest one up to the maximum packet size. Needs the throttled UDP or the TCP stream protocol, with plain UDP the packets stay at 1400 bytes.", // adv
+        "_root_connection_networkImpairment.name": "Network impairment emulation", // adv
+        // "_root_connection_networkImpairment.description": use "_root_connection_networkImpairment_enabled.description"
+        "_root_connection_networkImpairment_enabled.description": "For testing only. Makes the network between the server and the client behave worse than it is, in both directions, to test how the stream copes with it. Works on a local network or on loopback.", // adv
+        "_root_connection_networkImpairment_content_packetLoss.name": "Packet loss", // adv
+        "_root_connection_networkImpairment_content_packetLoss_content-choice-.name": "Loss model", // adv
+        "_root_connection_networkImpairment_content_packetLoss_content_bernoulli-choice-.name": "Random", // adv
+        "_root_connection_networkImpairment_content_packetLoss_content_bernoulli_lossRate.name": "Loss rate", // adv
+        "_root_connection_networkImpairment_content_packetLoss_content_gilbertElliott-choice-.name": "Bursts (Gilbert-Elliott)", // adv
+        "_root_connection_networkImpairment_content_packetLoss_content_gilbertElliott_pGoodToBad.name": "Burst start probability", // adv
+        "_root_connection_networkImpairment_content_packetLoss_content_gilbertElliott_pGoodToBad.description": "Probability for each packet to start a burst.", // adv
+        "_root_connection_networkImpairment_content_packetLoss_content_gilbertElliott_pBadToGood.name": "Burst end probability", // adv
+        "_root_connection_networkImpairment_content_packetLoss_content_gilbertElliott_pBadToGood.description": "Probability for each packet to end the burst. Bursts last 1 / this value packets on average.", // adv
+        "_root_connection_networkImpairment_content_packetLoss_content_gilbertElliott_goodLossRate.name": "Loss rate outside bursts", // adv
+        "_root_connection_networkImpairment_content_packetLoss_content_gilbertElliott_badLossRate.name": "Loss rate in bursts", // adv
+        "_root_connection_networkImpairment_content_delayMs.name": "Delay (ms)", // adv
+        "_root_connection_networkImpairment_content_jitterMs.name": "Jitter (ms)", // adv
+        "_root_connection_networkImpairment_content_jitterMs.description": "Random extra delay, up to this value. Packets stay in order.", // adv
+        "_root_connection_networkImpairment_content_reorderPercentage.name": "Reordered packets (%)", // adv
+        "_root_connection_networkImpairment_content_reorderDelayMs.name": "Reordering delay (ms)", // adv
+        "_root_connection_networkImpairment_content_reorderDelayMs.description": "Reordered packets are held back by this much, so that the next packets overtake them.", // adv
+        "_root_connection_networkImpairment_content_duplicatePercentage.name": "Duplicated packets (%)", // adv
+        "_root_connection_networkImpairment_content_bandwidthLimit.name": "Bandwidth limit", // adv
+        "_root_connection_networkImpairment_content_bandwidthLimit_content_bitrateMbs.name": "Bandwidth (Mbps)", // adv
+        "_root_connection_networkImpairment_content_bandwidthLimit_content_queueLimitMs.name": "Queue length (ms)", // adv
+        "_root_connection_networkImpairment_content_bandwidthLimit_content_queueLimitMs.description": "Packets that would wait longer than this in the queue of the bottleneck are dropped.", // adv
+        "_root_connection_networkImpairment_content_traceFile.name": "Trace file", // adv
+        "_root_connection_networkImpairment_content_traceFile.description": "Optional file that changes the parameters over time. Each line is a time in milliseconds since the start of the stream followed by parameters, for example &#34;10000 bandwidth_mbs=20 loss=0.02 delay_ms=10&#34;. Other parameters are jitter_ms, reorder_percentage and duplicate_percentage.", // adv
+        "_root_connection_networkImpairment_content_seed.name": "Random seed", // adv
+        "_root_connection_networkImpairment_content_seed.description": "The same seed gives the same impairment for the same packets.", // adv
         // Extra tab
         "_root_extra_tab.name": "Extra",
         "_root_extra_theme-choice-.name": "Theme",
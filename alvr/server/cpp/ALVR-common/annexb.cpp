@@ -0,0 +1,276 @@
+#include "annexb.h"
+
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define ANNEXB_SSE2
+#include <emmintrin.h>
+#endif
+#if defined(ANNEXB_SSE2) && defined(__GNUC__)
+#define ANNEXB_AVX2
+#include <immintrin.h>
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define ANNEXB_NEON
+#include <arm_neon.h>
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace {
+	typedef const uint8_t *(*FindFunction)(const uint8_t *begin, const uint8_t *end);
+
+#if defined(ANNEXB_SSE2) || defined(ANNEXB_NEON)
+	int CountTrailingZeros(uint64_t mask) {
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanForward64(&index, mask);
+		return (int)index;
+#else
+		return __builtin_ctzll(mask);
+#endif
+	}
+#endif
+
+	// Each vector step compares the bytes at p, p + 1 and p + 2 of every position at once, so it
+	// needs 2 bytes past the vector.
+
+#ifdef ANNEXB_SSE2
+	const uint8_t *FindStartCodeSse2(const uint8_t *begin, const uint8_t *end) {
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i one = _mm_set1_epi8(1);
+		const uint8_t *p = begin;
+		for (; end - p >= 16 + 2; p += 16) {
+			__m128i a = _mm_loadu_si128((const __m128i *)p);
+			__m128i b = _mm_loadu_si128((const __m128i *)(p + 1));
+			__m128i c = _mm_loadu_si128((const __m128i *)(p + 2));
+			__m128i match = _mm_and_si128(_mm_and_si128(_mm_cmpeq_epi8(a, zero), _mm_cmpeq_epi8(b, zero)),
+				_mm_cmpeq_epi8(c, one));
+			int mask = _mm_movemask_epi8(match);
+			if (mask != 0) {
+				return p + CountTrailingZeros((uint64_t)mask);
+			}
+		}
+		return AnnexBFindStartCodeScalar(p, end);
+	}
+#endif
+
+#ifdef ANNEXB_AVX2
+	__attribute__((target("avx2")))
+	const uint8_t *FindStartCodeAvx2(const uint8_t *begin, const uint8_t *end) {
+		const __m256i zero = _mm256_setzero_si256();
+		const __m256i one = _mm256_set1_epi8(1);
+		const uint8_t *p = begin;
+		for (; end - p >= 32 + 2; p += 32) {
+			__m256i a = _mm256_loadu_si256((const __m256i *)p);
+			__m256i b = _mm256_loadu_si256((const __m256i *)(p + 1));
+			__m256i c = _mm256_loadu_si256((const __m256i *)(p + 2));
+			__m256i match = _mm256_and_si256(
+				_mm256_and_si256(_mm256_cmpeq_epi8(a, zero), _mm256_cmpeq_epi8(b, zero)),
+				_mm256_cmpeq_epi8(c, one));
+			uint32_t mask = (uint32_t)_mm256_movemask_epi8(match);
+			if (mask != 0) {
+				return p + CountTrailingZeros(mask);
+			}
+		}
+		return FindStartCodeSse2(p, end);
+	}
+#endif
+
+#ifdef ANNEXB_NEON
+	const uint8_t *FindStartCodeNeon(const uint8_t *begin, const uint8_t *end) {
+		const uint8x16_t zero = vdupq_n_u8(0);
+		const uint8x16_t one = vdupq_n_u8(1);
+		const uint8_t *p = begin;
+		for (; end - p >= 16 + 2; p += 16) {
+			uint8x16_t match = vandq_u8(vandq_u8(vceqq_u8(vld1q_u8(p), zero), vceqq_u8(vld1q_u8(p + 1), zero)),
+				vceqq_u8(vld1q_u8(p + 2), one));
+			// NEON has no movemask: narrowing keeps 4 bits per position.
+			uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(match), 4)), 0);
+			if (mask != 0) {
+				return p + CountTrailingZeros(mask) / 4;
+			}
+		}
+		return AnnexBFindStartCodeScalar(p, end);
+	}
+#endif
+
+	FindFunction SelectFindFunction() {
+#ifdef ANNEXB_AVX2
+		if (__builtin_cpu_supports("avx2")) {
+			return FindStartCodeAvx2;
+		}
+#endif
+#if defined(ANNEXB_SSE2)
+		return FindStartCodeSse2;
+#elif defined(ANNEXB_NEON)
+		return FindStartCodeNeon;
+#else
+		return AnnexBFindStartCodeScalar;
+#endif
+	}
+
+	FindFunction GetFindFunction() {
+		static const FindFunction function = SelectFindFunction();
+		return function;
+	}
+
+	// Moves the run [run, runEnd) to out, returns the end of the moved bytes.
+	uint8_t *MoveRun(uint8_t *out, const uint8_t *run, const uint8_t *runEnd) {
+		if (run != runEnd && run != out) {
+			memmove(out, run, runEnd - run);
+		}
+		return out + (runEnd - run);
+	}
+}
+
+const uint8_t *AnnexBFindStartCode(const uint8_t *begin, const uint8_t *end) {
+	return GetFindFunction()(begin, end);
+}
+
+const uint8_t *AnnexBFindStartCodeScalar(const uint8_t *begin, const uint8_t *end) {
+	const uint8_t *p = begin;
+	while (end - p >= 3) {
+		// A start code at p, p + 1 or p + 2 needs p[2] to be 0 or 1.
+		if (p[2] > 1) {
+			p += 3;
+		} else if (p[2] == 0) {
+			p++;
+		} else if (p[0] == 0 && p[1] == 0) {
+			return p;
+		} else {
+			p += 3;
+		}
+	}
+	return end;
+}
+
+const char *AnnexBSearchIsa() {
+	FindFunction function = GetFindFunction();
+	(void)function;
+#ifdef ANNEXB_AVX2
+	if (function == FindStartCodeAvx2) {
+		return "avx2";
+	}
+#endif
+#ifdef ANNEXB_SSE2
+	if (function == FindStartCodeSse2) {
+		return "sse2";
+	}
+#endif
+#ifdef ANNEXB_NEON
+	if (function == FindStartCodeNeon) {
+		return "neon";
+	}
+#endif
+	return "scalar";
+}
+
+AnnexBParser::AnnexBParser(const uint8_t *data, size_t size, bool h265)
+	: m_begin(data), m_end(data + size), m_h265(h265) {
+	m_code = AnnexBFindStartCode(m_begin, m_end);
+}
+
+bool AnnexBParser::Next(AnnexBNal &nal) {
+	if (m_code == m_end) {
+		return false;
+	}
+	const uint8_t *header = m_code + 3;
+	nal.begin = m_code != m_begin && m_code[-1] == 0 ? m_code - 1 : m_code;
+	m_code = AnnexBFindStartCode(header, m_end);
+	// A zero before the next start code belongs to it.
+	nal.end = m_code != m_end && m_code[-1] == 0 ? m_code - 1 : m_code;
+	if (header >= nal.end) {
+		nal.type = -1;
+	} else if (m_h265) {
+		nal.type = (header[0] >> 1) & 0x3F;
+	} else {
+		nal.type = header[0] & 0x1F;
+	}
+	return true;
+}
+
+bool AnnexBIsDroppable(int type, bool h265) {
+	if (h265) {
+		// access unit delimiter, supplemental enhancement information
+		return type == 35 || type == 39;
+	}
+	// supplemental enhancement information, access unit delimiter
+	return type == 6 || type == 9;
+}
+
+bool AnnexBIsSlice(int type, bool h265) {
+	if (h265) {
+		return type >= 0 && type < 32;
+	}
+	return type >= 1 && type <= 5;
+}
+
+bool AnnexBIsParameterSet(int type, bool h265) {
+	if (h265) {
+		return type >= 32 && type <= 34;
+	}
+	return type == 7 || type == 8;
+}
+
+bool AnnexBIsKeyframeSlice(int type, bool h265) {
+	if (h265) {
+		return type >= 16 && type <= 23;
+	}
+	return type == 5;
+}
+
+bool AnnexBIsFirstSlice(const AnnexBNal &nal, bool h265) {
+	// Data partitions B and C start with slice_id instead of a slice header.
+	if (!AnnexBIsSlice(nal.type, h265) || (!h265 && (nal.type == 3 || nal.type == 4))) {
+		return false;
+	}
+	const uint8_t *header = nal.begin[2] == 0 ? nal.begin + 4 : nal.begin + 3;
+	const uint8_t *sliceHeader = header + (h265 ? 2 : 1);
+	// first_mb_in_slice is ue(v) coded, 0 is a single 1 bit. Emulation prevention cannot have
+	// inserted a byte before it, the NAL header is never zero.
+	return sliceHeader < nal.end && (sliceHeader[0] & 0x80) != 0;
+}
+
+size_t AnnexBFindSecondPicture(const uint8_t *data, size_t size, bool h265) {
+	AnnexBParser parser(data, size, h265);
+	AnnexBNal nal;
+	bool sliceSeen = false;
+	// First NAL unit after the last slice seen, the second picture starts there if a first slice
+	// follows.
+	const uint8_t *afterSlices = nullptr;
+	while (parser.Next(nal)) {
+		if (AnnexBIsSlice(nal.type, h265)) {
+			if (sliceSeen && AnnexBIsFirstSlice(nal, h265)) {
+				return (afterSlices != nullptr ? afterSlices : nal.begin) - data;
+			}
+			sliceSeen = true;
+			afterSlices = nullptr;
+		} else if (sliceSeen && afterSlices == nullptr) {
+			afterSlices = nal.begin;
+		}
+	}
+	return size;
+}
+
+size_t AnnexBFilterInPlace(uint8_t *data, size_t size, bool h265) {
+	AnnexBParser parser(data, size, h265);
+	AnnexBNal nal;
+	uint8_t *out = data;
+	// Kept NAL units not moved yet, contiguous. The parser only reads ahead of them.
+	const uint8_t *run = data;
+	const uint8_t *runEnd = data;
+	while (parser.Next(nal)) {
+		if (AnnexBIsDroppable(nal.type, h265)) {
+			continue;
+		}
+		if (nal.begin != runEnd) {
+			out = MoveRun(out, run, runEnd);
+			run = nal.begin;
+		}
+		runEnd = nal.end;
+	}
+	out = MoveRun(out, run, runEnd);
+	return out - data;
+}
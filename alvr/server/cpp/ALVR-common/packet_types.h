@@ -19,6 +19,14 @@ enum ALVR_PACKET_TYPE {
 	ALVR_PACKET_TYPE_VIDEO_FRAME = 9,
 	ALVR_PACKET_TYPE_PACKET_ERROR_REPORT = 12,
 	ALVR_PACKET_TYPE_HAPTICS = 13,
+	ALVR_PACKET_TYPE_FEC_REPAIR_REQUEST = 14,
+	ALVR_PACKET_TYPE_VIDEO_FRAME_ACK = 15,
+	ALVR_PACKET_TYPE_VIDEO_ARRIVAL_REPORT = 16,
+	// Video packet with the compact header. Only its first byte is the type, see
+	// EncodeCompactVideoHeader.
+	ALVR_PACKET_TYPE_VIDEO_FRAME_COMPACT = 17,
+	ALVR_PACKET_TYPE_MTU_PROBE = 18,
+	ALVR_PACKET_TYPE_MTU_PROBE_ACK = 19,
 };
 
 enum ALVR_CODEC {
@@ -28,6 +36,9 @@ enum ALVR_CODEC {
 
 enum ALVR_LOST_FRAME_TYPE {
 	ALVR_LOST_FRAME_TYPE_VIDEO = 0,
+	// Video packets fromPacketCounter to toPacketCounter (inclusive) were lost and can still be
+	// used if they are sent again.
+	ALVR_LOST_FRAME_TYPE_VIDEO_NACK = 1,
 };
 
 enum ALVR_INPUT {
@@ -259,6 +270,15 @@ struct VideoFrame {
 	uint32_t frameByteSize;
 	uint32_t fecIndex;
 	uint16_t fecPercentage;
+	// A frame can be sent as several FEC groups, one per encoder slice, so that the first slices
+	// leave before the whole frame is processed. frameByteSize, fecIndex and fecPercentage refer
+	// to the group. The access unit is the concatenation of the groups in sliceIndex order.
+	uint8_t sliceIndex;
+	uint8_t lastSlice; // 1 on the packets of the last group of the frame.
+	// 1 if the frame does not reference any frame the client may have lost: the encoder predicted
+	// it from an acknowledged frame after a loss, or an intra refresh wave ends with it. IDR frames
+	// are recognized by their NAL type.
+	uint8_t recoveryFrame;
 	// char frameBuffer[];
 };
 // Report packet loss/error from client to server.
@@ -277,11 +297,72 @@ struct HapticsFeedback {
 	float frequency;
 	uint8_t hand; // 0:Right, 1:Left
 };
+// Ask the server for more parity of a frame sent in the rateless FEC mode.
+struct FecRepairRequest {
+	uint32_t type; // ALVR_PACKET_TYPE_FEC_REPAIR_REQUEST
+	uint64_t videoFrameIndex;
+	uint8_t sliceIndex;
+	uint32_t parityShards; // Parity shards needed in addition to those already sent.
+};
+// Sent for each frame the client received completely while all the frames it references were
+// received too, since the last IDR or recovery frame. The server predicts from these frames instead
+// of inserting an IDR when a frame is lost.
+struct VideoFrameAck {
+	uint32_t type; // ALVR_PACKET_TYPE_VIDEO_FRAME_ACK
+	uint64_t videoFrameIndex;
+	uint64_t trackingFrameIndex;
+};
+static const int ALVR_ARRIVAL_REPORT_MAX_PACKETS = 256;
+static const uint32_t ALVR_PACKET_NOT_RECEIVED = 0xFFFFFFFF;
+// Arrival times of consecutive video packets, measured on the client clock. The server matches
+// them with the send times of the packets to estimate the available bandwidth. Only the first
+// packetCount entries of arrivalTimes are sent.
+struct VideoArrivalReport {
+	uint32_t type; // ALVR_PACKET_TYPE_VIDEO_ARRIVAL_REPORT
+	uint32_t firstPacketCounter;
+	uint64_t baseArrivalTime;
+	uint16_t packetCount;
+	// Arrival time of packet firstPacketCounter + i in microseconds after baseArrivalTime, or
+	// ALVR_PACKET_NOT_RECEIVED.
+	uint32_t arrivalTimes[ALVR_ARRIVAL_REPORT_MAX_PACKETS];
+};
+// Path MTU probing. The server sends probes padded to the video packet sizes it could use, the
+// client sends each probe it receives back without the padding, as an ack.
+struct MtuProbe {
+	uint32_t type; // ALVR_PACKET_TYPE_MTU_PROBE or ALVR_PACKET_TYPE_MTU_PROBE_ACK
+	uint32_t round;
+	uint32_t size; // Size of the probe, padding included.
+};
 #pragma pack(pop)
 
 static const int ALVR_MAX_VIDEO_BUFFER_SIZE = ALVR_MAX_PACKET_SIZE - sizeof(VideoFrame);
 
+// Maximum number of FEC groups (encoder slices) of a video frame.
+static const int ALVR_MAX_VIDEO_SLICES = 8;
+
 static const int ALVR_FEC_SHARDS_MAX = 20;
+// Shard limit of the large block mode. It is the limit of the GF(2^8) reed solomon implementation.
+static const int ALVR_FEC_SHARDS_MAX_LARGE = 255;
+
+// The high bits of VideoFrame::fecPercentage are mode flags, the low bits are the percentage.
+static const uint16_t ALVR_FEC_FLAG_LARGE_BLOCK = 0x8000;
+// Rateless mode: the parity shards are rows of a code sized for ALVR_FEC_RATELESS_CAPACITY percent of
+// parity, and only the percentage in the low bits is sent with the frame. The client asks for more
+// rows with FecRepairRequest while it cannot recover the frame. Uses the large block shard limit.
+static const uint16_t ALVR_FEC_FLAG_RATELESS = 0x4000;
+static const uint16_t ALVR_FEC_PERCENTAGE_MASK = 0x0FFF;
+static const int ALVR_FEC_RATELESS_CAPACITY = 100;
+
+inline int GetFECPercentage(uint16_t fecPercentage) {
+	return fecPercentage & ALVR_FEC_PERCENTAGE_MASK;
+}
+inline int GetFECMaxShards(uint16_t fecPercentage) {
+	return (fecPercentage & (ALVR_FEC_FLAG_LARGE_BLOCK | ALVR_FEC_FLAG_RATELESS)) ? ALVR_FEC_SHARDS_MAX_LARGE : ALVR_FEC_SHARDS_MAX;
+}
+// Parity percentage the shard geometry is computed for.
+inline int GetFECCodePercentage(uint16_t fecPercentage) {
+	return (fecPercentage & ALVR_FEC_FLAG_RATELESS) ? ALVR_FEC_RATELESS_CAPACITY : GetFECPercentage(fecPercentage);
+}
 
 inline int CalculateParityShards(int dataShards, int fecPercentage) {
 	int totalParityShards = (dataShards * fecPercentage + 99) / 100;
@@ -289,16 +370,152 @@ inline int CalculateParityShards(int dataShards, int fecPercentage) {
 }
 
 // Calculate how many packet is needed for make signal shard.
-inline int CalculateFECShardPackets(int len, int fecPercentage) {
+// payloadSize is the payload of a full packet.
+inline int CalculateFECShardPackets(int len, int fecPercentage, int maxShards = ALVR_FEC_SHARDS_MAX, int payloadSize = ALVR_MAX_VIDEO_BUFFER_SIZE) {
 	// This reed solomon implementation accept only 255 shards.
 	// Normally, we use ALVR_MAX_VIDEO_BUFFER_SIZE as block_size and single packet becomes single shard.
 	// If we need more than maxDataShards packets, we need to combine multiple packet to make single shrad.
 	// NOTE: Moonlight seems to use only 255 shards for video frame.
-	int maxDataShards = ((ALVR_FEC_SHARDS_MAX - 2) * 100 + 99 + fecPercentage) / (100 + fecPercentage);
+	int maxDataShards = ((maxShards - 2) * 100 + 99 + fecPercentage) / (100 + fecPercentage);
 	int minBlockSize = (len + maxDataShards - 1) / maxDataShards;
-	int shardPackets = (minBlockSize + ALVR_MAX_VIDEO_BUFFER_SIZE - 1) / ALVR_MAX_VIDEO_BUFFER_SIZE;
-	assert(maxDataShards + CalculateParityShards(maxDataShards, fecPercentage) <= ALVR_FEC_SHARDS_MAX);
+	int shardPackets = (minBlockSize + payloadSize - 1) / payloadSize;
+	assert(maxDataShards + CalculateParityShards(maxDataShards, fecPercentage) <= maxShards);
 	return shardPackets;
 }
 
+// Compact video packet header, sent instead of VideoFrame when the server uses compact video
+// packets. It carries the same fields: the indices as varints (LEB128), trackingFrameIndex as the
+// zigzag encoded difference with videoFrameIndex, and sentTime as its low 32 bits, restored by the
+// client from its estimate of the server clock. It also carries the payload size of the full
+// packets, so that the server can change the packet size from one frame to the next.
+//   u8 type: ALVR_PACKET_TYPE_VIDEO_FRAME_COMPACT
+//   u8 version << 5 | recoveryFrame << 4 | lastSlice << 3 | sliceIndex
+//   u32 packetCounter
+//   varint videoFrameIndex
+//   varint zigzag(trackingFrameIndex - videoFrameIndex)
+//   u32 sentTime (low bits)
+//   varint frameByteSize
+//   varint fecIndex
+//   u16 fecPercentage
+//   u16 payload size of the full packets
+// Fixed size fields are little endian. The payload follows.
+static const int ALVR_COMPACT_VIDEO_HEADER_VERSION = 1;
+static const int ALVR_COMPACT_VIDEO_HEADER_MAX_SIZE = 44;
+// Room reserved for the header in front of the payloads on the server. It holds the header of
+// frames up to 2^35 bytes with indices below 2^34, and fecIndex below 2^21.
+static const int ALVR_COMPACT_VIDEO_HEADER_RESERVE = 32;
+// Largest video packet, for jumbo frames: an MTU of 9000 bytes less the IPv6 and UDP headers and
+// the framing of the stream socket.
+static const int ALVR_MAX_JUMBO_PACKET_SIZE = 9000 - 48 - 9;
+
+inline int WriteVarint(uint8_t *out, uint64_t value) {
+	int size = 0;
+	while (value >= 0x80) {
+		out[size++] = (uint8_t)(value | 0x80);
+		value >>= 7;
+	}
+	out[size++] = (uint8_t)value;
+	return size;
+}
+
+// Returns false if the varint does not end before end.
+inline bool ReadVarint(const uint8_t *&p, const uint8_t *end, uint64_t &value) {
+	value = 0;
+	for (int shift = 0; shift < 64 && p < end; shift += 7) {
+		uint8_t byte = *p++;
+		value |= (uint64_t)(byte & 0x7F) << shift;
+		if ((byte & 0x80) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+inline void WriteLE(uint8_t *out, uint64_t value, int size) {
+	for (int i = 0; i < size; i++) {
+		out[i] = (uint8_t)(value >> (8 * i));
+	}
+}
+
+inline uint64_t ReadLE(const uint8_t *p, int size) {
+	uint64_t value = 0;
+	for (int i = 0; i < size; i++) {
+		value |= (uint64_t)p[i] << (8 * i);
+	}
+	return value;
+}
+
+// Writes the header to out, which must have room for ALVR_COMPACT_VIDEO_HEADER_MAX_SIZE bytes, and
+// returns its size.
+inline int EncodeCompactVideoHeader(const VideoFrame &header, int payloadSize, uint8_t *out) {
+	int size = 0;
+	out[size++] = ALVR_PACKET_TYPE_VIDEO_FRAME_COMPACT;
+	out[size++] = (uint8_t)(ALVR_COMPACT_VIDEO_HEADER_VERSION << 5 | (header.recoveryFrame ? 1 << 4 : 0) |
+		(header.lastSlice ? 1 << 3 : 0) | (header.sliceIndex & 0x7));
+	WriteLE(out + size, header.packetCounter, 4);
+	size += 4;
+	size += WriteVarint(out + size, header.videoFrameIndex);
+	int64_t trackingDelta = (int64_t)(header.trackingFrameIndex - header.videoFrameIndex);
+	size += WriteVarint(out + size, ((uint64_t)trackingDelta << 1) ^ (uint64_t)(trackingDelta >> 63));
+	WriteLE(out + size, header.sentTime, 4);
+	size += 4;
+	size += WriteVarint(out + size, header.frameByteSize);
+	size += WriteVarint(out + size, header.fecIndex);
+	WriteLE(out + size, header.fecPercentage, 2);
+	size += 2;
+	WriteLE(out + size, (uint64_t)payloadSize, 2);
+	size += 2;
+	return size;
+}
+
+// Reads the header of a video packet in either format. serverTime is the current time of the
+// server as estimated by the client, it must be within 30 minutes of sentTime. payloadSize is set
+// to the payload size of the full packets of the frame. Returns the offset of the payload, 0 if the
+// packet is not a valid video packet.
+inline int ParseVideoPacket(const uint8_t *packet, int packetSize, uint64_t serverTime, VideoFrame &header, int &payloadSize) {
+	if (packetSize >= (int)sizeof(VideoFrame) && ReadLE(packet, 4) == ALVR_PACKET_TYPE_VIDEO_FRAME) {
+		header = *(const VideoFrame *)packet;
+		payloadSize = ALVR_MAX_VIDEO_BUFFER_SIZE;
+		return sizeof(VideoFrame);
+	}
+	const uint8_t *p = packet;
+	const uint8_t *end = packet + packetSize;
+	if (packetSize < 6 || p[0] != ALVR_PACKET_TYPE_VIDEO_FRAME_COMPACT || (p[1] >> 5) != ALVR_COMPACT_VIDEO_HEADER_VERSION) {
+		return 0;
+	}
+	header.type = ALVR_PACKET_TYPE_VIDEO_FRAME;
+	header.sliceIndex = p[1] & 0x7;
+	header.lastSlice = (p[1] >> 3) & 1;
+	header.recoveryFrame = (p[1] >> 4) & 1;
+	header.packetCounter = (uint32_t)ReadLE(p + 2, 4);
+	p += 6;
+	uint64_t videoFrameIndex, trackingDelta, frameByteSize, fecIndex;
+	if (!ReadVarint(p, end, videoFrameIndex) || !ReadVarint(p, end, trackingDelta) || end - p < 4) {
+		return 0;
+	}
+	header.videoFrameIndex = videoFrameIndex;
+	header.trackingFrameIndex = videoFrameIndex + (uint64_t)((int64_t)(trackingDelta >> 1) ^ -(int64_t)(trackingDelta & 1));
+	// The candidate nearest to serverTime.
+	uint64_t sentTime = (serverTime & ~0xFFFFFFFFull) | ReadLE(p, 4);
+	if (sentTime > serverTime + 0x80000000ull && sentTime >= 0x100000000ull) {
+		sentTime -= 0x100000000ull;
+	} else if (sentTime + 0x80000000ull < serverTime) {
+		sentTime += 0x100000000ull;
+	}
+	header.sentTime = sentTime;
+	p += 4;
+	if (!ReadVarint(p, end, frameByteSize) || !ReadVarint(p, end, fecIndex) || end - p < 4) {
+		return 0;
+	}
+	header.frameByteSize = (uint32_t)frameByteSize;
+	header.fecIndex = (uint32_t)fecIndex;
+	header.fecPercentage = (uint16_t)ReadLE(p, 2);
+	payloadSize = (int)ReadLE(p + 2, 2);
+	p += 4;
+	if (payloadSize == 0 || end - p > payloadSize) {
+		return 0;
+	}
+	return (int)(p - packet);
+}
+
 #endif //ALVRCLIENT_PACKETTYPES_H
@@ -14,6 +14,9 @@ extern "C" {
 		int shards;
 		unsigned char* m;
 		unsigned char* parity;
+		/* lazily allocated cache of inverted decode matrices, see reed_solomon_reconstruct */
+		struct _rs_decode_entry* decode_cache;
+		unsigned int decode_clock;
 	} reed_solomon;
 
 	/**
@@ -33,6 +36,16 @@ extern "C" {
 	 * */
 	int reed_solomon_encode(reed_solomon* rs, unsigned char** shards, int nr_shards, int block_size);
 
+	/**
+	 * encode only some parity shards of a single block
+	 * input:
+	 * rs
+	 * data_blocks[rs->data_shards][block_size]
+	 * fec_blocks[nr_parity][block_size] receives parity rows first_parity .. first_parity + nr_parity - 1
+	 * The rows do not depend on each other, so more of them can be computed later on demand.
+	 * */
+	int reed_solomon_encode_parity(reed_solomon* rs, unsigned char** data_blocks, unsigned char** fec_blocks, int first_parity, int nr_parity, int block_size);
+
 	/**
 	 * reconstruct a big size of buffer
 	 * input:
@@ -40,6 +53,7 @@ extern "C" {
 	 * nr_shards: assert(0 == nr_shards % rs->data_shards)
 	 * shards[nr_shards][block_size]
 	 * marks[nr_shards] marks as errors
+	 * Decode matrices are cached inside rs, so concurrent calls on the same instance are not allowed.
 	 * */
 	int reed_solomon_reconstruct(reed_solomon* rs, unsigned char** shards, unsigned char* marks, int nr_shards, int block_size);
 
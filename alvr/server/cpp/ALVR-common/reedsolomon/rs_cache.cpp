@@ -0,0 +1,32 @@
+#include "rs_cache.h"
+
+ReedSolomonCache &ReedSolomonCache::Instance() {
+	static ReedSolomonCache instance;
+	return instance;
+}
+
+ReedSolomonCache::ReedSolomonCache() {
+	reed_solomon_init();
+}
+
+std::shared_ptr<reed_solomon> ReedSolomonCache::Get(int dataShards, int parityShards) {
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	for (auto it = m_entries.begin(); it != m_entries.end(); ++it) {
+		if (it->dataShards == dataShards && it->parityShards == parityShards) {
+			m_entries.splice(m_entries.begin(), m_entries, it);
+			return it->rs;
+		}
+	}
+
+	reed_solomon *rs = reed_solomon_new(dataShards, parityShards);
+	if (rs == NULL) {
+		return nullptr;
+	}
+	// Evicted instances stay alive while a caller still holds them.
+	m_entries.push_front({ dataShards, parityShards, std::shared_ptr<reed_solomon>(rs, reed_solomon_release) });
+	if (m_entries.size() > MAX_ENTRIES) {
+		m_entries.pop_back();
+	}
+	return m_entries.front().rs;
+}
@@ -0,0 +1,294 @@
+#include "BandwidthEstimator.h"
+
+#include <algorithm>
+#include <cmath>
+
+BandwidthEstimator::BandwidthEstimator(uint64_t initialBitrate, uint64_t minBitrate, uint64_t maxBitrate)
+	: m_minBitrate(minBitrate)
+	, m_maxBitrate(maxBitrate)
+	, m_sentPackets(SENT_HISTORY)
+{
+	m_targetBitrate = std::clamp(initialBitrate, m_minBitrate, m_maxBitrate);
+	m_delayBasedBitrate = (double)m_targetBitrate;
+	m_lossBasedBitrate = (double)m_targetBitrate;
+	for (auto &packet : m_sentPackets) {
+		packet = {};
+	}
+}
+
+void BandwidthEstimator::OnPacketSent(uint64_t nowUs, uint32_t packetCounter, int size)
+{
+	m_sentPackets[packetCounter % SENT_HISTORY] = { packetCounter, nowUs, size, false };
+}
+
+void BandwidthEstimator::OnPacketRetransmitted(uint64_t nowUs, uint32_t packetCounter, int size)
+{
+	SentPacket &packet = m_sentPackets[packetCounter % SENT_HISTORY];
+	if (packet.size == 0 || packet.packetCounter != packetCounter) {
+		packet = { packetCounter, nowUs, size, true };
+	}
+	packet.retransmitted = true;
+}
+
+void BandwidthEstimator::OnArrivalReport(uint64_t nowUs, const VideoArrivalReport &report)
+{
+	int count = std::min((int)report.packetCount, ALVR_ARRIVAL_REPORT_MAX_PACKETS);
+	int received = 0;
+	int lost = 0;
+	for (int i = 0; i < count; i++) {
+		uint32_t packetCounter = report.firstPacketCounter + i;
+		const SentPacket &packet = m_sentPackets[packetCounter % SENT_HISTORY];
+		if (packet.size == 0 || packet.packetCounter != packetCounter) {
+			continue;
+		}
+		if (report.arrivalTimes[i] == ALVR_PACKET_NOT_RECEIVED) {
+			lost++;
+			continue;
+		}
+		received++;
+		if (packet.retransmitted) {
+			UpdateReceiveBitrate(report.baseArrivalTime + report.arrivalTimes[i], packet.size);
+			continue;
+		}
+		OnPacketArrival(nowUs, packet, report.baseArrivalTime + report.arrivalTimes[i]);
+	}
+	UpdateLoss(nowUs, received, lost);
+	UpdateTarget(nowUs);
+}
+
+void BandwidthEstimator::OnPacketArrival(uint64_t nowUs, const SentPacket &packet, uint64_t arrivalTime)
+{
+	UpdateReceiveBitrate(arrivalTime, packet.size);
+
+	int64_t delay = (int64_t)(arrivalTime - packet.sendTime);
+	if (!m_hasGroup) {
+		m_group = { packet.sendTime, packet.sendTime, arrivalTime, delay };
+		m_hasGroup = true;
+		return;
+	}
+	if (packet.sendTime < m_group.firstSendTime) {
+		// Reordered, its group is already complete.
+		return;
+	}
+	if (packet.sendTime - m_group.firstSendTime > BURST_INTERVAL_US) {
+		if (m_hasPreviousGroup) {
+			double sendDeltaMs = (m_group.lastSendTime - m_previousGroup.lastSendTime) / 1000.;
+			double arrivalDeltaMs = (int64_t)(m_group.lastArrival - m_previousGroup.lastArrival) / 1000.;
+			OnGroupDelta(nowUs, m_group, sendDeltaMs, arrivalDeltaMs);
+		}
+		UpdateQueueingDelay(nowUs, m_group.minDelay);
+		m_previousGroup = m_group;
+		m_hasPreviousGroup = true;
+		m_group = { packet.sendTime, packet.sendTime, arrivalTime, delay };
+		return;
+	}
+	m_group.lastSendTime = std::max(m_group.lastSendTime, packet.sendTime);
+	m_group.lastArrival = std::max(m_group.lastArrival, arrivalTime);
+	m_group.minDelay = std::min(m_group.minDelay, delay);
+}
+
+// Trendline filter: slope of the smoothed accumulated delay over the arrival time.
+void BandwidthEstimator::OnGroupDelta(uint64_t nowUs, const Group &group, double sendDeltaMs, double arrivalDeltaMs)
+{
+	if (m_delayHistory.empty() && m_numDeltas == 0) {
+		m_firstArrival = group.lastArrival;
+	}
+	m_numDeltas = std::min(m_numDeltas + 1, TRENDLINE_MAX_DELTAS);
+	m_accumulatedDelayMs += arrivalDeltaMs - sendDeltaMs;
+	m_smoothedDelayMs = TRENDLINE_SMOOTHING * m_smoothedDelayMs + (1. - TRENDLINE_SMOOTHING) * m_accumulatedDelayMs;
+
+	m_delayHistory.emplace_back((int64_t)(group.lastArrival - m_firstArrival) / 1000., m_smoothedDelayMs);
+	if (m_delayHistory.size() > TRENDLINE_WINDOW) {
+		m_delayHistory.pop_front();
+	}
+	if (m_delayHistory.size() == TRENDLINE_WINDOW) {
+		double meanX = 0.;
+		double meanY = 0.;
+		for (auto &point : m_delayHistory) {
+			meanX += point.first;
+			meanY += point.second;
+		}
+		meanX /= TRENDLINE_WINDOW;
+		meanY /= TRENDLINE_WINDOW;
+		double numerator = 0.;
+		double denominator = 0.;
+		for (auto &point : m_delayHistory) {
+			numerator += (point.first - meanX) * (point.second - meanY);
+			denominator += (point.first - meanX) * (point.first - meanX);
+		}
+		if (denominator != 0.) {
+			m_trend = numerator / denominator;
+		}
+	}
+
+	Detect(nowUs, sendDeltaMs);
+}
+
+// Overuse is only signaled when the trend stays above the threshold for a while and is still
+// rising.
+void BandwidthEstimator::Detect(uint64_t nowUs, double sendDeltaMs)
+{
+	double modifiedTrend = m_numDeltas * m_trend * TRENDLINE_GAIN;
+	if (modifiedTrend > m_thresholdMs) {
+		if (m_timeOverUsingMs < 0.) {
+			m_timeOverUsingMs = sendDeltaMs / 2;
+		} else {
+			m_timeOverUsingMs += sendDeltaMs;
+		}
+		m_overuseCounter++;
+		if (m_timeOverUsingMs > OVERUSE_TIME_THRESHOLD_MS && m_overuseCounter > 1 && m_trend >= m_previousTrend) {
+			m_timeOverUsingMs = 0.;
+			m_overuseCounter = 0;
+			m_usage = USAGE_OVERUSE;
+			m_rateState = RATE_DECREASE;
+		}
+	} else if (modifiedTrend < -m_thresholdMs) {
+		m_timeOverUsingMs = -1.;
+		m_overuseCounter = 0;
+		m_usage = USAGE_UNDERUSE;
+	} else {
+		m_timeOverUsingMs = -1.;
+		m_overuseCounter = 0;
+		m_usage = USAGE_NORMAL;
+	}
+	m_previousTrend = m_trend;
+
+	UpdateThreshold(nowUs, modifiedTrend);
+}
+
+// The threshold follows the trend slowly, so that the detector neither starves against competing
+// TCP flows nor triggers on the jitter of the link. Spikes are ignored.
+void BandwidthEstimator::UpdateThreshold(uint64_t nowUs, double modifiedTrend)
+{
+	if (m_lastThresholdUpdate == 0) {
+		m_lastThresholdUpdate = nowUs;
+	}
+	double absTrend = std::abs(modifiedTrend);
+	if (absTrend > m_thresholdMs + MAX_THRESHOLD_OFFSET_MS) {
+		m_lastThresholdUpdate = nowUs;
+		return;
+	}
+	double k = absTrend < m_thresholdMs ? THRESHOLD_K_DOWN : THRESHOLD_K_UP;
+	double elapsedMs = std::min((nowUs - m_lastThresholdUpdate) / 1000., 100.);
+	m_thresholdMs += k * (absTrend - m_thresholdMs) * elapsedMs;
+	m_thresholdMs = std::clamp(m_thresholdMs, MIN_THRESHOLD_MS, MAX_THRESHOLD_MS);
+	m_lastThresholdUpdate = nowUs;
+}
+
+// The base delay is the lowest delay of the current and the previous half window, so that it
+// follows route changes and the drift between the clocks.
+void BandwidthEstimator::UpdateQueueingDelay(uint64_t nowUs, int64_t delay)
+{
+	if (m_delayWindowStart == 0) {
+		m_delayWindowStart = nowUs;
+	}
+	if (nowUs - m_delayWindowStart > DELAY_BASE_WINDOW_US / 2) {
+		m_minDelay[0] = m_minDelay[1];
+		m_minDelay[1] = INT64_MAX;
+		m_delayWindowStart = nowUs;
+	}
+	m_minDelay[1] = std::min(m_minDelay[1], delay);
+	int64_t base = std::min(m_minDelay[0], m_minDelay[1]);
+	m_queueingDelayUs = (uint64_t)(delay - base);
+}
+
+void BandwidthEstimator::UpdateReceiveBitrate(uint64_t arrivalTime, int size)
+{
+	if (m_firstReceiveTime == 0) {
+		m_firstReceiveTime = arrivalTime;
+	}
+	m_receivedPackets.emplace_back(arrivalTime, size);
+	m_receivedBytes += size;
+	while (m_receivedPackets.front().first + RECEIVE_RATE_WINDOW_US < arrivalTime) {
+		m_receivedBytes -= m_receivedPackets.front().second;
+		m_receivedPackets.pop_front();
+	}
+	if (arrivalTime - m_firstReceiveTime >= RECEIVE_RATE_WINDOW_US) {
+		m_receiveBitrate = m_receivedBytes * 8 * 1000 * 1000 / RECEIVE_RATE_WINDOW_US;
+	}
+}
+
+void BandwidthEstimator::UpdateLoss(uint64_t nowUs, int received, int lost)
+{
+	if (m_lossIntervalStart == 0) {
+		m_lossIntervalStart = nowUs;
+	}
+	m_lossReceived += received;
+	m_lossLost += lost;
+	if (nowUs - m_lossIntervalStart < LOSS_INTERVAL_US || m_lossReceived + m_lossLost == 0) {
+		return;
+	}
+	double loss = (double)m_lossLost / (m_lossReceived + m_lossLost);
+	if (loss > HIGH_LOSS) {
+		m_lossBasedBitrate = std::min(m_lossBasedBitrate, (double)m_targetBitrate) * (1. - 0.5 * loss);
+	} else if (loss < LOW_LOSS) {
+		m_lossBasedBitrate *= 1.05;
+	}
+	m_lossBasedBitrate = std::clamp(m_lossBasedBitrate, (double)m_minBitrate, (double)m_maxBitrate);
+	m_lossIntervalStart = nowUs;
+	m_lossReceived = 0;
+	m_lossLost = 0;
+}
+
+void BandwidthEstimator::UpdateMaxBitrateEstimate(double bitrate)
+{
+	// Kept in kbps, the normalized variance bounds are those of GCC.
+	const double alpha = 0.05;
+	double kbps = bitrate / 1000.;
+	if (m_avgMaxBitrate < 0.) {
+		m_avgMaxBitrate = kbps;
+	} else {
+		m_avgMaxBitrate = (1. - alpha) * m_avgMaxBitrate + alpha * kbps;
+	}
+	double norm = std::max(m_avgMaxBitrate, 1.);
+	m_varMaxBitrate = (1. - alpha) * m_varMaxBitrate + alpha * (m_avgMaxBitrate - kbps) * (m_avgMaxBitrate - kbps) / norm;
+	m_varMaxBitrate = std::clamp(m_varMaxBitrate, 0.4, 2.5);
+}
+
+void BandwidthEstimator::UpdateTarget(uint64_t nowUs)
+{
+	if (m_lastTargetUpdate == 0) {
+		m_lastTargetUpdate = nowUs;
+	}
+	double elapsedS = std::min((nowUs - m_lastTargetUpdate) / 1e6, 1.);
+	m_lastTargetUpdate = nowUs;
+
+	if (m_usage == USAGE_UNDERUSE) {
+		// The queues are draining, wait for them to be empty.
+		m_rateState = RATE_HOLD;
+	} else if (m_usage == USAGE_NORMAL && m_rateState == RATE_HOLD) {
+		m_rateState = RATE_INCREASE;
+	}
+
+	double receive = (double)m_receiveBitrate;
+	double receiveKbps = receive / 1000.;
+	double stdMaxKbps = std::sqrt(m_varMaxBitrate * std::max(m_avgMaxBitrate, 0.));
+	double bitrate = m_delayBasedBitrate;
+	if (m_rateState == RATE_INCREASE) {
+		if (receive > 0. && m_avgMaxBitrate >= 0. && receiveKbps > m_avgMaxBitrate + 3 * stdMaxKbps) {
+			// The link got faster, the previous maximum no longer applies.
+			m_avgMaxBitrate = -1.;
+		}
+		if (m_avgMaxBitrate >= 0.) {
+			bitrate += ADDITIVE_INCREASE_BPS_PER_SECOND * elapsedS;
+		} else {
+			bitrate *= std::pow(MULTIPLICATIVE_INCREASE_PER_SECOND, elapsedS);
+		}
+		// Do not run away from what the encoder actually produces.
+		if (receive > 0.) {
+			bitrate = std::min(bitrate, std::max(m_delayBasedBitrate, MAX_RECEIVE_RATIO * receive + 10000.));
+		}
+	} else if (m_rateState == RATE_DECREASE) {
+		bitrate = std::min(bitrate, DECREASE_FACTOR * (receive > 0. ? receive : bitrate));
+		if (receive > 0.) {
+			if (m_avgMaxBitrate >= 0. && receiveKbps < m_avgMaxBitrate - 3 * stdMaxKbps) {
+				m_avgMaxBitrate = -1.;
+			}
+			UpdateMaxBitrateEstimate(receive);
+		}
+		m_rateState = RATE_HOLD;
+	}
+	m_delayBasedBitrate = std::clamp(bitrate, (double)m_minBitrate, (double)m_maxBitrate);
+
+	m_targetBitrate = (uint64_t)std::clamp(std::min(m_delayBasedBitrate, m_lossBasedBitrate), (double)m_minBitrate, (double)m_maxBitrate);
+}
@@ -0,0 +1,156 @@
+#pragma once
+
+#include <stdint.h>
+#include <deque>
+#include <vector>
+
+#include "ALVR-common/packet_types.h"
+
+// Estimates the bitrate the network can carry from the arrival times the client reports for the
+// video packets, in the manner of Google Congestion Control (draft-ietf-rmcat-gcc).
+// Packets sent within BURST_INTERVAL_US of each other form a group, in practice the packets of a
+// frame. The change of the one-way delay from one group to the next is accumulated and its trend
+// is estimated by a linear regression over the last groups. A trend above an adaptive threshold
+// means that a queue builds up on the path (overuse): the target bitrate is cut to a fraction of
+// the rate the client receives. Otherwise it grows again, multiplicatively while far from the
+// rates at which overuse was seen before, additively near them. Losses above 10% lower the target
+// too, as the FEC cannot cover them.
+// Time is always passed by the caller (in microseconds) so that the estimator can be driven by a
+// simulated network. Arrival times are on the client clock, only their differences are used.
+class BandwidthEstimator
+{
+public:
+	// Bitrates are in bits per second.
+	BandwidthEstimator(uint64_t initialBitrate, uint64_t minBitrate, uint64_t maxBitrate);
+
+	// Video packets as they are queued for sending.
+	void OnPacketSent(uint64_t nowUs, uint32_t packetCounter, int size);
+	// Packets sent again on a NACK keep their packetCounter. Their arrival only counts in the receive
+	// rate: its delay from the first send time includes the round trip of the NACK and would bias
+	// the trend.
+	void OnPacketRetransmitted(uint64_t nowUs, uint32_t packetCounter, int size);
+	void OnArrivalReport(uint64_t nowUs, const VideoArrivalReport &report);
+
+	uint64_t GetTargetBitrate() const { return m_targetBitrate; }
+	// 0 until the client reported packets over a whole RECEIVE_RATE_WINDOW_US.
+	uint64_t GetReceiveBitrate() const { return m_receiveBitrate; }
+	// One-way delay of the last group above the lowest one seen in the last DELAY_BASE_WINDOW_US.
+	uint64_t GetQueueingDelayUs() const { return m_queueingDelayUs; }
+	bool IsOverusing() const { return m_usage == USAGE_OVERUSE; }
+
+private:
+	enum Usage {
+		USAGE_NORMAL,
+		USAGE_OVERUSE,
+		USAGE_UNDERUSE,
+	};
+	enum RateState {
+		RATE_HOLD,
+		RATE_INCREASE,
+		RATE_DECREASE,
+	};
+
+	struct SentPacket {
+		uint32_t packetCounter;
+		uint64_t sendTime;
+		int size;
+		bool retransmitted;
+	};
+	struct Group {
+		uint64_t firstSendTime;
+		uint64_t lastSendTime;
+		uint64_t lastArrival;
+		// Lowest arrival - send time of the packets of the group.
+		int64_t minDelay;
+	};
+
+	void OnPacketArrival(uint64_t nowUs, const SentPacket &packet, uint64_t arrivalTime);
+	void OnGroupDelta(uint64_t nowUs, const Group &group, double sendDeltaMs, double arrivalDeltaMs);
+	void Detect(uint64_t nowUs, double sendDeltaMs);
+	void UpdateThreshold(uint64_t nowUs, double modifiedTrend);
+	void UpdateQueueingDelay(uint64_t nowUs, int64_t delay);
+	void UpdateReceiveBitrate(uint64_t arrivalTime, int size);
+	void UpdateLoss(uint64_t nowUs, int received, int lost);
+	void UpdateTarget(uint64_t nowUs);
+	void UpdateMaxBitrateEstimate(double bitrate);
+
+	static const int SENT_HISTORY = 4096;
+	static const uint64_t BURST_INTERVAL_US = 5000;
+
+	// Trendline filter.
+	static const int TRENDLINE_WINDOW = 20;
+	static constexpr double TRENDLINE_SMOOTHING = 0.9;
+	static constexpr double TRENDLINE_GAIN = 4.;
+	static const int TRENDLINE_MAX_DELTAS = 60;
+
+	// Overuse detector. Delays are in milliseconds.
+	static constexpr double OVERUSE_TIME_THRESHOLD_MS = 10.;
+	static constexpr double INITIAL_THRESHOLD_MS = 12.5;
+	static constexpr double MIN_THRESHOLD_MS = 6.;
+	static constexpr double MAX_THRESHOLD_MS = 600.;
+	static constexpr double THRESHOLD_K_UP = 0.0087;
+	static constexpr double THRESHOLD_K_DOWN = 0.039;
+	static constexpr double MAX_THRESHOLD_OFFSET_MS = 15.;
+
+	// Rate controller.
+	static constexpr double DECREASE_FACTOR = 0.85;
+	static constexpr double MULTIPLICATIVE_INCREASE_PER_SECOND = 1.08;
+	static constexpr double ADDITIVE_INCREASE_BPS_PER_SECOND = 1000. * 1000;
+	static constexpr double MAX_RECEIVE_RATIO = 1.5;
+	static const uint64_t RECEIVE_RATE_WINDOW_US = 500 * 1000;
+
+	// Loss based bound.
+	static const uint64_t LOSS_INTERVAL_US = 200 * 1000;
+	static constexpr double HIGH_LOSS = 0.1;
+	static constexpr double LOW_LOSS = 0.02;
+
+	static const uint64_t DELAY_BASE_WINDOW_US = 10 * 1000 * 1000;
+
+	uint64_t m_minBitrate;
+	uint64_t m_maxBitrate;
+	uint64_t m_targetBitrate;
+
+	std::vector<SentPacket> m_sentPackets;
+
+	bool m_hasGroup = false;
+	bool m_hasPreviousGroup = false;
+	Group m_group;
+	Group m_previousGroup;
+
+	uint64_t m_firstArrival = 0;
+	double m_accumulatedDelayMs = 0.;
+	double m_smoothedDelayMs = 0.;
+	int m_numDeltas = 0;
+	// (arrival time, smoothed accumulated delay) of the last groups, in milliseconds.
+	std::deque<std::pair<double, double>> m_delayHistory;
+	double m_trend = 0.;
+	double m_previousTrend = 0.;
+
+	Usage m_usage = USAGE_NORMAL;
+	double m_thresholdMs = INITIAL_THRESHOLD_MS;
+	uint64_t m_lastThresholdUpdate = 0;
+	double m_timeOverUsingMs = -1.;
+	int m_overuseCounter = 0;
+
+	RateState m_rateState = RATE_HOLD;
+	double m_delayBasedBitrate;
+	uint64_t m_lastTargetUpdate = 0;
+	// Average and variance (normalized by the average) of the receive bitrates at which overuse
+	// was detected, in kilobits per second. Negative when unknown.
+	double m_avgMaxBitrate = -1.;
+	double m_varMaxBitrate = 0.4;
+
+	std::deque<std::pair<uint64_t, int>> m_receivedPackets;
+	uint64_t m_receivedBytes = 0;
+	uint64_t m_firstReceiveTime = 0;
+	uint64_t m_receiveBitrate = 0;
+
+	double m_lossBasedBitrate;
+	uint64_t m_lossIntervalStart = 0;
+	int m_lossReceived = 0;
+	int m_lossLost = 0;
+
+	int64_t m_minDelay[2] = { INT64_MAX, INT64_MAX };
+	uint64_t m_delayWindowStart = 0;
+	uint64_t m_queueingDelayUs = 0;
+};
@@ -1,4 +1,5 @@
 #include "ClientConnection.h"
+#include <algorithm>
 #include <mutex>
 #include <string.h>
 
@@ -7,123 +8,462 @@
 #include "bindings.h"
 #include "Utils.h"
 #include "Settings.h"
+#include "FecPolicy.h"
+#include "BandwidthEstimator.h"
+#include "PacketPacer.h"
+#include "MtuProber.h"
+#include "VideoFrameBuffer.h"
+#include "ALVR-common/annexb.h"
+#include "ALVR-common/reedsolomon/rs_cache.h"
+
+namespace {
+
+const int FRAME_HAS_IDR = 1 << 0;
+const int FRAME_HAS_PARAMETER_SETS = 1 << 1;
+
+// Look at the NAL units preceding the first slice of an Annex-B access unit.
+int ClassifyFrame(const uint8_t *buf, int len) {
+	bool h265 = Settings::Instance().m_codec == ALVR_CODEC_H265;
+	int flags = 0;
+	AnnexBParser parser(buf, len, h265);
+	AnnexBNal nal;
+	while (parser.Next(nal)) {
+		if (AnnexBIsParameterSet(nal.type, h265)) {
+			flags |= FRAME_HAS_PARAMETER_SETS;
+		} else if (AnnexBIsSlice(nal.type, h265)) {
+			if (AnnexBIsKeyframeSlice(nal.type, h265)) {
+				flags |= FRAME_HAS_IDR;
+			}
+			break;
+		}
+	}
+	return flags;
+}
+
+}
 
 ClientConnection::ClientConnection(
 	std::function<void()> poseUpdatedCallback,
-	std::function<void()> packetLossCallback)
+	std::function<void()> packetLossCallback,
+	std::function<void(uint64_t)> frameAckCallback)
 	: m_bExiting(false)
 	, m_LastStatisticsUpdate(0) {
 	m_PoseUpdatedCallback = poseUpdatedCallback;
 	m_PacketLossCallback = packetLossCallback;
+	m_FrameAckCallback = frameAckCallback;
 
 	m_TrackingInfo = {};
 
 	m_Statistics = std::make_shared<Statistics>();
 
-	reed_solomon_init();
-	
 	videoPacketCounter = 0;
 	soundPacketCounter = 0;
-	m_fecPercentage = INITIAL_FEC_PERCENTAGE;
+	if (Settings::Instance().m_adaptiveFec) {
+		m_fecPolicy = std::make_unique<AdaptiveFecPolicy>(Settings::Instance().m_fecInterPercentage);
+	} else {
+		m_fecPolicy = std::make_unique<FixedFecPolicy>(Settings::Instance().m_fecInterPercentage);
+	}
+	m_fecPercentage = m_fecPolicy->GetFecPercentage(GetTimestampUs());
+	if (Settings::Instance().m_enableAdaptiveBitrate) {
+		uint64_t maxBitrate = Settings::Instance().mEncodeBitrateMBs * 1024 * 1024;
+		uint64_t minBitrate = Settings::Instance().m_adaptiveBitrateMinMBs * 1024 * 1024;
+		m_bandwidthEstimator = std::make_unique<BandwidthEstimator>(maxBitrate, minBitrate, maxBitrate);
+	}
+	m_sentPackets.resize(RETRANSMIT_HISTORY);
+	// Every slice of the frames that can still be retransmitted or repaired holds its buffer, and
+	// so do the frame being encoded and the one being sent.
+	int retainedFrames = (int)(RETRANSMIT_DEADLINE_US * Settings::Instance().m_refreshRate / (1000 * 1000)) + 1;
+	VideoFrameBuffer::SetPoolSize((size_t)(std::max(retainedFrames, RATELESS_FEC_HISTORY) + 2) * ALVR_MAX_VIDEO_SLICES);
+	if (Settings::Instance().m_compactVideoPackets) {
+		m_videoPacketSize = Settings::Instance().m_maxVideoPacketSize;
+		if (Settings::Instance().m_mtuProbing) {
+			m_mtuProber = std::make_unique<MtuProber>(std::min(ALVR_MAX_PACKET_SIZE, m_videoPacketSize), m_videoPacketSize);
+			m_videoPacketSize = m_mtuProber->GetPacketSize();
+		}
+		VideoFrameBuffer::SetPacketFormat(m_videoPacketSize, true);
+	} else {
+		VideoFrameBuffer::SetPacketFormat(ALVR_MAX_PACKET_SIZE, false);
+	}
 	memset(&m_reportedStatistics, 0, sizeof(m_reportedStatistics));
 	m_Statistics->ResetAll();
+
+	if (Settings::Instance().m_packetPacingPercentage > 0) {
+		uint64_t frameIntervalUs = 1000 * 1000 / Settings::Instance().m_refreshRate;
+		m_pacer = std::make_unique<PacketPacer>(frameIntervalUs, Settings::Instance().m_packetPacingPercentage);
+		m_pacerThread = std::thread([this]() { PacerThread(); });
+	}
 }
 
 ClientConnection::~ClientConnection() {
+	if (m_pacerThread.joinable()) {
+		{
+			std::unique_lock lock(m_pacerMutex);
+			m_bExiting = true;
+		}
+		m_pacerCondition.notify_one();
+		m_pacerThread.join();
+	}
+	for (auto &frame : m_ratelessFrames) {
+		if (frame.buffer != nullptr) {
+			frame.buffer->Release();
+		}
+	}
+	for (auto &sent : m_sentPackets) {
+		if (sent.frame != nullptr) {
+			sent.frame->Release();
+		}
+	}
 }
 
-void ClientConnection::FECSend(uint8_t *buf, int len, uint64_t frameIndex, uint64_t videoFrameIndex) {
-	int shardPackets = CalculateFECShardPackets(len, m_fecPercentage);
+void ClientConnection::FECSend(VideoFrameBuffer *frame, uint64_t frameIndex, uint64_t videoFrameIndex, int sliceIndex, bool lastSlice, bool recoveryFrame) {
+	SendMtuProbes(GetTimestampUs());
+
+	int len = frame->GetFrameByteSize();
+
+	int fecPercentage;
+	{
+		std::unique_lock lock(m_fecPolicyMutex);
+		fecPercentage = m_fecPolicy->GetFecPercentage(GetTimestampUs());
+	}
+	m_fecPercentage = fecPercentage;
+
+	// Losing a keyframe or the parameter sets costs a freeze until the next IDR, so they get at
+	// least their own ratio. They precede the first slice (of the group), which starts within the
+	// first packet.
+	int frameStartSize;
+	const uint8_t *frameStart = frame->GetFrameStart(frameStartSize);
+	int frameFlags = ClassifyFrame(frameStart, frameStartSize);
+	if (frameFlags & FRAME_HAS_IDR) {
+		fecPercentage = std::max(fecPercentage, Settings::Instance().m_fecIdrPercentage);
+	}
+	if (frameFlags & FRAME_HAS_PARAMETER_SETS) {
+		fecPercentage = std::max(fecPercentage, Settings::Instance().m_fecParameterSetsPercentage);
+	}
+
+	bool rateless = Settings::Instance().m_fecRateless;
+	uint16_t fecFlags = 0;
+	if (rateless) {
+		fecFlags = ALVR_FEC_FLAG_RATELESS;
+	} else if (Settings::Instance().m_fecLargeBlocks) {
+		fecFlags = ALVR_FEC_FLAG_LARGE_BLOCK;
+	}
+	uint16_t fecField = (uint16_t)fecPercentage | fecFlags;
+	int shardPackets = CalculateFECShardPackets(len, GetFECCodePercentage(fecField), GetFECMaxShards(fecField), frame->GetPayloadSize());
 
-	int blockSize = shardPackets * ALVR_MAX_VIDEO_BUFFER_SIZE;
+	int blockSize = shardPackets * frame->GetPayloadSize();
 
 	int dataShards = (len + blockSize - 1) / blockSize;
-	int totalParityShards = CalculateParityShards(dataShards, m_fecPercentage);
+	// In the rateless mode, the code has more parity rows than we send now.
+	int codeParityShards = CalculateParityShards(dataShards, GetFECCodePercentage(fecField));
+	int totalParityShards = std::min(CalculateParityShards(dataShards, fecPercentage), codeParityShards);
 	int totalShards = dataShards + totalParityShards;
 
-	assert(totalShards <= DATA_SHARDS_MAX);
+	assert(dataShards + codeParityShards <= DATA_SHARDS_MAX);
+
+	Debug("FECSend. sliceIndex=%d dataShards=%d totalParityShards=%d totalShards=%d blockSize=%d shardPackets=%d\n"
+		, sliceIndex, dataShards, totalParityShards, totalShards, blockSize, shardPackets);
+
+	auto rs = ReedSolomonCache::Instance().Get(dataShards, codeParityShards);
 
-	Debug("reed_solomon_new. dataShards=%d totalParityShards=%d totalShards=%d blockSize=%d shardPackets=%d\n"
-		, dataShards, totalParityShards, totalShards, blockSize, shardPackets);
+	// Parity rows that may be asked for later are laid out now, the buffer cannot move once its
+	// packets are handed out.
+	frame->PrepareFec(shardPackets, dataShards, rateless ? codeParityShards : totalParityShards);
+	frame->EncodeParity(rs.get(), 0, totalParityShards);
 
-	reed_solomon *rs = reed_solomon_new(dataShards, totalParityShards);
+	std::unique_lock sendLock(m_fecSendMutex);
 
-	std::vector<uint8_t *> shards(totalShards);
+	ReleaseExpiredPackets(GetTimestampUs());
 
-	for (int i = 0; i < dataShards; i++) {
-		shards[i] = buf + i * blockSize;
+	if (rateless) {
+		// Keep a reference to the frame to encode more parity for repair requests.
+		RatelessFrame &ratelessFrame = m_ratelessFrames[(videoFrameIndex * ALVR_MAX_VIDEO_SLICES + sliceIndex) % (RATELESS_FEC_HISTORY * ALVR_MAX_VIDEO_SLICES)];
+		if (ratelessFrame.buffer != nullptr) {
+			ratelessFrame.buffer->Release();
+		}
+		frame->AddRef();
+		ratelessFrame.buffer = frame;
+		ratelessFrame.videoFrameIndex = videoFrameIndex;
+		ratelessFrame.sliceIndex = sliceIndex;
+		ratelessFrame.lastSlice = lastSlice;
+		ratelessFrame.recoveryFrame = recoveryFrame;
+		ratelessFrame.trackingFrameIndex = frameIndex;
+		ratelessFrame.sentTime = GetTimestampUs();
+		ratelessFrame.fecPercentage = fecField;
+		ratelessFrame.shardPackets = shardPackets;
+		ratelessFrame.dataShards = dataShards;
+		ratelessFrame.nextParityShard = totalParityShards;
+		ratelessFrame.rs = rs;
 	}
-	if (len % blockSize != 0) {
-		// Padding
-		shards[dataShards - 1] = new uint8_t[blockSize];
-		memset(shards[dataShards - 1], 0, blockSize);
-		memcpy(shards[dataShards - 1], buf + (dataShards - 1) * blockSize, len % blockSize);
+
+	int dataPackets = frame->GetDataPackets();
+	int packetCount = dataPackets + totalParityShards * shardPackets;
+	m_sendPackets.clear();
+	m_sendPackets.reserve(packetCount);
+
+	VideoFrame header;
+
+	Debug("Sending video frame. trackingFrameIndex=%llu videoFrameIndex=%llu sliceIndex=%d size=%d\n", frameIndex, videoFrameIndex, sliceIndex, len);
+
+	header.type = ALVR_PACKET_TYPE_VIDEO_FRAME;
+	header.trackingFrameIndex = frameIndex;
+	header.videoFrameIndex = videoFrameIndex;
+	header.sentTime = GetTimestampUs();
+	header.frameByteSize = len;
+	header.fecPercentage = fecField;
+	header.sliceIndex = (uint8_t)sliceIndex;
+	header.lastSlice = lastSlice ? 1 : 0;
+	header.recoveryFrame = recoveryFrame ? 1 : 0;
+	for (int i = 0; i < dataPackets; i++) {
+		QueueVideoPacket(frame, header, i);
 	}
-	for (int i = 0; i < totalParityShards; i++) {
-		shards[dataShards + i] = new uint8_t[blockSize];
+	for (int i = 0; i < totalParityShards * shardPackets; i++) {
+		QueueVideoPacket(frame, header, dataShards * shardPackets + i);
 	}
+	FlushVideoPackets(frame, false);
+	sendLock.unlock();
 
-	int ret = reed_solomon_encode(rs, &shards[0], totalShards, blockSize);
-	assert(ret == 0);
+	std::unique_lock lock(m_fecPolicyMutex);
+	m_fecPolicy->OnPacketsSent(GetTimestampUs(), packetCount);
+}
 
-	reed_solomon_release(rs);
+// Only the header is written, the payload is already in place in the frame buffer.
+void ClientConnection::QueueVideoPacket(VideoFrameBuffer *frame, VideoFrame &header, int fecIndex) {
+	header.fecIndex = fecIndex;
+	header.packetCounter = videoPacketCounter;
+	videoPacketCounter++;
+	frame->SetHeader(fecIndex, header);
 
-	uint8_t packetBuffer[2000];
-	VideoFrame *header = (VideoFrame *)packetBuffer;
-	uint8_t *payload = packetBuffer + sizeof(VideoFrame);
-	int dataRemain = len;
+	int size = frame->GetPacketSize(fecIndex);
+	m_sendPackets.push_back({ frame->GetPacket(fecIndex), size });
+	m_Statistics->CountPacket(size);
+	{
+		std::unique_lock lock(m_bandwidthMutex);
+		if (m_bandwidthEstimator) {
+			m_bandwidthEstimator->OnPacketSent(GetTimestampUs(), header.packetCounter, size);
+		}
+	}
 
-	Debug("Sending video frame. trackingFrameIndex=%llu videoFrameIndex=%llu size=%d\n", frameIndex, videoFrameIndex, len);
+	SentPacket &sent = m_sentPackets[header.packetCounter % RETRANSMIT_HISTORY];
+	if (sent.frame != nullptr) {
+		sent.frame->Release();
+	}
+	frame->AddRef();
+	sent.packetCounter = header.packetCounter;
+	sent.sentTime = header.sentTime;
+	sent.frame = frame;
+	sent.packet = m_sendPackets.back();
+}
 
-	header->type = ALVR_PACKET_TYPE_VIDEO_FRAME;
-	header->trackingFrameIndex = frameIndex;
-	header->videoFrameIndex = videoFrameIndex;
-	header->sentTime = GetTimestampUs();
-	header->frameByteSize = len;
-	header->fecIndex = 0;
-	header->fecPercentage = (uint16_t)m_fecPercentage;
-	for (int i = 0; i < dataShards; i++) {
-		for (int j = 0; j < shardPackets; j++) {
-			int copyLength = std::min(ALVR_MAX_VIDEO_BUFFER_SIZE, dataRemain);
-			if (copyLength <= 0) {
-				break;
+// The network thread (or the pacer) takes its own reference to the frame until the packets are
+// sent.
+void ClientConnection::FlushVideoPackets(VideoFrameBuffer *frame, bool urgent) {
+	if (m_sendPackets.empty()) {
+		return;
+	}
+	if (m_pacer) {
+		{
+			std::unique_lock lock(m_pacerMutex);
+			m_pacer->AddBatch(GetCounterUs(), frame, m_sendPackets, urgent);
+		}
+		m_pacerCondition.notify_one();
+	} else {
+		frame->AddRef();
+		LegacySendBatch(&m_sendPackets[0], (int)m_sendPackets.size(), frame);
+	}
+	m_sendPackets.clear();
+}
+
+// Sends the packets released by m_pacer and sleeps until the next release.
+void ClientConnection::PacerThread() {
+	std::vector<PacketPacer::Packet> packets;
+
+	std::unique_lock lock(m_pacerMutex);
+	while (!m_bExiting) {
+		packets.clear();
+		// The lists only grow when more packets are queued than ever before.
+		size_t pending = m_pacer->GetPendingPackets();
+		packets.reserve(pending);
+		m_pacedPackets.reserve(pending);
+		m_pacer->Poll(GetCounterUs(), packets);
+		// One call per run of packets of the same frame.
+		for (size_t begin = 0; begin < packets.size();) {
+			VideoFrameBuffer *frame = packets[begin].frame;
+			m_pacedPackets.clear();
+			size_t end = begin;
+			for (; end < packets.size() && packets[end].frame == frame; end++) {
+				m_pacedPackets.push_back(packets[end].packet);
+			}
+			frame->AddRef();
+			LegacySendBatch(&m_pacedPackets[0], (int)m_pacedPackets.size(), frame);
+			begin = end;
+		}
+
+		uint64_t next = m_pacer->GetNextReleaseTime();
+		if (next == UINT64_MAX) {
+			m_pacerCondition.wait(lock);
+		} else {
+			uint64_t now = GetCounterUs();
+			if (next > now) {
+				m_pacerCondition.wait_for(lock, std::chrono::microseconds(next - now));
 			}
-			memcpy(payload, shards[i] + j * ALVR_MAX_VIDEO_BUFFER_SIZE, copyLength);
-			dataRemain -= ALVR_MAX_VIDEO_BUFFER_SIZE;
-
-			header->packetCounter = videoPacketCounter;
-			videoPacketCounter++;
-			LegacySend((unsigned char *)packetBuffer, sizeof(VideoFrame) + copyLength);
-			m_Statistics->CountPacket(sizeof(VideoFrame) + copyLength);
-			header->fecIndex++;
 		}
 	}
-	header->fecIndex = dataShards * shardPackets;
-	for (int i = 0; i < totalParityShards; i++) {
-		for (int j = 0; j < shardPackets; j++) {
-			int copyLength = ALVR_MAX_VIDEO_BUFFER_SIZE;
-			memcpy(payload, shards[dataShards + i] + j * ALVR_MAX_VIDEO_BUFFER_SIZE, copyLength);
-
-			header->packetCounter = videoPacketCounter;
-			videoPacketCounter++;
-			
-			LegacySend((unsigned char *)packetBuffer, sizeof(VideoFrame) + copyLength);
-			m_Statistics->CountPacket(sizeof(VideoFrame) + copyLength);
-			header->fecIndex++;
+}
+
+// Send more parity rows of a frame sent in the rateless FEC mode, as long as it is recent enough
+// to be useful.
+void ClientConnection::SendFecRepair(uint64_t videoFrameIndex, int sliceIndex, uint32_t parityShards) {
+	std::unique_lock sendLock(m_fecSendMutex);
+
+	RatelessFrame &frame = m_ratelessFrames[(videoFrameIndex * ALVR_MAX_VIDEO_SLICES + sliceIndex) % (RATELESS_FEC_HISTORY * ALVR_MAX_VIDEO_SLICES)];
+	if (frame.buffer == nullptr || frame.videoFrameIndex != videoFrameIndex || frame.sliceIndex != sliceIndex || GetTimestampUs() - frame.sentTime > RATELESS_FEC_DEADLINE_US) {
+		Debug("Ignoring FEC repair request. videoFrameIndex=%llu sliceIndex=%d\n", videoFrameIndex, sliceIndex);
+		return;
+	}
+	int count = std::min((int)parityShards, frame.rs->parity_shards - frame.nextParityShard);
+	if (count <= 0) {
+		return;
+	}
+
+	frame.buffer->EncodeParity(frame.rs.get(), frame.nextParityShard, count);
+
+	Debug("Sending FEC repair. videoFrameIndex=%llu sliceIndex=%d parityShards=%d firstParityShard=%d\n", videoFrameIndex, sliceIndex, count, frame.nextParityShard);
+
+	m_sendPackets.clear();
+	m_sendPackets.reserve(count * frame.shardPackets);
+
+	VideoFrame header;
+	header.type = ALVR_PACKET_TYPE_VIDEO_FRAME;
+	header.trackingFrameIndex = frame.trackingFrameIndex;
+	header.videoFrameIndex = frame.videoFrameIndex;
+	header.sentTime = frame.sentTime;
+	header.frameByteSize = frame.buffer->GetFrameByteSize();
+	header.fecPercentage = frame.fecPercentage;
+	header.sliceIndex = (uint8_t)frame.sliceIndex;
+	header.lastSlice = frame.lastSlice ? 1 : 0;
+	header.recoveryFrame = frame.recoveryFrame ? 1 : 0;
+	int firstPacket = (frame.dataShards + frame.nextParityShard) * frame.shardPackets;
+	for (int i = 0; i < count * frame.shardPackets; i++) {
+		QueueVideoPacket(frame.buffer, header, firstPacket + i);
+	}
+	// The client is waiting for the repair, it is not paced.
+	FlushVideoPackets(frame.buffer, true);
+	frame.nextParityShard += count;
+	sendLock.unlock();
+
+	std::unique_lock lock(m_fecPolicyMutex);
+	m_fecPolicy->OnPacketsSent(GetTimestampUs(), count * frame.shardPackets);
+}
+
+// The probes are sent alongside the video, the padding is not worth a thread of its own.
+void ClientConnection::SendMtuProbes(uint64_t now) {
+	if (!m_mtuProber) {
+		return;
+	}
+	std::unique_lock lock(m_mtuMutex);
+	uint32_t round;
+	m_mtuProber->Poll(now, round, m_probeSizes);
+	UpdateVideoPacketSize();
+	for (int size : m_probeSizes) {
+		m_probeBuffer.assign(size, 0);
+		MtuProbe probe;
+		probe.type = ALVR_PACKET_TYPE_MTU_PROBE;
+		probe.round = round;
+		probe.size = size;
+		memcpy(&m_probeBuffer[0], &probe, sizeof(probe));
+		LegacySend(&m_probeBuffer[0], size);
+	}
+}
+
+void ClientConnection::UpdateVideoPacketSize() {
+	int packetSize = m_mtuProber->GetPacketSize();
+	if (packetSize != m_videoPacketSize) {
+		Info("Video packet size: %d\n", packetSize);
+		m_videoPacketSize = packetSize;
+		VideoFrameBuffer::SetPacketFormat(packetSize, true);
+	}
+}
+
+// Frame buffers are only referenced by m_sentPackets while their packets can be retransmitted, so
+// that the pool of buffers is not drained by small frames.
+void ClientConnection::ReleaseExpiredPackets(uint64_t now) {
+	if (videoPacketCounter - m_oldestSentPacket > RETRANSMIT_HISTORY) {
+		m_oldestSentPacket = videoPacketCounter - RETRANSMIT_HISTORY;
+	}
+	for (; m_oldestSentPacket != videoPacketCounter; m_oldestSentPacket++) {
+		SentPacket &sent = m_sentPackets[m_oldestSentPacket % RETRANSMIT_HISTORY];
+		if (sent.frame == nullptr || sent.packetCounter != m_oldestSentPacket) {
+			continue;
+		}
+		if (now - sent.sentTime <= RETRANSMIT_DEADLINE_US) {
+			break;
 		}
+		sent.frame->Release();
+		sent.frame = nullptr;
 	}
+}
 
-	if (len % blockSize != 0) {
-		delete[] shards[dataShards - 1];
+// The packets are sent unchanged, with their original packetCounter, and are not paced.
+void ClientConnection::RetransmitVideoPackets(uint32_t fromPacketCounter, uint32_t toPacketCounter) {
+	std::unique_lock sendLock(m_fecSendMutex);
+
+	uint32_t count = toPacketCounter - fromPacketCounter + 1;
+	bool available = count <= RETRANSMIT_HISTORY;
+	uint64_t now = GetTimestampUs();
+	for (uint32_t i = 0; available && i < count; i++) {
+		uint32_t packetCounter = fromPacketCounter + i;
+		SentPacket &sent = m_sentPackets[packetCounter % RETRANSMIT_HISTORY];
+		available = sent.frame != nullptr && sent.packetCounter == packetCounter && now - sent.sentTime <= RETRANSMIT_DEADLINE_US;
+	}
+	if (!available) {
+		sendLock.unlock();
+		Debug("Cannot retransmit video packets. %u - %u\n", fromPacketCounter, toPacketCounter);
+		OnFecFailure();
+		return;
 	}
-	for (int i = 0; i < totalParityShards; i++) {
-		delete[] shards[dataShards + i];
+
+	Debug("Retransmitting video packets. %u - %u\n", fromPacketCounter, toPacketCounter);
+
+	// One batch per frame buffer.
+	m_sendPackets.clear();
+	VideoFrameBuffer *frame = nullptr;
+	for (uint32_t i = 0; i < count; i++) {
+		SentPacket &sent = m_sentPackets[(fromPacketCounter + i) % RETRANSMIT_HISTORY];
+		if (sent.frame != frame && frame != nullptr) {
+			FlushVideoPackets(frame, true);
+		}
+		frame = sent.frame;
+		m_sendPackets.push_back(sent.packet);
+		m_Statistics->CountPacket(sent.packet.len);
+		std::unique_lock lock(m_bandwidthMutex);
+		if (m_bandwidthEstimator) {
+			m_bandwidthEstimator->OnPacketRetransmitted(now, sent.packetCounter, sent.packet.len);
+		}
 	}
+	FlushVideoPackets(frame, true);
+	sendLock.unlock();
+
+	std::unique_lock lock(m_fecPolicyMutex);
+	m_fecPolicy->OnPacketsSent(GetTimestampUs(), count);
 }
 
-void ClientConnection::SendVideo(uint8_t *buf, int len, uint64_t frameIndex) {
-	FECSend(buf, len, frameIndex, mVideoFrameIndex);
-	mVideoFrameIndex++;
+void ClientConnection::SendVideo(VideoFrameBuffer *frame, uint64_t frameIndex, bool recoveryFrame) {
+	SendVideoSlice(frame, frameIndex, 0, true, recoveryFrame);
+}
+
+void ClientConnection::SendVideoSlice(VideoFrameBuffer *slice, uint64_t frameIndex, int sliceIndex, bool lastSlice, bool recoveryFrame) {
+	assert(sliceIndex < ALVR_MAX_VIDEO_SLICES);
+	FECSend(slice, frameIndex, mVideoFrameIndex, sliceIndex, lastSlice, recoveryFrame);
+	slice->Release();
+	if (lastSlice) {
+		mVideoFrameIndex++;
+	}
+}
+
+void ClientConnection::SendVideo(uint8_t *buf, int len, uint64_t frameIndex, bool recoveryFrame) {
+	VideoFrameBuffer *frame = VideoFrameBuffer::Acquire();
+	frame->Append(buf, len);
+	SendVideo(frame, frameIndex, recoveryFrame);
 }
 
 void ClientConnection::SendHapticsFeedback(uint64_t startTime, float amplitude, float duration, float frequency, uint8_t hand)
@@ -171,6 +511,10 @@ void ClientConnection::ProcessRecv(unsigned char *buf, size_t len) {
 
 		if (timeSync->mode == 0) {
 			m_reportedStatistics = *timeSync;
+			{
+				std::unique_lock lock(m_fecPolicyMutex);
+				m_fecPolicy->OnReport(Current, *timeSync);
+			}
 			TimeSync sendBuf = *timeSync;
 			sendBuf.mode = 1;
 			sendBuf.serverTime = Current;
@@ -195,12 +539,51 @@ void ClientConnection::ProcessRecv(unsigned char *buf, size_t len) {
 		if (packetErrorReport->lostFrameType == ALVR_LOST_FRAME_TYPE_VIDEO) {
 			// Recover video frame.
 			OnFecFailure();
+		} else if (packetErrorReport->lostFrameType == ALVR_LOST_FRAME_TYPE_VIDEO_NACK) {
+			RetransmitVideoPackets(packetErrorReport->fromPacketCounter, packetErrorReport->toPacketCounter);
+		}
+	}
+	else if (type == ALVR_PACKET_TYPE_FEC_REPAIR_REQUEST && len >= sizeof(FecRepairRequest)) {
+		auto *request = (FecRepairRequest *)buf;
+		if (request->sliceIndex < ALVR_MAX_VIDEO_SLICES) {
+			SendFecRepair(request->videoFrameIndex, request->sliceIndex, request->parityShards);
+		}
+	}
+	else if (type == ALVR_PACKET_TYPE_VIDEO_FRAME_ACK && len >= sizeof(VideoFrameAck)) {
+		auto *ack = (VideoFrameAck *)buf;
+		m_FrameAckCallback(ack->trackingFrameIndex);
+	}
+	else if (type == ALVR_PACKET_TYPE_MTU_PROBE_ACK && len >= sizeof(MtuProbe)) {
+		auto *ack = (MtuProbe *)buf;
+		if (m_mtuProber) {
+			std::unique_lock lock(m_mtuMutex);
+			m_mtuProber->OnProbeAck(ack->round, (int)ack->size);
+			UpdateVideoPacketSize();
+		}
+	}
+	else if (type == ALVR_PACKET_TYPE_VIDEO_ARRIVAL_REPORT && len >= offsetof(VideoArrivalReport, arrivalTimes)) {
+		auto *report = (VideoArrivalReport *)buf;
+		if (report->packetCount <= ALVR_ARRIVAL_REPORT_MAX_PACKETS
+			&& len >= offsetof(VideoArrivalReport, arrivalTimes) + report->packetCount * sizeof(uint32_t)) {
+			std::unique_lock lock(m_bandwidthMutex);
+			if (m_bandwidthEstimator) {
+				m_bandwidthEstimator->OnArrivalReport(GetTimestampUs(), *report);
+			}
 		}
 	}
 
 	uint64_t now = GetTimestampUs();
 	if (now - m_LastStatisticsUpdate > STATISTICS_TIMEOUT_US)
 	{
+		uint64_t targetBitrate = 0;
+		uint64_t queueingDelay = 0;
+		{
+			std::unique_lock lock(m_bandwidthMutex);
+			if (m_bandwidthEstimator) {
+				targetBitrate = m_bandwidthEstimator->GetTargetBitrate();
+				queueingDelay = m_bandwidthEstimator->GetQueueingDelayUs();
+			}
+		}
 		Info("#{ \"id\": \"Statistics\", \"data\": {"
 			"\"totalPackets\": %llu, "
 			"\"packetRate\": %llu, "
@@ -214,6 +597,13 @@ void ClientConnection::ProcessRecv(unsigned char *buf, size_t len) {
 			"\"transportLatency\": %f, "
 			"\"decodeLatency\": %f, "
 			"\"fecPercentage\": %d, "
+			"\"targetBitrate\": %f, "
+			"\"queueingDelay\": %f, "
+			"\"convertStageLatency\": %f, "
+			"\"encodeStageLatency\": %f, "
+			"\"sendStageLatency\": %f, "
+			"\"encodeQueueDepth\": %llu, "
+			"\"sendQueueDepth\": %llu, "
 			"\"fecFailureTotal\": %llu, "
 			"\"fecFailureInSecond\": %llu, "
 			"\"clientFPS\": %d, "
@@ -230,6 +620,13 @@ void ClientConnection::ProcessRecv(unsigned char *buf, size_t len) {
 			(double)(m_Statistics->GetEncodeLatencyMax()) / US_TO_MS,
 			m_reportedStatistics.averageTransportLatency / 1000.0,
 			m_reportedStatistics.averageDecodeLatency / 1000.0, m_fecPercentage,
+			targetBitrate / 1000. / 1000.,
+			queueingDelay / 1000.,
+			m_Statistics->GetPipelineLatencyAverage(Statistics::STAGE_CONVERT) / 1000.,
+			m_Statistics->GetPipelineLatencyAverage(Statistics::STAGE_ENCODE) / 1000.,
+			m_Statistics->GetPipelineLatencyAverage(Statistics::STAGE_SEND) / 1000.,
+			m_Statistics->GetPipelineQueueDepthMax(Statistics::STAGE_ENCODE),
+			m_Statistics->GetPipelineQueueDepthMax(Statistics::STAGE_SEND),
 			m_reportedStatistics.fecFailureTotal,
 			m_reportedStatistics.fecFailureInSecond,
 			m_reportedStatistics.fps,
@@ -258,15 +655,29 @@ uint64_t ClientConnection::serverToClientTime(uint64_t serverTime) const {
 
 void ClientConnection::OnFecFailure() {
 	Debug("Listener::OnFecFailure()\n");
-	if (GetTimestampUs() - m_lastFecFailure < CONTINUOUS_FEC_FAILURE) {
-		if (m_fecPercentage < MAX_FEC_PERCENTAGE) {
-			m_fecPercentage += 5;
-		}
+	{
+		std::unique_lock lock(m_fecPolicyMutex);
+		m_fecPolicy->OnFecFailure(GetTimestampUs());
 	}
-	m_lastFecFailure = GetTimestampUs();
 	m_PacketLossCallback();
 }
 
+uint64_t ClientConnection::GetTargetBitrate() {
+	std::unique_lock lock(m_bandwidthMutex);
+	if (!m_bandwidthEstimator) {
+		return 0;
+	}
+	return m_bandwidthEstimator->GetTargetBitrate();
+}
+
+void ClientConnection::DisableAdaptiveBitrate() {
+	std::unique_lock lock(m_bandwidthMutex);
+	if (m_bandwidthEstimator) {
+		Info("The encoder cannot change its bitrate, adaptive bitrate is disabled.\n");
+		m_bandwidthEstimator.reset();
+	}
+}
+
 std::shared_ptr<Statistics> ClientConnection::GetStatistics() {
 	return m_Statistics;
 }
@@ -1,22 +1,40 @@
 #pragma once
 
+#include <condition_variable>
 #include <functional>
 #include <memory>
 #include <fstream>
 #include <mutex>
+#include <thread>
+#include <vector>
 
 #include "ALVR-common/packet_types.h"
+#include "bindings.h"
 
 class Statistics;
+class FecPolicy;
+class BandwidthEstimator;
+class PacketPacer;
+class MtuProber;
+class VideoFrameBuffer;
 
 class ClientConnection {
 public:
 
-	ClientConnection(std::function<void()> poseUpdatedCallback, std::function<void()> packetLossCallback);
+	ClientConnection(std::function<void()> poseUpdatedCallback, std::function<void()> packetLossCallback, std::function<void(uint64_t)> frameAckCallback);
 	~ClientConnection();
 
-	void FECSend(uint8_t *buf, int len, uint64_t frameIndex, uint64_t videoFrameIndex);
-	void SendVideo(uint8_t *buf, int len, uint64_t frameIndex);
+	void FECSend(VideoFrameBuffer *frame, uint64_t frameIndex, uint64_t videoFrameIndex, int sliceIndex, bool lastSlice, bool recoveryFrame);
+	void SendFecRepair(uint64_t videoFrameIndex, int sliceIndex, uint32_t parityShards);
+	// Sends the video packets again if they are still in m_sentPackets, requests an IDR otherwise.
+	void RetransmitVideoPackets(uint32_t fromPacketCounter, uint32_t toPacketCounter);
+	// Takes over the reference to frame.
+	void SendVideo(VideoFrameBuffer *frame, uint64_t frameIndex, bool recoveryFrame);
+	// Sends one slice of the frame as its own FEC group, without waiting for the rest of the
+	// frame. Slices must be sent in order. Takes over the reference to slice.
+	void SendVideoSlice(VideoFrameBuffer *slice, uint64_t frameIndex, int sliceIndex, bool lastSlice, bool recoveryFrame);
+	// recoveryFrame: the frame only references frames the client acknowledged, see IDRScheduler.
+	void SendVideo(uint8_t *buf, int len, uint64_t frameIndex, bool recoveryFrame);
 	void SendAudio(uint8_t *buf, int len, uint64_t presentationTime);
 	void SendHapticsFeedback(uint64_t startTime, float amplitude, float duration, float frequency, uint8_t hand);
 	void ProcessRecv(unsigned char *buf, size_t len);
@@ -25,35 +43,109 @@ public:
 	uint64_t clientToServerTime(uint64_t clientTime) const;
 	uint64_t serverToClientTime(uint64_t serverTime) const;
 	void OnFecFailure();
+	// Bitrate the encoder should use in bits per second, 0 without adaptive bitrate.
+	uint64_t GetTargetBitrate();
+	// For encoders that cannot change their bitrate while encoding. Stops the bandwidth estimation.
+	void DisableAdaptiveBitrate();
 	std::shared_ptr<Statistics> GetStatistics();
 private:
+	void QueueVideoPacket(VideoFrameBuffer *frame, VideoFrame &header, int fecIndex);
+	void FlushVideoPackets(VideoFrameBuffer *frame, bool urgent);
+	void PacerThread();
+	void ReleaseExpiredPackets(uint64_t now);
+	void SendMtuProbes(uint64_t now);
+	// Applies the packet size found by m_mtuProber to the next frames. Called with m_mtuMutex held.
+	void UpdateVideoPacketSize();
+
 	bool m_bExiting;
 	std::shared_ptr<Statistics> m_Statistics;
 
 	std::ofstream outfile;
 
-	// Maximum UDP payload
-	static const int PACKET_SIZE = 1400;
 	static const int64_t REQUEST_TIMEOUT = 5 * 1000 * 1000;
 	static const int64_t CONNECTION_TIMEOUT = 5 * 1000 * 1000;
 	static const int64_t STATISTICS_TIMEOUT_US = 1000 * 1000;
+	// Frames sent in the rateless FEC mode are repaired for this long.
+	static const uint64_t RATELESS_FEC_DEADLINE_US = 100 * 1000;
+	static const int RATELESS_FEC_HISTORY = 4;
+	// Video packets kept for retransmission.
+	static const int RETRANSMIT_HISTORY = 4096;
+	// Older packets are not sent again, the client has given up on their frame by then.
+	static const uint64_t RETRANSMIT_DEADLINE_US = 50 * 1000;
 
 	uint32_t videoPacketCounter = 0;
 	uint32_t soundPacketCounter = 0;
 
 	std::function<void()> m_PoseUpdatedCallback;
 	std::function<void()> m_PacketLossCallback;
+	// Called with the tracking frame index of the frames acknowledged by the client.
+	std::function<void(uint64_t)> m_FrameAckCallback;
 	TrackingInfo m_TrackingInfo;
 
 	uint64_t m_TimeDiff = 0;
 	std::mutex m_CS;
 
 	TimeSync m_reportedStatistics;
-	uint64_t m_lastFecFailure = 0;
-	static const uint64_t CONTINUOUS_FEC_FAILURE = 60 * 1000 * 1000;
-	static const int INITIAL_FEC_PERCENTAGE = 5;
-	static const int MAX_FEC_PERCENTAGE = 10;
-	int m_fecPercentage = INITIAL_FEC_PERCENTAGE;
+	std::unique_ptr<FecPolicy> m_fecPolicy;
+	std::mutex m_fecPolicyMutex;
+	// Last percentage chosen by m_fecPolicy, for statistics.
+	int m_fecPercentage = 0;
+
+	// Only set with adaptive bitrate, guarded by m_bandwidthMutex. Fed with every video packet sent
+	// and the arrival reports.
+	std::unique_ptr<BandwidthEstimator> m_bandwidthEstimator;
+	std::mutex m_bandwidthMutex;
+
+	// Video packets of the frame being sent. They point into its VideoFrameBuffer.
+	std::vector<LegacySendPacket> m_sendPackets;
+	// Held while sending video packets, FECSend and SendFecRepair share m_sendPackets.
+	std::mutex m_fecSendMutex;
+
+	// Only set when packet pacing is enabled. Paced packets are sent by m_pacerThread.
+	std::unique_ptr<PacketPacer> m_pacer;
+	std::mutex m_pacerMutex;
+	std::condition_variable m_pacerCondition;
+	std::thread m_pacerThread;
+	// Used by m_pacerThread only.
+	std::vector<LegacySendPacket> m_pacedPackets;
+
+	// Only set when probing the path MTU, with compact video packets.
+	std::unique_ptr<MtuProber> m_mtuProber;
+	std::mutex m_mtuMutex;
+	int m_videoPacketSize = ALVR_MAX_PACKET_SIZE;
+	std::vector<int> m_probeSizes;
+	std::vector<unsigned char> m_probeBuffer;
+
+	// Recently sent video packets, indexed by packetCounter % RETRANSMIT_HISTORY. Each entry
+	// holds a reference to the frame buffer the packet points into.
+	struct SentPacket {
+		uint32_t packetCounter;
+		uint64_t sentTime;
+		VideoFrameBuffer *frame = nullptr;
+		LegacySendPacket packet;
+	};
+	std::vector<SentPacket> m_sentPackets;
+	// Oldest packet of m_sentPackets that may still hold a reference.
+	uint32_t m_oldestSentPacket = 0;
+
+	// Frame (or slice of a frame) sent in the rateless FEC mode. Its buffer is kept to compute more
+	// parity.
+	struct RatelessFrame {
+		VideoFrameBuffer *buffer = nullptr;
+		uint64_t videoFrameIndex = 0;
+		int sliceIndex;
+		bool lastSlice;
+		bool recoveryFrame;
+		uint64_t trackingFrameIndex;
+		uint64_t sentTime;
+		uint16_t fecPercentage;
+		int shardPackets;
+		int dataShards;
+		// Next parity row to send.
+		int nextParityShard;
+		std::shared_ptr<reed_solomon> rs;
+	};
+	RatelessFrame m_ratelessFrames[RATELESS_FEC_HISTORY * ALVR_MAX_VIDEO_SLICES];
 
 	uint64_t mVideoFrameIndex = 1;
 
@@ -0,0 +1,109 @@
+#include "FecPolicy.h"
+
+#include <algorithm>
+#include <cmath>
+
+FixedFecPolicy::FixedFecPolicy(int initialPercentage)
+	: m_fecPercentage(initialPercentage)
+	, m_maxPercentage(initialPercentage + 5)
+{
+}
+
+void FixedFecPolicy::OnFecFailure(uint64_t nowUs)
+{
+	if (nowUs - m_lastFecFailure < CONTINUOUS_FEC_FAILURE) {
+		if (m_fecPercentage < m_maxPercentage) {
+			m_fecPercentage += 5;
+		}
+	}
+	m_lastFecFailure = nowUs;
+}
+
+AdaptiveFecPolicy::AdaptiveFecPolicy(int initialPercentage, int minPercentage, int maxPercentage)
+	: m_initialPercentage(initialPercentage)
+	, m_minPercentage(minPercentage)
+	, m_maxPercentage(maxPercentage)
+{
+	m_fecPercentage = std::clamp(m_initialPercentage, m_minPercentage, m_maxPercentage);
+}
+
+void AdaptiveFecPolicy::CountSecond(uint64_t nowUs)
+{
+	uint64_t second = nowUs / (1000 * 1000);
+	if (second != m_currentSecond) {
+		// The previous second is unknown if nothing was sent during it.
+		m_sentInPreviousSecond = second == m_currentSecond + 1 ? m_sentInSecond : 0;
+		m_sentInSecond = 0;
+		m_currentSecond = second;
+	}
+}
+
+void AdaptiveFecPolicy::OnPacketsSent(uint64_t nowUs, int packets)
+{
+	CountSecond(nowUs);
+	m_sentInSecond += packets;
+}
+
+void AdaptiveFecPolicy::OnReport(uint64_t nowUs, const TimeSync &report)
+{
+	CountSecond(nowUs);
+
+	uint32_t latency = report.averageTransportLatency;
+	if (latency != 0) {
+		if (m_baseTransportLatency == 0 || latency < m_baseTransportLatency) {
+			m_baseTransportLatency = latency;
+		} else {
+			// Let the baseline follow slow route changes.
+			m_baseTransportLatency += (latency - m_baseTransportLatency) / 64;
+		}
+		m_congested = latency > m_baseTransportLatency * CONGESTION_RATIO + CONGESTION_SLACK_US;
+	}
+
+	if (m_sentInPreviousSecond == 0) {
+		// Idle stream, nothing to learn from.
+		return;
+	}
+	double sample = std::min(1., (double)report.packetsLostInSecond / m_sentInPreviousSecond);
+
+	if (m_hasReport) {
+		double alpha = 1. - std::exp(-(double)(nowUs - m_lastReportTime) / LOSS_TIME_CONSTANT_US);
+		m_lossRate += alpha * (sample - m_lossRate);
+	} else {
+		m_lossRate = sample;
+	}
+
+	if (report.fecFailureInSecond > 0 && m_lossRate * 100. < m_fecPercentage) {
+		// Frames were lost although the parity covered the average loss: losses come in bursts.
+		m_burstLength = std::min(MAX_BURST_LENGTH, m_burstLength * 1.5);
+	} else if (report.fecFailureInSecond == 0) {
+		m_burstLength = std::max(1., m_burstLength * 0.9);
+	}
+
+	m_hasReport = true;
+	m_lastReportTime = nowUs;
+}
+
+void AdaptiveFecPolicy::OnFecFailure(uint64_t nowUs)
+{
+	m_failureBoost = m_failureBoost * std::exp2(-(double)(nowUs - m_lastFecFailure) / FAILURE_BOOST_HALF_LIFE_US) + FAILURE_BOOST;
+	m_lastFecFailure = nowUs;
+}
+
+int AdaptiveFecPolicy::GetFecPercentage(uint64_t nowUs)
+{
+	double boost = m_failureBoost * std::exp2(-(double)(nowUs - m_lastFecFailure) / FAILURE_BOOST_HALF_LIFE_US);
+
+	double target;
+	if (m_hasReport) {
+		target = m_lossRate * m_burstLength * SAFETY_MARGIN * 100. + boost;
+	} else {
+		target = m_initialPercentage + boost;
+	}
+
+	int percentage = (int)std::ceil(target);
+	if (m_congested && percentage > m_fecPercentage) {
+		percentage = m_fecPercentage;
+	}
+	m_fecPercentage = std::clamp(percentage, m_minPercentage, m_maxPercentage);
+	return m_fecPercentage;
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <stdint.h>
+#include "ALVR-common/packet_types.h"
+
+// Chooses the FEC percentage of each video frame from the feedback of the client.
+// Time is always passed by the caller (in microseconds) so that policies can be driven by a
+// simulated clock.
+class FecPolicy
+{
+public:
+	virtual ~FecPolicy() {}
+
+	// Video packets (data and parity) sent by FECSend.
+	virtual void OnPacketsSent(uint64_t nowUs, int packets) = 0;
+	// Statistics sent by the client once per second (TimeSync with mode=0).
+	virtual void OnReport(uint64_t nowUs, const TimeSync &report) = 0;
+	// The client could not recover a video frame.
+	virtual void OnFecFailure(uint64_t nowUs) = 0;
+
+	virtual int GetFecPercentage(uint64_t nowUs) = 0;
+};
+
+// Previous behaviour: start at the initial percentage and add 5% when FEC failures happen within a
+// minute of each other, up to 5% more. The percentage is never lowered.
+class FixedFecPolicy : public FecPolicy
+{
+public:
+	FixedFecPolicy(int initialPercentage = INITIAL_FEC_PERCENTAGE);
+
+	void OnPacketsSent(uint64_t, int) override {}
+	void OnReport(uint64_t, const TimeSync &) override {}
+	void OnFecFailure(uint64_t nowUs) override;
+	int GetFecPercentage(uint64_t) override { return m_fecPercentage; }
+
+private:
+	static const uint64_t CONTINUOUS_FEC_FAILURE = 60 * 1000 * 1000;
+	static const int INITIAL_FEC_PERCENTAGE = 5;
+
+	uint64_t m_lastFecFailure = 0;
+	int m_fecPercentage;
+	int m_maxPercentage;
+};
+
+// Follows the measured loss rate, in both directions.
+// The loss rate is the number of packets the client reported lost in the last second over the
+// number of video packets sent in the same second, smoothed over a few seconds. It is scaled by
+// an estimate of the burst length, which grows when frames fail while the parity should have
+// covered the average loss, and shrinks back to 1 otherwise. Each FEC failure also adds a boost
+// that fades out over a few seconds.
+// When the transport latency rises well above its baseline, losses are likely caused by
+// congestion, which more parity would make worse, so the percentage is not raised then.
+class AdaptiveFecPolicy : public FecPolicy
+{
+public:
+	AdaptiveFecPolicy(int initialPercentage = INITIAL_FEC_PERCENTAGE, int minPercentage = MIN_FEC_PERCENTAGE, int maxPercentage = MAX_FEC_PERCENTAGE);
+
+	void OnPacketsSent(uint64_t nowUs, int packets) override;
+	void OnReport(uint64_t nowUs, const TimeSync &report) override;
+	void OnFecFailure(uint64_t nowUs) override;
+	int GetFecPercentage(uint64_t nowUs) override;
+
+	double GetLossRate() const { return m_lossRate; }
+	double GetBurstLength() const { return m_burstLength; }
+
+	static constexpr int INITIAL_FEC_PERCENTAGE = 5;
+	static constexpr int MIN_FEC_PERCENTAGE = 1;
+	static constexpr int MAX_FEC_PERCENTAGE = 50;
+
+private:
+	void CountSecond(uint64_t nowUs);
+
+	static constexpr double LOSS_TIME_CONSTANT_US = 3. * 1000 * 1000;
+	static constexpr double FAILURE_BOOST = 5.;
+	static constexpr double FAILURE_BOOST_HALF_LIFE_US = 5. * 1000 * 1000;
+	static constexpr double MAX_BURST_LENGTH = 8.;
+	static constexpr double SAFETY_MARGIN = 2.;
+	// Latency above baseline * CONGESTION_RATIO + CONGESTION_SLACK_US is considered congestion.
+	static constexpr double CONGESTION_RATIO = 1.5;
+	static constexpr uint32_t CONGESTION_SLACK_US = 5000;
+
+	int m_initialPercentage;
+	int m_minPercentage;
+	int m_maxPercentage;
+
+	uint64_t m_currentSecond = 0;
+	uint64_t m_sentInSecond = 0;
+	uint64_t m_sentInPreviousSecond = 0;
+
+	bool m_hasReport = false;
+	uint64_t m_lastReportTime = 0;
+	double m_lossRate = 0.;
+	double m_burstLength = 1.;
+	uint32_t m_baseTransportLatency = 0;
+	bool m_congested = false;
+
+	double m_failureBoost = 0.;
+	uint64_t m_lastFecFailure = 0;
+
+	int m_fecPercentage;
+};
@@ -1,6 +1,7 @@
 #include "IDRScheduler.h"
 
 #include "Utils.h"
+#include "Logger.h"
 #include <mutex>
 
 IDRScheduler::IDRScheduler()
@@ -16,19 +17,25 @@ void IDRScheduler::OnPacketLoss()
 {
 	std::unique_lock lock(m_mutex);
 
-	if (m_scheduled) {
-		// Waiting next insertion.
-		return;
-	}
-	if (GetTimestampUs() - m_insertIDRTime > m_minIDRFrameInterval) {
-		// Insert immediately
-		m_insertIDRTime = GetTimestampUs();
-		m_scheduled = true;
-	}
-	else {
-		// Schedule next insertion.
-		m_insertIDRTime += m_minIDRFrameInterval;
-		m_scheduled = true;
+	// Handled when the next frame is encoded, with an IDR or from an acknowledged frame.
+	m_lossPending = true;
+	// Frames sent until then may reference the lost frame.
+	m_firstAckableFrame = UINT64_MAX;
+}
+
+void IDRScheduler::OnFrameAck(uint64_t frameIndex)
+{
+	std::unique_lock lock(m_mutex);
+
+	// Several frames can share a tracking frame index, the oldest one is assumed.
+	for (uint64_t frameNumber = m_nextFrameNumber > FRAME_HISTORY ? m_nextFrameNumber - FRAME_HISTORY : 1;
+		frameNumber < m_nextFrameNumber; frameNumber++) {
+		if (m_frameIndices[frameNumber % FRAME_HISTORY] == frameIndex) {
+			if (frameNumber >= m_firstAckableFrame && frameNumber > m_ackedFrame) {
+				m_ackedFrame = frameNumber;
+			}
+			return;
+		}
 	}
 }
 
@@ -50,9 +57,46 @@ void IDRScheduler::InsertIDR()
 	m_scheduled = true;
 }
 
+void IDRScheduler::SetIntraRefresh(int period)
+{
+	std::unique_lock lock(m_mutex);
+
+	m_refreshPeriod = period;
+}
+
+void IDRScheduler::ScheduleIDR()
+{
+	if (m_scheduled) {
+		// Waiting next insertion.
+		return;
+	}
+	if (GetTimestampUs() - m_insertIDRTime > m_minIDRFrameInterval) {
+		// Insert immediately
+		m_insertIDRTime = GetTimestampUs();
+		m_scheduled = true;
+	}
+	else {
+		// Schedule next insertion.
+		m_insertIDRTime += m_minIDRFrameInterval;
+		m_scheduled = true;
+	}
+}
+
 bool IDRScheduler::CheckIDRInsertion() {
 	std::unique_lock lock(m_mutex);
 
+	return CheckIDRInsertionLocked();
+}
+
+bool IDRScheduler::CheckIDRInsertionLocked() {
+	if (m_lossPending) {
+		m_lossPending = false;
+		if (m_refreshPeriod > 0) {
+			m_refreshLossPending = true;
+		} else {
+			ScheduleIDR();
+		}
+	}
 	if (m_scheduled) {
 		if (m_insertIDRTime <= GetTimestampUs()) {
 			m_scheduled = false;
@@ -61,3 +105,62 @@ bool IDRScheduler::CheckIDRInsertion() {
 	}
 	return false;
 }
+
+EncodeFrameInfo IDRScheduler::NextFrame(uint64_t frameIndex, int maxInvalidatedFrames) {
+	std::unique_lock lock(m_mutex);
+
+	EncodeFrameInfo info = {};
+	info.frameNumber = m_nextFrameNumber++;
+	info.invalidateFrom = 1;
+	info.invalidateTo = 0;
+	m_frameIndices[info.frameNumber % FRAME_HISTORY] = frameIndex;
+
+	if (m_lossPending && !m_scheduled && m_ackedFrame != 0
+		&& info.frameNumber - m_ackedFrame <= (uint64_t)maxInvalidatedFrames + 1) {
+		// Predict from the last acknowledged frame, which is still a reference of the encoder.
+		m_lossPending = false;
+		info.invalidateFrom = m_ackedFrame + 1;
+		info.invalidateTo = info.frameNumber - 1;
+		info.recoveryFrame = true;
+		Debug("Recovering from packet loss. frameNumber=%llu ackedFrame=%llu\n", info.frameNumber, m_ackedFrame);
+	}
+
+	info.insertIDR = CheckIDRInsertionLocked();
+	if (info.insertIDR) {
+		// The references are reset.
+		info.invalidateFrom = 1;
+		info.invalidateTo = 0;
+		info.recoveryFrame = false;
+		m_ackedFrame = 0;
+	}
+	if (info.insertIDR || info.recoveryFrame) {
+		m_firstAckableFrame = info.frameNumber;
+	}
+	return info;
+}
+
+bool IDRScheduler::CheckRefreshRecovery(bool idr) {
+	std::unique_lock lock(m_mutex);
+
+	if (m_refreshPeriod <= 0 || idr) {
+		m_refreshFrames = 0;
+		m_refreshRecoveryFrame = 0;
+		m_refreshLossPending = false;
+		return false;
+	}
+	m_refreshFrames++;
+	if (m_refreshLossPending) {
+		// Wave j sweeps the frames (j - 1) * period + 1 to j * period after the IDR. A wave already
+		// running when the loss was reported may reference the lost frame, the first wave that
+		// starts at this frame or later does not. A later loss moves the recovery to a later wave.
+		m_refreshLossPending = false;
+		uint64_t period = m_refreshPeriod;
+		m_refreshRecoveryFrame = (m_refreshFrames + 2 * period - 2) / period * period;
+	}
+	if (m_refreshRecoveryFrame != 0 && m_refreshFrames == m_refreshRecoveryFrame) {
+		m_refreshRecoveryFrame = 0;
+		Debug("Intra refresh recovered from packet loss. frames=%llu\n", m_refreshFrames);
+		return true;
+	}
+	return false;
+}
@@ -4,6 +4,19 @@
 #include <mutex>
 #include "Settings.h"
 
+// How the encoder should code the next frame.
+struct EncodeFrameInfo {
+	// Incremented for every frame given to the encoder. Encoders that can invalidate references use
+	// it as the timestamp of the frame.
+	uint64_t frameNumber;
+	bool insertIDR;
+	// Frames the encoder must not reference anymore, none if invalidateFrom > invalidateTo.
+	uint64_t invalidateFrom;
+	uint64_t invalidateTo;
+	// The frame only references frames the client acknowledged.
+	bool recoveryFrame;
+};
+
 class IDRScheduler
 {
 public:
@@ -11,16 +24,52 @@ public:
 	~IDRScheduler();
 
 	void OnPacketLoss();
+	// The client received the frame with this tracking frame index and everything it references.
+	void OnFrameAck(uint64_t frameIndex);
 
 	void OnStreamStart();
 	void InsertIDR();
+	// With a periodic intra refresh of period frames, the next refresh wave repairs losses and they
+	// do not insert an IDR. Requested IDRs are still inserted. 0 disables it.
+	void SetIntraRefresh(int period);
 
+	// For encoders that cannot invalidate references: a loss always costs an IDR.
 	bool CheckIDRInsertion();
+	// For encoders that can stop referencing the frames after the last acknowledged one, at most
+	// maxInvalidatedFrames of them. A loss only costs an IDR if no acknowledged frame is recent
+	// enough.
+	EncodeFrameInfo NextFrame(uint64_t frameIndex, int maxInvalidatedFrames);
+	// With intra refresh, called for every frame after CheckIDRInsertion(). True if the frame ends
+	// the first full refresh wave that started after the last loss: the picture is clean again.
+	// Waves cannot be restarted on demand, they start every period frames after the last IDR.
+	bool CheckRefreshRecovery(bool idr);
 private:
+	bool CheckIDRInsertionLocked();
+	void ScheduleIDR();
+
 	static const int MIN_IDR_FRAME_INTERVAL = 100 * 1000; // 100-milliseconds
 	static const int MIN_IDR_FRAME_INTERVAL_AGGRESSIVE = 5 * 1000; // 5-milliseconds (less than screen refresh interval)
+	// Encoded frames remembered to match the acknowledgements.
+	static const int FRAME_HISTORY = 64;
 	uint64_t m_insertIDRTime = 0;
 	bool m_scheduled = false;
 	std::mutex m_mutex;
 	uint64_t m_minIDRFrameInterval = MIN_IDR_FRAME_INTERVAL;
+
+	// A loss was reported and is not handled yet.
+	bool m_lossPending = false;
+	int m_refreshPeriod = 0;
+	// A loss was handled by the intra refresh and its recovery frame is not known yet.
+	bool m_refreshLossPending = false;
+	// Frames since the last IDR, and the one that ends the recovery wave, 0 if none.
+	uint64_t m_refreshFrames = 0;
+	uint64_t m_refreshRecoveryFrame = 0;
+	uint64_t m_nextFrameNumber = 1;
+	// Tracking frame index of the frames given to NextFrame(), indexed by frameNumber % FRAME_HISTORY.
+	uint64_t m_frameIndices[FRAME_HISTORY] = {};
+	// Acknowledgements of older frames are ignored, they may have been invalidated. UINT64_MAX while
+	// a loss is pending.
+	uint64_t m_firstAckableFrame = 0;
+	// Last acknowledged frame number, 0 if none since the last IDR.
+	uint64_t m_ackedFrame = 0;
 };
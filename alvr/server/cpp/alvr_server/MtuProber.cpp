@@ -0,0 +1,51 @@
+#include "MtuProber.h"
+
+#include <algorithm>
+
+namespace {
+	// MTUs of Ethernet, of FDDI and of jumbo Ethernet frames, the common steps of local networks.
+	const int LINK_MTUS[] = { 1500, 4352, 9000 };
+	// IPv6 and UDP headers, and the stream ID, packet index and length prefix of the stream socket.
+	const int PACKET_OVERHEAD = 40 + 8 + 9;
+}
+
+MtuProber::MtuProber(int baseSize, int maxSize)
+	: m_baseSize(baseSize)
+	, m_packetSize(baseSize)
+{
+	for (int mtu : LINK_MTUS) {
+		int size = mtu - PACKET_OVERHEAD;
+		if (size > baseSize && size < maxSize) {
+			m_candidates.push_back(size);
+		}
+	}
+	if (maxSize > baseSize) {
+		m_candidates.push_back(maxSize);
+	}
+}
+
+void MtuProber::Poll(uint64_t nowUs, uint32_t &round, std::vector<int> &sizes)
+{
+	sizes.clear();
+	if (m_candidates.empty() || nowUs < m_nextRoundTime) {
+		return;
+	}
+	if (m_round > 0) {
+		m_packetSize = std::max(m_roundAckedSize, m_baseSize);
+	}
+	m_round++;
+	m_roundAckedSize = 0;
+	m_nextRoundTime = nowUs + PROBE_INTERVAL_US;
+
+	round = m_round;
+	sizes = m_candidates;
+}
+
+void MtuProber::OnProbeAck(uint32_t round, int size)
+{
+	if (round != m_round || std::find(m_candidates.begin(), m_candidates.end(), size) == m_candidates.end()) {
+		return;
+	}
+	m_roundAckedSize = std::max(m_roundAckedSize, size);
+	m_packetSize = std::max(m_packetSize, size);
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+// Finds the largest video packet that reaches the client, in the manner of datagram packetization
+// layer path MTU discovery (RFC 8899). A round of probes padded to the candidate sizes is sent
+// every PROBE_INTERVAL_US, and the client acks each probe it receives. The packet size grows as
+// soon as a larger probe is acked. At the start of the next round it is set to the largest probe
+// acked in the previous one, so that it shrinks again when the path changes, down to the base size
+// when nothing was acked.
+// The probes must be sent without fragmentation, so that a probe larger than the path MTU is lost.
+// Time is always passed by the caller (in microseconds) so that the prober can be driven by a
+// simulated network.
+class MtuProber
+{
+public:
+	// baseSize is assumed to fit any path, the probes are up to maxSize. Sizes are video packet
+	// sizes, headers of the stream socket excluded.
+	MtuProber(int baseSize, int maxSize);
+
+	// Sets sizes to the probes to send now, in increasing order, and round to the round they
+	// belong to. sizes is cleared when there is nothing to send.
+	void Poll(uint64_t nowUs, uint32_t &round, std::vector<int> &sizes);
+	void OnProbeAck(uint32_t round, int size);
+	int GetPacketSize() const { return m_packetSize; }
+
+	static const uint64_t PROBE_INTERVAL_US = 5 * 1000 * 1000;
+
+private:
+	int m_baseSize;
+	// Candidate sizes above the base size, in increasing order.
+	std::vector<int> m_candidates;
+	int m_packetSize;
+
+	uint32_t m_round = 0;
+	uint64_t m_nextRoundTime = 0;
+	// Largest probe acked in the current round, 0 if none.
+	int m_roundAckedSize = 0;
+};
@@ -361,7 +361,7 @@ vr::EVRInitError OvrHmd::Activate(vr::TrackedDeviceIndex_t unObjectId)
 		}
 
 		//create listener
-		m_Listener.reset(new ClientConnection([&]() { OnPoseUpdated(); }, [&]() { OnPacketLoss(); }));
+		m_Listener.reset(new ClientConnection([&]() { OnPoseUpdated(); }, [&]() { OnPacketLoss(); }, [&](uint64_t frameIndex) { OnFrameAck(frameIndex); }));
 
 		// Spin up a separate thread to handle the overlapped encoding/transmit step.
 		if (IsHMD())
@@ -509,6 +509,13 @@ vr::EVRInitError OvrHmd::Activate(vr::TrackedDeviceIndex_t unObjectId)
 		m_encoder->OnPacketLoss();
 	}
 
+	void OvrHmd::OnFrameAck(uint64_t frameIndex) {
+		if (!m_streamComponentsInitialized || IsTrackingRef()) {
+			return;
+		}
+		m_encoder->OnFrameAck(frameIndex);
+	}
+
 	void OvrHmd::OnShutdown() {
 		Info("Sending shutdown signal to vrserver.\n");
 		vr::VREvent_Reserved_t data = {};
@@ -60,6 +60,8 @@ public:
 
 	void OnPacketLoss();
 
+	void OnFrameAck(uint64_t frameIndex);
+
 	void OnShutdown();
 
 	void RequestIDR();
@@ -0,0 +1,117 @@
+#include "PacketPacer.h"
+
+#include <algorithm>
+
+#include "VideoFrameBuffer.h"
+
+PacketPacer::PacketPacer(uint64_t frameIntervalUs, int windowPercentage)
+	: m_windowUs(frameIntervalUs * std::clamp(windowPercentage, 0, 100) / 100)
+{
+	m_batches.reserve(RESERVED_BATCHES);
+	m_freeLists.reserve(RESERVED_BATCHES);
+}
+
+PacketPacer::~PacketPacer()
+{
+	for (auto &batch : m_batches) {
+		batch.frame->Release();
+	}
+}
+
+void PacketPacer::AddBatch(uint64_t nowUs, VideoFrameBuffer *frame, const std::vector<LegacySendPacket> &packets, bool urgent)
+{
+	RecycleSentBatches();
+	if (packets.empty()) {
+		return;
+	}
+
+	Batch batch;
+	batch.startTime = nowUs;
+	batch.windowUs = urgent ? 0 : m_windowUs;
+	batch.urgent = urgent;
+	frame->AddRef();
+	batch.frame = frame;
+	m_largestBatch = std::max(m_largestBatch, packets.size());
+	if (!m_freeLists.empty()) {
+		batch.packets.swap(m_freeLists.back());
+		m_freeLists.pop_back();
+	}
+	// Every list can take the largest batch, so that the lists only grow with it.
+	batch.packets.reserve(m_largestBatch);
+	batch.packets.assign(packets.begin(), packets.end());
+	batch.next = 0;
+	m_batches.push_back(std::move(batch));
+}
+
+void PacketPacer::Poll(uint64_t nowUs, std::vector<Packet> &out)
+{
+	RecycleSentBatches();
+
+	uint64_t releaseLimit = nowUs + QUANTUM_US;
+	while (true) {
+		Batch *earliest = nullptr;
+		uint64_t earliestDeadline = UINT64_MAX;
+		for (auto &batch : m_batches) {
+			if (batch.next < batch.packets.size() && ReleaseTime(batch, batch.next) <= releaseLimit) {
+				uint64_t deadline = Deadline(batch, batch.next);
+				if (deadline < earliestDeadline) {
+					earliest = &batch;
+					earliestDeadline = deadline;
+				}
+			}
+		}
+		if (earliest == nullptr) {
+			break;
+		}
+		out.push_back({ earliest->packets[earliest->next], earliest->frame });
+		earliest->next++;
+	}
+}
+
+uint64_t PacketPacer::GetNextReleaseTime() const
+{
+	uint64_t next = UINT64_MAX;
+	for (auto &batch : m_batches) {
+		if (batch.next < batch.packets.size()) {
+			next = std::min(next, ReleaseTime(batch, batch.next));
+		}
+	}
+	return next;
+}
+
+size_t PacketPacer::GetPendingPackets() const
+{
+	size_t pending = 0;
+	for (auto &batch : m_batches) {
+		pending += batch.packets.size() - batch.next;
+	}
+	return pending;
+}
+
+uint64_t PacketPacer::ReleaseTime(const Batch &batch, size_t packet)
+{
+	return batch.startTime + batch.windowUs * packet / batch.packets.size();
+}
+
+uint64_t PacketPacer::Deadline(const Batch &batch, size_t packet)
+{
+	if (batch.urgent) {
+		return 0;
+	}
+	return batch.startTime + batch.windowUs * (packet + 1) / batch.packets.size();
+}
+
+// Packets returned by the last Poll() may still be in use until the next call, so batches are
+// only dropped here.
+void PacketPacer::RecycleSentBatches()
+{
+	for (auto it = m_batches.begin(); it != m_batches.end();) {
+		if (it->next == it->packets.size()) {
+			it->frame->Release();
+			m_freeLists.push_back(std::move(it->packets));
+			it = m_batches.erase(it);
+		} else {
+			++it;
+		}
+	}
+}
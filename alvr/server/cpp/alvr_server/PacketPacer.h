@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "bindings.h"
+
+class VideoFrameBuffer;
+
+// Spreads the video packets of each frame over a fraction of the frame interval instead of sending
+// them back to back, so that large frames do not overflow the buffers of the access point.
+// Packet i of a batch of n packets is released at start + window * i / n and is due at
+// start + window * (i + 1) / n. Released packets of all batches are sent earliest deadline first,
+// so the tail of a late frame still goes before the next frame. Urgent batches (FEC repair,
+// retransmissions) go before both, in the order they were added.
+// Time is always passed by the caller (in microseconds, from a monotonic clock) so that the
+// pacing can be driven by a simulated clock.
+class PacketPacer
+{
+public:
+	struct Packet {
+		LegacySendPacket packet;
+		VideoFrameBuffer *frame;
+	};
+
+	// windowPercentage: part of the frame interval the packets of a frame are spread over.
+	PacketPacer(uint64_t frameIntervalUs, int windowPercentage);
+	PacketPacer(const PacketPacer &) = delete;
+	PacketPacer &operator=(const PacketPacer &) = delete;
+	~PacketPacer();
+
+	// The packets point into frame, which is referenced until they are all released.
+	// Urgent batches are released immediately.
+	void AddBatch(uint64_t nowUs, VideoFrameBuffer *frame, const std::vector<LegacySendPacket> &packets, bool urgent);
+	// Appends the packets released at nowUs to out, earliest deadline first. Their frames stay
+	// referenced until the next call to AddBatch() or Poll().
+	void Poll(uint64_t nowUs, std::vector<Packet> &out);
+	// UINT64_MAX when there is nothing to send.
+	uint64_t GetNextReleaseTime() const;
+	// Packets added and not released yet, the most the next Poll() can append.
+	size_t GetPendingPackets() const;
+	bool IsEmpty() const { return m_batches.empty(); }
+
+	// Packets released within this time of each other are sent together, which bounds the number
+	// of wakeups of the sending thread.
+	static const uint64_t QUANTUM_US = 250;
+
+private:
+	struct Batch {
+		uint64_t startTime;
+		uint64_t windowUs;
+		bool urgent;
+		VideoFrameBuffer *frame;
+		std::vector<LegacySendPacket> packets;
+		// Next packet to send.
+		size_t next;
+	};
+
+	// Batches in flight the pacer has room for before it allocates: a few frames, their slices and
+	// the retransmissions.
+	static const size_t RESERVED_BATCHES = 64;
+
+	static uint64_t ReleaseTime(const Batch &batch, size_t packet);
+	static uint64_t Deadline(const Batch &batch, size_t packet);
+	void RecycleSentBatches();
+
+	uint64_t m_windowUs;
+	// In the order they were added. A vector, so that the steady state does not allocate.
+	std::vector<Batch> m_batches;
+	// Packet lists of sent batches, kept for their capacity.
+	std::vector<std::vector<LegacySendPacket>> m_freeLists;
+	size_t m_largestBatch = 0;
+};
@@ -88,6 +88,16 @@ void Settings::Load()
 		m_enableViveTrackerProxy = config.get("enable_vive_tracker_proxy").get<bool>();
 
 		m_aggressiveKeyframeResend = config.get("aggressive_keyframe_resend").get<bool>();
+		m_fecLargeBlocks = config.get("fec_large_blocks").get<bool>();
+		m_fecRateless = config.get("fec_rateless").get<bool>();
+		m_adaptiveFec = config.get("adaptive_fec").get<bool>();
+		m_fecInterPercentage = (int)config.get("fec_inter_percentage").get<int64_t>();
+		m_fecIdrPercentage = (int)config.get("fec_idr_percentage").get<int64_t>();
+		m_fecParameterSetsPercentage = (int)config.get("fec_parameter_sets_percentage").get<int64_t>();
+		m_packetPacingPercentage = (int)config.get("packet_pacing_percentage").get<int64_t>();
+		m_compactVideoPackets = config.get("compact_video_packets").get<bool>();
+		m_maxVideoPacketSize = (int)config.get("max_video_packet_size").get<int64_t>();
+		m_mtuProbing = config.get("mtu_probing").get<bool>();
 
 		m_nAdapterIndex = (int32_t)config.get("adapter_index").get<int64_t>();
 
@@ -95,6 +105,15 @@ void Settings::Load()
 		m_refreshRate = (int)config.get("refresh_rate").get<int64_t>();
 		mEncodeBitrateMBs = (int)config.get("encode_bitrate_mbs").get<int64_t>();
 		m_use10bitEncoder = config.get("use_10bit_encoder").get<bool>();
+		m_encoderSlices = (int)config.get("encoder_slices").get<int64_t>();
+		m_splitEyeEncoding = config.get("split_eye_encoding").get<bool>();
+		m_enableIntraRefresh = config.get("enable_intra_refresh").get<bool>();
+		m_intraRefreshFrames = (int)config.get("intra_refresh_frames").get<int64_t>();
+		m_enableAdaptiveBitrate = config.get("enable_adaptive_bitrate").get<bool>();
+		m_adaptiveBitrateMinMBs = config.get("adaptive_bitrate_min_mbs").get<int64_t>();
+		m_convertThreadCpu = (int)config.get("convert_thread_cpu").get<int64_t>();
+		m_encodeThreadCpu = (int)config.get("encode_thread_cpu").get<int64_t>();
+		m_sendThreadCpu = (int)config.get("send_thread_cpu").get<int64_t>();
 
 		m_controllerTrackingSystemName = config.get("controllers_tracking_system_name").get<std::string>();
 		m_controllerManufacturerName = config.get("controllers_manufacturer_name").get<std::string>();
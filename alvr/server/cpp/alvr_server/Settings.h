@@ -61,6 +61,22 @@ public:
 	int m_codec;
 	uint64_t mEncodeBitrateMBs;
 	bool m_use10bitEncoder;
+	// Slices per frame. With more than one, each slice is sent as its own FEC group.
+	int m_encoderSlices;
+	// One software encoder per eye, running in parallel. Each eye is a stream of its own, sent
+	// after the other in the same frame.
+	bool m_splitEyeEncoding;
+	// Periodic intra refresh over m_intraRefreshFrames frames instead of keyframes.
+	bool m_enableIntraRefresh;
+	int m_intraRefreshFrames;
+	// The bitrate follows the bandwidth estimated from the packet arrival times reported by the
+	// client, between m_adaptiveBitrateMinMBs and mEncodeBitrateMBs.
+	bool m_enableAdaptiveBitrate;
+	uint64_t m_adaptiveBitrateMinMBs;
+	// CPU the threads of the Linux encoding pipeline are pinned to, -1 to let them run anywhere.
+	int m_convertThreadCpu;
+	int m_encodeThreadCpu;
+	int m_sendThreadCpu;
 
 	// Controller configs
 	std::string m_controllerTrackingSystemName;
@@ -85,14 +101,25 @@ public:
 
 	float m_hapticsIntensity;
 
-	int32_t m_causePacketLoss;
-
 	int32_t m_trackingFrameOffset;
 
 	bool m_force3DOF;
 
 	bool m_aggressiveKeyframeResend;
 
+	bool m_fecLargeBlocks;
+	bool m_fecRateless;
+	bool m_adaptiveFec;
+	int m_fecInterPercentage;
+	int m_fecIdrPercentage;
+	int m_fecParameterSetsPercentage;
+	int m_packetPacingPercentage;
+	// Video packets with the compact header, of up to m_maxVideoPacketSize bytes. With
+	// m_mtuProbing, the size grows from ALVR_MAX_PACKET_SIZE as far as the path MTU allows.
+	bool m_compactVideoPackets;
+	int m_maxVideoPacketSize;
+	bool m_mtuProbing;
+
 	// They are not in config json and set by "SetConfig" command.
 	bool m_captureLayerDDSTrigger = false;
 	bool m_captureComposedDDSTrigger = false;
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <stddef.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+// Bounded queue between exactly one producer thread and one consumer thread.
+// TryPush() and TryPop() never lock: the producer only writes m_tail, the consumer only writes
+// m_head, each on its own cache line. Push() and Pop() try a few more times and then sleep until
+// the other side makes progress. A sleeping side announces itself with its flag, so that the other
+// side only takes the mutex to wake it up when needed.
+// The waits also end when exiting is set, checked at least every WAIT_TIMEOUT.
+template <typename T>
+class SpscQueue
+{
+public:
+	// The capacity is rounded up to a power of two.
+	explicit SpscQueue(size_t capacity) {
+		size_t size = 1;
+		while (size < capacity) {
+			size *= 2;
+		}
+		m_items.resize(size);
+		m_mask = size - 1;
+	}
+	SpscQueue(const SpscQueue &) = delete;
+	SpscQueue &operator=(const SpscQueue &) = delete;
+
+	bool TryPush(T &&item) {
+		size_t tail = m_tail.load(std::memory_order_relaxed);
+		if (tail - m_head.load(std::memory_order_acquire) == m_items.size()) {
+			return false;
+		}
+		m_items[tail & m_mask] = std::move(item);
+		m_tail.store(tail + 1, std::memory_order_release);
+		WakeUp(m_consumerWaiting);
+		return true;
+	}
+
+	bool TryPop(T &item) {
+		size_t head = m_head.load(std::memory_order_relaxed);
+		if (head == m_tail.load(std::memory_order_acquire)) {
+			return false;
+		}
+		item = std::move(m_items[head & m_mask]);
+		m_head.store(head + 1, std::memory_order_release);
+		WakeUp(m_producerWaiting);
+		return true;
+	}
+
+	// Returns false if exiting was set before the item could be queued.
+	bool Push(T item, const std::atomic_bool &exiting) {
+		return Wait(exiting, m_producerWaiting, [&] { return TryPush(std::move(item)); });
+	}
+
+	// Returns false if exiting was set before an item came.
+	bool Pop(T &item, const std::atomic_bool &exiting) {
+		return Wait(exiting, m_consumerWaiting, [&] { return TryPop(item); });
+	}
+
+	// Exact when called by the producer or the consumer, a snapshot otherwise.
+	size_t Size() const {
+		return m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_acquire);
+	}
+
+	size_t Capacity() const { return m_items.size(); }
+
+private:
+	// Items come at most a few times per frame, spinning longer than this only burns the CPU.
+	static const int SPIN_COUNT = 128;
+	static constexpr std::chrono::milliseconds WAIT_TIMEOUT{10};
+
+	template <typename Try>
+	bool Wait(const std::atomic_bool &exiting, std::atomic_bool &waiting, Try tryOnce) {
+		for (int i = 0; i < SPIN_COUNT; i++) {
+			if (tryOnce()) {
+				return true;
+			}
+		}
+		while (!exiting) {
+			waiting.store(true);
+			// Pairs with the fence of WakeUp(): either the other side sees the flag, or this
+			// attempt sees its progress.
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (tryOnce()) {
+				waiting.store(false);
+				return true;
+			}
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_condition.wait_for(lock, WAIT_TIMEOUT, [&] { return !waiting.load() || exiting; });
+		}
+		waiting.store(false);
+		return false;
+	}
+
+	void WakeUp(std::atomic_bool &waiting) {
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (waiting.load(std::memory_order_relaxed)) {
+			std::lock_guard<std::mutex> lock(m_mutex);
+			waiting.store(false);
+			m_condition.notify_all();
+		}
+	}
+
+	std::vector<T> m_items;
+	size_t m_mask;
+	// Free running counters, the slot of an item is its counter & m_mask.
+	alignas(64) std::atomic<size_t> m_head{0};
+	alignas(64) std::atomic<size_t> m_tail{0};
+
+	alignas(64) std::atomic_bool m_producerWaiting{false};
+	std::atomic_bool m_consumerWaiting{false};
+	std::mutex m_mutex;
+	std::condition_variable m_condition;
+};
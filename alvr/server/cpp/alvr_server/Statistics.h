@@ -1,11 +1,20 @@
 #pragma once
 
 #include <algorithm>
+#include <mutex>
 #include <stdint.h>
 #include <time.h>
 
 class Statistics {
 public:
+	// Stages of the pipelined encoder of Linux, each on its own thread.
+	enum PipelineStage {
+		STAGE_CONVERT,
+		STAGE_ENCODE,
+		STAGE_SEND,
+		STAGE_COUNT,
+	};
+
 	Statistics() {
 		ResetAll();
 		m_current = time(NULL);
@@ -50,6 +59,29 @@ public:
 		m_encodeSampleCount++;
 	}
 
+	// latencyUs: from the time the previous stage queued the item (the frame was acquired, for the
+	// first stage) to the time this stage is done with it. queueDepth: items left in the input
+	// queue of the stage when it took the item. Called from the thread of the stage.
+	void PipelineStageOutput(PipelineStage stage, uint64_t latencyUs, size_t queueDepth) {
+		std::unique_lock<std::mutex> lock(m_stageMutex);
+		time_t current = time(NULL);
+		if (m_stageCurrent != current) {
+			m_stageCurrent = current;
+			for (auto &s : m_stages) {
+				StageStatistics previous = s;
+				s = {};
+				s.latencyAveragePrev = previous.sampleCount ? previous.latencyTotalUs / previous.sampleCount : 0;
+				s.latencyMaxPrev = previous.latencyMax;
+				s.queueDepthMaxPrev = previous.queueDepthMax;
+			}
+		}
+		StageStatistics &s = m_stages[stage];
+		s.latencyTotalUs += latencyUs;
+		s.latencyMax = std::max(latencyUs, s.latencyMax);
+		s.queueDepthMax = std::max((uint64_t)queueDepth, s.queueDepthMax);
+		s.sampleCount++;
+	}
+
 	uint64_t GetPacketsSentTotal() {
 		return m_packetsSentTotal;
 	}
@@ -74,6 +106,18 @@ public:
 	uint64_t GetEncodeLatencyMax() {
 		return m_encodeLatencyMaxPrev;
 	}
+	uint64_t GetPipelineLatencyAverage(PipelineStage stage) {
+		std::unique_lock<std::mutex> lock(m_stageMutex);
+		return m_stages[stage].latencyAveragePrev;
+	}
+	uint64_t GetPipelineLatencyMax(PipelineStage stage) {
+		std::unique_lock<std::mutex> lock(m_stageMutex);
+		return m_stages[stage].latencyMaxPrev;
+	}
+	uint64_t GetPipelineQueueDepthMax(PipelineStage stage) {
+		std::unique_lock<std::mutex> lock(m_stageMutex);
+		return m_stages[stage].queueDepthMaxPrev;
+	}
 private:
 	void ResetSecond() {
 		m_packetsSentInSecondPrev = m_packetsSentInSecond;
@@ -125,4 +169,18 @@ private:
 	uint64_t m_encodeLatencyMaxPrev;
 
 	time_t m_current;
+
+	// The stages report from their own threads.
+	struct StageStatistics {
+		uint64_t latencyTotalUs;
+		uint64_t latencyMax;
+		uint64_t queueDepthMax;
+		uint64_t sampleCount;
+		uint64_t latencyAveragePrev;
+		uint64_t latencyMaxPrev;
+		uint64_t queueDepthMaxPrev;
+	};
+	std::mutex m_stageMutex;
+	StageStatistics m_stages[STAGE_COUNT] = {};
+	time_t m_stageCurrent = 0;
 };
\ No newline at end of file
@@ -0,0 +1,189 @@
+#include "VideoFrameBuffer.h"
+
+#include <assert.h>
+#include <string.h>
+#include <algorithm>
+#include <mutex>
+
+namespace {
+	std::mutex g_poolMutex;
+	std::vector<VideoFrameBuffer *> g_pool;
+	// Until SetPoolSize is called.
+	size_t g_poolSize = 32;
+	int g_packetSize = ALVR_MAX_PACKET_SIZE;
+	bool g_compactHeader = false;
+
+	// Stands for the packets past the end of the frame in the last data shard.
+	const uint8_t ZERO_PAYLOAD[ALVR_MAX_JUMBO_PACKET_SIZE] = {};
+}
+
+void VideoFrameBuffer::SetPacketFormat(int packetSize, bool compactHeader) {
+	assert(packetSize <= ALVR_MAX_JUMBO_PACKET_SIZE);
+	assert(compactHeader || packetSize == ALVR_MAX_PACKET_SIZE);
+	std::unique_lock lock(g_poolMutex);
+	g_packetSize = packetSize;
+	g_compactHeader = compactHeader;
+}
+
+void VideoFrameBuffer::SetPoolSize(size_t size) {
+	std::vector<VideoFrameBuffer *> freed;
+	{
+		std::unique_lock lock(g_poolMutex);
+		g_poolSize = size;
+		g_pool.reserve(size);
+		while (g_pool.size() > size) {
+			freed.push_back(g_pool.back());
+			g_pool.pop_back();
+		}
+	}
+	for (auto buffer : freed) {
+		delete buffer;
+	}
+}
+
+VideoFrameBuffer *VideoFrameBuffer::Acquire() {
+	VideoFrameBuffer *buffer = nullptr;
+	int packetSize;
+	bool compactHeader;
+	{
+		std::unique_lock lock(g_poolMutex);
+		if (!g_pool.empty()) {
+			buffer = g_pool.back();
+			g_pool.pop_back();
+		}
+		packetSize = g_packetSize;
+		compactHeader = g_compactHeader;
+	}
+	if (buffer == nullptr) {
+		buffer = new VideoFrameBuffer();
+	}
+	if (buffer->m_packetSize != packetSize) {
+		buffer->m_chunks.clear();
+		buffer->m_packetSize = packetSize;
+	}
+	buffer->m_compactHeader = compactHeader;
+	buffer->m_headerReserve = compactHeader ? ALVR_COMPACT_VIDEO_HEADER_RESERVE : (int)sizeof(VideoFrame);
+	buffer->m_payloadSize = packetSize - buffer->m_headerReserve;
+	buffer->m_refCount = 1;
+	return buffer;
+}
+
+void VideoFrameBuffer::AddRef() {
+	m_refCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+void VideoFrameBuffer::Release() {
+	if (m_refCount.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+		return;
+	}
+	m_frameByteSize = 0;
+	m_copiedBytes = 0;
+	m_shardPackets = 0;
+
+	std::unique_lock lock(g_poolMutex);
+	if (g_pool.size() < g_poolSize) {
+		g_pool.push_back(this);
+	} else {
+		lock.unlock();
+		delete this;
+	}
+}
+
+void VideoFrameBuffer::Append(const uint8_t *data, size_t size) {
+	assert(m_shardPackets == 0);
+
+	while (size > 0) {
+		int packet = (int)(m_frameByteSize / m_payloadSize);
+		size_t offset = m_frameByteSize % m_payloadSize;
+		size_t copyLength = std::min(size, (size_t)m_payloadSize - offset);
+		Reserve(packet + 1);
+		memcpy(GetPayload(packet) + offset, data, copyLength);
+
+		data += copyLength;
+		size -= copyLength;
+		m_frameByteSize += copyLength;
+		m_copiedBytes += copyLength;
+	}
+}
+
+const uint8_t *VideoFrameBuffer::GetFrameStart(int &size) {
+	size = (int)std::min(m_frameByteSize, (size_t)m_payloadSize);
+	return size > 0 ? GetPayload(0) : nullptr;
+}
+
+void VideoFrameBuffer::PrepareFec(int shardPackets, int dataShards, int parityShards) {
+	m_shardPackets = shardPackets;
+	m_dataShards = dataShards;
+	m_parityShards = parityShards;
+	Reserve((dataShards + parityShards) * shardPackets);
+
+	// The code sees whole packets, the end of the last one is zero padding.
+	size_t tail = m_frameByteSize % m_payloadSize;
+	if (tail != 0) {
+		memset(GetPayload(GetDataPackets() - 1) + tail, 0, m_payloadSize - tail);
+	}
+
+	m_dataBlocks.resize(dataShards);
+	m_parityBlocks.resize(parityShards);
+	m_headerSizes.resize((size_t)(dataShards + parityShards) * shardPackets);
+}
+
+void VideoFrameBuffer::EncodeParity(reed_solomon *rs, int firstParity, int count) {
+	assert(firstParity + count <= m_parityShards);
+
+	int dataPackets = GetDataPackets();
+	for (int column = 0; column < m_shardPackets; column++) {
+		for (int i = 0; i < m_dataShards; i++) {
+			int packet = i * m_shardPackets + column;
+			m_dataBlocks[i] = packet < dataPackets ? GetPayload(packet) : (uint8_t *)ZERO_PAYLOAD;
+		}
+		for (int i = 0; i < count; i++) {
+			m_parityBlocks[i] = GetPayload((m_dataShards + firstParity + i) * m_shardPackets + column);
+		}
+		int ret = reed_solomon_encode_parity(rs, &m_dataBlocks[0], &m_parityBlocks[0], firstParity, count, m_payloadSize);
+		assert(ret == 0);
+	}
+}
+
+int VideoFrameBuffer::GetDataPackets() const {
+	return (int)((m_frameByteSize + m_payloadSize - 1) / m_payloadSize);
+}
+
+uint8_t *VideoFrameBuffer::GetPacket(int fecIndex) {
+	return GetPayload(fecIndex) - m_headerSizes[fecIndex];
+}
+
+int VideoFrameBuffer::GetPacketSize(int fecIndex) const {
+	size_t payloadOffset = (size_t)fecIndex * m_payloadSize;
+	if (fecIndex >= m_dataShards * m_shardPackets || m_frameByteSize - payloadOffset >= (size_t)m_payloadSize) {
+		return m_headerSizes[fecIndex] + m_payloadSize;
+	}
+	return (int)(m_headerSizes[fecIndex] + m_frameByteSize - payloadOffset);
+}
+
+void VideoFrameBuffer::SetHeader(int fecIndex, const VideoFrame &header) {
+	if (!m_compactHeader) {
+		memcpy(GetSlot(fecIndex), &header, sizeof(VideoFrame));
+		m_headerSizes[fecIndex] = sizeof(VideoFrame);
+		return;
+	}
+	uint8_t compactHeader[ALVR_COMPACT_VIDEO_HEADER_MAX_SIZE];
+	int size = EncodeCompactVideoHeader(header, m_payloadSize, compactHeader);
+	assert(size <= m_headerReserve);
+	memcpy(GetPayload(fecIndex) - size, compactHeader, size);
+	m_headerSizes[fecIndex] = (uint8_t)size;
+}
+
+void VideoFrameBuffer::Reserve(int packets) {
+	while ((int)m_chunks.size() * CHUNK_PACKETS < packets) {
+		m_chunks.push_back(std::make_unique<uint8_t[]>((size_t)CHUNK_PACKETS * m_packetSize));
+	}
+}
+
+uint8_t *VideoFrameBuffer::GetSlot(int fecIndex) {
+	return &m_chunks[fecIndex / CHUNK_PACKETS][(size_t)(fecIndex % CHUNK_PACKETS) * m_packetSize];
+}
+
+uint8_t *VideoFrameBuffer::GetPayload(int fecIndex) {
+	return GetSlot(fecIndex) + m_headerReserve;
+}
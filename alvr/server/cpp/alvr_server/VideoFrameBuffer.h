@@ -0,0 +1,86 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "ALVR-common/packet_types.h"
+#include "ALVR-common/reedsolomon/rs.h"
+
+// Encoded video frame stored as the packets that carry it. Every slot of the packet size holds
+// room for the header followed by the payload of the packet with the same fecIndex.
+// The encoder output is written once, straight into the payload areas, and the parity is encoded
+// into the slots that follow, so the frame is not copied again before it reaches the socket.
+// Buffers are reference counted. The network thread keeps a reference until the packets are
+// sent, and the rateless FEC mode keeps one to encode more parity later. Released buffers are
+// pooled, so the steady state does not allocate.
+// A buffer keeps the packet format it was acquired with, SetPacketFormat only applies to the
+// buffers acquired afterwards.
+class VideoFrameBuffer {
+public:
+	// packetSize includes the header. VideoFrame headers need ALVR_MAX_PACKET_SIZE, the payload
+	// size the client expects for them. The compact header is written right before the payload,
+	// in the ALVR_COMPACT_VIDEO_HEADER_RESERVE bytes reserved for it.
+	static void SetPacketFormat(int packetSize, bool compactHeader);
+	// Released buffers kept for reuse, beyond which they are freed. It should cover all the buffers
+	// referenced at once, or the steady state allocates.
+	static void SetPoolSize(size_t size);
+	// Returns an empty buffer with a reference count of 1.
+	static VideoFrameBuffer *Acquire();
+	void AddRef();
+	void Release();
+
+	void Append(const uint8_t *data, size_t size);
+	int GetFrameByteSize() const { return (int)m_frameByteSize; }
+	// Beginning of the frame, up to one packet.
+	const uint8_t *GetFrameStart(int &size);
+	// Payload of the full packets.
+	int GetPayloadSize() const { return m_payloadSize; }
+
+	// Lays out the data and parity packets. parityShards is the number of parity rows of the code,
+	// which can be more than the rows encoded at first. The buffer does not move afterwards, so
+	// packets can be handed out while more parity is encoded.
+	void PrepareFec(int shardPackets, int dataShards, int parityShards);
+	// Encodes parity rows [firstParity, firstParity + count) into their packets. The rows of the
+	// code are independent byte by byte, so each packet column is encoded on its own, straight
+	// from the payload of the data packets.
+	void EncodeParity(reed_solomon *rs, int firstParity, int count);
+	int GetDataPackets() const;
+	// The header must be written with SetHeader before the packet is sent, the compact header
+	// moves the beginning of the packet.
+	uint8_t *GetPacket(int fecIndex);
+	int GetPacketSize(int fecIndex) const;
+	void SetHeader(int fecIndex, const VideoFrame &header);
+
+	// Bytes copied into this buffer since it was acquired.
+	uint64_t GetCopiedBytes() const { return m_copiedBytes; }
+
+private:
+	VideoFrameBuffer() {}
+	void Reserve(int packets);
+	uint8_t *GetSlot(int fecIndex);
+	uint8_t *GetPayload(int fecIndex);
+
+	// Packets are allocated in chunks that never move, growing the buffer does not copy it.
+	static const int CHUNK_PACKETS = 64;
+
+	std::atomic<int> m_refCount{ 0 };
+	// Size of the slots, the chunks are allocated again when it changes.
+	int m_packetSize = 0;
+	bool m_compactHeader = false;
+	int m_headerReserve = 0;
+	int m_payloadSize = 0;
+	// Only grows.
+	std::vector<std::unique_ptr<uint8_t[]>> m_chunks;
+	size_t m_frameByteSize = 0;
+	uint64_t m_copiedBytes = 0;
+	int m_shardPackets = 0;
+	int m_dataShards = 0;
+	int m_parityShards = 0;
+	std::vector<uint8_t *> m_dataBlocks;
+	std::vector<uint8_t *> m_parityBlocks;
+	// Size of the header written to each packet.
+	std::vector<uint8_t> m_headerSizes;
+};
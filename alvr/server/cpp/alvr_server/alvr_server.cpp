@@ -13,6 +13,7 @@
 #endif
 #include "openvr_driver.h"
 #include "ClientConnection.h"
+#include "VideoFrameBuffer.h"
 #include "OvrHMD.h"
 #include "driverlog.h"
 #include "Settings.h"
@@ -142,6 +143,7 @@ void (*LogInfo)(const char *stringPtr);
 void (*LogDebug)(const char *stringPtr);
 void (*DriverReadyIdle)(bool setDefaultChaprone);
 void (*LegacySend)(unsigned char *buf, int len);
+void (*LegacySendBatch)(const LegacySendPacket *packets, int count, void *videoBuffer);
 void (*ShutdownRuntime)();
 
 void *CppEntryPoint(const char *pInterfaceName, int *pReturnCode)
@@ -189,6 +191,10 @@ void LegacyReceive(unsigned char *buf, int len) {
 	}
 }
 
+void ReleaseVideoBuffer(void *videoBuffer) {
+	static_cast<VideoFrameBuffer *>(videoBuffer)->Release();
+}
+
 extern "C" void ShutdownSteamvr() {
 	if (g_serverDriverDisplayRedirect.m_pRemoteHmd)
 		g_serverDriverDisplayRedirect.m_pRemoteHmd->OnShutdown();
@@ -13,12 +13,20 @@ extern "C" unsigned int COLOR_CORRECTION_CSO_LEN;
 
 extern "C" const char *g_alvrDir;
 
+struct LegacySendPacket {
+    unsigned char *buf;
+    int len;
+};
+
 extern "C" void (*LogError)(const char *stringPtr);
 extern "C" void (*LogWarn)(const char *stringPtr);
 extern "C" void (*LogInfo)(const char *stringPtr);
 extern "C" void (*LogDebug)(const char *stringPtr);
 extern "C" void (*DriverReadyIdle)(bool setDefaultChaprone);
 extern "C" void (*LegacySend)(unsigned char *buf, int len);
+// Send several packets with a single call, in order. The packets point into videoBuffer, the
+// callee takes over one reference and calls ReleaseVideoBuffer once they are sent.
+extern "C" void (*LegacySendBatch)(const LegacySendPacket *packets, int count, void *videoBuffer);
 extern "C" void (*ShutdownRuntime)();
 
 extern "C" void *CppEntryPoint(const char *pInterfaceName, int *pReturnCode);
@@ -29,4 +37,5 @@ extern "C" void SetChaperone(const float transform[12], float areaWidth, float a
                              float (*perimeterPoints)[2], unsigned int perimeterPointsCount);
 extern "C" void SetDefaultChaperone();
 extern "C" void LegacyReceive(unsigned char *buf, int len);
+extern "C" void ReleaseVideoBuffer(void *videoBuffer);
 extern "C" void ShutdownSteamvr();
\ No newline at end of file
@@ -3,6 +3,8 @@
 #include <chrono>
 #include <exception>
 #include <memory>
+#include <pthread.h>
+#include <sched.h>
 #include <sstream>
 #include <stdexcept>
 #include <stdlib.h>
@@ -10,6 +12,7 @@
 #include <sys/mman.h>
 #include <sys/socket.h>
 #include <sys/un.h>
+#include <thread>
 #include <unistd.h>
 
 #include "ALVR-common/packet_types.h"
@@ -18,7 +21,9 @@
 #include "alvr_server/Logger.h"
 #include "alvr_server/PoseHistory.h"
 #include "alvr_server/Settings.h"
+#include "alvr_server/SpscQueue.h"
 #include "alvr_server/Statistics.h"
+#include "alvr_server/VideoFrameBuffer.h"
 #include "alvr_server/include/openvr_math.h"
 #include "protocol.h"
 #include "ffmpeg_helper.h"
@@ -35,6 +40,118 @@ CEncoder::CEncoder(std::shared_ptr<ClientConnection> listener,
 CEncoder::~CEncoder() { Stop(); }
 
 namespace {
+// Frame converted for the encoder, from the convert stage to the encode stage.
+struct ConvertedFrame {
+    int slot;
+    uint32_t image;
+    bool idr;
+    bool refreshed;
+    uint64_t frameIndex;
+    std::chrono::steady_clock::time_point acquired;
+    std::chrono::steady_clock::time_point queued;
+};
+
+// Slice of an encoded frame, from the encode stage to the send stage.
+struct EncodedSlice {
+    VideoFrameBuffer *buffer;
+    uint64_t frameIndex;
+    int sliceIndex;
+    bool last;
+    bool recoveryFrame;
+    std::chrono::steady_clock::time_point acquired;
+    std::chrono::steady_clock::time_point queued;
+};
+
+// Queues the slices of a frame for the send stage as the encoder output is filtered. A slice is
+// only known to be the last one of the frame once the encoder has nothing more to give, so the
+// latest slice is held back until the next one ends or Finish() is called. Without slices, the
+// frame is queued whole by Finish().
+class SliceSender : public alvr::EncodeOutput {
+  public:
+    SliceSender(SpscQueue<EncodedSlice> &queue, const ConvertedFrame &frame, bool slices,
+                std::atomic_bool &exiting)
+        : m_queue(queue), m_frame(frame), m_slices(slices), m_exiting(exiting),
+          m_current(VideoFrameBuffer::Acquire()) {}
+    ~SliceSender() {
+        if (m_ready)
+            m_ready->Release();
+        if (m_current)
+            m_current->Release();
+    }
+
+    void Append(const uint8_t *data, size_t size) override { m_current->Append(data, size); }
+
+    void EndSlice() override {
+        // Extra slices go with the last group the client can take.
+        if (not m_slices or m_sliceIndex + (m_ready ? 1 : 0) == ALVR_MAX_VIDEO_SLICES - 1)
+            return;
+        if (m_ready)
+            Send(m_ready, false);
+        m_ready = m_current;
+        m_current = VideoFrameBuffer::Acquire();
+    }
+
+    void Finish() {
+        if (m_ready and m_current->GetFrameByteSize() == 0) {
+            Send(m_ready, true);
+            return;
+        }
+        if (m_ready)
+            Send(m_ready, false);
+        Send(m_current, true);
+    }
+
+  private:
+    void Send(VideoFrameBuffer *&slice, bool last) {
+        EncodedSlice item{slice, m_frame.frameIndex, m_sliceIndex++, last, m_frame.refreshed,
+                          m_frame.acquired, std::chrono::steady_clock::now()};
+        // The send stage takes over the reference, unless it is gone.
+        if (not m_queue.Push(item, m_exiting))
+            slice->Release();
+        slice = nullptr;
+    }
+
+    SpscQueue<EncodedSlice> &m_queue;
+    const ConvertedFrame &m_frame;
+    bool m_slices;
+    std::atomic_bool &m_exiting;
+    int m_sliceIndex = 0;
+    // Complete slice not sent yet.
+    VideoFrameBuffer *m_ready = nullptr;
+    VideoFrameBuffer *m_current;
+};
+
+uint64_t elapsed_us(std::chrono::steady_clock::time_point since) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now() - since)
+        .count();
+}
+
+// Names the calling thread and pins it to cpu, if not negative.
+void setup_stage_thread(const char *name, int cpu) {
+    pthread_setname_np(pthread_self(), name);
+    if (cpu < 0)
+        return;
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu, &cpus);
+    int err = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    if (err != 0)
+        Error("failed to pin thread %s to CPU %d: %s\n", name, cpu, strerror(err));
+}
+
+// The threads of the pipeline stop all together, when one fails or the encoder is stopped.
+template <typename Stage>
+void run_stage(const char *name, int cpu, std::atomic_bool &exiting, Stage stage) {
+    setup_stage_thread(name, cpu);
+    try {
+        stage();
+    } catch (std::exception &e) {
+        Error("error in encoder thread %s: %s\n", name, e.what());
+    }
+    exiting = true;
+}
+
 void read_exactly(int fd, char *out, size_t size, std::atomic_bool &exiting) {
     while (not exiting and size != 0) {
         timeval timeout{.tv_sec = 0, .tv_usec = 15000};
@@ -204,58 +321,122 @@ void CEncoder::Run() {
       }
 
       auto encode_pipeline = alvr::EncodePipeline::Create(images, vk_frame_ctx);
-
-      fprintf(stderr, "CEncoder starting to read present packets");
-      std::vector<uint8_t> encoded_data;
-      while (not m_exiting) {
-        uint32_t image = present_shm::none_id;
-        {
-          std::unique_lock<std::mutex> lock(shm->mutex);
-          while (not m_exiting)
-          {
-            image = shm->next;
-            if (image != present_shm::none_id)
+      int intra_refresh_period = encode_pipeline->IntraRefreshPeriod();
+      m_scheduler.SetIntraRefresh(intra_refresh_period);
+      bool reads_input_until_encoded = encode_pipeline->ReadsInputUntilEncoded();
+      const auto &settings = Settings::Instance();
+      auto statistics = m_listener->GetStatistics();
+      bool adaptive_bitrate = settings.m_enableAdaptiveBitrate and encode_pipeline->SupportsBitrateChange();
+      if (settings.m_enableAdaptiveBitrate and not adaptive_bitrate)
+        m_listener->DisableAdaptiveBitrate();
+
+      // The frames go through three stages, each on its own thread: the convert stage (this
+      // thread) acquires the images and converts them for the encoder, the encode stage runs the
+      // encoder, and the send stage computes the FEC of the slices and sends them (the packets
+      // are sent from the pacer thread with packet pacing). A frame can then be converted while
+      // the previous one is encoded and the one before is sent. The slots of the encoder input
+      // go back from the encode stage to the convert stage through free_slots.
+      SpscQueue<int> free_slots(alvr::EncodePipeline::INPUT_SLOTS);
+      SpscQueue<ConvertedFrame> converted_frames(alvr::EncodePipeline::INPUT_SLOTS);
+      SpscQueue<EncodedSlice> encoded_slices(2 * ALVR_MAX_VIDEO_SLICES);
+      for (int slot = 0; slot < alvr::EncodePipeline::INPUT_SLOTS; ++slot)
+        free_slots.TryPush(std::move(slot));
+
+      std::thread encode_thread([&] {
+        run_stage("alvr-encode", settings.m_encodeThreadCpu, m_exiting, [&] {
+          ConvertedFrame frame;
+          while (converted_frames.Pop(frame, m_exiting)) {
+            size_t queue_depth = converted_frames.Size();
+            if (adaptive_bitrate)
             {
-              shm->owned_by_consumer = image;
-              shm->next = present_shm::none_id;
-              break;
+              uint64_t bitrate = m_listener->GetTargetBitrate();
+              if (bitrate > 0)
+                encode_pipeline->SetBitrate(bitrate);
             }
-            shm->cv.wait_for(lock, std::chrono::milliseconds(10));
+            encode_pipeline->EncodeFrame(frame.slot, frame.idr);
+
+            // With split encoding, the pictures of the two eyes end up in groups of their own.
+            bool slices = settings.m_encoderSlices > 1 or settings.m_splitEyeEncoding;
+            SliceSender sender(encoded_slices, frame, slices, m_exiting);
+            while (encode_pipeline->GetEncoded(sender)) {}
+            if (reads_input_until_encoded)
+              shm->release();
+            free_slots.TryPush(std::move(frame.slot));
+            sender.Finish();
+
+            statistics->PipelineStageOutput(Statistics::STAGE_ENCODE, elapsed_us(frame.queued), queue_depth);
           }
-        }
-        if (m_exiting)
-          break;
-        assert(image != present_shm::none_id);
-        assert(image < init.num_images);
+        });
+      });
+
+      std::thread send_thread([&] {
+        run_stage("alvr-send", settings.m_sendThreadCpu, m_exiting, [&] {
+          EncodedSlice slice;
+          while (encoded_slices.Pop(slice, m_exiting)) {
+            size_t queue_depth = encoded_slices.Size();
+            m_listener->SendVideoSlice(slice.buffer, slice.frameIndex, slice.sliceIndex, slice.last, slice.recoveryFrame);
+
+            statistics->PipelineStageOutput(Statistics::STAGE_SEND, elapsed_us(slice.queued), queue_depth);
+            if (slice.last)
+              statistics->EncodeOutput(elapsed_us(slice.acquired));
+          }
+        });
+      });
+
+      run_stage("alvr-convert", settings.m_convertThreadCpu, m_exiting, [&] {
+        fprintf(stderr, "CEncoder starting to read present packets");
+        int slot;
+        while (free_slots.Pop(slot, m_exiting)) {
+          // The previous image may still be read by the encoder, see ReadsInputUntilEncoded().
+          // acquire() waits for it to be released.
+          uint32_t image = present_shm::none_id;
+          while (not m_exiting and image == present_shm::none_id)
+            image = shm->acquire(std::chrono::milliseconds(10));
+          if (m_exiting)
+            break;
+          assert(image != present_shm::none_id);
+          assert(image < init.num_images);
 
-        auto encode_start = std::chrono::steady_clock::now();
-        encode_pipeline->PushFrame(image, m_scheduler.CheckIDRInsertion());
+          ConvertedFrame frame;
+          frame.slot = slot;
+          frame.image = image;
+          frame.acquired = std::chrono::steady_clock::now();
+          frame.idr = m_scheduler.CheckIDRInsertion();
+          // Tells the client when a refresh wave has swept a loss out of the picture.
+          frame.refreshed = m_scheduler.CheckRefreshRecovery(frame.idr);
 
-        static_assert(sizeof(shm->info[0].pose) == sizeof(vr::HmdMatrix34_t&));
+          static_assert(sizeof(shm->info[0].pose) == sizeof(vr::HmdMatrix34_t&));
 
-        // tranform provided by the compositor needs to be converted back to raw position, as configured in chaperone
-        auto t = vrmath::matMul33(vrmath::transposeMul33(*(const vr::HmdMatrix34_t*) ZeroToRawPose(false)), (const vr::HmdMatrix34_t&)shm->info[image].pose);
+          // tranform provided by the compositor needs to be converted back to raw position, as configured in chaperone
+          auto t = vrmath::matMul33(vrmath::transposeMul33(*(const vr::HmdMatrix34_t*) ZeroToRawPose(false)), (const vr::HmdMatrix34_t&)shm->info[image].pose);
 
-        auto pose = m_poseHistory->GetBestPoseMatch(t);
-        if (pose)
-        {
-          if (pose->info.FrameIndex < m_poseSubmitIndex)
+          auto pose = m_poseHistory->GetBestPoseMatch(t);
+          if (pose)
           {
-            ZeroToRawPose(true);
+            if (pose->info.FrameIndex < m_poseSubmitIndex)
+            {
+              ZeroToRawPose(true);
+            }
+            m_poseSubmitIndex = pose->info.FrameIndex;
           }
-          m_poseSubmitIndex = pose->info.FrameIndex;
-        }
+          frame.frameIndex = m_poseSubmitIndex + settings.m_trackingFrameOffset;
 
-        encoded_data.clear();
-        while (encode_pipeline->GetEncoded(encoded_data)) {}
-        shm->owned_by_consumer = present_shm::none_id;
-        m_listener->SendVideo(encoded_data.data(), encoded_data.size(), m_poseSubmitIndex + Settings::Instance().m_trackingFrameOffset);
+          encode_pipeline->ConvertFrame(image, slot);
+          if (not reads_input_until_encoded)
+            shm->release();
 
-        auto encode_end = std::chrono::steady_clock::now();
-
-        m_listener->GetStatistics()->EncodeOutput(std::chrono::duration_cast<std::chrono::microseconds>(encode_end - encode_start).count());
+          frame.queued = std::chrono::steady_clock::now();
+          if (not converted_frames.Push(frame, m_exiting))
+            break;
+          statistics->PipelineStageOutput(Statistics::STAGE_CONVERT, elapsed_us(frame.acquired), 0);
+        }
+      });
 
-      }
+      encode_thread.join();
+      send_thread.join();
+      EncodedSlice slice;
+      while (encoded_slices.TryPop(slice))
+        slice.buffer->Release();
     }
     catch (std::exception &e) {
       std::stringstream err;
@@ -270,4 +451,7 @@ void CEncoder::Stop() {
 
 void CEncoder::OnPacketLoss() { m_scheduler.OnPacketLoss(); }
 
+// libavcodec does not expose reference invalidation, losses are recovered with an IDR.
+void CEncoder::OnFrameAck(uint64_t frameIndex) { m_scheduler.OnFrameAck(frameIndex); }
+
 void CEncoder::InsertIDR() { m_scheduler.InsertIDR(); }
@@ -18,6 +18,7 @@ class CEncoder : public CThread {
 
     void Stop();
     void OnPacketLoss();
+    void OnFrameAck(uint64_t frameIndex);
     void InsertIDR();
 
   private:
@@ -0,0 +1,335 @@
+#include "ColorConverter.h"
+
+#include <algorithm>
+#include <immintrin.h>
+
+namespace
+{
+
+// BT.601 limited range, in 1/256:
+//   Y = ( 66 R + 129 G +  25 B) / 256 + 16
+//   U = (-38 R -  74 G + 112 B) / 256 + 128
+//   V = (112 R -  94 G -  18 B) / 256 + 128
+// U and V take the sum of the 4 pixels of a block, so they are divided by 1024 instead.
+// The vector kernels compute exactly the same values as the scalar one.
+
+uint8_t luma(int r, int g, int b)
+{
+  return ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
+}
+
+// r, g and b: sums over the 4 pixels of a block.
+uint8_t chroma_u(int r, int g, int b)
+{
+  return ((-38 * r - 74 * g + 112 * b + 512) >> 10) + 128;
+}
+
+uint8_t chroma_v(int r, int g, int b)
+{
+  return ((112 * r - 94 * g - 18 * b + 512) >> 10) + 128;
+}
+
+// Columns [x_begin, width) of a pair of rows. For odd sizes, the last column (row) is its own
+// neighbour.
+void convert_columns_scalar(const uint8_t *src0, const uint8_t *src1, uint8_t *y0, uint8_t *y1,
+                            uint8_t *u, uint8_t *v, int x_begin, int width, bool bgr)
+{
+  int r_offset = bgr ? 2 : 0;
+  int b_offset = bgr ? 0 : 2;
+  for (int x = x_begin; x < width; x += 2)
+  {
+    int xs[2] = {x, std::min(x + 1, width - 1)};
+    int r = 0, g = 0, b = 0;
+    for (int i = 0; i < 2; i++)
+    {
+      const uint8_t *p0 = src0 + 4 * xs[i];
+      const uint8_t *p1 = src1 + 4 * xs[i];
+      y0[xs[i]] = luma(p0[r_offset], p0[1], p0[b_offset]);
+      y1[xs[i]] = luma(p1[r_offset], p1[1], p1[b_offset]);
+      r += p0[r_offset] + p1[r_offset];
+      g += p0[1] + p1[1];
+      b += p0[b_offset] + p1[b_offset];
+    }
+    u[x / 2] = chroma_u(r, g, b);
+    v[x / 2] = chroma_v(r, g, b);
+  }
+}
+
+void convert_rows_scalar(const uint8_t *src0, const uint8_t *src1, uint8_t *y0, uint8_t *y1,
+                         uint8_t *u, uint8_t *v, int width, bool bgr)
+{
+  convert_columns_scalar(src0, src1, y0, y1, u, v, 0, width, bgr);
+}
+
+// The vector kernels split each 32 bit pixel in two vectors of 16 bit pairs: bytes 1 and 3, and
+// byte 2 with the ignored byte 4, which multiply-add with a pair of coefficients into the 32 bit
+// lane of the pixel.
+int32_t coefficient_pair(int low, int high)
+{
+  return int32_t(uint32_t(high) << 16 | uint32_t(low & 0xffff));
+}
+
+struct Coefficients
+{
+  int32_t y_13, y_2;
+  int32_t u_13, u_2;
+  int32_t v_13, v_2;
+};
+
+Coefficients coefficients(bool bgr)
+{
+  auto pair = [bgr](int r, int b) { return bgr ? coefficient_pair(b, r) : coefficient_pair(r, b); };
+  return {
+      pair(66, 25), coefficient_pair(129, 0),
+      pair(-38, 112), coefficient_pair(-74, 0),
+      pair(112, -18), coefficient_pair(-94, 0),
+  };
+}
+
+// 32 pixels of two rows per step: 32 luma samples per row and 16 chroma samples.
+const int BLOCK = 32;
+
+__attribute__((target("avx2")))
+inline __m256i luma_avx2(__m256i px, __m256i mask, __m256i c_13, __m256i c_2)
+{
+  __m256i p_13 = _mm256_and_si256(px, mask);
+  __m256i p_2 = _mm256_and_si256(_mm256_srli_epi32(px, 8), mask);
+  __m256i sum = _mm256_add_epi32(_mm256_madd_epi16(p_13, c_13), _mm256_madd_epi16(p_2, c_2));
+  return _mm256_add_epi32(_mm256_srai_epi32(_mm256_add_epi32(sum, _mm256_set1_epi32(128)), 8),
+                          _mm256_set1_epi32(16));
+}
+
+// Chroma of the 4 blocks of 8 pixels in two rows, in the even 32 bit lanes.
+__attribute__((target("avx2")))
+inline void chroma_avx2(__m256i row0, __m256i row1, __m256i mask, const Coefficients &c,
+                        __m256i &u, __m256i &v)
+{
+  __m256i p_13 = _mm256_add_epi32(_mm256_and_si256(row0, mask), _mm256_and_si256(row1, mask));
+  __m256i p_2 = _mm256_add_epi32(_mm256_and_si256(_mm256_srli_epi32(row0, 8), mask),
+                                 _mm256_and_si256(_mm256_srli_epi32(row1, 8), mask));
+  // Adds the odd pixel to the even one, the 16 bit sums cannot overflow.
+  p_13 = _mm256_add_epi32(p_13, _mm256_srli_epi64(p_13, 32));
+  p_2 = _mm256_add_epi32(p_2, _mm256_srli_epi64(p_2, 32));
+  __m256i round = _mm256_set1_epi32(512);
+  __m256i offset = _mm256_set1_epi32(128);
+  u = _mm256_add_epi32(_mm256_madd_epi16(p_13, _mm256_set1_epi32(c.u_13)), _mm256_madd_epi16(p_2, _mm256_set1_epi32(c.u_2)));
+  u = _mm256_add_epi32(_mm256_srai_epi32(_mm256_add_epi32(u, round), 10), offset);
+  v = _mm256_add_epi32(_mm256_madd_epi16(p_13, _mm256_set1_epi32(c.v_13)), _mm256_madd_epi16(p_2, _mm256_set1_epi32(c.v_2)));
+  v = _mm256_add_epi32(_mm256_srai_epi32(_mm256_add_epi32(v, round), 10), offset);
+}
+
+// Packs 4 vectors of 8 samples to 32 bytes in order.
+__attribute__((target("avx2")))
+inline __m256i pack_avx2(__m256i a, __m256i b, __m256i c, __m256i d)
+{
+  // packs and packus work in 128 bit lanes, the 4 byte groups come out as a0 b0 c0 d0 a1 b1 c1 d1.
+  __m256i packed = _mm256_packus_epi16(_mm256_packs_epi32(a, b), _mm256_packs_epi32(c, d));
+  return _mm256_permutevar8x32_epi32(packed, _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7));
+}
+
+// Packs the even lanes of 4 vectors to 16 bytes in order.
+__attribute__((target("avx2")))
+inline __m128i pack_even_avx2(__m256i a, __m256i b, __m256i c, __m256i d)
+{
+  __m256i even = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+  __m256i ab = _mm256_permute2x128_si256(_mm256_permutevar8x32_epi32(a, even),
+                                         _mm256_permutevar8x32_epi32(b, even), 0x20);
+  __m256i cd = _mm256_permute2x128_si256(_mm256_permutevar8x32_epi32(c, even),
+                                         _mm256_permutevar8x32_epi32(d, even), 0x20);
+  __m256i words = _mm256_permute4x64_epi64(_mm256_packs_epi32(ab, cd), 0xd8);
+  __m256i bytes = _mm256_permute4x64_epi64(_mm256_packus_epi16(words, words), 0x08);
+  return _mm256_castsi256_si128(bytes);
+}
+
+__attribute__((target("avx2")))
+void convert_rows_avx2(const uint8_t *src0, const uint8_t *src1, uint8_t *y0, uint8_t *y1,
+                       uint8_t *u, uint8_t *v, int width, bool bgr)
+{
+  const Coefficients c = coefficients(bgr);
+  const __m256i mask = _mm256_set1_epi32(0x00ff00ff);
+  const __m256i y_13 = _mm256_set1_epi32(c.y_13);
+  const __m256i y_2 = _mm256_set1_epi32(c.y_2);
+  int x = 0;
+  for (; x + BLOCK <= width; x += BLOCK)
+  {
+    __m256i row0[4], row1[4], us[4], vs[4];
+    for (int i = 0; i < 4; i++)
+    {
+      row0[i] = _mm256_loadu_si256((const __m256i *)(src0 + 4 * (x + 8 * i)));
+      row1[i] = _mm256_loadu_si256((const __m256i *)(src1 + 4 * (x + 8 * i)));
+      chroma_avx2(row0[i], row1[i], mask, c, us[i], vs[i]);
+    }
+    _mm256_storeu_si256((__m256i *)(y0 + x),
+                        pack_avx2(luma_avx2(row0[0], mask, y_13, y_2), luma_avx2(row0[1], mask, y_13, y_2),
+                                  luma_avx2(row0[2], mask, y_13, y_2), luma_avx2(row0[3], mask, y_13, y_2)));
+    _mm256_storeu_si256((__m256i *)(y1 + x),
+                        pack_avx2(luma_avx2(row1[0], mask, y_13, y_2), luma_avx2(row1[1], mask, y_13, y_2),
+                                  luma_avx2(row1[2], mask, y_13, y_2), luma_avx2(row1[3], mask, y_13, y_2)));
+    _mm_storeu_si128((__m128i *)(u + x / 2), pack_even_avx2(us[0], us[1], us[2], us[3]));
+    _mm_storeu_si128((__m128i *)(v + x / 2), pack_even_avx2(vs[0], vs[1], vs[2], vs[3]));
+  }
+  convert_columns_scalar(src0, src1, y0, y1, u, v, x, width, bgr);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+inline __m128i luma_avx512(__m512i px, __m512i mask, __m512i c_13, __m512i c_2)
+{
+  __m512i p_13 = _mm512_and_si512(px, mask);
+  __m512i p_2 = _mm512_and_si512(_mm512_srli_epi32(px, 8), mask);
+  __m512i sum = _mm512_add_epi32(_mm512_madd_epi16(p_13, c_13), _mm512_madd_epi16(p_2, c_2));
+  sum = _mm512_add_epi32(_mm512_srai_epi32(_mm512_add_epi32(sum, _mm512_set1_epi32(128)), 8),
+                         _mm512_set1_epi32(16));
+  return _mm512_cvtepi32_epi8(sum);
+}
+
+// Chroma of the 8 blocks of 16 pixels in two rows, as 8 bytes.
+__attribute__((target("avx512f,avx512bw")))
+inline void chroma_avx512(__m512i row0, __m512i row1, __m512i mask, const Coefficients &c,
+                          __m128i &u, __m128i &v)
+{
+  __m512i p_13 = _mm512_add_epi32(_mm512_and_si512(row0, mask), _mm512_and_si512(row1, mask));
+  __m512i p_2 = _mm512_add_epi32(_mm512_and_si512(_mm512_srli_epi32(row0, 8), mask),
+                                 _mm512_and_si512(_mm512_srli_epi32(row1, 8), mask));
+  p_13 = _mm512_add_epi32(p_13, _mm512_srli_epi64(p_13, 32));
+  p_2 = _mm512_add_epi32(p_2, _mm512_srli_epi64(p_2, 32));
+  __m512i round = _mm512_set1_epi32(512);
+  __m512i offset = _mm512_set1_epi32(128);
+  __m512i us = _mm512_add_epi32(_mm512_madd_epi16(p_13, _mm512_set1_epi32(c.u_13)), _mm512_madd_epi16(p_2, _mm512_set1_epi32(c.u_2)));
+  us = _mm512_add_epi32(_mm512_srai_epi32(_mm512_add_epi32(us, round), 10), offset);
+  __m512i vs = _mm512_add_epi32(_mm512_madd_epi16(p_13, _mm512_set1_epi32(c.v_13)), _mm512_madd_epi16(p_2, _mm512_set1_epi32(c.v_2)));
+  vs = _mm512_add_epi32(_mm512_srai_epi32(_mm512_add_epi32(vs, round), 10), offset);
+  // The low byte of each 64 bit lane is the one of the even 32 bit lane.
+  u = _mm512_cvtepi64_epi8(us);
+  v = _mm512_cvtepi64_epi8(vs);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+void convert_rows_avx512(const uint8_t *src0, const uint8_t *src1, uint8_t *y0, uint8_t *y1,
+                         uint8_t *u, uint8_t *v, int width, bool bgr)
+{
+  const Coefficients c = coefficients(bgr);
+  const __m512i mask = _mm512_set1_epi32(0x00ff00ff);
+  const __m512i y_13 = _mm512_set1_epi32(c.y_13);
+  const __m512i y_2 = _mm512_set1_epi32(c.y_2);
+  int x = 0;
+  for (; x + BLOCK <= width; x += BLOCK)
+  {
+    __m128i us[2], vs[2];
+    for (int i = 0; i < 2; i++)
+    {
+      __m512i row0 = _mm512_loadu_si512(src0 + 4 * (x + 16 * i));
+      __m512i row1 = _mm512_loadu_si512(src1 + 4 * (x + 16 * i));
+      _mm_storeu_si128((__m128i *)(y0 + x + 16 * i), luma_avx512(row0, mask, y_13, y_2));
+      _mm_storeu_si128((__m128i *)(y1 + x + 16 * i), luma_avx512(row1, mask, y_13, y_2));
+      chroma_avx512(row0, row1, mask, c, us[i], vs[i]);
+    }
+    _mm_storeu_si128((__m128i *)(u + x / 2), _mm_unpacklo_epi64(us[0], us[1]));
+    _mm_storeu_si128((__m128i *)(v + x / 2), _mm_unpacklo_epi64(vs[0], vs[1]));
+  }
+  convert_columns_scalar(src0, src1, y0, y1, u, v, x, width, bgr);
+}
+
+alvr::ColorConverter::RowKernel select_kernel()
+{
+  if (__builtin_cpu_supports("avx512f") and __builtin_cpu_supports("avx512bw"))
+    return convert_rows_avx512;
+  if (__builtin_cpu_supports("avx2"))
+    return convert_rows_avx2;
+  return convert_rows_scalar;
+}
+
+}
+
+alvr::ColorConverter::ColorConverter(Layout layout, int width, int height, int threads):
+  layout(layout),
+  width(width),
+  height(height),
+  kernel(select_kernel()),
+  // At least a pair of rows per band.
+  bands(std::clamp(threads, 1, (height + 1) / 2))
+{
+  for (int band = 1; band < bands; band++)
+    workers.emplace_back(&ColorConverter::worker, this, band);
+}
+
+alvr::ColorConverter::~ColorConverter()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    exiting = true;
+  }
+  start_cv.notify_all();
+  for (auto &worker: workers)
+    worker.join();
+}
+
+void alvr::ColorConverter::convert(const uint8_t *src, int src_stride, uint8_t *const dst[3], const int dst_stride[3])
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    this->src = src;
+    this->src_stride = src_stride;
+    for (int i = 0; i < 3; i++)
+    {
+      this->dst[i] = dst[i];
+      this->dst_stride[i] = dst_stride[i];
+    }
+    pending = workers.size();
+    generation++;
+  }
+  start_cv.notify_all();
+  convert_band(0);
+  std::unique_lock<std::mutex> lock(mutex);
+  done_cv.wait(lock, [this] { return pending == 0; });
+}
+
+const char *alvr::ColorConverter::kernel_name() const
+{
+  if (kernel == convert_rows_avx512)
+    return "avx512";
+  if (kernel == convert_rows_avx2)
+    return "avx2";
+  return "scalar";
+}
+
+void alvr::ColorConverter::use_scalar_kernel()
+{
+  kernel = convert_rows_scalar;
+}
+
+void alvr::ColorConverter::convert_band(int band)
+{
+  int pairs = (height + 1) / 2;
+  int begin = int64_t(pairs) * band / bands;
+  int end = int64_t(pairs) * (band + 1) / bands;
+  bool bgr = layout == Layout::BGRX;
+  for (int pair = begin; pair < end; pair++)
+  {
+    int row0 = 2 * pair;
+    int row1 = std::min(row0 + 1, height - 1);
+    kernel(src + int64_t(row0) * src_stride, src + int64_t(row1) * src_stride,
+           dst[0] + int64_t(row0) * dst_stride[0], dst[0] + int64_t(row1) * dst_stride[0],
+           dst[1] + int64_t(pair) * dst_stride[1], dst[2] + int64_t(pair) * dst_stride[2], width, bgr);
+  }
+}
+
+void alvr::ColorConverter::worker(int band)
+{
+  uint64_t seen = 0;
+  while (true)
+  {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      start_cv.wait(lock, [&] { return exiting or generation != seen; });
+      if (exiting)
+        return;
+      seen = generation;
+    }
+    convert_band(band);
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      pending--;
+    }
+    done_cv.notify_one();
+  }
+}
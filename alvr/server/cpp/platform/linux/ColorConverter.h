@@ -0,0 +1,69 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace alvr
+{
+
+// Converts packed 8 bit RGB frames to planar YUV 4:2:0 of the same size, for the software
+// encoder. Same BT.601 limited range equations as swscale with the default colorspace, the chroma
+// of a 2x2 block is computed from the average of its pixels.
+// The rows are split in bands, converted in parallel by the calling thread and threads - 1 worker
+// threads, with AVX-512 or AVX2 kernels when the CPU has them. Has no libav dependency, so that the
+// benchmark builds without the rest of the server.
+class ColorConverter
+{
+public:
+  // Byte order of the pixels in memory, the fourth byte is ignored.
+  enum class Layout
+  {
+    RGBX,
+    BGRX,
+  };
+
+  ColorConverter(Layout layout, int width, int height, int threads);
+  ~ColorConverter();
+  ColorConverter(const ColorConverter &) = delete;
+  ColorConverter &operator=(const ColorConverter &) = delete;
+
+  // dst and dst_stride: Y, U and V planes. Returns when the whole frame is converted.
+  void convert(const uint8_t *src, int src_stride, uint8_t *const dst[3], const int dst_stride[3]);
+
+  // "avx512", "avx2" or "scalar".
+  const char *kernel_name() const;
+  // Reference for the benchmark.
+  void use_scalar_kernel();
+
+  typedef void (*RowKernel)(const uint8_t *src0, const uint8_t *src1, uint8_t *y0, uint8_t *y1,
+                            uint8_t *u, uint8_t *v, int width, bool bgr);
+
+private:
+  void convert_band(int band);
+  void worker(int band);
+
+  Layout layout;
+  int width;
+  int height;
+  RowKernel kernel;
+  int bands;
+
+  // Frame being converted, set by convert() for the workers.
+  const uint8_t *src = nullptr;
+  int src_stride = 0;
+  uint8_t *dst[3] = {};
+  int dst_stride[3] = {};
+
+  std::vector<std::thread> workers;
+  std::mutex mutex;
+  std::condition_variable start_cv;
+  std::condition_variable done_cv;
+  uint64_t generation = 0;
+  int pending = 0;
+  bool exiting = false;
+};
+
+}
@@ -1,5 +1,6 @@
 #include "EncodePipeline.h"
 
+#include "ALVR-common/annexb.h"
 #include "alvr_server/Logger.h"
 #include "alvr_server/Settings.h"
 #include "EncodePipelineSW.h"
@@ -10,61 +11,42 @@ extern "C" {
 #include <libavcodec/avcodec.h>
 }
 
-namespace {
-
-bool should_keep_nal_h264(const uint8_t * header_start)
+// Drops SEI and access unit delimiters. Kept NAL units are appended straight from the packet,
+// adjacent ones in one piece.
+void alvr::EncodePipeline::filter_NAL(const uint8_t* input, size_t input_size, EncodeOutput &out)
 {
-  uint8_t nal_type = (header_start[2] == 0 ? header_start[4] : header_start[3]) & 0x1F;
-    switch (nal_type)
+  bool h265 = Settings::Instance().m_codec == ALVR_CODEC_H265;
+  AnnexBParser parser(input, input_size, h265);
+  AnnexBNal nal;
+  const uint8_t *run = input;
+  const uint8_t *run_end = input;
+  while (parser.Next(nal))
+  {
+    if (AnnexBIsDroppable(nal.type, h265))
+      continue;
+    if (nal.begin != run_end)
     {
-      case 6: // supplemental enhancement information
-      case 9: // access unit delimiter
-        return false;
-      default:
-        return true;
+      if (run != run_end)
+        out.Append(run, run_end - run);
+      run = nal.begin;
     }
-}
-
-bool should_keep_nal_h265(const uint8_t * header_start)
-{
-  uint8_t nal_type = ((header_start[2] == 0 ? header_start[4] : header_start[3]) >> 1) & 0x3F;
-  switch (nal_type)
-  {
-    case 35: // access unit delimiter
-    case 39: // supplemental enhancement information
-      return false;
-    default:
-      return true;
-  }
-}
-
-void filter_NAL(const uint8_t* input, size_t input_size, std::vector<uint8_t> &out)
-{
-  if (input_size < 4)
-    return;
-  auto codec = Settings::Instance().m_codec;
-  std::array<uint8_t, 3> header = {{0, 0, 1}};
-  auto end = input + input_size;
-  auto header_start = input;
-  while (header_start != end)
-  {
-    auto next_header = std::search(header_start + 3, end, header.begin(), header.end());
-    if (next_header != end and next_header[-1] == 0)
+    run_end = nal.end;
+    if (AnnexBIsSlice(nal.type, h265))
     {
-      next_header--;
+      out.Append(run, run_end - run);
+      out.EndSlice();
+      run = run_end;
     }
-    if (codec == ALVR_CODEC_H264 and should_keep_nal_h264(header_start))
-      out.insert(out.end(), header_start, next_header);
-    if (codec == ALVR_CODEC_H265 and should_keep_nal_h265(header_start))
-      out.insert(out.end(), header_start, next_header);
-    header_start = next_header;
   }
-}
-
+  if (run != run_end)
+    out.Append(run, run_end - run);
 }
 
 std::unique_ptr<alvr::EncodePipeline> alvr::EncodePipeline::Create(std::vector<VkFrame> &input_frames, VkFrameCtx &vk_frame_ctx)
 {
+  // Only the software encoder can run one encoder per eye.
+  if (Settings::Instance().m_splitEyeEncoding)
+    return std::make_unique<alvr::EncodePipelineSW>(input_frames, vk_frame_ctx);
   try {
     return std::make_unique<alvr::EncodePipelineVAAPI>(input_frames, vk_frame_ctx);
   } catch (...)
@@ -79,7 +61,7 @@ alvr::EncodePipeline::~EncodePipeline()
   AVCODEC.avcodec_free_context(&encoder_ctx);
 }
 
-bool alvr::EncodePipeline::GetEncoded(std::vector<uint8_t> &out)
+bool alvr::EncodePipeline::GetEncoded(EncodeOutput &out)
 {
   AVPacket * enc_pkt = AVCODEC.av_packet_alloc();
   int err = AVCODEC.avcodec_receive_packet(encoder_ctx, enc_pkt);
@@ -1,4 +1,5 @@
 #pragma once
+#include <cstddef>
 #include <cstdint>
 #include <memory>
 #include <vector>
@@ -8,6 +9,16 @@ extern "C" struct AVCodecContext;
 namespace alvr
 {
 
+// Receives the NAL units kept from the encoder output. EndSlice() follows every slice, which can
+// then be sent together with the NAL units preceding it.
+class EncodeOutput
+{
+public:
+  virtual ~EncodeOutput() = default;
+  virtual void Append(const uint8_t *data, size_t size) = 0;
+  virtual void EndSlice() = 0;
+};
+
 class VkFrame;
 class VkFrameCtx;
 
@@ -16,11 +27,30 @@ class EncodePipeline
 public:
   virtual ~EncodePipeline();
 
-  virtual void PushFrame(uint32_t frame_index, bool idr) = 0;
-  bool GetEncoded(std::vector<uint8_t> & out);
+  // Frames are converted for the encoder into one of INPUT_SLOTS slots and encoded from there, so
+  // that a frame can be converted on one thread while the previous ones are encoded on another.
+  // ConvertFrame() and EncodeFrame() each stay on one thread, and a slot is only converted again
+  // after its frame was encoded and the output drained with GetEncoded().
+  static const int INPUT_SLOTS = 3;
+  virtual void ConvertFrame(uint32_t frame_index, int slot) = 0;
+  // Whether input frame frame_index is still read after ConvertFrame() returned, until the output
+  // of its slot was drained. The producer must not overwrite it until then.
+  virtual bool ReadsInputUntilEncoded() { return false; }
+  virtual void EncodeFrame(int slot, bool idr) = 0;
+  // Frames a refresh wave takes when the encoder refreshes the picture gradually instead of with
+  // keyframes, 0 otherwise. Losses are then repaired by the next wave.
+  virtual int IntraRefreshPeriod() { return 0; }
+  // Bitrate of the next frames, in bits per second. Called from the thread of EncodeFrame().
+  virtual void SetBitrate(int64_t bitrate) = 0;
+  // Whether SetBitrate() takes effect while encoding. Adaptive bitrate is disabled otherwise.
+  virtual bool SupportsBitrateChange() { return true; }
+  virtual bool GetEncoded(EncodeOutput & out);
 
   static std::unique_ptr<EncodePipeline> Create(std::vector<VkFrame> &input_frames, VkFrameCtx &vk_frame_ctx);
 protected:
+  // Appends the NAL units of an encoder packet the client needs to out.
+  static void filter_NAL(const uint8_t* input, size_t input_size, EncodeOutput &out);
+
   AVCodecContext *encoder_ctx = nullptr; //shall be initialized by child class
 };
 
@@ -2,8 +2,12 @@
 
 #include <algorithm>
 #include <chrono>
+#include <pthread.h>
+#include <thread>
 
+#include "alvr_server/Logger.h"
 #include "alvr_server/Settings.h"
+#include "ColorConverter.h"
 #include "ffmpeg_helper.h"
 
 extern "C" {
@@ -27,16 +31,26 @@ const char * encoder(ALVR_CODEC codec)
   throw std::runtime_error("invalid codec " + std::to_string(codec));
 }
 
-
-}
-
-alvr::EncodePipelineSW::EncodePipelineSW(std::vector<VkFrame>& input_frames, VkFrameCtx& vk_frame_ctx)
+bool converter_layout(AVPixelFormat format, alvr::ColorConverter::Layout &layout)
 {
-  for (auto& input_frame: input_frames)
+  switch (format)
   {
-    vk_frames.push_back(input_frame.make_av_frame(vk_frame_ctx).release());
+    case AV_PIX_FMT_RGBA:
+    case AV_PIX_FMT_RGB0:
+      layout = alvr::ColorConverter::Layout::RGBX;
+      return true;
+    case AV_PIX_FMT_BGRA:
+    case AV_PIX_FMT_BGR0:
+      layout = alvr::ColorConverter::Layout::BGRX;
+      return true;
+    default:
+      return false;
   }
+}
 
+// thread_count 0 lets the encoder pick.
+AVCodecContext * open_encoder(int width, int height, int64_t bitrate, int intra_refresh_period, int thread_count)
+{
   const auto& settings = Settings::Instance();
 
   auto codec_id = ALVR_CODEC(settings.m_codec);
@@ -47,7 +61,7 @@ alvr::EncodePipelineSW::EncodePipelineSW(std::vector<VkFrame>& input_frames, VkF
     throw std::runtime_error(std::string("Failed to find encoder ") + encoder_name);
   }
 
-  encoder_ctx = AVCODEC.avcodec_alloc_context3(codec);
+  AVCodecContext *encoder_ctx = AVCODEC.avcodec_alloc_context3(codec);
   if (not encoder_ctx)
   {
     throw std::runtime_error("failed to allocate " + std::string(encoder_name) + " encoder");
@@ -61,67 +75,322 @@ alvr::EncodePipelineSW::EncodePipelineSW(std::vector<VkFrame>& input_frames, VkF
       AVUTIL.av_dict_set(&opt, "preset", "ultrafast", 0);
       AVUTIL.av_dict_set(&opt, "tune", "zerolatency", 0);
       encoder_ctx->gop_size = 72;
+      // zerolatency already encodes the slices of a frame in parallel (sliced threads).
+      encoder_ctx->slices = settings.m_encoderSlices;
+      if (intra_refresh_period > 0)
+      {
+        AVUTIL.av_dict_set(&opt, "intra-refresh", "1", 0);
+        encoder_ctx->gop_size = intra_refresh_period;
+      }
       break;
     case ALVR_CODEC_H265:
+    {
       encoder_ctx->profile = FF_PROFILE_HEVC_MAIN;
       AVUTIL.av_dict_set(&opt, "preset", "ultrafast", 0);
       AVUTIL.av_dict_set(&opt, "tune", "zerolatency", 0);
       encoder_ctx->gop_size = 72;
+      // libx265 does not read AVCodecContext::slices.
+      std::string x265_params;
+      if (settings.m_encoderSlices > 1)
+        x265_params = "slices=" + std::to_string(settings.m_encoderSlices);
+      if (intra_refresh_period > 0)
+      {
+        x265_params += std::string(x265_params.empty() ? "" : ":") + "intra-refresh=1";
+        encoder_ctx->gop_size = intra_refresh_period;
+      }
+      if (not x265_params.empty())
+        AVUTIL.av_dict_set(&opt, "x265-params", x265_params.c_str(), 0);
       break;
+    }
   }
 
 
-  encoder_ctx->width = settings.m_renderWidth;
-  encoder_ctx->height = settings.m_renderHeight;
+  encoder_ctx->width = width;
+  encoder_ctx->height = height;
   encoder_ctx->time_base = {std::chrono::steady_clock::period::num, std::chrono::steady_clock::period::den};
   encoder_ctx->framerate = AVRational{settings.m_refreshRate, 1};
   encoder_ctx->sample_aspect_ratio = AVRational{1, 1};
   encoder_ctx->pix_fmt = AV_PIX_FMT_YUV420P;
   encoder_ctx->max_b_frames = 0;
-  encoder_ctx->bit_rate = settings.mEncodeBitrateMBs * 1024 * 1024;
+  encoder_ctx->bit_rate = bitrate;
+  encoder_ctx->thread_count = thread_count;
 
   int err = AVCODEC.avcodec_open2(encoder_ctx, codec, &opt);
   if (err < 0) {
+    AVCODEC.avcodec_free_context(&encoder_ctx);
     throw alvr::AvException("Cannot open video encoder codec:", err);
   }
+  return encoder_ctx;
+}
+
+void send_frame(AVCodecContext *encoder_ctx, AVFrame *frame)
+{
+  int err;
+  if ((err = AVCODEC.avcodec_send_frame(encoder_ctx, frame)) < 0) {
+    throw alvr::AvException("avcodec_send_frame failed:", err);
+  }
+}
+
+}
+
+alvr::EncodePipelineSW::EncodePipelineSW(std::vector<VkFrame>& input_frames, VkFrameCtx& vk_frame_ctx)
+{
+  for (auto& input_frame: input_frames)
+  {
+    vk_frames.push_back(input_frame.make_av_frame(vk_frame_ctx).release());
+  }
+
+  const auto& settings = Settings::Instance();
+
+  // With intra refresh, the GOP is the refresh period: a column of intra blocks sweeps across the
+  // picture in gop_size frames, and the sweeps repeat. Only the first frame and the frames forced
+  // by EncodeFrame() are IDRs. libavcodec does not expose x264_encoder_intra_refresh(), so a sweep
+  // cannot be started on demand: a loss waits for the next sweep, see CheckRefreshRecovery().
+  if (settings.m_enableIntraRefresh)
+    intra_refresh_period = settings.m_intraRefreshFrames;
+
+  int64_t bitrate = settings.mEncodeBitrateMBs * 1024 * 1024;
+  if (settings.m_splitEyeEncoding)
+  {
+    // Both encoders get the same frames with the same IDR requests and the same GOP, so their
+    // keyframes and refresh waves stay on the same frames. Each gets half of the cores and of
+    // the bitrate.
+    if (settings.m_renderWidth % 4 != 0)
+      throw std::runtime_error("split eye encoding needs a width multiple of 4");
+    int threads = std::max(1, int(std::thread::hardware_concurrency()) / 2);
+    encoder_ctx = open_encoder(settings.m_renderWidth / 2, settings.m_renderHeight, bitrate / 2, intra_refresh_period, threads);
+    right_encoder_ctx = open_encoder(settings.m_renderWidth / 2, settings.m_renderHeight, bitrate / 2, intra_refresh_period, threads);
+    Info("encoding each eye with its own encoder, %d threads each", threads);
+  }
+  else
+  {
+    encoder_ctx = open_encoder(settings.m_renderWidth, settings.m_renderHeight, bitrate, intra_refresh_period, 0);
+  }
 
   transferred_frame = AVUTIL.av_frame_alloc();
-  encoder_frame = AVUTIL.av_frame_alloc();
-  encoder_frame->width = settings.m_renderWidth;
-  encoder_frame->height = settings.m_renderHeight;
-  encoder_frame->format = encoder_ctx->pix_fmt;
-  AVUTIL.av_frame_get_buffer(encoder_frame, 0);
-
-  scaler_ctx = SWSCALE.sws_getContext(
-          vk_frames[0]->width, vk_frames[0]->height, ((AVHWFramesContext*)vk_frames[0]->hw_frames_ctx->data)->sw_format,
-          encoder_ctx->width, encoder_ctx->height, encoder_ctx->pix_fmt,
-          SWS_BILINEAR,
-          NULL, NULL, NULL);
+  for (auto &encoder_frame: encoder_frames)
+  {
+    encoder_frame = AVUTIL.av_frame_alloc();
+    encoder_frame->width = settings.m_renderWidth;
+    encoder_frame->height = settings.m_renderHeight;
+    encoder_frame->format = AV_PIX_FMT_YUV420P;
+    AVUTIL.av_frame_get_buffer(encoder_frame, 0);
+  }
+
+  if (right_encoder_ctx)
+  {
+    for (int slot = 0; slot < INPUT_SLOTS; ++slot)
+    {
+      for (int eye = 0; eye < 2; ++eye)
+      {
+        // Reference the buffers of the whole frame, libavcodec then does not copy the half.
+        AVFrame *eye_frame = AVUTIL.av_frame_alloc();
+        AVFrame *encoder_frame = encoder_frames[slot];
+        eye_frame->width = encoder_frame->width / 2;
+        eye_frame->height = encoder_frame->height;
+        eye_frame->format = encoder_frame->format;
+        for (int plane = 0; plane < 3; ++plane)
+        {
+          int plane_width = plane == 0 ? eye_frame->width : eye_frame->width / 2;
+          eye_frame->data[plane] = encoder_frame->data[plane] + eye * plane_width;
+          eye_frame->linesize[plane] = encoder_frame->linesize[plane];
+        }
+        for (size_t i = 0; i < sizeof(eye_frame->buf) / sizeof(eye_frame->buf[0]) and encoder_frame->buf[i]; ++i)
+          eye_frame->buf[i] = AVUTIL.av_buffer_ref(encoder_frame->buf[i]);
+        eye_frames[slot][eye] = eye_frame;
+      }
+    }
+    right_thread = std::thread([this] { right_eye_worker(); });
+  }
+
+  auto input_format = ((AVHWFramesContext*)vk_frames[0]->hw_frames_ctx->data)->sw_format;
+  ColorConverter::Layout layout;
+  int width = encoder_frames[0]->width;
+  int height = encoder_frames[0]->height;
+  if (vk_frames[0]->width == width and vk_frames[0]->height == height
+      and converter_layout(input_format, layout))
+  {
+    // x264 keeps most cores busy, a few bands are enough to convert a frame while the previous
+    // one is encoded.
+    int threads = std::clamp(int(std::thread::hardware_concurrency()) / 4, 1, 4);
+    color_converter = std::make_unique<ColorConverter>(layout, width, height, threads);
+    Info("converting frames with %d threads, %s kernel", threads, color_converter->kernel_name());
+  }
+  else
+  {
+    scaler_ctx = SWSCALE.sws_getContext(
+            vk_frames[0]->width, vk_frames[0]->height, input_format,
+            width, height, AV_PIX_FMT_YUV420P,
+            SWS_BILINEAR,
+            NULL, NULL, NULL);
+  }
 }
 
 alvr::EncodePipelineSW::~EncodePipelineSW()
 {
+  if (right_thread.joinable())
+  {
+    {
+      std::lock_guard<std::mutex> lock(right_mutex);
+      exiting = true;
+    }
+    right_cv.notify_all();
+    right_thread.join();
+  }
+  for (auto &packet: right_packets)
+    AVCODEC.av_packet_free(&packet);
+  AVCODEC.avcodec_free_context(&right_encoder_ctx);
+  for (auto &slot_frames: eye_frames)
+    for (auto &eye_frame: slot_frames)
+      AVUTIL.av_frame_free(&eye_frame);
   for (auto &vk_frame: vk_frames)
     AVUTIL.av_frame_free(&vk_frame);
   AVUTIL.av_frame_free(&transferred_frame);
-  AVUTIL.av_frame_free(&encoder_frame);
+  for (auto &encoder_frame: encoder_frames)
+    AVUTIL.av_frame_free(&encoder_frame);
 }
 
-void alvr::EncodePipelineSW::PushFrame(uint32_t frame_index, bool idr)
+// The frame is downloaded and converted before ConvertFrame() returns, the input can be reused.
+void alvr::EncodePipelineSW::ConvertFrame(uint32_t frame_index, int slot)
 {
+  AVFrame *encoder_frame = encoder_frames[slot];
   int err = AVUTIL.av_hwframe_transfer_data(transferred_frame, vk_frames[frame_index], 0);
   if (err)
     throw alvr::AvException("av_hwframe_transfer_data", err);
 
-  err = SWSCALE.sws_scale(scaler_ctx, transferred_frame->data, transferred_frame->linesize, 0, transferred_frame->height,
-      encoder_frame->data, encoder_frame->linesize);
-  if (err == 0)
-    throw alvr::AvException("sws_scale failed:", err);
+  if (color_converter)
+  {
+    color_converter->convert(transferred_frame->data[0], transferred_frame->linesize[0],
+        encoder_frame->data, encoder_frame->linesize);
+  }
+  else
+  {
+    err = SWSCALE.sws_scale(scaler_ctx, transferred_frame->data, transferred_frame->linesize, 0, transferred_frame->height,
+        encoder_frame->data, encoder_frame->linesize);
+    if (err == 0)
+      throw alvr::AvException("sws_scale failed:", err);
+  }
 
-  encoder_frame->pict_type = idr ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_NONE;
   encoder_frame->pts = std::chrono::steady_clock::now().time_since_epoch().count();
+  if (right_encoder_ctx)
+  {
+    eye_frames[slot][0]->pts = encoder_frame->pts;
+    eye_frames[slot][1]->pts = encoder_frame->pts;
+  }
+}
 
-  if ((err = AVCODEC.avcodec_send_frame(encoder_ctx, encoder_frame)) < 0) {
-    throw alvr::AvException("avcodec_send_frame failed:", err);
+void alvr::EncodePipelineSW::EncodeFrame(int slot, bool idr)
+{
+  auto pict_type = idr ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_NONE;
+  if (right_encoder_ctx)
+  {
+    eye_frames[slot][0]->pict_type = pict_type;
+    eye_frames[slot][1]->pict_type = pict_type;
+    {
+      std::lock_guard<std::mutex> lock(right_mutex);
+      right_slot = slot;
+      right_done = false;
+    }
+    right_cv.notify_all();
+    right_pending = true;
+    send_frame(encoder_ctx, eye_frames[slot][0]);
+    return;
+  }
+
+  AVFrame *encoder_frame = encoder_frames[slot];
+  encoder_frame->pict_type = pict_type;
+  send_frame(encoder_ctx, encoder_frame);
+}
+
+// The left eye first, then the right eye once its encoder is done. The client cuts the frame at
+// the start of the second picture.
+bool alvr::EncodePipelineSW::GetEncoded(EncodeOutput &out)
+{
+  if (EncodePipeline::GetEncoded(out))
+    return true;
+  if (not right_pending)
+    return false;
+  right_pending = false;
+
+  std::vector<AVPacket *> packets;
+  std::exception_ptr error;
+  {
+    std::unique_lock<std::mutex> lock(right_mutex);
+    right_cv.wait(lock, [this] { return right_done; });
+    packets.swap(right_packets);
+    std::swap(error, right_error);
   }
+  for (auto &packet: packets)
+  {
+    if (not error)
+      filter_NAL(packet->data, packet->size, out);
+    AVCODEC.av_packet_free(&packet);
+  }
+  if (error)
+    std::rethrow_exception(error);
+  return true;
+}
+
+void alvr::EncodePipelineSW::right_eye_worker()
+{
+  pthread_setname_np(pthread_self(), "alvr-encode-r");
+  std::unique_lock<std::mutex> lock(right_mutex);
+  for (;;)
+  {
+    right_cv.wait(lock, [this] { return exiting or right_slot >= 0; });
+    if (exiting)
+      return;
+    int slot = right_slot;
+    lock.unlock();
+
+    std::vector<AVPacket *> packets;
+    std::exception_ptr error;
+    try
+    {
+      send_frame(right_encoder_ctx, eye_frames[slot][1]);
+      for (;;)
+      {
+        AVPacket *packet = AVCODEC.av_packet_alloc();
+        int err = AVCODEC.avcodec_receive_packet(right_encoder_ctx, packet);
+        if (err)
+        {
+          AVCODEC.av_packet_free(&packet);
+          if (err == AVERROR(EAGAIN))
+            break;
+          throw alvr::AvException("failed to encode", err);
+        }
+        packets.push_back(packet);
+      }
+    }
+    catch (...)
+    {
+      error = std::current_exception();
+    }
+
+    lock.lock();
+    right_packets = std::move(packets);
+    right_error = error;
+    right_slot = -1;
+    right_done = true;
+    right_cv.notify_all();
+  }
+}
+
+void alvr::EncodePipelineSW::SetBitrate(int64_t bitrate)
+{
+  // libx264 reconfigures its rate control when bit_rate changed before the next frame.
+  if (right_encoder_ctx)
+  {
+    // The right eye encoder is idle, GetEncoded() waited for its previous frame.
+    encoder_ctx->bit_rate = bitrate / 2;
+    right_encoder_ctx->bit_rate = bitrate / 2;
+    return;
+  }
+  encoder_ctx->bit_rate = bitrate;
+}
+
+bool alvr::EncodePipelineSW::SupportsBitrateChange()
+{
+  // libx265 is not reconfigured by libavcodec while encoding.
+  return Settings::Instance().m_codec != ALVR_CODEC_H265;
 }
@@ -2,24 +2,60 @@
 
 #include "EncodePipeline.h"
 
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+
 extern "C" struct AVFrame;
+extern "C" struct AVPacket;
 extern "C" struct SwsContext;
 
 namespace alvr
 {
 
+class ColorConverter;
+
 class EncodePipelineSW: public EncodePipeline
 {
 public:
   ~EncodePipelineSW();
   EncodePipelineSW(std::vector<VkFrame> &input_frames, VkFrameCtx& vk_frame_ctx);
 
-  void PushFrame(uint32_t frame_index, bool idr) override;
+  void ConvertFrame(uint32_t frame_index, int slot) override;
+  void EncodeFrame(int slot, bool idr) override;
+  int IntraRefreshPeriod() override { return intra_refresh_period; }
+  void SetBitrate(int64_t bitrate) override;
+  bool SupportsBitrateChange() override;
+  bool GetEncoded(EncodeOutput & out) override;
 
 private:
+  void right_eye_worker();
+
   std::vector<AVFrame *> vk_frames;
   AVFrame * transferred_frame = nullptr;
-  AVFrame * encoder_frame = nullptr;
+  AVFrame * encoder_frames[INPUT_SLOTS] = {};
+  // The converter when the size does not change and the input is packed RGB, swscale otherwise.
+  std::unique_ptr<ColorConverter> color_converter;
   SwsContext *scaler_ctx = nullptr;
+  int intra_refresh_period = 0;
+
+  // Split encoding: encoder_ctx encodes the left eye on the calling thread while
+  // right_encoder_ctx encodes the right one on right_thread. The eye frames are the halves of
+  // encoder_frames, without copy.
+  AVCodecContext *right_encoder_ctx = nullptr;
+  AVFrame * eye_frames[INPUT_SLOTS][2] = {};
+  std::thread right_thread;
+  std::mutex right_mutex;
+  std::condition_variable right_cv;
+  // Slot the right eye encoder is asked to encode, -1 when it has nothing to do.
+  int right_slot = -1;
+  bool right_done = false;
+  bool exiting = false;
+  // Output of the last frame of the right eye, and what it threw.
+  std::vector<AVPacket *> right_packets;
+  std::exception_ptr right_error;
+  // The right eye output of the frame encoded last was not given to GetEncoded() yet.
+  bool right_pending = false;
 };
 }
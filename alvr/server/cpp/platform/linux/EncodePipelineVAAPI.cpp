@@ -2,6 +2,7 @@
 #include "ALVR-common/packet_types.h"
 #include "ffmpeg_helper.h"
 #include "alvr_server/Settings.h"
+#include "alvr_server/Logger.h"
 #include <chrono>
 
 extern "C" {
@@ -112,49 +113,23 @@ alvr::EncodePipelineVAAPI::EncodePipelineVAAPI(std::vector<VkFrame>& input_frame
 
   const auto& settings = Settings::Instance();
 
-  auto codec_id = ALVR_CODEC(settings.m_codec);
-  const char * encoder_name = encoder(codec_id);
-  AVCodec *codec = AVCODEC.avcodec_find_encoder_by_name(encoder_name);
+  const char * encoder_name = encoder(ALVR_CODEC(settings.m_codec));
+  codec = AVCODEC.avcodec_find_encoder_by_name(encoder_name);
   if (codec == nullptr)
   {
     throw std::runtime_error(std::string("Failed to find encoder ") + encoder_name);
   }
 
-  encoder_ctx = AVCODEC.avcodec_alloc_context3(codec);
-  if (not encoder_ctx)
-  {
-    throw std::runtime_error("failed to allocate VAAPI encoder");
-  }
-
-  switch (codec_id)
-  {
-    case ALVR_CODEC_H264:
-      encoder_ctx->profile = FF_PROFILE_H264_MAIN;
-      AVUTIL.av_opt_set(encoder_ctx, "rc_mode", "2", 0); //CBR
-      break;
-    case ALVR_CODEC_H265:
-      encoder_ctx->profile = FF_PROFILE_HEVC_MAIN;
-      AVUTIL.av_opt_set(encoder_ctx, "rc_mode", "2", 0);
-      break;
-  }
-
-  encoder_ctx->width = settings.m_renderWidth;
-  encoder_ctx->height = settings.m_renderHeight;
-  encoder_ctx->time_base = {std::chrono::steady_clock::period::num, std::chrono::steady_clock::period::den};
-  encoder_ctx->framerate = AVRational{settings.m_refreshRate, 1};
-  encoder_ctx->sample_aspect_ratio = AVRational{1, 1};
-  encoder_ctx->pix_fmt = AV_PIX_FMT_VAAPI;
-  encoder_ctx->max_b_frames = 0;
-  encoder_ctx->bit_rate = settings.mEncodeBitrateMBs * 1024 * 1024;
-
-  set_hwframe_ctx(encoder_ctx, hw_ctx);
+  // libavcodec has no option for the rolling intra refresh of VAAPI drivers.
+  if (settings.m_enableIntraRefresh)
+    Info("intra refresh is not available with VAAPI, using keyframes");
 
-  err = AVCODEC.avcodec_open2(encoder_ctx, codec, NULL);
-  if (err < 0) {
-    throw alvr::AvException("Cannot open video encoder codec:", err);
-  }
+  open_encoder(settings.mEncodeBitrateMBs * 1024 * 1024);
+  target_bitrate = encoder_ctx->bit_rate;
 
   mapped_frames = map_frames(hw_ctx, input_frames, vk_frame_ctx);
+  for (auto &encoder_frame: encoder_frames)
+    encoder_frame = AVUTIL.av_frame_alloc();
 
   filter_graph = AVFILTER.avfilter_graph_alloc();
 
@@ -214,13 +189,68 @@ alvr::EncodePipelineVAAPI::~EncodePipelineVAAPI()
   {
     AVUTIL.av_frame_free(&frame);
   }
+  for (auto &frame: encoder_frames)
+  {
+    AVUTIL.av_frame_free(&frame);
+  }
   AVUTIL.av_buffer_unref(&hw_ctx);
 }
 
-void alvr::EncodePipelineVAAPI::PushFrame(uint32_t frame_index, bool idr)
+// The VAAPI encoder of libavcodec only gives its rate control parameters to the driver when it is
+// opened, so the encoder is opened again with the new bitrate. Frames still in flight in the old
+// encoder are dropped, the new one starts with an IDR.
+void alvr::EncodePipelineVAAPI::open_encoder(int64_t bitrate)
+{
+  const auto& settings = Settings::Instance();
+
+  AVCODEC.avcodec_free_context(&encoder_ctx);
+  encoder_ctx = AVCODEC.avcodec_alloc_context3(codec);
+  if (not encoder_ctx)
+  {
+    throw std::runtime_error("failed to allocate VAAPI encoder");
+  }
+
+  switch (ALVR_CODEC(settings.m_codec))
+  {
+    case ALVR_CODEC_H264:
+      encoder_ctx->profile = FF_PROFILE_H264_MAIN;
+      AVUTIL.av_opt_set(encoder_ctx, "rc_mode", "2", 0); //CBR
+      break;
+    case ALVR_CODEC_H265:
+      encoder_ctx->profile = FF_PROFILE_HEVC_MAIN;
+      AVUTIL.av_opt_set(encoder_ctx, "rc_mode", "2", 0);
+      break;
+  }
+
+  encoder_ctx->width = settings.m_renderWidth;
+  encoder_ctx->height = settings.m_renderHeight;
+  encoder_ctx->time_base = {std::chrono::steady_clock::period::num, std::chrono::steady_clock::period::den};
+  encoder_ctx->framerate = AVRational{settings.m_refreshRate, 1};
+  encoder_ctx->sample_aspect_ratio = AVRational{1, 1};
+  encoder_ctx->pix_fmt = AV_PIX_FMT_VAAPI;
+  encoder_ctx->max_b_frames = 0;
+  encoder_ctx->bit_rate = bitrate;
+  // The driver may round the slice count to what the hardware supports.
+  encoder_ctx->slices = settings.m_encoderSlices;
+
+  set_hwframe_ctx(encoder_ctx, hw_ctx);
+
+  int err = AVCODEC.avcodec_open2(encoder_ctx, codec, NULL);
+  if (err < 0) {
+    throw alvr::AvException("Cannot open video encoder codec:", err);
+  }
+}
+
+void alvr::EncodePipelineVAAPI::SetBitrate(int64_t bitrate)
+{
+  target_bitrate = bitrate;
+}
+
+void alvr::EncodePipelineVAAPI::ConvertFrame(uint32_t frame_index, int slot)
 {
   assert(frame_index < mapped_frames.size());
-  AVFrame *encoder_frame = AVUTIL.av_frame_alloc();
+  AVFrame *encoder_frame = encoder_frames[slot];
+  AVUTIL.av_frame_unref(encoder_frame);
   int err = AVFILTER.av_buffersrc_add_frame_flags(filter_in, mapped_frames[frame_index], AV_BUFFERSRC_FLAG_PUSH | AV_BUFFERSRC_FLAG_KEEP_REF);
   if (err != 0)
   {
@@ -232,9 +262,24 @@ void alvr::EncodePipelineVAAPI::PushFrame(uint32_t frame_index, bool idr)
     throw alvr::AvException("av_buffersink_get_frame failed", err);
   }
 
-  encoder_frame->pict_type = idr ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_NONE;
   encoder_frame->pts = std::chrono::steady_clock::now().time_since_epoch().count();
+}
+
+void alvr::EncodePipelineVAAPI::EncodeFrame(int slot, bool idr)
+{
+  // Opening the encoder again costs an IDR: only do it for large changes, or when an IDR is due
+  // anyway.
+  int64_t current_bitrate = encoder_ctx->bit_rate;
+  if (target_bitrate != current_bitrate and
+      (idr or target_bitrate < current_bitrate * 3 / 4 or target_bitrate > current_bitrate * 5 / 4))
+  {
+    open_encoder(target_bitrate);
+  }
+
+  AVFrame *encoder_frame = encoder_frames[slot];
+  encoder_frame->pict_type = idr ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_NONE;
 
+  int err;
   if ((err = AVCODEC.avcodec_send_frame(encoder_ctx, encoder_frame)) < 0) {
     throw alvr::AvException("avcodec_send_frame failed: ", err);
   }
@@ -3,6 +3,7 @@
 #include "EncodePipeline.h"
 
 extern "C" struct AVBufferRef;
+extern "C" struct AVCodec;
 extern "C" struct AVCodecContext;
 extern "C" struct AVFilterContext;
 extern "C" struct AVFilterGraph;
@@ -17,11 +18,20 @@ public:
   ~EncodePipelineVAAPI();
   EncodePipelineVAAPI(std::vector<VkFrame> &input_frames, VkFrameCtx& vk_frame_ctx);
 
-  void PushFrame(uint32_t frame_index, bool idr) override;
+  void ConvertFrame(uint32_t frame_index, int slot) override;
+  // The conversion only queues work on the GPU, it is waited for by the encoder.
+  bool ReadsInputUntilEncoded() override { return true; }
+  void EncodeFrame(int slot, bool idr) override;
+  void SetBitrate(int64_t bitrate) override;
 
 private:
+  void open_encoder(int64_t bitrate);
+
+  AVCodec *codec = nullptr;
+  int64_t target_bitrate = 0;
   AVBufferRef *hw_ctx = nullptr;
   std::vector<AVFrame *> mapped_frames;
+  AVFrame *encoder_frames[INPUT_SLOTS] = {};
   AVFilterGraph *filter_graph = nullptr;
   AVFilterContext *filter_in = nullptr;
   AVFilterContext *filter_out = nullptr;
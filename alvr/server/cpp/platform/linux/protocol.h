@@ -2,10 +2,13 @@
 
 #include <array>
 #include <atomic>
-#include <condition_variable>
+#include <chrono>
 #include <cstdint>
 #include <cstdlib>
-#include <mutex>
+#include <ctime>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 #include <vulkan/vulkan.h>
 
 struct init_packet {
@@ -20,13 +23,98 @@ struct present_info {
     float pose[3][4];
 };
 
+// Hand-off of the presented images from the vulkan layer (producer, in vrcompositor) to CEncoder
+// (consumer, in the driver), in memory shared by the two processes.
+// At most one image is pending (the latest presented, not taken yet) and one is owned by the
+// consumer, the producer renders into the others: a triple buffer of image indices. Both indices
+// and the number of presents so far are packed in a single atomic word, so that every transition
+// is one compare and swap, and the consumer sleeps on that word with a futex. Unlike std::mutex
+// and std::condition_variable, futexes are meant to work across processes on shared mappings.
+// The info of an image is written before it is presented and read after it is acquired.
 struct present_shm {
-	std::mutex mutex;
-	std::condition_variable cv;
-	uint32_t next = none_id; // latest frame being offered by producer
-	std::atomic<uint32_t> owned_by_consumer{none_id};
+	std::atomic<uint32_t> state{pack(none_id, none_id, 0)};
 	uint32_t size;
 	present_info info[];
 
-	static const uint32_t none_id = -1;
+	static const uint32_t none_id = 0xff;
+
+	// Producer side. Makes image the pending one, returns the image it replaces if the consumer
+	// did not take it, none_id otherwise.
+	uint32_t present(uint32_t image)
+	{
+		uint32_t old = state.load(std::memory_order_relaxed);
+		while (not state.compare_exchange_weak(old, pack(image, owned(old), sequence(old) + 1),
+		                                       std::memory_order_acq_rel, std::memory_order_relaxed))
+		{
+		}
+		wake();
+		return pending(old);
+	}
+
+	// Producer side. Image the consumer is reading, none_id if none. An image seen as not owned
+	// cannot become owned until it is presented again.
+	uint32_t owned_by_consumer() const
+	{
+		return owned(state.load(std::memory_order_acquire));
+	}
+
+	// Consumer side. Takes the pending image once the previous one was released, waiting at most
+	// timeout. Returns none_id on timeout. presents is set to the number of presents so far,
+	// modulo 2^16, to count the images replaced before the consumer took them.
+	uint32_t acquire(std::chrono::nanoseconds timeout, uint32_t *presents = nullptr)
+	{
+		auto deadline = std::chrono::steady_clock::now() + timeout;
+		uint32_t old = state.load(std::memory_order_acquire);
+		while (true)
+		{
+			if (pending(old) != none_id and owned(old) == none_id)
+			{
+				if (state.compare_exchange_weak(old, pack(none_id, pending(old), sequence(old)),
+				                                std::memory_order_acq_rel, std::memory_order_acquire))
+				{
+					if (presents)
+						*presents = sequence(old);
+					return pending(old);
+				}
+				continue;
+			}
+			auto remaining = deadline - std::chrono::steady_clock::now();
+			if (remaining <= std::chrono::nanoseconds::zero())
+				return none_id;
+			auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(remaining).count();
+			timespec wait_time{.tv_sec = time_t(ns / 1000000000), .tv_nsec = long(ns % 1000000000)};
+			// Returns at once if the word is no longer old.
+			syscall(SYS_futex, word(), FUTEX_WAIT, old, &wait_time, nullptr, 0);
+			old = state.load(std::memory_order_acquire);
+		}
+	}
+
+	// Consumer side. Gives the acquired image back to the producer.
+	void release()
+	{
+		uint32_t old = state.load(std::memory_order_relaxed);
+		while (not state.compare_exchange_weak(old, pack(pending(old), none_id, sequence(old)),
+		                                       std::memory_order_acq_rel, std::memory_order_relaxed))
+		{
+		}
+		wake();
+	}
+
+private:
+	static uint32_t pack(uint32_t pending, uint32_t owned, uint32_t sequence)
+	{
+		return pending | owned << 8 | (sequence & 0xffff) << 16;
+	}
+	static uint32_t pending(uint32_t state) { return state & 0xff; }
+	static uint32_t owned(uint32_t state) { return (state >> 8) & 0xff; }
+	static uint32_t sequence(uint32_t state) { return state >> 16; }
+
+	uint32_t *word()
+	{
+		static_assert(sizeof(state) == sizeof(uint32_t) and std::atomic<uint32_t>::is_always_lock_free);
+		return reinterpret_cast<uint32_t *>(&state);
+	}
+
+	// Not FUTEX_WAKE_PRIVATE, the waiter is in the other process.
+	void wake() { syscall(SYS_futex, word(), FUTEX_WAKE, INT32_MAX, nullptr, nullptr, 0); }
 };
@@ -78,7 +78,15 @@
 
 				if (m_FrameRender->GetTexture())
 				{
-					m_videoEncoder->Transmit(m_FrameRender->GetTexture().Get(), m_presentationTime, m_frameIndex, m_frameIndex2, m_clientTime, m_scheduler.CheckIDRInsertion());
+					EncodeFrameInfo info = {};
+					int maxInvalidatedFrames = m_videoEncoder->GetMaxInvalidatedFrames();
+					if (maxInvalidatedFrames > 0) {
+						info = m_scheduler.NextFrame(m_frameIndex, maxInvalidatedFrames);
+					} else {
+						info.insertIDR = m_scheduler.CheckIDRInsertion();
+						info.invalidateFrom = 1;
+					}
+					m_videoEncoder->Transmit(m_FrameRender->GetTexture().Get(), m_presentationTime, m_frameIndex, m_frameIndex2, m_clientTime, info);
 				}
 
 				m_frameIndex2++;
@@ -115,6 +123,10 @@
 			m_scheduler.OnPacketLoss();
 		}
 
+		void CEncoder::OnFrameAck(uint64_t frameIndex) {
+			m_scheduler.OnFrameAck(frameIndex);
+		}
+
 		void CEncoder::InsertIDR() {
 			m_scheduler.InsertIDR();
 		}
\ No newline at end of file
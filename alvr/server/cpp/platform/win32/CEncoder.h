@@ -48,6 +48,8 @@
 
 		void OnPacketLoss();
 
+		void OnFrameAck(uint64_t frameIndex);
+
 		void InsertIDR();
 
 	private:
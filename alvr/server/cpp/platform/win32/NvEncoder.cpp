@@ -509,6 +509,11 @@ void NvEncoder::GetEncodedPacket(std::vector<NV_ENC_OUTPUT_PTR> &vOutputBuffer,
     }
 }
 
+void NvEncoder::InvalidateRefFrames(uint64_t invalidRefFrameTimeStamp)
+{
+    NVENC_API_CALL(m_nvenc.nvEncInvalidateRefFrames(m_hEncoder, invalidRefFrameTimeStamp));
+}
+
 bool NvEncoder::Reconfigure(const NV_ENC_RECONFIGURE_PARAMS *pReconfigureParams)
 {
     NVENC_API_CALL(m_nvenc.nvEncReconfigureEncoder(m_hEncoder, const_cast<NV_ENC_RECONFIGURE_PARAMS*>(pReconfigureParams)));
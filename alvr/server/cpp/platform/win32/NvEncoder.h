@@ -141,6 +141,13 @@ public:
     */
     int GetCapabilityValue(GUID guidCodec, NV_ENC_CAPS capsToQuery);
 
+    /**
+    *  @brief  This function is used to invalidate a reference frame.
+    *  The encoder stops using the frame encoded with this timestamp for motion
+    *  estimation. It codes an intra frame if no reference frame is left.
+    */
+    void InvalidateRefFrames(uint64_t invalidRefFrameTimeStamp);
+
     /**
     *  @brief  This function is used to get the current device on which encoder is running.
     */
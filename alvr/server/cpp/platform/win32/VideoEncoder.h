@@ -3,6 +3,7 @@
 #include <memory>
 #include "shared/d3drender.h"
 #include "alvr_server/ClientConnection.h"
+#include "alvr_server/IDRScheduler.h"
 #include "NvEncoderD3D11.h"
 
 class VideoEncoder
@@ -11,5 +12,9 @@ public:
 	virtual void Initialize() = 0;
 	virtual void Shutdown() = 0;
 
-	virtual void Transmit(ID3D11Texture2D *pTexture, uint64_t presentationTime, uint64_t frameIndex, uint64_t frameIndex2, uint64_t clientTime, bool insertIDR) = 0;
+	virtual void Transmit(ID3D11Texture2D *pTexture, uint64_t presentationTime, uint64_t frameIndex, uint64_t frameIndex2, uint64_t clientTime, const EncodeFrameInfo &info) = 0;
+
+	// Number of recent frames the encoder can stop referencing, to recover from a loss without an IDR.
+	// 0 if it cannot invalidate references.
+	virtual int GetMaxInvalidatedFrames() { return 0; }
 };
@@ -91,7 +91,7 @@ void VideoEncoderNVENC::Shutdown()
 	}
 }
 
-void VideoEncoderNVENC::Transmit(ID3D11Texture2D *pTexture, uint64_t presentationTime, uint64_t frameIndex, uint64_t frameIndex2, uint64_t clientTime, bool insertIDR)
+void VideoEncoderNVENC::Transmit(ID3D11Texture2D *pTexture, uint64_t presentationTime, uint64_t frameIndex, uint64_t frameIndex2, uint64_t clientTime, const EncodeFrameInfo &info)
 {
 	std::vector<std::vector<uint8_t>> vPacket;
 
@@ -101,10 +101,14 @@ void VideoEncoderNVENC::Transmit(ID3D11Texture2D *pTexture, uint64_t presentatio
 	m_pD3DRender->GetContext()->CopyResource(pInputTexture, pTexture);
 
 	NV_ENC_PIC_PARAMS picParams = {};
-	if (insertIDR) {
+	picParams.inputTimeStamp = info.frameNumber;
+	if (info.insertIDR) {
 		Debug("Inserting IDR frame.\n");
 		picParams.encodePicFlags = NV_ENC_PIC_FLAG_FORCEIDR;
 	}
+	for (uint64_t frameNumber = info.invalidateFrom; frameNumber <= info.invalidateTo; frameNumber++) {
+		m_NvNecoder->InvalidateRefFrames(frameNumber);
+	}
 	m_NvNecoder->EncodeFrame(vPacket, &picParams);
 
 	Debug("Tracking info delay: %lld us FrameIndex=%llu\n", GetTimestampUs() - m_Listener->clientToServerTime(clientTime), frameIndex);
@@ -121,11 +125,16 @@ void VideoEncoderNVENC::Transmit(ID3D11Texture2D *pTexture, uint64_t presentatio
 			fpOut.write(reinterpret_cast<char*>(packet.data()), packet.size());
 		}
 		if (m_Listener) {
-			m_Listener->SendVideo(packet.data(), (int)packet.size(), frameIndex);
+			m_Listener->SendVideo(packet.data(), (int)packet.size(), frameIndex, info.recoveryFrame);
 		}
 	}
 }
 
+int VideoEncoderNVENC::GetMaxInvalidatedFrames()
+{
+	return mSupportsReferenceFrameInvalidation ? MAX_INVALIDATED_FRAMES : 0;
+}
+
 void VideoEncoderNVENC::FillEncodeConfig(NV_ENC_INITIALIZE_PARAMS &initializeParams, int refreshRate, int renderWidth, int renderHeight, uint64_t bitrateBits)
 {
 	auto &encodeConfig = *initializeParams.encodeConfig;
@@ -156,8 +165,8 @@ void VideoEncoderNVENC::FillEncodeConfig(NV_ENC_INITIALIZE_PARAMS &initializePar
 	Debug("VideoEncoderNVENC: SupportsIntraRefresh: %d\n", supportsIntraRefresh);
 
 	// 16 is recommended when using reference frame invalidation. But it has caused bad visual quality.
-	// Now, use 0 (use default).
-	int maxNumRefFrames = 0;
+	// Keep just enough backup references to predict from the last frame acknowledged by the client.
+	int maxNumRefFrames = mSupportsReferenceFrameInvalidation ? MAX_INVALIDATED_FRAMES + 1 : 0;
 
 	if (m_codec == ALVR_CODEC_H264) {
 		auto &config = encodeConfig.encodeCodecConfig.h264Config;
@@ -18,8 +18,12 @@ public:
 	void Initialize();
 	void Shutdown();
 
-	void Transmit(ID3D11Texture2D *pTexture, uint64_t presentationTime, uint64_t frameIndex, uint64_t frameIndex2, uint64_t clientTime, bool insertIDR);
+	void Transmit(ID3D11Texture2D *pTexture, uint64_t presentationTime, uint64_t frameIndex, uint64_t frameIndex2, uint64_t clientTime, const EncodeFrameInfo &info);
+	int GetMaxInvalidatedFrames();
 private:
+	// Frames that can be invalidated after a loss. The DPB keeps one more, the last acknowledged frame.
+	static const int MAX_INVALIDATED_FRAMES = 8;
+
 	void FillEncodeConfig(NV_ENC_INITIALIZE_PARAMS &initializeParams, int refreshRate, int renderWidth, int renderHeight, uint64_t bitrateBits);
 
 
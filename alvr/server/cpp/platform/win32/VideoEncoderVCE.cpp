@@ -285,7 +285,7 @@ void VideoEncoderVCE::Shutdown()
 	Debug("Successfully shutdown VideoEncoderVCE.\n");
 }
 
-void VideoEncoderVCE::Transmit(ID3D11Texture2D *pTexture, uint64_t presentationTime, uint64_t frameIndex, uint64_t frameIndex2, uint64_t clientTime, bool insertIDR)
+void VideoEncoderVCE::Transmit(ID3D11Texture2D *pTexture, uint64_t presentationTime, uint64_t frameIndex, uint64_t frameIndex2, uint64_t clientTime, const EncodeFrameInfo &info)
 {
 	amf::AMFSurfacePtr surface;
 	// Surface is cached by AMF.
@@ -297,7 +297,7 @@ void VideoEncoderVCE::Transmit(ID3D11Texture2D *pTexture, uint64_t presentationT
 	surface->SetProperty(START_TIME_PROPERTY, start_time);
 	surface->SetProperty(FRAME_INDEX_PROPERTY, frameIndex);
 
-	ApplyFrameProperties(surface, insertIDR);
+	ApplyFrameProperties(surface, info.insertIDR);
 
 	Debug("Submit surface. frameIndex=%llu\n", frameIndex);
 	m_converter->Submit(surface);
@@ -329,7 +329,7 @@ void VideoEncoderVCE::Receive(amf::AMFData *data)
 		fpOut.write(p, length);
 	}
 	if (m_Listener) {
-		m_Listener->SendVideo(reinterpret_cast<uint8_t *>(p), length, frameIndex);
+		m_Listener->SendVideo(reinterpret_cast<uint8_t *>(p), length, frameIndex, false);
 	}
 }
 
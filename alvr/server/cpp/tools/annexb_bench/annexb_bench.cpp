@@ -0,0 +1,284 @@
+// Host-only benchmark of the Annex B parsing shared by the server and the client (annexb.h).
+// Synthetic keyframes of a few hundred kilobytes are scanned for start codes with the byte-wise
+// std::search the Linux encoder used before, with the scalar reference, and with the vector search
+// picked for this CPU, then filtered in place.
+//
+// Build and run with "cargo xtask bench-annexb". Every configuration prints one JSON object per
+// line on stdout. Throughputs are in MB/s of input. Before measuring, the vector search is checked
+// against the scalar one at every position of random buffers, the in-place filter against the
+// previous filter, and the split of two pictures sent back to back; the program fails on any
+// difference.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include "annexb.h"
+
+namespace {
+	const double MEASURE_SECONDS = 0.2;
+
+	// Content of the slices. Noise is close to what high bitrate slices look like; sparse has many
+	// zero bytes, so the scalar search meets many candidates.
+	enum Content {
+		CONTENT_NOISE,
+		CONTENT_SPARSE,
+	};
+
+	const char *ContentName(Content content) {
+		return content == CONTENT_NOISE ? "noise" : "sparse";
+	}
+
+	class StreamWriter {
+	public:
+		explicit StreamWriter(std::mt19937 &rng) : m_rng(rng) {}
+
+		void StartNal(int type, bool h265, bool longStartCode) {
+			if (longStartCode) {
+				m_data.push_back(0);
+			}
+			m_data.insert(m_data.end(), { 0, 0, 1 });
+			m_zeros = 0;
+			if (h265) {
+				WriteByte((uint8_t)(type << 1));
+				WriteByte(1);
+			} else {
+				WriteByte((uint8_t)(0x60 | type));
+			}
+			m_nals++;
+		}
+
+		// With emulation prevention, as an encoder writes it.
+		void WriteByte(uint8_t byte) {
+			if (m_zeros >= 2 && byte <= 3) {
+				m_data.push_back(3);
+				m_zeros = 0;
+			}
+			m_data.push_back(byte);
+			m_zeros = byte == 0 ? m_zeros + 1 : 0;
+		}
+
+		void WritePayload(size_t size, Content content) {
+			std::uniform_int_distribution<int> byteDist(0, 255);
+			std::uniform_int_distribution<int> sparseDist(0, 3);
+			for (size_t i = 0; i < size; i++) {
+				uint8_t byte = (uint8_t)byteDist(m_rng);
+				if (content == CONTENT_SPARSE && sparseDist(m_rng) != 0) {
+					byte = 0;
+				}
+				WriteByte(byte);
+			}
+			// rbsp_stop_one_bit
+			WriteByte(0x80);
+		}
+
+		std::vector<uint8_t> &Data() { return m_data; }
+		int Nals() const { return m_nals; }
+
+	private:
+		std::mt19937 &m_rng;
+		std::vector<uint8_t> m_data;
+		int m_zeros = 0;
+		int m_nals = 0;
+	};
+
+	// Access unit delimiter, parameter sets, an SEI as x264 writes, then the slices of a keyframe.
+	std::vector<uint8_t> MakeKeyframe(size_t size, bool h265, int slices, Content content, int &nals, std::mt19937 &rng) {
+		StreamWriter writer(rng);
+		if (h265) {
+			writer.StartNal(35, true, true);
+			writer.WritePayload(1, CONTENT_NOISE);
+			writer.StartNal(32, true, true);
+			writer.WritePayload(20, CONTENT_NOISE);
+		} else {
+			writer.StartNal(9, false, true);
+			writer.WritePayload(1, CONTENT_NOISE);
+		}
+		writer.StartNal(h265 ? 33 : 7, h265, true);
+		writer.WritePayload(30, CONTENT_NOISE);
+		writer.StartNal(h265 ? 34 : 8, h265, true);
+		writer.WritePayload(8, CONTENT_NOISE);
+		writer.StartNal(h265 ? 39 : 6, h265, true);
+		writer.WritePayload(600, CONTENT_NOISE);
+		size_t sliceSize = size / slices;
+		for (int i = 0; i < slices; i++) {
+			writer.StartNal(h265 ? 19 : 5, h265, i == 0);
+			// first_mb_in_slice or first_slice_segment_in_pic_flag, then the rest of the header.
+			writer.WriteByte(i == 0 ? 0x88 : 0x24);
+			writer.WritePayload(sliceSize, content);
+		}
+		nals = writer.Nals();
+		return std::move(writer.Data());
+	}
+
+	// filter_NAL of the Linux encoder before annexb.h, appending the kept NAL units to out.
+	void ReferenceFilter(const uint8_t *input, size_t inputSize, bool h265, std::vector<uint8_t> &out) {
+		std::array<uint8_t, 3> header = { { 0, 0, 1 } };
+		auto end = input + inputSize;
+		auto headerStart = input;
+		while (headerStart != end) {
+			auto nextHeader = std::search(headerStart + 3, end, header.begin(), header.end());
+			if (nextHeader != end && nextHeader[-1] == 0) {
+				nextHeader--;
+			}
+			uint8_t byte = headerStart[2] == 0 ? headerStart[4] : headerStart[3];
+			int type = h265 ? (byte >> 1) & 0x3F : byte & 0x1F;
+			if (!AnnexBIsDroppable(type, h265)) {
+				out.insert(out.end(), headerStart, nextHeader);
+			}
+			headerStart = nextHeader;
+		}
+	}
+
+	int CountStartCodes(const uint8_t *data, size_t size, const uint8_t *(*find)(const uint8_t *, const uint8_t *)) {
+		const uint8_t *end = data + size;
+		int count = 0;
+		for (const uint8_t *p = find(data, end); p != end; p = find(p + 3, end)) {
+			count++;
+		}
+		return count;
+	}
+
+	// Compares the vector and scalar searches from every position of random buffers of every
+	// small size, at every alignment.
+	bool CheckSearch(std::mt19937 &rng) {
+		std::uniform_int_distribution<int> byteDist(0, 255);
+		std::uniform_int_distribution<int> sparseDist(0, 2);
+		std::vector<uint8_t> storage(256 + 64);
+		for (int round = 0; round < 2000; round++) {
+			size_t offset = round % 64;
+			size_t size = round % 256;
+			uint8_t *data = storage.data() + offset;
+			for (size_t i = 0; i < size; i++) {
+				// Mostly 0 and 1, so that start codes and near misses are everywhere.
+				int r = sparseDist(rng);
+				data[i] = r == 0 ? 0 : r == 1 ? 1 : (uint8_t)byteDist(rng);
+			}
+			for (size_t start = 0; start <= size; start++) {
+				if (AnnexBFindStartCode(data + start, data + size) != AnnexBFindStartCodeScalar(data + start, data + size)) {
+					fprintf(stderr, "Start code search mismatch: size %zu, offset %zu, start %zu\n", size, offset, start);
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	bool CheckFilter(const std::vector<uint8_t> &frame, bool h265, int nals) {
+		int parsed = 0;
+		AnnexBParser parser(frame.data(), frame.size(), h265);
+		AnnexBNal nal;
+		while (parser.Next(nal)) {
+			parsed++;
+		}
+		std::vector<uint8_t> expected;
+		ReferenceFilter(frame.data(), frame.size(), h265, expected);
+		std::vector<uint8_t> filtered = frame;
+		filtered.resize(AnnexBFilterInPlace(filtered.data(), filtered.size(), h265));
+		if (parsed != nals || filtered != expected) {
+			fprintf(stderr, "Filter mismatch: %d NAL units parsed out of %d, %zu bytes kept instead of %zu\n",
+				parsed, nals, filtered.size(), expected.size());
+			return false;
+		}
+		return true;
+	}
+
+	// Two keyframes back to back, as split encoding sends them, must be split between the two.
+	bool CheckSecondPicture(const std::vector<uint8_t> &frame, bool h265, std::mt19937 &rng) {
+		int nals;
+		std::vector<uint8_t> second = MakeKeyframe(frame.size() / 2, h265, 2, CONTENT_NOISE, nals, rng);
+		std::vector<uint8_t> both = frame;
+		both.insert(both.end(), second.begin(), second.end());
+		size_t single = AnnexBFindSecondPicture(frame.data(), frame.size(), h265);
+		size_t split = AnnexBFindSecondPicture(both.data(), both.size(), h265);
+		if (single != frame.size() || split != frame.size()) {
+			fprintf(stderr, "Second picture mismatch: found at %zu and %zu instead of %zu\n", single, split, frame.size());
+			return false;
+		}
+		return true;
+	}
+
+	// Runs step until MEASURE_SECONDS have passed, returns MB/s of size bytes per step.
+	template <typename Step>
+	double Measure(size_t size, Step step) {
+		auto start = std::chrono::steady_clock::now();
+		double elapsed = 0;
+		uint64_t steps = 0;
+		do {
+			elapsed += step();
+			steps++;
+		} while (std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() < MEASURE_SECONDS);
+		return (double)size * steps / elapsed / 1e6;
+	}
+
+	template <typename Function>
+	double Time(Function function) {
+		auto start = std::chrono::steady_clock::now();
+		function();
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	// Keeps the compiler from dropping unused results.
+	volatile uint64_t g_sink;
+
+	bool Run(size_t size, bool h265, Content content, std::mt19937 &rng) {
+		const int slices = 4;
+		int nals;
+		std::vector<uint8_t> frame = MakeKeyframe(size, h265, slices, content, nals, rng);
+		if (!CheckFilter(frame, h265, nals) || !CheckSecondPicture(frame, h265, rng)) {
+			return false;
+		}
+
+		std::vector<uint8_t> out;
+		out.reserve(frame.size());
+		double stdSearch = Measure(frame.size(), [&] {
+			return Time([&] {
+				out.clear();
+				ReferenceFilter(frame.data(), frame.size(), h265, out);
+				g_sink = out.size();
+			});
+		});
+		double scalar = Measure(frame.size(), [&] {
+			return Time([&] { g_sink = CountStartCodes(frame.data(), frame.size(), AnnexBFindStartCodeScalar); });
+		});
+		double vector = Measure(frame.size(), [&] {
+			return Time([&] { g_sink = CountStartCodes(frame.data(), frame.size(), AnnexBFindStartCode); });
+		});
+		std::vector<uint8_t> copy(frame.size());
+		double filter = Measure(frame.size(), [&] {
+			memcpy(copy.data(), frame.data(), frame.size());
+			return Time([&] { g_sink = AnnexBFilterInPlace(copy.data(), copy.size(), h265); });
+		});
+
+		printf("{\"size_kb\":%zu,\"codec\":\"%s\",\"content\":\"%s\",\"isa\":\"%s\",\"nals\":%d,"
+			"\"std_search_mb_s\":%.0f,\"scalar_mb_s\":%.0f,\"vector_mb_s\":%.0f,\"filter_in_place_mb_s\":%.0f,"
+			"\"speedup\":%.1f}\n",
+			frame.size() / 1024, h265 ? "h265" : "h264", ContentName(content), AnnexBSearchIsa(), nals,
+			stdSearch, scalar, vector, filter, vector / stdSearch);
+		fflush(stdout);
+		return true;
+	}
+}
+
+int main() {
+	std::mt19937 rng(1);
+	if (!CheckSearch(rng)) {
+		return 1;
+	}
+	for (size_t size : { 200 * 1024, 500 * 1024, 1000 * 1024 }) {
+		for (bool h265 : { false, true }) {
+			for (Content content : { CONTENT_NOISE, CONTENT_SPARSE }) {
+				if (!Run(size, h265, content, rng)) {
+					return 1;
+				}
+			}
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,224 @@
+// Host-only network simulation of the bandwidth estimation.
+// The server side is BandwidthEstimator, the client side is the ArrivalReporter of the client,
+// between them a bottleneck link with a drop-tail queue and random loss. The encoder produces
+// frames of the target bitrate divided by the frame rate, with some noise and a keyframe every few
+// seconds. Everything runs on a simulated clock with a fixed seed, so runs are reproducible.
+//
+// Build and run with "cargo xtask test-bandwidth-estimator". Every scenario prints one JSON object
+// per line on stdout, and the program fails if the estimate of a scenario is off.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <deque>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "packet_types.h"
+#include "arrival_report.h"
+#include "alvr_server/BandwidthEstimator.h"
+
+namespace {
+	const uint64_t TICK_US = 100;
+	const int REFRESH_RATE = 72;
+	const uint64_t FRAME_INTERVAL_US = 1000 * 1000 / REFRESH_RATE;
+	const int KEYFRAME_INTERVAL = 2 * REFRESH_RATE;
+	const double KEYFRAME_SIZE_RATIO = 3.;
+	const uint64_t PROPAGATION_DELAY_US = 3000;
+	const uint64_t REPORT_DELAY_US = 3000;
+	const double QUEUE_BYTES = 256 * 1024;
+	// The clocks of the server and the client are unrelated.
+	const uint64_t CLIENT_CLOCK_OFFSET_US = 1234567890;
+
+	struct Scenario {
+		const char *name;
+		uint64_t durationUs;
+		// The capacity switches from capacityBefore to capacityAfter at stepUs.
+		uint64_t stepUs;
+		double capacityBefore;
+		double capacityAfter;
+		double lossRate;
+		double maxBitrate;
+		// The target averaged over [evalStartUs, durationUs) must be within these ratios of the
+		// capacity (of maxBitrate if it is lower), and the queueing delay below maxQueueDelayMs.
+		uint64_t evalStartUs;
+		double minRatio;
+		double maxRatio;
+		double maxQueueDelayMs;
+	};
+
+	const double MBPS = 1000. * 1000.;
+
+	const Scenario SCENARIOS[] = {
+		{ "steady", 30000000, 0, 40 * MBPS, 40 * MBPS, 0., 60 * MBPS, 10000000, 0.6, 1.0, 30. },
+		{ "step-down", 30000000, 10000000, 50 * MBPS, 20 * MBPS, 0., 60 * MBPS, 15000000, 0.6, 1.0, 30. },
+		{ "step-up", 40000000, 10000000, 15 * MBPS, 40 * MBPS, 0., 60 * MBPS, 30000000, 0.6, 1.0, 30. },
+		{ "random-loss", 20000000, 0, 60 * MBPS, 60 * MBPS, 0.03, 30 * MBPS, 5000000, 0.9, 1.0, 30. },
+		{ "high-loss", 20000000, 0, 60 * MBPS, 60 * MBPS, 0.2, 30 * MBPS, 10000000, 0., 0.5, 30. },
+	};
+
+	// Bottleneck link: packets are serialized at the capacity, after the packets queued before
+	// them, and dropped when the queue is full.
+	class Link {
+	public:
+		Link(uint32_t seed) : m_rng(seed) {}
+
+		// Returns false if the packet is lost, its arrival time otherwise.
+		bool Send(uint64_t nowUs, int size, double capacity, double lossRate, uint64_t &arrivalUs) {
+			uint64_t start = std::max(m_freeAt, nowUs);
+			if ((start - nowUs) * capacity / 8. / 1e6 + size > QUEUE_BYTES) {
+				return false;
+			}
+			m_freeAt = start + (uint64_t)(size * 8. * 1e6 / capacity);
+			if (std::uniform_real_distribution<double>(0., 1.)(m_rng) < lossRate) {
+				return false;
+			}
+			arrivalUs = m_freeAt + PROPAGATION_DELAY_US;
+			return true;
+		}
+
+		uint64_t GetQueueDelayUs(uint64_t nowUs) const {
+			return m_freeAt > nowUs ? m_freeAt - nowUs : 0;
+		}
+
+	private:
+		std::mt19937 m_rng;
+		uint64_t m_freeAt = 0;
+	};
+
+	struct PendingReport {
+		uint64_t deliveryUs;
+		std::vector<uint8_t> data;
+	};
+
+	// ArrivalReporter takes a plain function as callback.
+	uint64_t g_clientNowUs = 0;
+	std::deque<PendingReport> *g_reports = nullptr;
+
+	void QueueReport(const VideoArrivalReport &report, unsigned int size) {
+		PendingReport pending;
+		pending.deliveryUs = g_clientNowUs - CLIENT_CLOCK_OFFSET_US + REPORT_DELAY_US;
+		pending.data.assign((const uint8_t *)&report, (const uint8_t *)&report + size);
+		g_reports->push_back(std::move(pending));
+	}
+
+	bool Run(const Scenario &scenario, uint32_t seed) {
+		BandwidthEstimator estimator((uint64_t)scenario.maxBitrate, (uint64_t)(1 * MBPS), (uint64_t)scenario.maxBitrate);
+		ArrivalReporter reporter;
+		reporter.setSendCallback(QueueReport);
+		Link link(seed);
+		std::mt19937 rng(seed);
+		std::lognormal_distribution<double> frameNoise(0., 0.2);
+
+		std::deque<std::pair<uint64_t, uint32_t>> inFlight;
+		std::deque<PendingReport> reports;
+		g_reports = &reports;
+
+		uint32_t packetCounter = 0;
+		uint64_t nextFrameUs = 0;
+		int frame = 0;
+		uint64_t sentPackets = 0;
+		uint64_t lostPackets = 0;
+
+		double targetSum = 0.;
+		double queueDelaySum = 0.;
+		double estimateDelaySum = 0.;
+		int samples = 0;
+		// First time the target went below the capacity after the step.
+		uint64_t reactionUs = 0;
+
+		// The buffer of ArrivalReporter is a VideoArrivalReport, copied when queued.
+		VideoArrivalReport report;
+
+		for (uint64_t now = 0; now < scenario.durationUs; now += TICK_US) {
+			double capacity = now < scenario.stepUs ? scenario.capacityBefore : scenario.capacityAfter;
+
+			if (now >= nextFrameUs) {
+				double bytes = estimator.GetTargetBitrate() / 8. / REFRESH_RATE * frameNoise(rng);
+				if (frame % KEYFRAME_INTERVAL == 0) {
+					bytes *= KEYFRAME_SIZE_RATIO;
+				}
+				frame++;
+				nextFrameUs += FRAME_INTERVAL_US;
+				for (int remaining = (int)bytes; remaining > 0; remaining -= ALVR_MAX_VIDEO_BUFFER_SIZE) {
+					int size = std::min(remaining, ALVR_MAX_VIDEO_BUFFER_SIZE) + (int)sizeof(VideoFrame);
+					estimator.OnPacketSent(now, packetCounter, size);
+					uint64_t arrivalUs;
+					sentPackets++;
+					if (link.Send(now, size, capacity, scenario.lossRate, arrivalUs)) {
+						inFlight.emplace_back(arrivalUs, packetCounter);
+					} else {
+						lostPackets++;
+					}
+					packetCounter++;
+				}
+			}
+
+			while (!inFlight.empty() && inFlight.front().first <= now) {
+				g_clientNowUs = inFlight.front().first + CLIENT_CLOCK_OFFSET_US;
+				reporter.addVideoPacket(inFlight.front().second, g_clientNowUs);
+				inFlight.pop_front();
+			}
+
+			while (!reports.empty() && reports.front().deliveryUs <= now) {
+				memset(&report, 0, sizeof(report));
+				memcpy(&report, reports.front().data.data(), std::min(reports.front().data.size(), sizeof(report)));
+				estimator.OnArrivalReport(now, report);
+				reports.pop_front();
+			}
+
+			if (scenario.stepUs > 0 && now >= scenario.stepUs && reactionUs == 0
+				&& estimator.GetTargetBitrate() < scenario.capacityAfter) {
+				reactionUs = now - scenario.stepUs;
+			}
+			if (now >= scenario.evalStartUs && now % (10 * 1000) == 0) {
+				targetSum += estimator.GetTargetBitrate();
+				queueDelaySum += link.GetQueueDelayUs(now);
+				estimateDelaySum += estimator.GetQueueingDelayUs();
+				samples++;
+			}
+		}
+
+		double reference = std::min(scenario.capacityAfter, scenario.maxBitrate);
+		double meanTarget = targetSum / samples;
+		double meanQueueDelayMs = queueDelaySum / samples / 1000.;
+		double ratio = meanTarget / reference;
+		bool pass = ratio >= scenario.minRatio && ratio <= scenario.maxRatio && meanQueueDelayMs <= scenario.maxQueueDelayMs;
+
+		printf("{\"scenario\":\"%s\",\"capacity_mbps\":%.1f,\"max_bitrate_mbps\":%.1f,\"loss_rate\":%.3f,"
+			"\"mean_target_mbps\":%.2f,\"target_ratio\":%.3f,\"mean_queue_delay_ms\":%.2f,"
+			"\"mean_estimated_queueing_delay_ms\":%.2f,\"reaction_ms\":%.1f,\"packet_loss\":%.4f,\"pass\":%s}\n",
+			scenario.name, scenario.capacityAfter / MBPS, scenario.maxBitrate / MBPS, scenario.lossRate,
+			meanTarget / MBPS, ratio, meanQueueDelayMs, estimateDelaySum / samples / 1000., reactionUs / 1000.,
+			sentPackets ? (double)lostPackets / sentPackets : 0., pass ? "true" : "false");
+		fflush(stdout);
+		return pass;
+	}
+}
+
+int main(int argc, char **argv) {
+	uint32_t seed = 1;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--seed" && i + 1 < argc) {
+			seed = (uint32_t)strtoul(argv[++i], nullptr, 10);
+		} else {
+			fprintf(stderr, "Usage: %s [--seed <seed>]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	bool pass = true;
+	for (const Scenario &scenario : SCENARIOS) {
+		pass = Run(scenario, seed) && pass;
+	}
+	if (!pass) {
+		fprintf(stderr, "Bandwidth estimation failed in some scenarios.\n");
+		return 1;
+	}
+	return 0;
+}
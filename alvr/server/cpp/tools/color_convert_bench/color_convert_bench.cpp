@@ -0,0 +1,175 @@
+// Host-only benchmark of the RGB to YUV 4:2:0 conversion of the software encoder.
+// Compares the previous path, one sws_scale call with SWS_BILINEAR at the same size, to
+// ColorConverter with its scalar kernel and with the vector kernel of this CPU, on 1 to 8 threads.
+// The download of the frame from the GPU (av_hwframe_transfer_data) comes before both and is not
+// measured.
+//
+// Build and run with "cargo xtask bench-color-convert". Every configuration prints one JSON object
+// per line on stdout. Times are wall clock per frame in milliseconds. The differences are the
+// largest absolute difference of a Y, U or V sample with the output of swscale. The program fails
+// if the vector kernel and the scalar kernel do not give the same output.
+// Options: --width and --height of the frame, default to the 2x1832x1920 of a Quest 2 at the
+// default resolution.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "platform/linux/ColorConverter.h"
+
+extern "C" {
+#include <libavutil/pixfmt.h>
+#include <libswscale/swscale.h>
+}
+
+namespace {
+	const int WARMUP_FRAMES = 5;
+	const int MEASURED_FRAMES = 60;
+
+	struct Frame {
+		Frame(int width, int height) {
+			int chromaWidth = (width + 1) / 2;
+			int chromaHeight = (height + 1) / 2;
+			// Same alignment as av_frame_get_buffer().
+			strides[0] = (width + 63) / 64 * 64;
+			strides[1] = strides[2] = (chromaWidth + 63) / 64 * 64;
+			planes[0].resize((size_t)strides[0] * height);
+			planes[1].resize((size_t)strides[1] * chromaHeight);
+			planes[2].resize((size_t)strides[2] * chromaHeight);
+			for (int i = 0; i < 3; i++) {
+				data[i] = planes[i].data();
+			}
+		}
+
+		std::vector<uint8_t> planes[3];
+		uint8_t *data[3];
+		int strides[3];
+	};
+
+	// Gradients with noise, so that neighbour pixels differ as in a rendered frame.
+	std::vector<uint8_t> MakeRgba(int width, int height) {
+		std::mt19937 rng(1);
+		std::uniform_int_distribution<int> noise(-24, 24);
+		std::vector<uint8_t> rgba((size_t)width * height * 4);
+		for (int y = 0; y < height; y++) {
+			for (int x = 0; x < width; x++) {
+				uint8_t *p = &rgba[((size_t)y * width + x) * 4];
+				p[0] = (uint8_t)std::clamp(x * 255 / width + noise(rng), 0, 255);
+				p[1] = (uint8_t)std::clamp(y * 255 / height + noise(rng), 0, 255);
+				p[2] = (uint8_t)std::clamp((x + y) * 255 / (width + height) + noise(rng), 0, 255);
+				p[3] = 255;
+			}
+		}
+		return rgba;
+	}
+
+	int MaxDifference(const Frame &a, const Frame &b, int width, int height) {
+		int difference = 0;
+		for (int plane = 0; plane < 3; plane++) {
+			int planeWidth = plane == 0 ? width : (width + 1) / 2;
+			int planeHeight = plane == 0 ? height : (height + 1) / 2;
+			for (int y = 0; y < planeHeight; y++) {
+				const uint8_t *rowA = a.data[plane] + (size_t)y * a.strides[plane];
+				const uint8_t *rowB = b.data[plane] + (size_t)y * b.strides[plane];
+				for (int x = 0; x < planeWidth; x++) {
+					difference = std::max(difference, abs(rowA[x] - rowB[x]));
+				}
+			}
+		}
+		return difference;
+	}
+
+	struct Times {
+		double meanMs;
+		double maxMs;
+	};
+
+	template <typename Convert>
+	Times Measure(Convert convert) {
+		for (int i = 0; i < WARMUP_FRAMES; i++) {
+			convert();
+		}
+		std::vector<double> times;
+		for (int i = 0; i < MEASURED_FRAMES; i++) {
+			auto start = std::chrono::steady_clock::now();
+			convert();
+			times.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+		}
+		double total = 0;
+		for (double time : times) {
+			total += time;
+		}
+		return { total / times.size(), *std::max_element(times.begin(), times.end()) };
+	}
+
+	void Print(const char *path, const char *kernel, int threads, int width, int height, Times times, double baselineMs, int difference) {
+		printf("{\"path\":\"%s\",\"kernel\":\"%s\",\"threads\":%d,\"width\":%d,\"height\":%d,"
+			"\"mean_ms\":%.2f,\"max_ms\":%.2f,\"speedup\":%.1f,\"max_difference\":%d}\n",
+			path, kernel, threads, width, height, times.meanMs, times.maxMs, baselineMs / times.meanMs, difference);
+		fflush(stdout);
+	}
+}
+
+int main(int argc, char **argv) {
+	int width = 2 * 1832;
+	int height = 1920;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--width" && i + 1 < argc) {
+			width = atoi(argv[++i]);
+		} else if (arg == "--height" && i + 1 < argc) {
+			height = atoi(argv[++i]);
+		} else {
+			fprintf(stderr, "Usage: %s [--width <pixels>] [--height <pixels>]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	std::vector<uint8_t> rgba = MakeRgba(width, height);
+	const uint8_t *src[1] = { rgba.data() };
+	int srcStride[1] = { width * 4 };
+
+	Frame swsFrame(width, height);
+	SwsContext *sws = sws_getContext(width, height, AV_PIX_FMT_RGBA, width, height, AV_PIX_FMT_YUV420P,
+		SWS_BILINEAR, NULL, NULL, NULL);
+	if (sws == NULL) {
+		fprintf(stderr, "sws_getContext failed\n");
+		return 1;
+	}
+	Times swsTimes = Measure([&] {
+		sws_scale(sws, src, srcStride, 0, height, swsFrame.data, swsFrame.strides);
+	});
+	sws_freeContext(sws);
+	Print("sws_scale", "swscale", 1, width, height, swsTimes, swsTimes.meanMs, 0);
+
+	Frame scalarFrame(width, height);
+	{
+		alvr::ColorConverter converter(alvr::ColorConverter::Layout::RGBX, width, height, 1);
+		converter.use_scalar_kernel();
+		Times times = Measure([&] {
+			converter.convert(rgba.data(), srcStride[0], scalarFrame.data, scalarFrame.strides);
+		});
+		Print("converter", "scalar", 1, width, height, times, swsTimes.meanMs, MaxDifference(scalarFrame, swsFrame, width, height));
+	}
+
+	bool pass = true;
+	for (int threads : { 1, 2, 4, 8 }) {
+		Frame frame(width, height);
+		alvr::ColorConverter converter(alvr::ColorConverter::Layout::RGBX, width, height, threads);
+		Times times = Measure([&] {
+			converter.convert(rgba.data(), srcStride[0], frame.data, frame.strides);
+		});
+		Print("converter", converter.kernel_name(), threads, width, height, times, swsTimes.meanMs, MaxDifference(frame, swsFrame, width, height));
+		if (MaxDifference(frame, scalarFrame, width, height) != 0) {
+			fprintf(stderr, "The %s kernel differs from the scalar one on %d threads\n", converter.kernel_name(), threads);
+			pass = false;
+		}
+	}
+	return pass ? 0 : 1;
+}
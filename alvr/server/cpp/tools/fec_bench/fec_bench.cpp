@@ -0,0 +1,587 @@
+// Host-only benchmark of the video FEC path.
+// The server side is ClientConnection itself: frames are sent with SendVideoSlice, and
+// LegacySendBatch is replaced by a stub that hands the packets to the client side. The client side
+// feeds the packets to FECQueue after a loss model has dropped some of them. No SteamVR, headset or
+// network is involved.
+//
+// Build and run with "cargo xtask bench-fec". Every configuration prints one JSON object per line
+// on stdout, so the output can be stored and compared between revisions.
+//
+// Times are wall clock per frame in microseconds. Allocations are C++ heap allocations counted
+// with a global operator new, per measured frame. Copied bytes are the encoded bytes copied on the
+// server side between the encoder and the socket, next to what the previous packetization copied.
+// Frames used for warmup are not measured.
+// Frames are sent back to back, faster than a headset would receive them, so more buffers are
+// kept for retransmission than in the server and the send path allocates.
+// With --slices, every frame is sent as that many FEC groups, as in the slice mode of the Linux
+// encoder. With --packet-size, the packets have the compact header and that size, as with compact
+// video packets. With --pacing, the packets are paced over that percentage of the frame interval
+// by the pacer thread of ClientConnection, and frames are sent at the refresh rate.
+// With --check-allocations, the streams of a 90 and a 120 Hz headset are sent at their refresh
+// rate instead, and the program fails if the send path allocates after the warmup frames. "cargo
+// xtask test-fec-allocations" runs this mode. Frames are kept for retransmission for a wall clock
+// time, so it needs an otherwise idle machine: a stall of more than two frames keeps more buffers
+// than the warmup has created.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "packet_types.h"
+#include "reedsolomon/rs_cache.h"
+#include "fec.h"
+#include "alvr_server/bindings.h"
+#include "alvr_server/ClientConnection.h"
+#include "alvr_server/Settings.h"
+#include "alvr_server/VideoFrameBuffer.h"
+
+namespace {
+	std::atomic<uint64_t> g_allocations{ 0 };
+	uint64_t g_clockUs = 1;
+
+	uint64_t FakeClock() {
+		return g_clockUs;
+	}
+
+	// At 90 Hz, the frame interval is above the FECQueue deadline, so an unrecoverable frame is
+	// given up as soon as the packets of the next one arrive.
+	const int DEFAULT_RATE = 90;
+	const int WARMUP_FRAMES = 8;
+	// Packets in flight between ClientConnection and the client side, more than a frame of the
+	// largest configuration, so that the lists do not grow.
+	const size_t MAX_SENT_PACKETS = 16 * 1024;
+
+	// Packets given to LegacySendBatch, and the buffer reference taken over with each batch. The
+	// pacer thread sends from its own thread.
+	std::mutex g_sentMutex;
+	std::vector<LegacySendPacket> g_sentPackets;
+	std::vector<VideoFrameBuffer *> g_sentBuffers;
+
+	void SendBatch(const LegacySendPacket *packets, int count, void *videoBuffer) {
+		std::unique_lock lock(g_sentMutex);
+		g_sentPackets.insert(g_sentPackets.end(), packets, packets + count);
+		g_sentBuffers.push_back((VideoFrameBuffer *)videoBuffer);
+	}
+
+	void Send(unsigned char *, int) {}
+}
+
+void (*LegacySend)(unsigned char *buf, int len) = Send;
+void (*LegacySendBatch)(const LegacySendPacket *packets, int count, void *videoBuffer) = SendBatch;
+uint64_t g_DriverTestMode = 0;
+
+// The server logs are dropped.
+void Error(const char *, ...) {}
+void Warn(const char *, ...) {}
+void Info(const char *, ...) {}
+void Debug(const char *, ...) {}
+
+namespace {
+	// Sends the frames through ClientConnection, and takes the packets it sent.
+	class Sender {
+	public:
+		// ClientConnection reads its configuration from Settings.
+		Sender() {
+			m_connection = std::make_unique<ClientConnection>([]() {}, []() {}, [](uint64_t) {});
+			m_packets.reserve(MAX_SENT_PACKETS);
+			m_buffers.reserve(MAX_SENT_PACKETS);
+			std::unique_lock lock(g_sentMutex);
+			g_sentPackets.reserve(MAX_SENT_PACKETS);
+			g_sentBuffers.reserve(MAX_SENT_PACKETS);
+		}
+
+		// The pacer thread is stopped first, it may still be sending.
+		~Sender() {
+			m_connection.reset();
+			TakeSent();
+			ReleaseSent();
+		}
+
+		void Send(const uint8_t *buf, int len, uint64_t videoFrameIndex, int fecPercentage, uint16_t fecFlags, int slices) {
+			m_copiedBytes = 0;
+			m_previousCopiedBytes = 0;
+			for (int slice = 0; slice < slices; slice++) {
+				int begin = (int)((int64_t)len * slice / slices);
+				int end = (int)((int64_t)len * (slice + 1) / slices);
+				VideoFrameBuffer *buffer = VideoFrameBuffer::Acquire();
+				buffer->Append(buf + begin, end - begin);
+				CountCopies(buffer, fecPercentage, fecFlags);
+				m_connection->SendVideoSlice(buffer, videoFrameIndex, slice, slice == slices - 1, false);
+			}
+		}
+
+		// Takes the packets sent since the last call, and releases those of the last call. Returns
+		// their number.
+		int TakeSent() {
+			ReleaseSent();
+			std::unique_lock lock(g_sentMutex);
+			m_packets.swap(g_sentPackets);
+			m_buffers.swap(g_sentBuffers);
+			return (int)m_packets.size();
+		}
+
+		const LegacySendPacket &GetPacket(int i) const {
+			return m_packets[i];
+		}
+
+		uint64_t GetCopiedBytes() const {
+			return m_copiedBytes;
+		}
+
+		uint64_t GetPreviousCopiedBytes() const {
+			return m_previousCopiedBytes;
+		}
+
+	private:
+		// Before the packets were built in place, the frame was copied into a vector by the
+		// encoder, its last shard into a padding shard, and every data and parity payload into a
+		// packet. The shards are laid out like ClientConnection::FECSend does.
+		void CountCopies(VideoFrameBuffer *buffer, int fecPercentage, uint16_t fecFlags) {
+			int len = buffer->GetFrameByteSize();
+			int shardPackets = CalculateFECShardPackets(len, fecPercentage, GetFECMaxShards(fecFlags), buffer->GetPayloadSize());
+			int blockSize = shardPackets * buffer->GetPayloadSize();
+			int dataShards = (len + blockSize - 1) / blockSize;
+			int totalParityShards = CalculateParityShards(dataShards, fecPercentage);
+			m_previousCopiedBytes += (uint64_t)len + len % blockSize + (uint64_t)len +
+				(uint64_t)totalParityShards * blockSize;
+			m_copiedBytes += buffer->GetCopiedBytes();
+		}
+
+		// As the network thread does with ReleaseVideoBuffer once the packets are sent.
+		void ReleaseSent() {
+			for (auto buffer : m_buffers) {
+				buffer->Release();
+			}
+			m_buffers.clear();
+			m_packets.clear();
+		}
+
+		std::unique_ptr<ClientConnection> m_connection;
+		std::vector<LegacySendPacket> m_packets;
+		std::vector<VideoFrameBuffer *> m_buffers;
+		uint64_t m_copiedBytes = 0;
+		uint64_t m_previousCopiedBytes = 0;
+	};
+
+	enum LossPattern {
+		LOSS_NONE,
+		// Independent losses.
+		LOSS_RANDOM,
+		// Gilbert-Elliott: short runs of consecutive losses, as seen on a busy Wi-Fi channel.
+		LOSS_BURSTY,
+		// The end of some frames is dropped, as a full queue does with a large frame.
+		LOSS_TAIL_DROP,
+	};
+
+	const char *LossPatternName(LossPattern pattern) {
+		switch (pattern) {
+		case LOSS_NONE:
+			return "none";
+		case LOSS_RANDOM:
+			return "random";
+		case LOSS_BURSTY:
+			return "bursty";
+		case LOSS_TAIL_DROP:
+			return "tail-drop";
+		}
+		return "";
+	}
+
+	class LossModel {
+	public:
+		LossModel(LossPattern pattern, uint32_t seed) : m_pattern(pattern), m_rng(seed) {}
+
+		// Marks the packets of a frame to drop.
+		void Apply(std::vector<bool> &drop, int packetCount) {
+			drop.assign(packetCount, false);
+			switch (m_pattern) {
+			case LOSS_NONE:
+				break;
+			case LOSS_RANDOM:
+				for (int i = 0; i < packetCount; i++) {
+					drop[i] = Chance(RANDOM_LOSS);
+				}
+				break;
+			case LOSS_BURSTY:
+				for (int i = 0; i < packetCount; i++) {
+					m_bad = m_bad ? !Chance(BAD_TO_GOOD) : Chance(GOOD_TO_BAD);
+					drop[i] = m_bad;
+				}
+				break;
+			case LOSS_TAIL_DROP:
+				if (Chance(TAIL_DROP_FRAMES)) {
+					int dropped = std::max(1, (int)(packetCount * TAIL_DROP_FRACTION));
+					for (int i = packetCount - dropped; i < packetCount; i++) {
+						drop[i] = true;
+					}
+				}
+				break;
+			}
+		}
+
+	private:
+		static constexpr double RANDOM_LOSS = 0.01;
+		// Average loss of 0.01 / (0.01 + 0.3) = 3.2% in runs of 3.3 packets.
+		static constexpr double GOOD_TO_BAD = 0.01;
+		static constexpr double BAD_TO_GOOD = 0.3;
+		static constexpr double TAIL_DROP_FRAMES = 0.1;
+		static constexpr double TAIL_DROP_FRACTION = 0.1;
+
+		bool Chance(double probability) {
+			return std::uniform_real_distribution<double>(0., 1.)(m_rng) < probability;
+		}
+
+		LossPattern m_pattern;
+		std::mt19937 m_rng;
+		bool m_bad = false;
+	};
+
+	struct Samples {
+		std::vector<double> timesUs;
+		uint64_t bytes = 0;
+		uint64_t allocations = 0;
+		uint64_t copiedBytes = 0;
+		uint64_t previousCopiedBytes = 0;
+
+		void Add(double timeUs, uint64_t frameBytes, uint64_t frameAllocations) {
+			timesUs.push_back(timeUs);
+			bytes += frameBytes;
+			allocations += frameAllocations;
+		}
+
+		void AddCopies(uint64_t frameCopiedBytes, uint64_t framePreviousCopiedBytes) {
+			copiedBytes += frameCopiedBytes;
+			previousCopiedBytes += framePreviousCopiedBytes;
+		}
+
+		double Percentile(double p) {
+			if (timesUs.empty()) {
+				return 0.;
+			}
+			std::sort(timesUs.begin(), timesUs.end());
+			size_t index = std::min(timesUs.size() - 1, (size_t)(p * timesUs.size()));
+			return timesUs[index];
+		}
+
+		double ThroughputMBs() {
+			double totalUs = 0.;
+			for (double t : timesUs) {
+				totalUs += t;
+			}
+			return totalUs > 0. ? bytes / totalUs : 0.;
+		}
+
+		double AllocationsPerFrame() {
+			return timesUs.empty() ? 0. : (double)allocations / timesUs.size();
+		}
+
+		double CopiedBytesPerFrame(uint64_t copied) {
+			return timesUs.empty() ? 0. : (double)copied / timesUs.size();
+		}
+	};
+
+	struct Config {
+		int frameSize;
+		int fecPercentage;
+		bool largeBlocks;
+		LossPattern loss;
+		int frames;
+		int slices;
+		// Including the header.
+		int packetSize;
+		bool compactHeader;
+		// 0 without pacing.
+		int pacingPercentage;
+		// Frames per second.
+		int rate;
+		// Frames are sent at the rate instead of back to back.
+		bool realTime;
+		int warmupFrames;
+	};
+
+	void ApplySettings(const Config &config) {
+		Settings &settings = Settings::Instance();
+		settings.m_refreshRate = config.rate;
+		settings.m_codec = ALVR_CODEC_H264;
+		settings.m_adaptiveFec = false;
+		settings.m_fecInterPercentage = config.fecPercentage;
+		// The frames are random data, which may look like keyframes.
+		settings.m_fecIdrPercentage = 0;
+		settings.m_fecParameterSetsPercentage = 0;
+		settings.m_fecLargeBlocks = config.largeBlocks;
+		settings.m_fecRateless = false;
+		settings.m_enableAdaptiveBitrate = false;
+		settings.m_packetPacingPercentage = config.pacingPercentage;
+		settings.m_compactVideoPackets = config.compactHeader;
+		settings.m_maxVideoPacketSize = config.packetSize;
+		settings.m_mtuProbing = false;
+	}
+
+	struct Result {
+		// Frames whose output differs from the input.
+		int corrupted;
+		// Heap allocations of the send path over the measured frames.
+		uint64_t sendAllocations;
+	};
+
+	double ElapsedUs(std::chrono::steady_clock::time_point start) {
+		return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	Result Run(const Config &config, const std::vector<uint8_t> &source, uint32_t seed) {
+		ApplySettings(config);
+		Sender sender;
+		FECQueue queue;
+		queue.setClock(FakeClock);
+		LossModel lossModel(config.loss, seed);
+		std::mt19937 rng(seed);
+
+		Samples encode;
+		Samples decode;
+		std::vector<bool> drop;
+		// Source offset of each frame in flight, indexed by videoFrameIndex.
+		std::vector<size_t> offsets(config.frames + 1);
+		uint64_t sentPackets = 0;
+		uint64_t lostPackets = 0;
+		int recovered = 0;
+		int corrupted = 0;
+		bool fecFailure = false;
+		auto frameInterval = std::chrono::microseconds(1000 * 1000 / config.rate);
+		auto nextFrame = std::chrono::steady_clock::now();
+
+		for (int frame = 1; frame <= config.frames; frame++) {
+			bool measured = frame > config.warmupFrames;
+			uint64_t videoFrameIndex = frame;
+			offsets[frame] = rng() % (source.size() - config.frameSize);
+			const uint8_t *buf = &source[offsets[frame]];
+
+			uint64_t allocations = g_allocations;
+			auto start = std::chrono::steady_clock::now();
+			sender.Send(buf, config.frameSize, videoFrameIndex, config.fecPercentage,
+				config.largeBlocks ? ALVR_FEC_FLAG_LARGE_BLOCK : 0, config.slices);
+			double sendUs = ElapsedUs(start);
+			// Halfway through the warmup, the next two frames are sent right away, as when the
+			// encoder catches up after a stall. Two more frames are kept for retransmission for a
+			// while, so that the timing jitter after the warmup does not drain the pool.
+			bool catchUp = frame == config.warmupFrames / 2 || frame == config.warmupFrames / 2 + 1;
+			if (config.realTime && !catchUp) {
+				// The paced packets are all sent by then.
+				nextFrame += frameInterval;
+				std::this_thread::sleep_until(nextFrame);
+			}
+			int packetCount = sender.TakeSent();
+			if (measured) {
+				encode.Add(sendUs, config.frameSize, g_allocations - allocations);
+				encode.AddCopies(sender.GetCopiedBytes(), sender.GetPreviousCopiedBytes());
+			}
+
+			lossModel.Apply(drop, packetCount);
+			g_clockUs += 1000000 / config.rate;
+
+			allocations = g_allocations;
+			start = std::chrono::steady_clock::now();
+			int output = 0;
+			for (int i = 0; i < packetCount; i++) {
+				sentPackets++;
+				if (drop[i]) {
+					lostPackets++;
+					continue;
+				}
+				g_clockUs++;
+				const LegacySendPacket &packet = sender.GetPacket(i);
+				VideoFrame header;
+				int fullPayloadSize;
+				int payloadOffset = ParseVideoPacket(packet.buf, packet.len, 0, header, fullPayloadSize);
+				queue.addVideoPacket(&header, (const std::byte *)packet.buf + payloadOffset, packet.len - payloadOffset, fullPayloadSize, fecFailure);
+				while (queue.reconstruct(fecFailure)) {
+					// Output happens for this frame or for an older one that was waiting for it.
+					uint64_t outputIndex = queue.getTrackingFrameIndex();
+					if (queue.getFrameByteSize() != config.frameSize ||
+						memcmp(queue.getFrameBuffer(), &source[offsets[outputIndex]], config.frameSize) != 0) {
+						corrupted++;
+					}
+					recovered++;
+					output++;
+				}
+			}
+			if (measured && output > 0) {
+				decode.Add(ElapsedUs(start), (uint64_t)output * config.frameSize, g_allocations - allocations);
+			}
+		}
+		int lostFrames = config.frames - recovered;
+
+		printf("{\"rate_hz\":%d,\"frame_size\":%d,\"slices\":%d,\"packet_size\":%d,\"pacing_percentage\":%d,\"fec_percentage\":%d,\"large_blocks\":%s,\"loss\":\"%s\",\"frames\":%d,"
+			"\"packets\":%llu,\"packet_loss\":%.4f,\"frames_recovered\":%d,\"frames_lost\":%d,\"frames_corrupted\":%d,"
+			"\"encode_mbps\":%.1f,\"encode_p50_us\":%.2f,\"encode_p99_us\":%.2f,\"encode_allocs_per_frame\":%.2f,"
+			"\"encode_copied_bytes_per_frame\":%.0f,\"previous_copied_bytes_per_frame\":%.0f,"
+			"\"decode_mbps\":%.1f,\"decode_p50_us\":%.2f,\"decode_p99_us\":%.2f,\"decode_allocs_per_frame\":%.2f}\n",
+			config.rate, config.frameSize, config.slices, config.packetSize, config.pacingPercentage, config.fecPercentage, config.largeBlocks ? "true" : "false", LossPatternName(config.loss),
+			config.frames, (unsigned long long)sentPackets, sentPackets ? (double)lostPackets / sentPackets : 0.,
+			recovered, lostFrames, corrupted,
+			encode.ThroughputMBs(), encode.Percentile(0.5), encode.Percentile(0.99), encode.AllocationsPerFrame(),
+			encode.CopiedBytesPerFrame(encode.copiedBytes), encode.CopiedBytesPerFrame(encode.previousCopiedBytes),
+			decode.ThroughputMBs(), decode.Percentile(0.5), decode.Percentile(0.99), decode.AllocationsPerFrame());
+		fflush(stdout);
+		return { corrupted, encode.allocations };
+	}
+}
+
+void *operator new(size_t size) {
+	g_allocations++;
+	void *p = malloc(size ? size : 1);
+	if (p == nullptr) {
+		throw std::bad_alloc();
+	}
+	return p;
+}
+
+void operator delete(void *p) noexcept {
+	free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+	free(p);
+}
+
+int main(int argc, char **argv) {
+	// Data processed per configuration, which sets the number of frames.
+	int budgetBytes = 32 * 1024 * 1024;
+	int minFrames = 100;
+	int maxFrames = 2000;
+	uint32_t seed = 1;
+	int slices = 1;
+	int packetSize = 0;
+	int pacingPercentage = 0;
+	bool checkAllocations = false;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--frames" && i + 1 < argc) {
+			minFrames = maxFrames = atoi(argv[++i]);
+		} else if (arg == "--seed" && i + 1 < argc) {
+			seed = (uint32_t)strtoul(argv[++i], nullptr, 10);
+		} else if (arg == "--slices" && i + 1 < argc) {
+			slices = atoi(argv[++i]);
+		} else if (arg == "--packet-size" && i + 1 < argc) {
+			packetSize = atoi(argv[++i]);
+		} else if (arg == "--pacing" && i + 1 < argc) {
+			pacingPercentage = atoi(argv[++i]);
+		} else if (arg == "--check-allocations") {
+			checkAllocations = true;
+		} else {
+			fprintf(stderr, "Usage: %s [--frames <count>] [--seed <seed>] [--slices <count>] [--packet-size <bytes>] [--pacing <percentage>] [--check-allocations]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (packetSize != 0) {
+		if (packetSize <= ALVR_COMPACT_VIDEO_HEADER_RESERVE || packetSize > ALVR_MAX_JUMBO_PACKET_SIZE) {
+			fprintf(stderr, "The packet size must be between %d and %d.\n", ALVR_COMPACT_VIDEO_HEADER_RESERVE + 1, ALVR_MAX_JUMBO_PACKET_SIZE);
+			return 1;
+		}
+	}
+	if (pacingPercentage < 0 || pacingPercentage > 100) {
+		fprintf(stderr, "The pacing percentage must be between 0 and 100.\n");
+		return 1;
+	}
+	if (slices < 1 || slices > ALVR_MAX_VIDEO_SLICES) {
+		fprintf(stderr, "The slice count must be between 1 and %d.\n", ALVR_MAX_VIDEO_SLICES);
+		return 1;
+	}
+	if (minFrames <= WARMUP_FRAMES) {
+		fprintf(stderr, "At least %d frames are needed.\n", WARMUP_FRAMES + 1);
+		return 1;
+	}
+
+	// From P-frames at a low bitrate to IDRs at a high one.
+	const int frameSizes[] = { 5 * 1000, 20 * 1000, 100 * 1000, 300 * 1000, 1000 * 1000 };
+	const int fecPercentages[] = { 5, 10, 20, 50 };
+	const LossPattern lossPatterns[] = { LOSS_NONE, LOSS_RANDOM, LOSS_BURSTY, LOSS_TAIL_DROP };
+
+	// Encoded video is close to random data.
+	std::vector<uint8_t> source(4 * 1000 * 1000);
+	std::mt19937 rng(seed);
+	for (auto &b : source) {
+		b = (uint8_t)rng();
+	}
+
+	int corrupted = 0;
+	if (checkAllocations) {
+		// One second of video at the default and the highest bitrates, with and without losses.
+		// The frames of a configuration are all the same size, so the pool and the arena reach
+		// their final size during the warmup, once the first frames kept for retransmission have
+		// expired.
+		uint64_t sendAllocations = 0;
+		for (int rate : { 90, 120 }) {
+			for (int bitrateMbs : { 30, 150 }) {
+				for (LossPattern loss : { LOSS_NONE, LOSS_BURSTY }) {
+					Config config;
+					config.frameSize = bitrateMbs * 1000 * 1000 / 8 / rate;
+					config.fecPercentage = 5;
+					config.largeBlocks = false;
+					config.loss = loss;
+					config.frames = std::max(rate, minFrames);
+					config.slices = slices;
+					config.packetSize = packetSize != 0 ? packetSize : ALVR_MAX_PACKET_SIZE;
+					config.compactHeader = packetSize != 0;
+					config.pacingPercentage = pacingPercentage;
+					config.rate = rate;
+					config.realTime = true;
+					config.warmupFrames = rate / 4;
+					Result result = Run(config, source, seed);
+					corrupted += result.corrupted;
+					sendAllocations += result.sendAllocations;
+				}
+			}
+		}
+		if (sendAllocations != 0) {
+			fprintf(stderr, "The send path made %llu allocations after the warmup.\n", (unsigned long long)sendAllocations);
+			return 1;
+		}
+		if (corrupted != 0) {
+			fprintf(stderr, "%d frames were corrupted.\n", corrupted);
+			return 1;
+		}
+		return 0;
+	}
+
+	for (int frameSize : frameSizes) {
+		for (int fecPercentage : fecPercentages) {
+			for (bool largeBlocks : { false, true }) {
+				for (LossPattern loss : lossPatterns) {
+					Config config;
+					config.frameSize = frameSize;
+					config.fecPercentage = fecPercentage;
+					config.largeBlocks = largeBlocks;
+					config.loss = loss;
+					config.frames = std::clamp(budgetBytes / frameSize, minFrames, maxFrames);
+					config.slices = slices;
+					config.packetSize = packetSize != 0 ? packetSize : ALVR_MAX_PACKET_SIZE;
+					config.compactHeader = packetSize != 0;
+					config.pacingPercentage = pacingPercentage;
+					config.rate = DEFAULT_RATE;
+					// The pacer sends the packets over the frame interval.
+					config.realTime = pacingPercentage > 0;
+					config.warmupFrames = WARMUP_FRAMES;
+					corrupted += Run(config, source, seed).corrupted;
+				}
+			}
+		}
+	}
+	if (corrupted != 0) {
+		fprintf(stderr, "%d frames were corrupted.\n", corrupted);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,226 @@
+// Host-only simulation of the FEC policies.
+// The server sends a video stream of fixed size frames with the FEC geometry of FECSend
+// (CalculateFECShardPackets, CalculateParityShards) and the percentage chosen by the policy. The
+// packets go through a Gilbert-Elliott loss model, and a frame is lost when a packet column misses
+// more shards than it has parity shards, as in FECQueue. The client side reports the losses,
+// failures and transport latency once per second like the TimeSync of the client. Everything runs
+// on a simulated clock with a fixed seed, so runs are reproducible.
+//
+// Build and run with "cargo xtask test-fec-policy". Every scenario prints one JSON object per line
+// and policy on stdout, and the program fails if the adaptive policy misses the expectations of a
+// scenario.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "packet_types.h"
+#include "alvr_server/FecPolicy.h"
+
+namespace {
+	const int REFRESH_RATE = 72;
+	const uint64_t FRAME_INTERVAL_US = 1000 * 1000 / REFRESH_RATE;
+	// 30 Mbps.
+	const int FRAME_SIZE = 30 * 1000 * 1000 / 8 / REFRESH_RATE;
+	const uint64_t DURATION_US = 60 * 1000 * 1000;
+	// Failures and overhead are measured after the policies had time to settle.
+	const uint64_t EVAL_START_US = 10 * 1000 * 1000;
+	const uint64_t BASE_LATENCY_US = 4000;
+	// Timestamps of the server are far from 0.
+	const uint64_t START_US = 1000ull * 1000 * 1000;
+
+	struct Phase {
+		// Until this time from the start of the scenario.
+		uint64_t endUs;
+		double lossRate;
+		// Average length of the runs of lost packets.
+		double burstLength;
+		// Added to the transport latency, queueing on a congested link.
+		uint64_t queueingUs;
+	};
+
+	struct Scenario {
+		const char *name;
+		bool largeBlocks;
+		std::vector<Phase> phases;
+		// Expectations on the adaptive policy, over the frames after EVAL_START_US.
+		double maxFailureRate;
+		double maxOverhead;
+		// Upper bound of the percentage at the end of the scenario, to check that it comes back
+		// down once the losses stop.
+		int maxFinalPercentage;
+	};
+
+	const uint64_t S = 1000 * 1000;
+
+	const Scenario SCENARIOS[] = {
+		// Nothing to protect against, the percentage goes below the initial 5%.
+		{ "clean", true, { { DURATION_US, 0., 1., 0 } }, 0., 0.03, 2 },
+		{ "random-2%", true, { { DURATION_US, 0.02, 1., 0 } }, 0.01, 0.15, 50 },
+		// The fixed policy loses about 7% of the frames.
+		{ "bursty-2%", true, { { DURATION_US, 0.02, 4., 0 } }, 0.02, 0.5, 50 },
+		{ "loss-then-clean", true, { { 30 * S, 0.03, 1., 0 }, { DURATION_US, 0., 1., 0 } }, 0.01, 0.1, 2 },
+		// The losses come with queueing, more parity would make them worse. Without the latency,
+		// the same losses raise the percentage to 13%. Frames are lost meanwhile.
+		{ "congestion", true, { { 30 * S, 0.01, 1., 0 }, { DURATION_US, 0.03, 1., 30000 } }, 0.15, 0.15, 8 },
+		{ "random-2%-small-blocks", false, { { DURATION_US, 0.02, 1., 0 } }, 0.01, 0.25, 50 },
+	};
+
+	class LossModel {
+	public:
+		LossModel(uint32_t seed) : m_rng(seed) {}
+
+		bool Lose(const Phase &phase) {
+			if (phase.lossRate <= 0.) {
+				m_bad = false;
+				return false;
+			}
+			double badToGood = 1. / phase.burstLength;
+			double goodToBad = phase.lossRate * badToGood / (1. - phase.lossRate);
+			m_bad = m_bad ? !Chance(badToGood) : Chance(goodToBad);
+			return m_bad;
+		}
+
+	private:
+		bool Chance(double probability) {
+			return std::uniform_real_distribution<double>(0., 1.)(m_rng) < probability;
+		}
+
+		std::mt19937 m_rng;
+		bool m_bad = false;
+	};
+
+	const Phase &PhaseAt(const Scenario &scenario, uint64_t timeUs) {
+		for (const Phase &phase : scenario.phases) {
+			if (timeUs < phase.endUs) {
+				return phase;
+			}
+		}
+		return scenario.phases.back();
+	}
+
+	bool Run(const Scenario &scenario, const char *policyName, FecPolicy &policy, bool checked, uint32_t seed) {
+		LossModel lossModel(seed);
+		std::mt19937 rng(seed);
+		std::uniform_int_distribution<int> jitter(0, 1000);
+		uint16_t fecFlags = scenario.largeBlocks ? ALVR_FEC_FLAG_LARGE_BLOCK : 0;
+		int payloadSize = ALVR_MAX_VIDEO_BUFFER_SIZE;
+
+		uint64_t lostInSecond = 0;
+		uint64_t failuresInSecond = 0;
+		uint64_t latencySum = 0;
+		uint64_t latencyCount = 0;
+		uint64_t nextReportUs = START_US + 1000 * 1000;
+
+		uint64_t frames = 0;
+		uint64_t failures = 0;
+		uint64_t dataPacketsSent = 0;
+		uint64_t parityPacketsSent = 0;
+		uint64_t percentageSum = 0;
+		int percentage = 0;
+		std::vector<int> columnLosses;
+
+		for (uint64_t time = 0; time < DURATION_US; time += FRAME_INTERVAL_US) {
+			uint64_t now = START_US + time;
+			const Phase &phase = PhaseAt(scenario, time);
+
+			if (now >= nextReportUs) {
+				TimeSync report = {};
+				report.type = ALVR_PACKET_TYPE_TIME_SYNC;
+				report.packetsLostInSecond = lostInSecond;
+				report.fecFailureInSecond = failuresInSecond;
+				report.averageTransportLatency = latencyCount ? (uint32_t)(latencySum / latencyCount) : 0;
+				policy.OnReport(now, report);
+				lostInSecond = 0;
+				failuresInSecond = 0;
+				latencySum = 0;
+				latencyCount = 0;
+				nextReportUs += 1000 * 1000;
+			}
+
+			percentage = policy.GetFecPercentage(now);
+			uint16_t fecField = (uint16_t)percentage | fecFlags;
+			int shardPackets = CalculateFECShardPackets(FRAME_SIZE, GetFECCodePercentage(fecField), GetFECMaxShards(fecField), payloadSize);
+			int blockSize = shardPackets * payloadSize;
+			int dataShards = (FRAME_SIZE + blockSize - 1) / blockSize;
+			int parityShards = CalculateParityShards(dataShards, percentage);
+			int dataPackets = (FRAME_SIZE + payloadSize - 1) / payloadSize;
+			int parityPackets = parityShards * shardPackets;
+			policy.OnPacketsSent(now, dataPackets + parityPackets);
+
+			// The packets are sent in fecIndex order, the padding packets are not sent.
+			columnLosses.assign(shardPackets, 0);
+			int lost = 0;
+			for (int i = 0; i < dataPackets + parityPackets; i++) {
+				int fecIndex = i < dataPackets ? i : dataShards * shardPackets + i - dataPackets;
+				if (lossModel.Lose(phase)) {
+					columnLosses[fecIndex % shardPackets]++;
+					lost++;
+				} else {
+					latencySum += BASE_LATENCY_US + phase.queueingUs + jitter(rng);
+					latencyCount++;
+				}
+			}
+			lostInSecond += lost;
+			bool failed = *std::max_element(columnLosses.begin(), columnLosses.end()) > parityShards;
+			if (failed) {
+				failuresInSecond++;
+				// The failure reaches the server after the transport latency.
+				policy.OnFecFailure(now + BASE_LATENCY_US + phase.queueingUs);
+			}
+
+			if (time >= EVAL_START_US) {
+				frames++;
+				failures += failed ? 1 : 0;
+				dataPacketsSent += dataPackets;
+				parityPacketsSent += parityPackets;
+				percentageSum += percentage;
+			}
+		}
+
+		double failureRate = (double)failures / frames;
+		double overhead = (double)parityPacketsSent / dataPacketsSent;
+		bool pass = !checked || (failureRate <= scenario.maxFailureRate && overhead <= scenario.maxOverhead &&
+			percentage <= scenario.maxFinalPercentage);
+
+		printf("{\"scenario\":\"%s\",\"policy\":\"%s\",\"large_blocks\":%s,\"frames\":%llu,\"failure_rate\":%.4f,"
+			"\"parity_overhead\":%.4f,\"mean_percentage\":%.2f,\"final_percentage\":%d,\"pass\":%s}\n",
+			scenario.name, policyName, scenario.largeBlocks ? "true" : "false", (unsigned long long)frames,
+			failureRate, overhead, (double)percentageSum / frames, percentage, pass ? "true" : "false");
+		fflush(stdout);
+		return pass;
+	}
+}
+
+int main(int argc, char **argv) {
+	uint32_t seed = 1;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--seed" && i + 1 < argc) {
+			seed = (uint32_t)strtoul(argv[++i], nullptr, 10);
+		} else {
+			fprintf(stderr, "Usage: %s [--seed <seed>]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	bool pass = true;
+	for (const Scenario &scenario : SCENARIOS) {
+		// The fixed policy is the reference, only the adaptive one is checked.
+		FixedFecPolicy fixed;
+		Run(scenario, "fixed", fixed, false, seed);
+		AdaptiveFecPolicy adaptive;
+		pass = Run(scenario, "adaptive", adaptive, true, seed) && pass;
+	}
+	if (!pass) {
+		fprintf(stderr, "The adaptive FEC policy failed in some scenarios.\n");
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,181 @@
+// Host-only checks of the frame window of FECQueue.
+// Frames of one packet are fed in various orders and the output of the queue is compared with the
+// expected frame indices. A NACK is also replayed: the retransmitted packet must complete its frame
+// and count as lost once in the loss statistics of the client (PacketLossCounter). The clock is
+// simulated, so runs are reproducible.
+//
+// Build and run with "cargo xtask test-fec-queue". Every case prints one JSON object per line on
+// stdout, and the program fails if a case does not give the expected output.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <chrono>
+#include <utility>
+#include <vector>
+
+#include "packet_types.h"
+#include "fec.h"
+#include "packet_loss.h"
+
+namespace {
+	const int FRAME_SIZE = 100;
+	const int FEC_PERCENTAGE = 5;
+	// 90 Hz. It is above the FECQueue deadline, so missing frames are given up as soon as the next
+	// frame arrives.
+	const uint64_t FRAME_INTERVAL_US = 11111;
+
+	uint64_t g_clockUs = 1;
+
+	uint64_t FakeClock() {
+		return g_clockUs;
+	}
+
+	struct Output {
+		std::vector<uint64_t> frames;
+		bool fecFailure = false;
+		bool corrupted = false;
+	};
+
+	// Sends a data packet of a frame of packets packets, the last one FRAME_SIZE bytes. The payload
+	// is derived from the frame index.
+	void SendPacket(FECQueue &queue, uint64_t videoFrameIndex, int packets, int fecIndex, uint32_t packetCounter,
+		Output &output) {
+		VideoFrame header = {};
+		header.type = ALVR_PACKET_TYPE_VIDEO_FRAME;
+		header.packetCounter = packetCounter;
+		header.trackingFrameIndex = videoFrameIndex;
+		header.videoFrameIndex = videoFrameIndex;
+		header.frameByteSize = (packets - 1) * ALVR_MAX_VIDEO_BUFFER_SIZE + FRAME_SIZE;
+		header.fecIndex = fecIndex;
+		header.fecPercentage = FEC_PERCENTAGE;
+		header.lastSlice = 1;
+
+		static std::byte payload[ALVR_MAX_VIDEO_BUFFER_SIZE];
+		int payloadSize = fecIndex == packets - 1 ? FRAME_SIZE : ALVR_MAX_VIDEO_BUFFER_SIZE;
+		memset(payload, (int)(videoFrameIndex & 0xFF), payloadSize);
+
+		queue.addVideoPacket(&header, payload, payloadSize, ALVR_MAX_VIDEO_BUFFER_SIZE, output.fecFailure);
+		while (queue.reconstruct(output.fecFailure)) {
+			uint64_t index = queue.getVideoFrameIndex();
+			const std::byte *buffer = queue.getFrameBuffer();
+			int size = queue.getFrameByteSize();
+			if (size % ALVR_MAX_VIDEO_BUFFER_SIZE != FRAME_SIZE || (uint8_t)buffer[0] != (uint8_t)(index & 0xFF) ||
+				(uint8_t)buffer[size - 1] != (uint8_t)(index & 0xFF)) {
+				output.corrupted = true;
+			}
+			output.frames.push_back(index);
+		}
+	}
+
+	// Sends the single packet of a frame.
+	void SendFrame(FECQueue &queue, uint64_t videoFrameIndex, Output &output) {
+		g_clockUs += FRAME_INTERVAL_US;
+		SendPacket(queue, videoFrameIndex, 1, 0, (uint32_t)videoFrameIndex, output);
+	}
+
+	struct Case {
+		const char *name;
+		std::vector<uint64_t> sent;
+		std::vector<uint64_t> expected;
+		bool expectedFecFailure;
+	};
+
+	bool Run(const Case &testCase) {
+		FECQueue queue;
+		queue.setClock(FakeClock);
+		Output output;
+
+		auto start = std::chrono::steady_clock::now();
+		for (uint64_t index : testCase.sent) {
+			SendFrame(queue, index, output);
+		}
+		double elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+		bool pass = output.frames == testCase.expected && output.fecFailure == testCase.expectedFecFailure &&
+			!output.corrupted;
+		printf("{\"case\":\"%s\",\"frames_sent\":%zu,\"frames_emitted\":%zu,\"fec_failure\":%s,\"corrupted\":%s,"
+			"\"elapsed_ms\":%.3f,\"pass\":%s}\n",
+			testCase.name, testCase.sent.size(), output.frames.size(), output.fecFailure ? "true" : "false",
+			output.corrupted ? "true" : "false", elapsedMs, pass ? "true" : "false");
+		fflush(stdout);
+		return pass;
+	}
+
+	std::vector<std::pair<uint32_t, uint32_t>> g_nacks;
+
+	void OnNack(uint32_t fromPacketCounter, uint32_t toPacketCounter) {
+		g_nacks.push_back({ fromPacketCounter, toPacketCounter });
+	}
+
+	// Frames of two packets. The second packet of frame 1 is lost and NACKed when frame 2 arrives,
+	// then retransmitted with its packet counter before frame 3. Every packet received goes through
+	// PacketLossCounter, as in ServerConnectionNative.
+	bool RunNack() {
+		const uint64_t RTT_US = 2000;
+		FECQueue queue;
+		queue.setClock(FakeClock);
+		queue.setNackCallback(OnNack);
+		queue.setRoundTripTime(RTT_US);
+		PacketLossCounter lossCounter;
+		Output output;
+		uint64_t lost = 0;
+		g_nacks.clear();
+
+		auto receive = [&](uint64_t videoFrameIndex, int fecIndex, uint32_t packetCounter) {
+			lost += lossCounter.addVideoPacket(packetCounter);
+			SendPacket(queue, videoFrameIndex, 2, fecIndex, packetCounter, output);
+		};
+		g_clockUs += FRAME_INTERVAL_US;
+		receive(1, 0, 1);
+		g_clockUs += FRAME_INTERVAL_US;
+		receive(2, 0, 3);
+		receive(2, 1, 4);
+		g_clockUs += RTT_US;
+		receive(1, 1, 2);
+		g_clockUs += FRAME_INTERVAL_US;
+		receive(3, 0, 5);
+		receive(3, 1, 6);
+
+		bool nacked = g_nacks.size() == 1 && g_nacks[0].first == 2 && g_nacks[0].second == 2;
+		bool pass = output.frames == std::vector<uint64_t>{ 1, 2, 3 } && !output.fecFailure && !output.corrupted &&
+			nacked && lost == 1;
+		printf("{\"case\":\"nack-retransmit\",\"frames_emitted\":%zu,\"nacks\":%zu,\"fec_failure\":%s,"
+			"\"corrupted\":%s,\"packets_lost\":%llu,\"pass\":%s}\n",
+			output.frames.size(), g_nacks.size(), output.fecFailure ? "true" : "false",
+			output.corrupted ? "true" : "false", (unsigned long long)lost, pass ? "true" : "false");
+		fflush(stdout);
+		return pass;
+	}
+}
+
+int main() {
+	const uint64_t FAR = 1ull << 40;
+	const Case CASES[] = {
+		{ "in-order", { 1, 2, 3, 4 }, { 1, 2, 3, 4 }, false },
+		// Frame 2 never arrives, it is given up by its deadline when frame 4 arrives.
+		{ "lost-frame", { 1, 3, 4, 5 }, { 1, 3, 4, 5 }, true },
+		// Within the window, the frame waits for the previous one.
+		{ "reordered", { 1, 3, 2, 4 }, { 1, 2, 3, 4 }, false },
+		// Frame 3 waits for frame 2 when the index jumps, it is given up with the window. Frame 10
+		// lands at the end of the window, 8 and 9 are given up when frame 11 arrives.
+		{ "short-jump", { 1, 3, 10, 11 }, { 1, 10, 11 }, true },
+		// A server restart or a corrupt header. The window moves at once.
+		{ "far-jump", { 1, 2, FAR, FAR + 1, FAR + 2 }, { 1, 2, FAR, FAR + 1, FAR + 2 }, true },
+		{ "far-jump-pending", { 1, 3, FAR, FAR + 1 }, { 1, FAR, FAR + 1 }, true },
+		// Packets of frames before the window are ignored.
+		{ "late-after-jump", { 1, FAR, 2, FAR + 1 }, { 1, FAR, FAR + 1 }, true },
+	};
+
+	bool pass = true;
+	for (const Case &testCase : CASES) {
+		pass = Run(testCase) && pass;
+	}
+	pass = RunNack() && pass;
+	if (!pass) {
+		fprintf(stderr, "FECQueue gave an unexpected output in some cases.\n");
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,491 @@
+// Host-only comparison of the loss recovery modes of the Linux software encoder.
+// A synthetic panning scene is encoded with libx264 as EncodePipelineSW does, once with keyframes
+// inserted on loss and once with the periodic intra refresh. Every frame goes through the FEC path
+// (VideoFrameBuffer packetization, FECQueue reassembly) over a synthetic loss trace: a bottleneck
+// link with a drop-tail queue, as a Wi-Fi access point has, plus bursty background loss. Large
+// frames overflow the queue, so keyframes cost packets on top of their size.
+//
+// Build and run with "cargo xtask bench-intra-refresh". Every mode prints one JSON object per line
+// on stdout.
+//
+// The server learns about a lost frame FEEDBACK_DELAY_FRAMES after it was given up by the client,
+// and spaces keyframes like IDRScheduler. A frame is counted as damaged from a loss until the
+// picture is clean again: until the next keyframe, or until a refresh wave that started after the
+// loss has swept the picture.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "packet_types.h"
+#include "reedsolomon/rs_cache.h"
+#include "fec.h"
+#include "alvr_server/bindings.h"
+#include "alvr_server/VideoFrameBuffer.h"
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavutil/opt.h>
+}
+
+namespace {
+	uint64_t g_clockUs = 1;
+
+	uint64_t FakeClock() {
+		return g_clockUs;
+	}
+
+	const int REFRESH_RATE = 72;
+	const uint64_t FRAME_INTERVAL_US = 1000 * 1000 / REFRESH_RATE;
+	// Round trip of the loss report.
+	const int FEEDBACK_DELAY_FRAMES = 2;
+	// IDRScheduler::MIN_IDR_FRAME_INTERVAL
+	const int MIN_IDR_FRAME_INTERVAL = REFRESH_RATE / 10;
+	// Keyframe interval of EncodePipelineSW.
+	const int GOP_SIZE = 72;
+	// Default fec_inter_percentage and fec_parameter_sets_percentage.
+	const int FEC_PERCENTAGE = 5;
+	const int FEC_PARAMETER_SETS_PERCENTAGE = 30;
+
+	enum Mode {
+		MODE_KEYFRAMES,
+		MODE_INTRA_REFRESH,
+	};
+
+	const char *ModeName(Mode mode) {
+		return mode == MODE_KEYFRAMES ? "keyframes" : "intra-refresh";
+	}
+
+	// Bottleneck link drained at a constant rate, with a drop-tail queue, followed by a
+	// Gilbert-Elliott channel.
+	class LinkModel {
+	public:
+		LinkModel(uint64_t bitrate, uint32_t seed) : m_bytesPerUs(bitrate / 8. / 1e6), m_rng(seed) {}
+
+		// Marks the packets of a frame to drop. The packets reach the queue together.
+		void Apply(std::vector<bool> &drop, const std::vector<int> &sizes, uint64_t nowUs) {
+			m_queuedBytes = std::max(0., m_queuedBytes - (nowUs - m_lastUs) * m_bytesPerUs);
+			m_lastUs = nowUs;
+			drop.assign(sizes.size(), false);
+			for (size_t i = 0; i < sizes.size(); i++) {
+				if (m_queuedBytes + sizes[i] > QUEUE_BYTES) {
+					drop[i] = true;
+					continue;
+				}
+				m_queuedBytes += sizes[i];
+				m_bad = m_bad ? !Chance(BAD_TO_GOOD) : Chance(GOOD_TO_BAD);
+				drop[i] = m_bad;
+			}
+		}
+
+	private:
+		static constexpr double QUEUE_BYTES = 128 * 1024;
+		// Average loss of 0.002 / (0.002 + 0.4) = 0.5% in runs of 2.5 packets.
+		static constexpr double GOOD_TO_BAD = 0.002;
+		static constexpr double BAD_TO_GOOD = 0.4;
+
+		bool Chance(double probability) {
+			return std::uniform_real_distribution<double>(0., 1.)(m_rng) < probability;
+		}
+
+		double m_bytesPerUs;
+		double m_queuedBytes = 0.;
+		uint64_t m_lastUs = 0;
+		std::mt19937 m_rng;
+		bool m_bad = false;
+	};
+
+	// Whether an Annex B H.264 access unit contains a NAL unit of the given type.
+	bool HasNalType(const uint8_t *buf, int len, int type) {
+		for (int i = 0; i + 3 < len; i++) {
+			if (buf[i] == 0 && buf[i + 1] == 0 && buf[i + 2] == 1 && (buf[i + 3] & 0x1F) == type) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	const int NAL_TYPE_IDR = 5;
+	const int NAL_TYPE_SPS = 7;
+
+	// Panning noise texture with a square moving across it, in YUV 4:2:0.
+	class Scene {
+	public:
+		Scene(int width, int height, uint32_t seed) : m_width(width), m_height(height) {
+			// Smoothed noise, wider than the frame to pan over it.
+			m_textureWidth = width * 2;
+			std::vector<uint8_t> noise(m_textureWidth * height);
+			std::mt19937 rng(seed);
+			for (auto &v : noise) {
+				v = (uint8_t)rng();
+			}
+			m_texture.resize(noise.size());
+			for (int y = 0; y < height; y++) {
+				for (int x = 0; x < m_textureWidth; x++) {
+					int sum = 0;
+					for (int dy = -2; dy <= 2; dy++) {
+						for (int dx = -2; dx <= 2; dx++) {
+							int sx = std::clamp(x + dx, 0, m_textureWidth - 1);
+							int sy = std::clamp(y + dy, 0, height - 1);
+							sum += noise[sy * m_textureWidth + sx];
+						}
+					}
+					m_texture[y * m_textureWidth + x] = (uint8_t)(sum / 25);
+				}
+			}
+		}
+
+		void Render(AVFrame *frame, int index) {
+			int pan = (index * 3) % m_width;
+			int squareX = (index * 7) % (m_width - SQUARE_SIZE);
+			int squareY = m_height / 2 - SQUARE_SIZE / 2;
+			for (int y = 0; y < m_height; y++) {
+				uint8_t *row = frame->data[0] + y * frame->linesize[0];
+				memcpy(row, &m_texture[y * m_textureWidth + pan], m_width);
+				if (y >= squareY && y < squareY + SQUARE_SIZE) {
+					memset(row + squareX, 235, SQUARE_SIZE);
+				}
+			}
+			for (int plane = 1; plane < 3; plane++) {
+				for (int y = 0; y < m_height / 2; y++) {
+					memset(frame->data[plane] + y * frame->linesize[plane], plane == 1 ? 110 : 140, m_width / 2);
+				}
+			}
+		}
+
+	private:
+		static const int SQUARE_SIZE = 64;
+
+		int m_width;
+		int m_height;
+		int m_textureWidth;
+		std::vector<uint8_t> m_texture;
+	};
+
+	class Encoder {
+	public:
+		Encoder(Mode mode, int width, int height, uint64_t bitrate, int refreshFrames) {
+			const AVCodec *codec = avcodec_find_encoder_by_name("libx264");
+			if (codec == nullptr) {
+				throw std::runtime_error("libx264 is not available");
+			}
+			m_ctx = avcodec_alloc_context3(codec);
+
+			// Same options as EncodePipelineSW.
+			AVDictionary *opt = nullptr;
+			m_ctx->profile = FF_PROFILE_H264_HIGH;
+			av_dict_set(&opt, "preset", "ultrafast", 0);
+			av_dict_set(&opt, "tune", "zerolatency", 0);
+			m_ctx->gop_size = GOP_SIZE;
+			if (mode == MODE_INTRA_REFRESH) {
+				av_dict_set(&opt, "intra-refresh", "1", 0);
+				m_ctx->gop_size = refreshFrames;
+			}
+			m_ctx->width = width;
+			m_ctx->height = height;
+			m_ctx->time_base = { 1, REFRESH_RATE };
+			m_ctx->framerate = { REFRESH_RATE, 1 };
+			m_ctx->pix_fmt = AV_PIX_FMT_YUV420P;
+			m_ctx->max_b_frames = 0;
+			m_ctx->bit_rate = bitrate;
+
+			int err = avcodec_open2(m_ctx, codec, &opt);
+			av_dict_free(&opt);
+			if (err < 0) {
+				throw std::runtime_error("Cannot open libx264");
+			}
+
+			m_frame = av_frame_alloc();
+			m_frame->width = width;
+			m_frame->height = height;
+			m_frame->format = AV_PIX_FMT_YUV420P;
+			av_frame_get_buffer(m_frame, 0);
+			m_packet = av_packet_alloc();
+		}
+
+		~Encoder() {
+			av_packet_free(&m_packet);
+			av_frame_free(&m_frame);
+			avcodec_free_context(&m_ctx);
+		}
+
+		AVFrame *GetFrame() {
+			av_frame_make_writable(m_frame);
+			return m_frame;
+		}
+
+		// Returns the access unit, valid until the next call.
+		const std::vector<uint8_t> &Encode(int64_t pts, bool idr) {
+			m_frame->pts = pts;
+			m_frame->pict_type = idr ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_NONE;
+			if (avcodec_send_frame(m_ctx, m_frame) < 0) {
+				throw std::runtime_error("avcodec_send_frame failed");
+			}
+			m_output.clear();
+			while (avcodec_receive_packet(m_ctx, m_packet) == 0) {
+				m_output.insert(m_output.end(), m_packet->data, m_packet->data + m_packet->size);
+				av_packet_unref(m_packet);
+			}
+			return m_output;
+		}
+
+	private:
+		AVCodecContext *m_ctx = nullptr;
+		AVFrame *m_frame = nullptr;
+		AVPacket *m_packet = nullptr;
+		std::vector<uint8_t> m_output;
+	};
+
+	// Same steps as ClientConnection::FECSend for a frame sent as one FEC group.
+	class Sender {
+	public:
+		~Sender() {
+			ReleaseFrame();
+		}
+
+		void Send(const uint8_t *buf, int len, uint64_t videoFrameIndex, int fecPercentage) {
+			ReleaseFrame();
+			m_packets.clear();
+			m_frame = VideoFrameBuffer::Acquire();
+			m_frame->Append(buf, len);
+
+			int shardPackets = CalculateFECShardPackets(len, fecPercentage, GetFECMaxShards(0), m_frame->GetPayloadSize());
+			int blockSize = shardPackets * m_frame->GetPayloadSize();
+			int dataShards = (len + blockSize - 1) / blockSize;
+			int totalParityShards = CalculateParityShards(dataShards, fecPercentage);
+
+			auto rs = ReedSolomonCache::Instance().Get(dataShards, totalParityShards);
+
+			m_frame->PrepareFec(shardPackets, dataShards, totalParityShards);
+			m_frame->EncodeParity(rs.get(), 0, totalParityShards);
+
+			VideoFrame header = {};
+			header.type = ALVR_PACKET_TYPE_VIDEO_FRAME;
+			header.trackingFrameIndex = videoFrameIndex;
+			header.videoFrameIndex = videoFrameIndex;
+			header.frameByteSize = len;
+			header.fecPercentage = (uint16_t)fecPercentage;
+			header.lastSlice = 1;
+
+			int dataPackets = m_frame->GetDataPackets();
+			for (int i = 0; i < dataPackets; i++) {
+				Emit(header, i);
+			}
+			for (int i = 0; i < totalParityShards * shardPackets; i++) {
+				Emit(header, dataShards * shardPackets + i);
+			}
+		}
+
+		const std::vector<LegacySendPacket> &GetPackets() const {
+			return m_packets;
+		}
+
+	private:
+		void ReleaseFrame() {
+			if (m_frame != nullptr) {
+				m_frame->Release();
+				m_frame = nullptr;
+			}
+		}
+
+		void Emit(VideoFrame &header, int fecIndex) {
+			header.fecIndex = fecIndex;
+			header.packetCounter = m_packetCounter++;
+			m_frame->SetHeader(fecIndex, header);
+			m_packets.push_back({ m_frame->GetPacket(fecIndex), m_frame->GetPacketSize(fecIndex) });
+		}
+
+		VideoFrameBuffer *m_frame = nullptr;
+		std::vector<LegacySendPacket> m_packets;
+		uint32_t m_packetCounter = 0;
+	};
+
+	struct Config {
+		Mode mode;
+		int width;
+		int height;
+		uint64_t bitrate;
+		uint64_t linkBitrate;
+		int refreshFrames;
+		int frames;
+	};
+
+	void Run(const Config &config, uint32_t seed) {
+		Scene scene(config.width, config.height, seed);
+		Encoder encoder(config.mode, config.width, config.height, config.bitrate, config.refreshFrames);
+		LinkModel link(config.linkBitrate, seed);
+		Sender sender;
+		FECQueue queue;
+		queue.setClock(FakeClock);
+
+		std::vector<int> frameBytes;
+		std::vector<int> packetSizes;
+		std::vector<bool> drop;
+		uint64_t sentPackets = 0;
+		uint64_t lostPackets = 0;
+		int idrFrames = 0;
+		int lostFrames = 0;
+		int damagedFrames = 0;
+		bool fecFailure = false;
+
+		// Next frame the client expects.
+		uint64_t nextOutput = 1;
+		// Frame at which the server learns about the last loss, 0 if none pending.
+		int lossReportFrame = 0;
+		int nextIdrFrame = 0;
+		int lastIdrFrame = -MIN_IDR_FRAME_INTERVAL;
+		// Last keyframe sent and last frame at which the client lost a frame.
+		int lastKeyframe = 1;
+		int lastLossFrame = 0;
+		bool damaged = false;
+
+		for (int frame = 1; frame <= config.frames; frame++) {
+			// Server side: react to the loss reports that arrived.
+			if (config.mode == MODE_KEYFRAMES && lossReportFrame != 0 && lossReportFrame <= frame) {
+				lossReportFrame = 0;
+				if (nextIdrFrame == 0) {
+					nextIdrFrame = std::max(frame, lastIdrFrame + MIN_IDR_FRAME_INTERVAL);
+				}
+			}
+			bool idr = frame == nextIdrFrame;
+			if (idr) {
+				nextIdrFrame = 0;
+				lastIdrFrame = frame;
+			}
+
+			scene.Render(encoder.GetFrame(), frame);
+			const std::vector<uint8_t> &au = encoder.Encode(frame, idr);
+			if (au.empty()) {
+				continue;
+			}
+			bool hasIdr = HasNalType(au.data(), (int)au.size(), NAL_TYPE_IDR);
+			if (hasIdr) {
+				idrFrames++;
+				lastKeyframe = frame;
+			}
+			frameBytes.push_back((int)au.size());
+
+			bool parameterSets = HasNalType(au.data(), (int)au.size(), NAL_TYPE_SPS);
+			sender.Send(au.data(), (int)au.size(), frame, parameterSets ? FEC_PARAMETER_SETS_PERCENTAGE : FEC_PERCENTAGE);
+
+			const auto &packets = sender.GetPackets();
+			packetSizes.clear();
+			for (auto &packet : packets) {
+				packetSizes.push_back(packet.len);
+			}
+			g_clockUs += FRAME_INTERVAL_US;
+			link.Apply(drop, packetSizes, g_clockUs);
+
+			// Client side.
+			for (size_t i = 0; i < packets.size(); i++) {
+				sentPackets++;
+				if (drop[i]) {
+					lostPackets++;
+					continue;
+				}
+				g_clockUs++;
+				VideoFrame header = *(const VideoFrame *)packets[i].buf;
+				queue.addVideoPacket(&header, (const std::byte *)packets[i].buf + sizeof(VideoFrame), packets[i].len - (int)sizeof(VideoFrame), ALVR_MAX_VIDEO_BUFFER_SIZE, fecFailure);
+				while (queue.reconstruct(fecFailure)) {
+					uint64_t output = queue.getTrackingFrameIndex();
+					if (output > nextOutput) {
+						// The frames in between were given up.
+						lostFrames += (int)(output - nextOutput);
+						lastLossFrame = frame;
+						damaged = true;
+						if (lossReportFrame == 0) {
+							lossReportFrame = frame + FEEDBACK_DELAY_FRAMES;
+						}
+					}
+					nextOutput = output + 1;
+
+					if (damaged) {
+						if (lastKeyframe > lastLossFrame && (int)output >= lastKeyframe) {
+							damaged = false;
+						} else if (config.mode == MODE_INTRA_REFRESH) {
+							// Waves start every refreshFrames frames after the keyframe.
+							int waveStart = lastKeyframe + ((lastLossFrame - lastKeyframe) / config.refreshFrames + 1) * config.refreshFrames;
+							if ((int)output >= waveStart + config.refreshFrames) {
+								damaged = false;
+							}
+						}
+					}
+					if (damaged) {
+						damagedFrames++;
+					}
+				}
+			}
+		}
+
+		std::vector<int> sorted = frameBytes;
+		std::sort(sorted.begin(), sorted.end());
+		double meanBytes = 0.;
+		for (int bytes : frameBytes) {
+			meanBytes += bytes;
+		}
+		meanBytes = frameBytes.empty() ? 0. : meanBytes / frameBytes.size();
+		int p99Bytes = sorted.empty() ? 0 : sorted[std::min(sorted.size() - 1, (size_t)(0.99 * sorted.size()))];
+		int peakBytes = sorted.empty() ? 0 : sorted.back();
+
+		printf("{\"mode\":\"%s\",\"width\":%d,\"height\":%d,\"bitrate\":%llu,\"link_bitrate\":%llu,\"refresh_frames\":%d,"
+			"\"frames\":%d,\"idr_frames\":%d,\"mean_frame_bytes\":%.0f,\"p99_frame_bytes\":%d,\"peak_frame_bytes\":%d,"
+			"\"peak_to_mean\":%.2f,\"packets\":%llu,\"packet_loss\":%.4f,\"frames_lost\":%d,\"fec_failure_rate\":%.4f,"
+			"\"frames_damaged\":%d}\n",
+			ModeName(config.mode), config.width, config.height, (unsigned long long)config.bitrate,
+			(unsigned long long)config.linkBitrate, config.refreshFrames, config.frames, idrFrames, meanBytes, p99Bytes,
+			peakBytes, meanBytes > 0. ? peakBytes / meanBytes : 0., (unsigned long long)sentPackets,
+			sentPackets ? (double)lostPackets / sentPackets : 0., lostFrames,
+			config.frames ? (double)lostFrames / config.frames : 0., damagedFrames);
+		fflush(stdout);
+	}
+}
+
+int main(int argc, char **argv) {
+	Config config;
+	config.width = 1920;
+	config.height = 1080;
+	config.bitrate = 30 * 1000 * 1000;
+	config.refreshFrames = 36;
+	config.frames = 2000;
+	uint32_t seed = 1;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--frames" && i + 1 < argc) {
+			config.frames = atoi(argv[++i]);
+		} else if (arg == "--seed" && i + 1 < argc) {
+			seed = (uint32_t)strtoul(argv[++i], nullptr, 10);
+		} else if (arg == "--bitrate-mbs" && i + 1 < argc) {
+			config.bitrate = strtoull(argv[++i], nullptr, 10) * 1000 * 1000;
+		} else if (arg == "--refresh-frames" && i + 1 < argc) {
+			config.refreshFrames = atoi(argv[++i]);
+		} else {
+			fprintf(stderr, "Usage: %s [--frames <count>] [--seed <seed>] [--bitrate-mbs <mbps>] [--refresh-frames <count>]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (config.frames < 1 || config.refreshFrames < 2) {
+		fprintf(stderr, "Invalid arguments.\n");
+		return 1;
+	}
+	// Twice the video bitrate: P-frames pass, keyframes fill the queue.
+	config.linkBitrate = config.bitrate * 2;
+
+	try {
+		for (Mode mode : { MODE_KEYFRAMES, MODE_INTRA_REFRESH }) {
+			config.mode = mode;
+			Run(config, seed);
+		}
+	} catch (std::exception &e) {
+		fprintf(stderr, "%s\n", e.what());
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,421 @@
+// Host-only simulation of the packet pacing of the server.
+// PacketPacer is driven on a simulated clock like ClientConnection::PacerThread drives it: the
+// sending thread polls when a batch is added and sleeps until the next release time, and wakes up
+// late by a random scheduling delay, sometimes by more than a frame interval. Frames of random
+// sizes are added at the refresh rate, and urgent batches (retransmissions, FEC repair) at random
+// times. Everything runs with a fixed seed, so runs are reproducible.
+// VideoFrameBuffer is replaced by a stub that only counts references, so that the references the
+// pacer takes and drops can be checked.
+//
+// Build and run with "cargo xtask test-packet-pacer". Every scenario prints one JSON object per
+// line on stdout, and the program fails if one of these does not hold:
+// - every packet is sent exactly once, and the frame buffer is released once all its packets are
+//   sent, exactly once;
+// - packets of the frames are sent in the order of the frames, the tail of a late frame before the
+//   next frame, and in the order of the batch within a frame;
+// - a packet is not sent before its release time minus QUANTUM_US, and, when the sending thread
+//   wakes up on time, not after the end of the window of its frame;
+// - urgent batches are sent by the first poll after they are added, before any other packet;
+// - the pending packets are those added and not sent yet;
+// - the sending thread wakes up at most once per QUANTUM_US of the window for each frame;
+// - after the first second, adding and polling batches only allocates when the pacer holds more
+//   batches than ever before.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <atomic>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "alvr_server/PacketPacer.h"
+#include "alvr_server/VideoFrameBuffer.h"
+
+namespace {
+	std::atomic<uint64_t> g_allocations{ 0 };
+
+	// References of the stub buffers, by buffer index.
+	std::vector<int> g_refCounts;
+	// Buffers with references.
+	int g_liveBuffers = 0;
+	// A reference was dropped below zero, or added to a released buffer.
+	bool g_refError = false;
+}
+
+void *operator new(size_t size) {
+	g_allocations++;
+	void *p = malloc(size ? size : 1);
+	if (p == nullptr) {
+		throw std::bad_alloc();
+	}
+	return p;
+}
+
+void operator delete(void *p) noexcept {
+	free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+	free(p);
+}
+
+// Stub of the buffer: m_frameByteSize holds its index in g_refCounts.
+VideoFrameBuffer *VideoFrameBuffer::Acquire() {
+	VideoFrameBuffer *buffer = new VideoFrameBuffer();
+	buffer->m_frameByteSize = g_refCounts.size();
+	g_refCounts.push_back(1);
+	g_liveBuffers++;
+	return buffer;
+}
+
+void VideoFrameBuffer::AddRef() {
+	int &refCount = g_refCounts[m_frameByteSize];
+	if (refCount <= 0) {
+		g_refError = true;
+	}
+	refCount++;
+}
+
+void VideoFrameBuffer::Release() {
+	int &refCount = g_refCounts[m_frameByteSize];
+	refCount--;
+	if (refCount == 0) {
+		g_liveBuffers--;
+	} else if (refCount < 0) {
+		g_refError = true;
+	}
+}
+
+namespace {
+	const uint64_t DURATION_US = 10 * 1000 * 1000;
+	const uint64_t WARMUP_US = 1000 * 1000;
+	const uint64_t START_US = 1000ull * 1000 * 1000;
+	const int MAX_FRAME_PACKETS = 300;
+	const int MAX_URGENT_PACKETS = 8;
+
+	struct Scenario {
+		const char *name;
+		int refreshRate;
+		int windowPercentage;
+		// Random delay of the wakeups of the sending thread, and the chance of a wakeup to be late
+		// by stallUs instead.
+		uint64_t maxWakeupDelayUs;
+		double stallChance;
+		uint64_t stallUs;
+		// Chance of an urgent batch after each frame.
+		double urgentChance;
+	};
+
+	const Scenario SCENARIOS[] = {
+		{ "paced-72hz", 72, 50, 0, 0., 0, 0. },
+		{ "paced-120hz-full-window", 120, 100, 0, 0., 0, 0. },
+		{ "late-wakeups", 90, 80, 3000, 0.01, 15000, 0. },
+		{ "urgent", 90, 50, 0, 0., 0, 0.3 },
+		{ "urgent-late-wakeups", 90, 80, 3000, 0.01, 15000, 0.3 },
+		{ "short-window", 90, 10, 500, 0., 0, 0.3 },
+	};
+
+	// A packet points to its entry in the batch it was added with: buf is the address of a
+	// PacketId.
+	struct PacketId {
+		int batch;
+		int index;
+	};
+
+	struct BatchInfo {
+		VideoFrameBuffer *frame;
+		bool urgent;
+		// Index of the frame among the normal batches.
+		int frameIndex;
+		uint64_t startUs;
+		std::vector<PacketId> ids;
+		std::vector<int> sentCount;
+	};
+
+	struct Checks {
+		uint64_t packets = 0;
+		uint64_t sent = 0;
+		uint64_t duplicates = 0;
+		uint64_t unsent = 0;
+		uint64_t leakedRefs = 0;
+		uint64_t sentAfterRelease = 0;
+		uint64_t frameOrder = 0;
+		uint64_t early = 0;
+		uint64_t lateOnTime = 0;
+		uint64_t urgentOrder = 0;
+		uint64_t pendingErrors = 0;
+		uint64_t wakeups = 0;
+		uint64_t frameWakeupsMax = 0;
+		uint64_t allocations = 0;
+		uint64_t maxLatenessUs = 0;
+	};
+
+	bool Run(const Scenario &scenario, uint32_t seed) {
+		std::mt19937 rng(seed);
+		std::uniform_int_distribution<int> frameSize(1, MAX_FRAME_PACKETS);
+		std::uniform_int_distribution<int> urgentSize(1, MAX_URGENT_PACKETS);
+		std::uniform_real_distribution<double> chance(0., 1.);
+		std::uniform_int_distribution<uint64_t> wakeupDelay(0, scenario.maxWakeupDelayUs);
+
+		uint64_t frameIntervalUs = 1000 * 1000 / scenario.refreshRate;
+		uint64_t windowUs = frameIntervalUs * scenario.windowPercentage / 100;
+		g_refCounts.clear();
+		g_refCounts.reserve(DURATION_US / frameIntervalUs * 2 + 16);
+		g_refError = false;
+		g_liveBuffers = 0;
+		// Most batches the pacer held at once.
+		int peakBatches = 0;
+
+		std::vector<BatchInfo> batches;
+		batches.reserve(g_refCounts.capacity());
+		std::vector<LegacySendPacket> packets;
+		packets.reserve(MAX_FRAME_PACKETS);
+		std::vector<PacketPacer::Packet> out;
+		out.reserve(2 * MAX_FRAME_PACKETS);
+		Checks checks;
+
+		PacketPacer pacer(frameIntervalUs, scenario.windowPercentage);
+
+		// Urgent batches added since the last poll, the next one must send them.
+		std::vector<int> pendingUrgent;
+		pendingUrgent.reserve(16);
+		// With a sending thread that always wakes up on time, packets go within the window.
+		bool onTime = scenario.maxWakeupDelayUs == 0 && scenario.stallChance == 0.;
+
+		auto addBatch = [&](uint64_t now, bool urgent, int count, int frameIndex) {
+			BatchInfo info;
+			info.frame = VideoFrameBuffer::Acquire();
+			info.urgent = urgent;
+			info.frameIndex = frameIndex;
+			info.startUs = now;
+			info.ids.resize(count);
+			info.sentCount.assign(count, 0);
+			for (int i = 0; i < count; i++) {
+				info.ids[i] = { (int)batches.size(), i };
+			}
+			batches.push_back(std::move(info));
+			BatchInfo &batch = batches.back();
+			packets.clear();
+			for (int i = 0; i < count; i++) {
+				packets.push_back({ (unsigned char *)&batch.ids[i], 1 });
+			}
+			checks.packets += count;
+			if (urgent) {
+				pendingUrgent.push_back((int)batches.size() - 1);
+			}
+
+			uint64_t allocations = g_allocations;
+			pacer.AddBatch(now, batch.frame, packets, urgent);
+			// The pacer holds the batches it references, sent ones until the next call.
+			if (now >= START_US + WARMUP_US && g_liveBuffers <= peakBatches) {
+				checks.allocations += g_allocations - allocations;
+			}
+			peakBatches = std::max(peakBatches, g_liveBuffers);
+			// The sender drops its reference once the packets are queued.
+			batch.frame->Release();
+		};
+
+		// Last normal frame sent from, and the next packet expected in it.
+		int lastFrame = -1;
+		int lastPacket = -1;
+		std::vector<uint64_t> frameWakeups;
+		frameWakeups.reserve(g_refCounts.capacity());
+
+		auto poll = [&](uint64_t now) {
+			checks.wakeups++;
+			out.clear();
+			uint64_t allocations = g_allocations;
+			pacer.Poll(now, out);
+			if (now >= START_US + WARMUP_US) {
+				checks.allocations += g_allocations - allocations;
+			}
+
+			checks.sent += out.size();
+			if (pacer.GetPendingPackets() != checks.packets - checks.sent) {
+				checks.pendingErrors++;
+			}
+
+			bool normalSeen = false;
+			for (const auto &packet : out) {
+				const PacketId &id = *(const PacketId *)packet.packet.buf;
+				BatchInfo &batch = batches[id.batch];
+				if (batch.frame != packet.frame) {
+					checks.duplicates++;
+					continue;
+				}
+				if (g_refCounts[id.batch] <= 0) {
+					checks.sentAfterRelease++;
+				}
+				if (batch.sentCount[id.index]++ != 0) {
+					checks.duplicates++;
+				}
+
+				if (batch.urgent) {
+					// Added before this poll, so nothing goes before it.
+					if (normalSeen) {
+						checks.urgentOrder++;
+					}
+					continue;
+				}
+				normalSeen = true;
+				if (batch.frameIndex < lastFrame || (batch.frameIndex == lastFrame && id.index != lastPacket + 1) ||
+					(batch.frameIndex > lastFrame && id.index != 0)) {
+					checks.frameOrder++;
+				}
+				lastFrame = batch.frameIndex;
+				lastPacket = id.index;
+
+				size_t count = batch.ids.size();
+				uint64_t release = batch.startUs + windowUs * id.index / count;
+				uint64_t deadline = batch.startUs + windowUs * (id.index + 1) / count;
+				if (now + PacketPacer::QUANTUM_US < release) {
+					checks.early++;
+				}
+				if (onTime && now > batch.startUs + windowUs) {
+					checks.lateOnTime++;
+				}
+				if (now > deadline) {
+					checks.maxLatenessUs = std::max(checks.maxLatenessUs, now - deadline);
+				}
+			}
+			for (int batch : pendingUrgent) {
+				for (int sent : batches[batch].sentCount) {
+					if (sent == 0) {
+						checks.urgentOrder++;
+					}
+				}
+			}
+			pendingUrgent.clear();
+
+			// Wakeups that sent packets of each frame.
+			int previous = -1;
+			for (const auto &packet : out) {
+				const PacketId &id = *(const PacketId *)packet.packet.buf;
+				const BatchInfo &batch = batches[id.batch];
+				if (!batch.urgent && batch.frameIndex != previous) {
+					if (frameWakeups.size() <= (size_t)batch.frameIndex) {
+						frameWakeups.resize(batch.frameIndex + 1, 0);
+					}
+					frameWakeups[batch.frameIndex]++;
+					previous = batch.frameIndex;
+				}
+			}
+		};
+
+		uint64_t now = START_US;
+		uint64_t nextFrameUs = START_US;
+		uint64_t nextUrgentUs = UINT64_MAX;
+		int frameIndex = 0;
+		// Next wakeup of the sending thread.
+		uint64_t wakeupUs = UINT64_MAX;
+
+		auto scheduleWakeup = [&](uint64_t target) {
+			uint64_t delay = wakeupDelay(rng);
+			if (chance(rng) < scenario.stallChance) {
+				delay = scenario.stallUs;
+			}
+			wakeupUs = std::min(wakeupUs, target + delay);
+		};
+
+		while (now < START_US + DURATION_US || !pacer.IsEmpty() || nextUrgentUs != UINT64_MAX) {
+			if (nextUrgentUs <= std::min(nextFrameUs, wakeupUs)) {
+				now = nextUrgentUs;
+				nextUrgentUs = UINT64_MAX;
+				addBatch(now, true, urgentSize(rng), -1);
+				// AddBatch() wakes the sending thread up.
+				scheduleWakeup(now);
+				continue;
+			}
+			if (now < START_US + DURATION_US && nextFrameUs <= wakeupUs) {
+				now = nextFrameUs;
+				// The largest frames first, the packet lists of the pacer then have their final
+				// size.
+				int size = now < START_US + WARMUP_US / 2 ? MAX_FRAME_PACKETS : frameSize(rng);
+				addBatch(now, false, size, frameIndex++);
+				if (chance(rng) < scenario.urgentChance) {
+					// Before the next frame.
+					nextUrgentUs = now + std::uniform_int_distribution<uint64_t>(0, frameIntervalUs - 1)(rng);
+				}
+				nextFrameUs += frameIntervalUs;
+				scheduleWakeup(now);
+				continue;
+			}
+			if (wakeupUs == UINT64_MAX) {
+				break;
+			}
+			now = std::max(now, wakeupUs);
+			wakeupUs = UINT64_MAX;
+			poll(now);
+			uint64_t next = pacer.GetNextReleaseTime();
+			if (next != UINT64_MAX) {
+				scheduleWakeup(std::max(next, now));
+			}
+		}
+		// The last references are dropped by the next call.
+		out.clear();
+		pacer.Poll(now, out);
+		checks.duplicates += out.size();
+
+		for (size_t i = 0; i < batches.size(); i++) {
+			for (int sent : batches[i].sentCount) {
+				if (sent == 0) {
+					checks.unsent++;
+				}
+			}
+			if (g_refCounts[i] != 0) {
+				checks.leakedRefs++;
+			}
+			delete batches[i].frame;
+		}
+		uint64_t maxFrameWakeups = windowUs / PacketPacer::QUANTUM_US + 2;
+		for (uint64_t wakeups : frameWakeups) {
+			checks.frameWakeupsMax = std::max(checks.frameWakeupsMax, wakeups);
+		}
+
+		bool pass = checks.duplicates == 0 && checks.unsent == 0 && checks.leakedRefs == 0 && !g_refError &&
+			checks.sentAfterRelease == 0 && checks.frameOrder == 0 && checks.early == 0 && checks.lateOnTime == 0 &&
+			checks.urgentOrder == 0 && checks.pendingErrors == 0 && checks.frameWakeupsMax <= maxFrameWakeups && checks.allocations == 0;
+		printf("{\"scenario\":\"%s\",\"refresh_rate\":%d,\"window_percentage\":%d,\"frames\":%d,\"packets\":%llu,"
+			"\"wakeups\":%llu,\"max_frame_wakeups\":%llu,\"max_lateness_us\":%llu,\"duplicates\":%llu,\"unsent\":%llu,"
+			"\"leaked_refs\":%llu,\"ref_errors\":%s,\"sent_after_release\":%llu,\"frame_order_errors\":%llu,"
+			"\"early\":%llu,\"late_on_time\":%llu,\"urgent_order_errors\":%llu,\"pending_errors\":%llu,\"allocations\":%llu,\"pass\":%s}\n",
+			scenario.name, scenario.refreshRate, scenario.windowPercentage, frameIndex,
+			(unsigned long long)checks.packets, (unsigned long long)checks.wakeups,
+			(unsigned long long)checks.frameWakeupsMax, (unsigned long long)checks.maxLatenessUs,
+			(unsigned long long)checks.duplicates, (unsigned long long)checks.unsent,
+			(unsigned long long)checks.leakedRefs, g_refError ? "true" : "false",
+			(unsigned long long)checks.sentAfterRelease, (unsigned long long)checks.frameOrder,
+			(unsigned long long)checks.early, (unsigned long long)checks.lateOnTime,
+			(unsigned long long)checks.urgentOrder, (unsigned long long)checks.pendingErrors,
+			(unsigned long long)checks.allocations, pass ? "true" : "false");
+		fflush(stdout);
+		return pass;
+	}
+}
+
+int main(int argc, char **argv) {
+	uint32_t seed = 1;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--seed" && i + 1 < argc) {
+			seed = (uint32_t)strtoul(argv[++i], nullptr, 10);
+		} else {
+			fprintf(stderr, "Usage: %s [--seed <seed>]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	bool pass = true;
+	for (const Scenario &scenario : SCENARIOS) {
+		pass = Run(scenario, seed) && pass;
+	}
+	if (!pass) {
+		fprintf(stderr, "The packet pacer failed in some scenarios.\n");
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,271 @@
+// Two process stress benchmark of the present_shm hand-off between the vulkan layer and CEncoder.
+// The parent process plays the layer: it renders into the free images of a swapchain (it only
+// stamps them), presents them at a fixed rate, or as fast as it can, and takes back the images
+// replaced or released as the layer does. The child process plays CEncoder: it acquires the
+// images, holds them for a while as the conversion would, and releases them.
+//
+// Build and run with "cargo xtask bench-present-shm". Every scenario prints one JSON object per
+// line on stdout. Latencies are from the call to present() to the return of acquire() in the
+// other process, in microseconds; jitter is their standard deviation. The program fails if the
+// producer ever wrote into an image owned by the consumer, or if an image never came back.
+
+#include <math.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "platform/linux/protocol.h"
+
+namespace {
+	const int MAX_IMAGES = 8;
+	const int MAX_SAMPLES = 1 << 20;
+
+	struct Scenario {
+		const char *name;
+		int images;
+		// 0 to present as fast as possible.
+		int rateHz;
+		// Time the consumer holds each image.
+		int holdUs;
+		int durationMs;
+	};
+
+	const Scenario SCENARIOS[] = {
+		{ "72hz", 3, 72, 3000, 5000 },
+		{ "90hz", 3, 90, 2000, 5000 },
+		{ "120hz", 3, 120, 4000, 5000 },
+		{ "120hz-slow-consumer", 3, 120, 12000, 5000 },
+		{ "stress", 3, 0, 0, 3000 },
+		{ "stress-hold", 3, 0, 100, 3000 },
+	};
+
+	// Written by the producer before presenting an image, checked by the consumer.
+	struct ImageStamp {
+		std::atomic<uint64_t> frame;
+		std::atomic<uint64_t> presentNs;
+	};
+
+	// Second shared mapping, next to present_shm.
+	struct Shared {
+		ImageStamp stamps[MAX_IMAGES];
+		std::atomic<bool> producerDone;
+		// Filled by the consumer.
+		uint64_t acquired;
+		uint64_t replaced;
+		uint64_t overwritten;
+		uint64_t latencySamples;
+		uint32_t latenciesNs[MAX_SAMPLES];
+	};
+
+	uint64_t NowNs() {
+		timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+	}
+
+	void BusyWaitUs(int us) {
+		uint64_t end = NowNs() + (uint64_t)us * 1000;
+		while (NowNs() < end) {
+		}
+	}
+
+	void RunConsumer(present_shm *shm, Shared *shared, const Scenario &scenario) {
+		uint32_t lastPresents = 0;
+		while (true) {
+			uint32_t presents;
+			uint32_t image = shm->acquire(std::chrono::milliseconds(100), &presents);
+			if (image == present_shm::none_id) {
+				if (shared->producerDone) {
+					break;
+				}
+				continue;
+			}
+			uint64_t now = NowNs();
+			uint64_t frame = shared->stamps[image].frame.load(std::memory_order_relaxed);
+			uint64_t latency = now - shared->stamps[image].presentNs.load(std::memory_order_relaxed);
+			if (shared->latencySamples < MAX_SAMPLES) {
+				shared->latenciesNs[shared->latencySamples++] = (uint32_t)std::min<uint64_t>(latency, UINT32_MAX);
+			}
+			shared->replaced += (uint16_t)(presents - lastPresents) - 1;
+			lastPresents = presents;
+			shared->acquired++;
+
+			BusyWaitUs(scenario.holdUs);
+			if (shared->stamps[image].frame.load(std::memory_order_relaxed) != frame) {
+				shared->overwritten++;
+			}
+			shm->release();
+		}
+	}
+
+	// Returns false if an image never came back. stalls: number of times no image was free.
+	bool RunProducer(present_shm *shm, Shared *shared, const Scenario &scenario, uint64_t &stalls) {
+		// Images presented and not given back yet, as swapchain_image::PRESENTED in the layer.
+		bool presented[MAX_IMAGES] = {};
+		bool lost = false;
+		uint64_t frame = 0;
+		uint64_t start = NowNs();
+		uint64_t end = start + (uint64_t)scenario.durationMs * 1000000;
+		uint64_t intervalNs = scenario.rateHz > 0 ? 1000000000 / scenario.rateHz : 0;
+		uint32_t lastPresented = present_shm::none_id;
+
+		while (NowNs() < end && !lost) {
+			if (intervalNs > 0) {
+				uint64_t due = start + frame * intervalNs;
+				timespec ts{ .tv_sec = (time_t)(due / 1000000000), .tv_nsec = (long)(due % 1000000000) };
+				clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr);
+			}
+
+			int image = -1;
+			uint64_t stallStart = NowNs();
+			while (image < 0 && !lost) {
+				// Same as the end of swapchain::present_image(), for the images released since.
+				uint32_t owned = shm->owned_by_consumer();
+				for (int i = 0; i < scenario.images; i++) {
+					if (presented[i] && (uint32_t)i != lastPresented && (uint32_t)i != owned) {
+						presented[i] = false;
+					}
+				}
+				for (int i = 0; i < scenario.images && image < 0; i++) {
+					if (!presented[i]) {
+						image = i;
+					}
+				}
+				if (image < 0) {
+					stalls++;
+					// The consumer holds one image for at most holdUs.
+					lost = NowNs() - stallStart > 1000000000;
+					sched_yield();
+				}
+			}
+			if (lost) {
+				break;
+			}
+
+			// Rendering.
+			shared->stamps[image].frame.store(frame, std::memory_order_relaxed);
+			presented[image] = true;
+			shared->stamps[image].presentNs.store(NowNs(), std::memory_order_relaxed);
+			uint32_t freed = shm->present(image);
+			lastPresented = image;
+			if (freed != present_shm::none_id) {
+				presented[freed] = false;
+			}
+			frame++;
+		}
+		shared->producerDone = true;
+		return !lost;
+	}
+
+	double Percentile(std::vector<uint32_t> &sorted, double p) {
+		if (sorted.empty()) {
+			return 0.;
+		}
+		return sorted[std::min(sorted.size() - 1, (size_t)(p * sorted.size()))] / 1000.;
+	}
+
+	bool Run(const Scenario &scenario) {
+		size_t shmSize = sizeof(present_shm) + scenario.images * sizeof(present_info);
+		int fd = memfd_create("present_shm_bench", MFD_CLOEXEC);
+		if (fd == -1 || ftruncate(fd, shmSize) != 0) {
+			perror("memfd_create");
+			exit(1);
+		}
+		auto *shm = (present_shm *)mmap(nullptr, shmSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		auto *shared = (Shared *)mmap(nullptr, sizeof(Shared), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+		if (shm == MAP_FAILED || shared == MAP_FAILED) {
+			perror("mmap");
+			exit(1);
+		}
+		new (shm) present_shm;
+		shm->size = scenario.images;
+		new (shared) Shared{};
+
+		pid_t child = fork();
+		if (child == -1) {
+			perror("fork");
+			exit(1);
+		}
+		if (child == 0) {
+			RunConsumer(shm, shared, scenario);
+			_exit(0);
+		}
+		uint64_t stalls = 0;
+		bool lost = !RunProducer(shm, shared, scenario, stalls);
+		if (lost) {
+			kill(child, SIGKILL);
+		}
+		int status;
+		waitpid(child, &status, 0);
+
+		std::vector<uint32_t> latencies(shared->latenciesNs, shared->latenciesNs + shared->latencySamples);
+		std::sort(latencies.begin(), latencies.end());
+		double mean = 0.;
+		for (uint32_t latency : latencies) {
+			mean += latency / 1000.;
+		}
+		mean /= std::max<size_t>(latencies.size(), 1);
+		double variance = 0.;
+		for (uint32_t latency : latencies) {
+			variance += (latency / 1000. - mean) * (latency / 1000. - mean);
+		}
+		variance /= std::max<size_t>(latencies.size(), 1);
+
+		bool pass = WIFEXITED(status) && WEXITSTATUS(status) == 0 && shared->overwritten == 0 && !lost;
+
+		printf("{\"scenario\":\"%s\",\"images\":%d,\"rate_hz\":%d,\"hold_us\":%d,\"acquired\":%llu,"
+			"\"replaced\":%llu,\"producer_stalls\":%llu,\"latency_mean_us\":%.1f,\"latency_p50_us\":%.1f,"
+			"\"latency_p99_us\":%.1f,\"latency_p999_us\":%.1f,\"latency_max_us\":%.1f,\"jitter_us\":%.1f,"
+			"\"overwritten\":%llu,\"lost\":%s,\"pass\":%s}\n",
+			scenario.name, scenario.images, scenario.rateHz, scenario.holdUs,
+			(unsigned long long)shared->acquired, (unsigned long long)shared->replaced, (unsigned long long)stalls,
+			mean, Percentile(latencies, 0.5), Percentile(latencies, 0.99), Percentile(latencies, 0.999),
+			latencies.empty() ? 0. : latencies.back() / 1000., sqrt(variance),
+			(unsigned long long)shared->overwritten, lost ? "true" : "false", pass ? "true" : "false");
+		fflush(stdout);
+
+		munmap(shm, shmSize);
+		munmap(shared, sizeof(Shared));
+		close(fd);
+		return pass;
+	}
+}
+
+int main(int argc, char **argv) {
+	std::string only;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--scenario" && i + 1 < argc) {
+			only = argv[++i];
+		} else {
+			fprintf(stderr, "Usage: %s [--scenario <name>]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	bool pass = true;
+	for (const Scenario &scenario : SCENARIOS) {
+		if (only.empty() || only == scenario.name) {
+			pass = Run(scenario) && pass;
+		}
+	}
+	if (!pass) {
+		fprintf(stderr, "The present_shm hand-off failed in some scenarios.\n");
+		return 1;
+	}
+	return 0;
+}
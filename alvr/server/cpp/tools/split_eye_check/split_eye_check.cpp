@@ -0,0 +1,298 @@
+// Host-only check that the two half-width streams of split eye encoding composite to the full
+// frame. A YUV 4:2:0 frame with a distinct value at every sample goes through the path of
+// EncodePipelineSW and of the client, with a lossless stand-in for the encoders and decoders:
+// - the eye pictures are the halves of the frame, referenced with the plane offsets and line sizes
+//   EncodePipelineSW gives to the two encoders;
+// - each eye picture is written as an Annex B access unit, its samples carried in the slices with
+//   emulation prevention, and filtered like filter_NAL; the right one follows the left one;
+// - the client cuts the frame with AnnexBFindSecondPicture and decodes each picture on its own;
+// - every pixel of both eye viewports is rendered with the uv of the vertex shader and the split
+//   fragment shader of render.cpp, sampling the nearest texel.
+// The rendered samples must be those of the full frame at the same position. libavcodec, the
+// decoders and the GPU are not involved.
+//
+// Build and run with "cargo xtask test-split-eye". Every configuration prints one JSON object per
+// line on stdout, and the program fails on any mismatch.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <random>
+#include <vector>
+
+#include "annexb.h"
+
+namespace {
+	// Line sizes are padded like av_frame_get_buffer() does.
+	const int LINESIZE_ALIGN = 64;
+
+	struct Picture {
+		int width;
+		int height;
+		uint8_t *data[3];
+		int linesize[3];
+	};
+
+	int PlaneWidth(const Picture &picture, int plane) {
+		return plane == 0 ? picture.width : picture.width / 2;
+	}
+
+	int PlaneHeight(const Picture &picture, int plane) {
+		return plane == 0 ? picture.height : picture.height / 2;
+	}
+
+	class Frame {
+	public:
+		Frame(int width, int height) {
+			m_picture.width = width;
+			m_picture.height = height;
+			for (int plane = 0; plane < 3; plane++) {
+				int linesize = (PlaneWidth(m_picture, plane) + LINESIZE_ALIGN - 1) / LINESIZE_ALIGN * LINESIZE_ALIGN;
+				m_planes[plane].assign((size_t)linesize * PlaneHeight(m_picture, plane), 0);
+				m_picture.data[plane] = m_planes[plane].data();
+				m_picture.linesize[plane] = linesize;
+			}
+		}
+
+		Picture &Get() { return m_picture; }
+
+	private:
+		Picture m_picture;
+		std::vector<uint8_t> m_planes[3];
+	};
+
+	// Distinct along the rows and across the planes, with many zero bytes so that emulation
+	// prevention is exercised.
+	void FillFrame(Picture &picture, std::mt19937 &rng) {
+		std::uniform_int_distribution<int> byteDist(0, 255);
+		for (int plane = 0; plane < 3; plane++) {
+			for (int y = 0; y < PlaneHeight(picture, plane); y++) {
+				uint8_t *row = picture.data[plane] + (size_t)y * picture.linesize[plane];
+				for (int x = 0; x < PlaneWidth(picture, plane); x++) {
+					row[x] = (x + y + plane) % 3 == 0 ? 0 : (uint8_t)byteDist(rng);
+				}
+			}
+		}
+	}
+
+	// The half of the frame an eye encoder reads, as set up by EncodePipelineSW: the buffers of
+	// the whole frame with the data offset by the width of the left half.
+	Picture EyePicture(const Picture &frame, int eye) {
+		Picture picture;
+		picture.width = frame.width / 2;
+		picture.height = frame.height;
+		for (int plane = 0; plane < 3; plane++) {
+			int planeWidth = plane == 0 ? picture.width : picture.width / 2;
+			picture.data[plane] = frame.data[plane] + eye * planeWidth;
+			picture.linesize[plane] = frame.linesize[plane];
+		}
+		return picture;
+	}
+
+	class StreamWriter {
+	public:
+		void StartNal(int type, bool h265) {
+			m_data.insert(m_data.end(), { 0, 0, 0, 1 });
+			m_zeros = 0;
+			if (h265) {
+				WriteByte((uint8_t)(type << 1));
+				WriteByte(1);
+			} else {
+				WriteByte((uint8_t)(0x60 | type));
+			}
+		}
+
+		// With emulation prevention, as an encoder writes it.
+		void WriteByte(uint8_t byte) {
+			if (m_zeros >= 2 && byte <= 3) {
+				m_data.push_back(3);
+				m_zeros = 0;
+			}
+			m_data.push_back(byte);
+			m_zeros = byte == 0 ? m_zeros + 1 : 0;
+		}
+
+		std::vector<uint8_t> &Data() { return m_data; }
+
+	private:
+		std::vector<uint8_t> m_data;
+		int m_zeros = 0;
+	};
+
+	// Rows of the picture a slice carries, the luma rows and the chroma rows under them.
+	void SliceRows(int height, int slices, int slice, int &begin, int &end) {
+		int rows = height / 2 / slices * 2;
+		begin = slice * rows;
+		end = slice == slices - 1 ? height : begin + rows;
+	}
+
+	// Lossless stand-in for an encoder: an access unit delimiter, the parameter sets of a keyframe
+	// and an SEI, then the samples of the picture in slices of whole rows.
+	std::vector<uint8_t> Encode(const Picture &picture, bool h265, bool keyframe, int slices) {
+		StreamWriter writer;
+		writer.StartNal(h265 ? 35 : 9, h265);
+		writer.WriteByte(0x50);
+		if (keyframe) {
+			if (h265) {
+				writer.StartNal(32, true);
+				writer.WriteByte(0x80);
+			}
+			writer.StartNal(h265 ? 33 : 7, h265);
+			writer.WriteByte(0x80);
+			writer.StartNal(h265 ? 34 : 8, h265);
+			writer.WriteByte(0x80);
+		}
+		writer.StartNal(h265 ? 39 : 6, h265);
+		writer.WriteByte(0x80);
+		for (int slice = 0; slice < slices; slice++) {
+			writer.StartNal(h265 ? (keyframe ? 19 : 1) : (keyframe ? 5 : 1), h265);
+			// first_mb_in_slice or first_slice_segment_in_pic_flag, then the rest of the header.
+			writer.WriteByte(slice == 0 ? 0x88 : 0x24);
+			int begin, end;
+			SliceRows(picture.height, slices, slice, begin, end);
+			for (int plane = 0; plane < 3; plane++) {
+				int shift = plane == 0 ? 0 : 1;
+				for (int y = begin >> shift; y < end >> shift; y++) {
+					const uint8_t *row = picture.data[plane] + (size_t)y * picture.linesize[plane];
+					for (int x = 0; x < PlaneWidth(picture, plane); x++) {
+						writer.WriteByte(row[x]);
+					}
+				}
+			}
+			// rbsp_stop_one_bit
+			writer.WriteByte(0x80);
+		}
+		std::vector<uint8_t> &data = writer.Data();
+		data.resize(AnnexBFilterInPlace(data.data(), data.size(), h265));
+		return std::move(data);
+	}
+
+	// Lossless stand-in for a decoder, the inverse of Encode(). Returns false if the access unit
+	// does not hold the slices of exactly one picture.
+	bool Decode(const uint8_t *data, size_t size, bool h265, int slices, Picture &picture) {
+		AnnexBParser parser(data, size, h265);
+		AnnexBNal nal;
+		int slice = 0;
+		std::vector<uint8_t> rbsp;
+		while (parser.Next(nal)) {
+			if (!AnnexBIsSlice(nal.type, h265)) {
+				continue;
+			}
+			if (slice == slices || AnnexBIsFirstSlice(nal, h265) != (slice == 0)) {
+				return false;
+			}
+			const uint8_t *p = nal.begin[2] == 0 ? nal.begin + 4 : nal.begin + 3;
+			p += (h265 ? 2 : 1) + 1;
+			rbsp.clear();
+			int zeros = 0;
+			for (; p < nal.end; p++) {
+				if (zeros >= 2 && *p == 3) {
+					zeros = 0;
+					continue;
+				}
+				rbsp.push_back(*p);
+				zeros = *p == 0 ? zeros + 1 : 0;
+			}
+
+			int begin, end;
+			SliceRows(picture.height, slices, slice, begin, end);
+			size_t offset = 0;
+			for (int plane = 0; plane < 3; plane++) {
+				int shift = plane == 0 ? 0 : 1;
+				int width = PlaneWidth(picture, plane);
+				for (int y = begin >> shift; y < end >> shift; y++) {
+					if (offset + width > rbsp.size()) {
+						return false;
+					}
+					memcpy(picture.data[plane] + (size_t)y * picture.linesize[plane], &rbsp[offset], width);
+					offset += width;
+				}
+			}
+			// Only the rbsp_stop_one_bit is left.
+			if (offset + 1 != rbsp.size()) {
+				return false;
+			}
+			slice++;
+		}
+		return slice == slices;
+	}
+
+	// Renders the viewport of each eye, half the width of the frame, with the uv of the vertex
+	// shader (shifted by 0.5 for the right eye) and FRAGMENT_SHADER_SPLIT, then compares with the
+	// frame. A texture is sampled at its nearest texel. Returns the samples that differ.
+	uint64_t CompareComposite(const Picture &frame, const Picture textures[2]) {
+		uint64_t mismatches = 0;
+		for (int eye = 0; eye < 2; eye++) {
+			for (int plane = 0; plane < 3; plane++) {
+				int viewportWidth = PlaneWidth(frame, plane) / 2;
+				int height = PlaneHeight(frame, plane);
+				for (int y = 0; y < height; y++) {
+					float v = (y + 0.5f) / height;
+					for (int x = 0; x < viewportWidth; x++) {
+						float u = (x + 0.5f) / viewportWidth * 0.5f + (eye == 1 ? 0.5f : 0.f);
+						const Picture &texture = u < 0.5f ? textures[0] : textures[1];
+						float textureU = u < 0.5f ? u * 2.f : u * 2.f - 1.f;
+						int texelX = (int)(textureU * PlaneWidth(texture, plane));
+						int texelY = (int)(v * PlaneHeight(texture, plane));
+						uint8_t rendered = texture.data[plane][(size_t)texelY * texture.linesize[plane] + texelX];
+						int frameX = eye * viewportWidth + x;
+						if (rendered != frame.data[plane][(size_t)y * frame.linesize[plane] + frameX]) {
+							mismatches++;
+						}
+					}
+				}
+			}
+		}
+		return mismatches;
+	}
+
+	bool Run(int width, int height, bool h265, bool keyframe, int slices, std::mt19937 &rng) {
+		Frame frame(width, height);
+		FillFrame(frame.Get(), rng);
+
+		// The left eye picture first, then the right one, as GetEncoded() outputs them.
+		std::vector<uint8_t> data = Encode(EyePicture(frame.Get(), 0), h265, keyframe, slices);
+		std::vector<uint8_t> right = Encode(EyePicture(frame.Get(), 1), h265, keyframe, slices);
+		size_t leftSize = data.size();
+		data.insert(data.end(), right.begin(), right.end());
+
+		size_t split = AnnexBFindSecondPicture(data.data(), data.size(), h265);
+		Frame left(width / 2, height);
+		Frame rightDecoded(width / 2, height);
+		bool decoded = split == leftSize && Decode(data.data(), split, h265, slices, left.Get()) &&
+			Decode(data.data() + split, data.size() - split, h265, slices, rightDecoded.Get());
+		const Picture textures[2] = { left.Get(), rightDecoded.Get() };
+		uint64_t mismatches = decoded ? CompareComposite(frame.Get(), textures) : 0;
+
+		bool pass = decoded && mismatches == 0;
+		printf("{\"width\":%d,\"height\":%d,\"codec\":\"%s\",\"keyframe\":%s,\"slices\":%d,\"frame_bytes\":%zu,"
+			"\"left_bytes\":%zu,\"split_at\":%zu,\"decoded\":%s,\"mismatches\":%llu,\"pass\":%s}\n",
+			width, height, h265 ? "h265" : "h264", keyframe ? "true" : "false", slices, data.size(), leftSize,
+			split, decoded ? "true" : "false", (unsigned long long)mismatches, pass ? "true" : "false");
+		fflush(stdout);
+		return pass;
+	}
+}
+
+int main() {
+	// Widths are multiples of 4, as EncodePipelineSW requires.
+	const int SIZES[][2] = { { 2880, 1600 }, { 3664, 1920 }, { 1028, 516 } };
+
+	std::mt19937 rng(1);
+	bool pass = true;
+	for (const auto &size : SIZES) {
+		for (bool h265 : { false, true }) {
+			for (bool keyframe : { true, false }) {
+				for (int slices : { 1, 4 }) {
+					pass = Run(size[0], size[1], h265, keyframe, slices, rng) && pass;
+				}
+			}
+		}
+	}
+	if (!pass) {
+		fprintf(stderr, "The eye streams do not composite to the full frame in some configurations.\n");
+		return 1;
+	}
+	return 0;
+}
@@ -1,23 +1,24 @@
 use crate::{
-    connection_utils, openvr, ClientListAction, CLIENTS_UPDATED_NOTIFIER, MAYBE_LEGACY_SENDER,
-    RESTART_NOTIFIER, SESSION_MANAGER,
+    connection_utils, openvr, ClientListAction, LegacyPacket, VideoPacketBatch,
+    CLIENTS_UPDATED_NOTIFIER, MAYBE_LEGACY_SENDER, RESTART_NOTIFIER, SESSION_MANAGER,
 };
 use alvr_common::{
     audio::AudioDevice,
     audio::{self, AudioDeviceType},
     data::{
         AudioDeviceId, ClientConfigPacket, ClientControlPacket, CodecType, FrameSize,
-        HeadsetInfoPacket, OpenvrConfig, PlayspaceSyncPacket, ServerControlPacket, Version,
-        ALVR_VERSION,
+        HeadsetInfoPacket, OpenvrConfig, PlayspaceSyncPacket, ServerControlPacket, SocketProtocol,
+        Version, ALVR_VERSION,
     },
     logging,
     prelude::*,
     sockets::{
-        ControlSocketReceiver, ControlSocketSender, PeerType, ProtoControlSocket,
-        StreamSocketBuilder, LEGACY,
+        ControlSocketReceiver, ControlSocketSender, NetworkImpairment, PeerType,
+        ProtoControlSocket, StreamSocketBuilder, LEGACY,
     },
     spawn_cancelable,
 };
+use bytes::BytesMut;
 use futures::future::{BoxFuture, Either};
 use nalgebra::Translation3;
 use settings_schema::Switch;
@@ -28,7 +29,7 @@ use std::{
     str::FromStr,
     sync::{mpsc as smpsc, Arc},
     thread,
-    time::Duration,
+    time::{Duration, Instant},
 };
 use tokio::{
     sync::{mpsc as tmpsc, Mutex},
@@ -40,6 +41,13 @@ const RETRY_CONNECT_MIN_INTERVAL: Duration = Duration::from_secs(1);
 const NETWORK_KEEPALIVE_INTERVAL: Duration = Duration::from_secs(1);
 const CLEANUP_PAUSE: Duration = Duration::from_millis(500);
 
+// Packets held back by the network impairment emulation
+#[derive(Clone)]
+enum ImpairedPacket {
+    Owned(Vec<u8>),
+    Video(Arc<VideoPacketBatch>, usize),
+}
+
 fn align32(value: f32) -> u32 {
     ((value / 32.).floor() * 32.) as u32
 }
@@ -215,6 +223,26 @@ async fn client_handshake(
         Switch::Disabled => 0.,
     };
 
+    // The probes must not be fragmented, which the plain UDP socket cannot ask for. Without them,
+    // the packets keep the size of the legacy video packets.
+    let compact_video_packets = &session_settings.connection.compact_video_packets;
+    let mtu_probing = compact_video_packets.content.path_mtu_probing
+        && !matches!(settings.connection.stream_protocol, SocketProtocol::Udp);
+    let max_video_packet_size = if compact_video_packets.content.path_mtu_probing && !mtu_probing {
+        compact_video_packets.content.max_packet_size.min(1400)
+    } else {
+        compact_video_packets.content.max_packet_size
+    };
+
+    let thread_affinity = &session_settings.video.encoder_thread_affinity;
+    let thread_cpu = |cpu: u32| {
+        if thread_affinity.enabled {
+            cpu as i32
+        } else {
+            -1
+        }
+    };
+
     let new_openvr_config = OpenvrConfig {
         universe_id: settings.headset.universe_id,
         headset_serial_number: settings.headset.serial_number,
@@ -233,11 +261,36 @@ async fn client_handshake(
         tracking_ref_only: settings.headset.tracking_ref_only,
         enable_vive_tracker_proxy: settings.headset.enable_vive_tracker_proxy,
         aggressive_keyframe_resend: settings.connection.aggressive_keyframe_resend,
+        fec_large_blocks: settings.connection.fec_large_blocks,
+        fec_rateless: settings.connection.fec_rateless,
+        adaptive_fec: settings.connection.adaptive_fec,
+        fec_inter_percentage: settings.connection.fec_inter_percentage,
+        fec_idr_percentage: settings.connection.fec_idr_percentage,
+        fec_parameter_sets_percentage: settings.connection.fec_parameter_sets_percentage,
+        packet_pacing_percentage: settings.connection.packet_pacing_percentage,
+        compact_video_packets: compact_video_packets.enabled,
+        max_video_packet_size,
+        mtu_probing,
         adapter_index: settings.video.adapter_index,
         codec: matches!(settings.video.codec, CodecType::HEVC) as _,
         refresh_rate: fps as _,
         use_10bit_encoder: settings.video.use_10bit_encoder,
         encode_bitrate_mbs: settings.video.encode_bitrate_mbs,
+        encoder_slices: settings.video.encoder_slices,
+        // Same condition as the client, which cannot foveate the pictures of split encoding.
+        split_eye_encoding: settings.video.split_eye_encoding
+            && !session_settings.video.foveated_rendering.enabled,
+        enable_intra_refresh: session_settings.video.intra_refresh.enabled,
+        intra_refresh_frames: session_settings.video.intra_refresh.content.frames,
+        enable_adaptive_bitrate: session_settings.video.adaptive_bitrate.enabled,
+        adaptive_bitrate_min_mbs: session_settings
+            .video
+            .adaptive_bitrate
+            .content
+            .min_bitrate_mbs,
+        convert_thread_cpu: thread_cpu(thread_affinity.content.convert_cpu),
+        encode_thread_cpu: thread_cpu(thread_affinity.content.encode_cpu),
+        send_thread_cpu: thread_cpu(thread_affinity.content.send_cpu),
         controllers_tracking_system_name: session_settings
             .headset
             .controllers
@@ -480,7 +533,11 @@ async fn connection_pipeline() -> StrResult {
             client_ip,
             settings.connection.stream_port,
             settings.connection.stream_protocol,
-            mbits_to_bytes(settings.video.encode_bitrate_mbs)
+            mbits_to_bytes(settings.video.encode_bitrate_mbs),
+            matches!(
+                &settings.connection.compact_video_packets,
+                Switch::Enabled(desc) if desc.path_mtu_probing
+            ),
         ) => res?,
         _ = time::sleep(Duration::from_secs(5)) => {
             return fmt_e!("Timeout while setting up streams");
@@ -562,16 +619,81 @@ async fn connection_pipeline() -> StrResult {
         Box::pin(future::pending())
     };
 
+    // The impairment of the network is emulated on the server only, for both directions
+    let (maybe_send_impairment, maybe_receive_impairment) =
+        if let Switch::Enabled(desc) = &settings.connection.network_impairment {
+            warn!("Network impairment emulation is enabled");
+            (
+                Some(NetworkImpairment::<ImpairedPacket>::new(desc, desc.seed)?),
+                Some(NetworkImpairment::<BytesMut>::new(
+                    desc,
+                    desc.seed.wrapping_add(1),
+                )?),
+            )
+        } else {
+            (None, None)
+        };
+
     let legacy_send_loop = {
         let mut socket_sender = stream_socket.request_stream::<_, LEGACY>().await?;
         async move {
             let (data_sender, mut data_receiver) = tmpsc::unbounded_channel();
             *MAYBE_LEGACY_SENDER.lock() = Some(data_sender);
 
-            while let Some(data) = data_receiver.recv().await {
-                let mut buffer = socket_sender.new_buffer(&(), data.len())?;
-                buffer.get_mut().extend(data);
-                socket_sender.send_buffer(buffer).await.ok();
+            if let Some(mut impairment) = maybe_send_impairment {
+                loop {
+                    let deadline = impairment.next_delivery();
+                    tokio::select! {
+                        maybe_packet = data_receiver.recv() => {
+                            let now = Instant::now();
+                            match maybe_packet {
+                                Some(LegacyPacket::Owned(data)) => {
+                                    impairment.push(now, data.len(), ImpairedPacket::Owned(data));
+                                }
+                                Some(LegacyPacket::Video(batch)) => {
+                                    // Each packet is impaired on its own, they share the batch
+                                    let batch = Arc::new(batch);
+                                    for index in 0..batch.packet_count() {
+                                        impairment.push(
+                                            now,
+                                            batch.packet(index).len(),
+                                            ImpairedPacket::Video(Arc::clone(&batch), index),
+                                        );
+                                    }
+                                }
+                                None => break,
+                            }
+                        }
+                        _ = time::sleep_until(deadline.unwrap_or_else(Instant::now).into()),
+                            if deadline.is_some() => {}
+                    }
+
+                    while let Some(packet) = impairment.pop(Instant::now()) {
+                        match packet {
+                            ImpairedPacket::Owned(data) => {
+                                let mut buffer = socket_sender.new_buffer(&(), data.len())?;
+                                buffer.get_mut().extend(data);
+                                socket_sender.send_buffer(buffer).await.ok();
+                            }
+                            ImpairedPacket::Video(batch, index) => {
+                                socket_sender.send_slices(&[batch.packet(index)]).await.ok();
+                            }
+                        }
+                    }
+                }
+            } else {
+                while let Some(packet) = data_receiver.recv().await {
+                    match packet {
+                        LegacyPacket::Owned(data) => {
+                            let mut buffer = socket_sender.new_buffer(&(), data.len())?;
+                            buffer.get_mut().extend(data);
+                            socket_sender.send_buffer(buffer).await.ok();
+                        }
+                        LegacyPacket::Video(batch) => {
+                            socket_sender.send_slices(&batch.packets()).await.ok();
+                        }
+                    }
+                }
             }
 
             Ok(())
@@ -581,10 +703,28 @@ async fn connection_pipeline() -> StrResult {
     let legacy_receive_loop = {
         let mut receiver = stream_socket.subscribe_to_stream::<(), LEGACY>().await?;
         async move {
-            loop {
-                let mut data = receiver.recv().await?.buffer;
+            if let Some(mut impairment) = maybe_receive_impairment {
+                loop {
+                    let deadline = impairment.next_delivery();
+                    tokio::select! {
+                        res = receiver.recv() => {
+                            let data = res?.buffer;
+                            impairment.push(Instant::now(), data.len(), data);
+                        }
+                        _ = time::sleep_until(deadline.unwrap_or_else(Instant::now).into()),
+                            if deadline.is_some() => {}
+                    }
 
-                unsafe { crate::LegacyReceive(data.as_mut_ptr(), data.len() as _) };
+                    while let Some(mut data) = impairment.pop(Instant::now()) {
+                        unsafe { crate::LegacyReceive(data.as_mut_ptr(), data.len() as _) };
+                    }
+                }
+            } else {
+                loop {
+                    let mut data = receiver.recv().await?.buffer;
+
+                    unsafe { crate::LegacyReceive(data.as_mut_ptr(), data.len() as _) };
+                }
             }
         }
     };
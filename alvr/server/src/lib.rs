@@ -37,6 +37,45 @@ use tokio::{
     sync::{broadcast, mpsc, Notify},
 };
 
+// Video packets written by C++ inside a VideoFrameBuffer. The buffer is referenced until the batch
+// is dropped, so the packets can be sent without copying them.
+pub struct VideoPacketBatch {
+    packets: Vec<LegacySendPacket>,
+    video_buffer: *mut c_void,
+}
+
+// The C++ reference count is atomic, and the packets are only read
+unsafe impl Send for VideoPacketBatch {}
+unsafe impl Sync for VideoPacketBatch {}
+
+impl VideoPacketBatch {
+    pub fn packet_count(&self) -> usize {
+        self.packets.len()
+    }
+
+    pub fn packet(&self, index: usize) -> &[u8] {
+        let packet = &self.packets[index];
+        unsafe { std::slice::from_raw_parts(packet.buf, packet.len as _) }
+    }
+
+    pub fn packets(&self) -> Vec<&[u8]> {
+        (0..self.packets.len())
+            .map(|index| self.packet(index))
+            .collect()
+    }
+}
+
+impl Drop for VideoPacketBatch {
+    fn drop(&mut self) {
+        unsafe { ReleaseVideoBuffer(self.video_buffer) };
+    }
+}
+
+pub enum LegacyPacket {
+    Owned(Vec<u8>),
+    Video(VideoPacketBatch),
+}
+
 lazy_static! {
     // Since ALVR_DIR is needed to initialize logging, if error then just panic
     static ref ALVR_DIR: PathBuf = {
@@ -46,7 +85,7 @@ lazy_static! {
     static ref MAYBE_RUNTIME: Mutex<Option<Runtime>> = Mutex::new(Runtime::new().ok());
     static ref CLIENTS_UPDATED_NOTIFIER: Notify = Notify::new();
     static ref MAYBE_WINDOW: Mutex<Option<Arc<alcro::UI>>> = Mutex::new(None);
-    static ref MAYBE_LEGACY_SENDER: Mutex<Option<mpsc::UnboundedSender<Vec<u8>>>> =
+    static ref MAYBE_LEGACY_SENDER: Mutex<Option<mpsc::UnboundedSender<LegacyPacket>>> =
         Mutex::new(None);
     static ref RESTART_NOTIFIER: Notify = Notify::new();
     static ref SHUTDOWN_NOTIFIER: Notify = Notify::new();
@@ -281,7 +320,24 @@ pub unsafe extern "C" fn HmdDriverFactory(
                 ptr::copy_nonoverlapping(buffer_ptr, vec_buffer.as_mut_ptr(), len as _);
             }
 
-            sender.send(vec_buffer).ok();
+            sender.send(LegacyPacket::Owned(vec_buffer)).ok();
+        }
+    }
+
+    extern "C" fn legacy_send_batch(
+        packets_ptr: *const LegacySendPacket,
+        count: i32,
+        video_buffer: *mut c_void,
+    ) {
+        // The reference to video_buffer is released when the batch is dropped, even if it is not
+        // sent
+        let batch = VideoPacketBatch {
+            packets: unsafe { std::slice::from_raw_parts(packets_ptr, count as _) }.to_vec(),
+            video_buffer,
+        };
+
+        if let Some(sender) = &*MAYBE_LEGACY_SENDER.lock() {
+            sender.send(LegacyPacket::Video(batch)).ok();
         }
     }
 
@@ -313,6 +369,7 @@ pub unsafe extern "C" fn HmdDriverFactory(
     LogDebug = Some(log_debug);
     DriverReadyIdle = Some(driver_ready_idle);
     LegacySend = Some(legacy_send);
+    LegacySendBatch = Some(legacy_send_batch);
     ShutdownRuntime = Some(_shutdown_runtime);
 
     // cast to usize to allow the variables to cross thread boundaries
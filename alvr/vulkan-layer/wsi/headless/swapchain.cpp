@@ -311,13 +311,7 @@ void swapchain::present_image(uint32_t pending_index) {
 
     m_swapchain_images[pending_index].status = swapchain_image::PRESENTED;
 
-    uint32_t freed;
-    {
-      std::unique_lock<std::mutex> lock(m_shm->mutex);
-      freed = m_shm->next;
-      m_shm->next = pending_index;
-      m_shm->cv.notify_all();
-    }
+    uint32_t freed = m_shm->present(pending_index);
     if (freed != present_shm::none_id)
       unpresent_image(freed);
 
@@ -325,7 +319,7 @@ void swapchain::present_image(uint32_t pending_index) {
     {
       if (m_swapchain_images[i].status == swapchain_image::PRESENTED)
       {
-        if (i != pending_index and i != m_shm->owned_by_consumer)
+        if (i != pending_index and i != m_shm->owned_by_consumer())
           unpresent_image(i);
       }
     }
@@ -30,6 +30,27 @@ SUBCOMMANDS:
     kill-oculus         Kill all Oculus processes
     bump-versions       Bump server and client package versions
     clippy              Show warnings for selected clippy lints
+    bench-fec           Build and run the FEC benchmark, results are saved in build/fec_bench.jsonl
+    test-fec-queue      Build and run the checks of the frame window of the FEC reassembly and of
+                        the loss count of retransmitted packets
+    test-fec-allocations
+                        Build the FEC benchmark and check that sending does not allocate at 90 and
+                        120 Hz, with one and eight slices and with packet pacing
+    bench-intra-refresh Build and run the keyframe vs intra refresh benchmark, results are saved in
+                        build/intra_refresh_bench.jsonl. Needs libavcodec with libx264
+    test-bandwidth-estimator
+                        Build and run the simulation of the adaptive bitrate over a bottleneck link
+    test-fec-policy     Build and run the simulation of the fixed and adaptive FEC policies over
+                        lossy links
+    test-packet-pacer   Build and run the simulation of the packet pacer on a simulated clock
+    bench-present-shm   Build and run the stress test of the frame hand-off between the vulkan layer
+                        and the encoder, results are saved in build/present_shm_bench.jsonl. Linux only
+    bench-annexb        Build and run the NAL unit parsing benchmark, results are saved in
+                        build/annexb_bench.jsonl
+    bench-color-convert Build and run the RGB to YUV conversion benchmark of the software encoder,
+                        results are saved in build/color_convert_bench.jsonl. Needs libswscale
+    test-split-eye      Build and run the check that the two streams of split eye encoding
+                        composite to the full frame
 
 FLAGS:
     --fetch             Update crates with "cargo update". Used only for build subcommands
@@ -491,6 +512,397 @@ pub fn kill_oculus_processes() {
     .unwrap();
 }
 
+fn build_fec_bench() -> PathBuf {
+    let client_dir = workspace_dir().join("alvr/client/android");
+    let common_dir = client_dir.join("ALVR-common");
+    let client_cpp_dir = client_dir.join("app/src/main/cpp");
+    let server_cpp_dir = workspace_dir().join("alvr/server/cpp");
+    let out_dir = target_dir().join("fec_bench");
+    fs::create_dir_all(&out_dir).unwrap();
+    fs::create_dir_all(build_dir()).unwrap();
+
+    let cc = env::var("CC").unwrap_or_else(|_| "cc".to_owned());
+    let cxx = env::var("CXX").unwrap_or_else(|_| "c++".to_owned());
+    let rs_obj = out_dir.join("rs.o");
+    let bench_exe = out_dir.join("fec_bench");
+
+    command::run(&format!(
+        "{} -O2 -c {} -o {}",
+        cc,
+        common_dir.join("reedsolomon/rs.c").to_string_lossy(),
+        rs_obj.to_string_lossy()
+    ))
+    .unwrap();
+    // The send path of the server, without the logger and the bindings to the Rust side.
+    let server_sources = [
+        "ClientConnection.cpp",
+        "Settings.cpp",
+        "FecPolicy.cpp",
+        "BandwidthEstimator.cpp",
+        "PacketPacer.cpp",
+        "MtuProber.cpp",
+        "VideoFrameBuffer.cpp",
+    ]
+    .iter()
+    .map(|source| {
+        server_cpp_dir
+            .join("alvr_server")
+            .join(source)
+            .to_string_lossy()
+            .into_owned()
+    })
+    .collect::<Vec<_>>()
+    .join(" ");
+
+    command::run(&format!(
+        "{} -std=c++17 -O2 -I{} -I{} -I{} -I{} -I{} {} {} {} {} {} {} -o {} -lpthread",
+        cxx,
+        common_dir.to_string_lossy(),
+        client_cpp_dir.to_string_lossy(),
+        server_cpp_dir.to_string_lossy(),
+        server_cpp_dir.join("alvr_server").to_string_lossy(),
+        server_cpp_dir.join("openvr/headers").to_string_lossy(),
+        server_cpp_dir
+            .join("tools/fec_bench/fec_bench.cpp")
+            .to_string_lossy(),
+        server_sources,
+        common_dir.join("annexb.cpp").to_string_lossy(),
+        common_dir
+            .join("reedsolomon/rs_cache.cpp")
+            .to_string_lossy(),
+        client_cpp_dir.join("fec.cpp").to_string_lossy(),
+        rs_obj.to_string_lossy(),
+        bench_exe.to_string_lossy()
+    ))
+    .unwrap();
+
+    bench_exe
+}
+
+// Host-only checks of the frame window of FECQueue and of the loss count of NACKed packets. Linux
+// only.
+pub fn test_fec_queue() {
+    let client_dir = workspace_dir().join("alvr/client/android");
+    let common_dir = client_dir.join("ALVR-common");
+    let client_cpp_dir = client_dir.join("app/src/main/cpp");
+    let server_cpp_dir = workspace_dir().join("alvr/server/cpp");
+    let out_dir = target_dir().join("fec_queue_test");
+    fs::create_dir_all(&out_dir).unwrap();
+
+    let cc = env::var("CC").unwrap_or_else(|_| "cc".to_owned());
+    let cxx = env::var("CXX").unwrap_or_else(|_| "c++".to_owned());
+    let rs_obj = out_dir.join("rs.o");
+    let test_exe = out_dir.join("fec_queue_test");
+
+    command::run(&format!(
+        "{} -O2 -c {} -o {}",
+        cc,
+        common_dir.join("reedsolomon/rs.c").to_string_lossy(),
+        rs_obj.to_string_lossy()
+    ))
+    .unwrap();
+    command::run(&format!(
+        "{} -std=c++17 -O2 -I{} -I{} {} {} {} {} {} -o {} -lpthread",
+        cxx,
+        common_dir.to_string_lossy(),
+        client_cpp_dir.to_string_lossy(),
+        server_cpp_dir
+            .join("tools/fec_queue_test/fec_queue_test.cpp")
+            .to_string_lossy(),
+        common_dir
+            .join("reedsolomon/rs_cache.cpp")
+            .to_string_lossy(),
+        client_cpp_dir.join("fec.cpp").to_string_lossy(),
+        client_cpp_dir.join("packet_loss.cpp").to_string_lossy(),
+        rs_obj.to_string_lossy(),
+        test_exe.to_string_lossy()
+    ))
+    .unwrap();
+    command::run(&test_exe.to_string_lossy()).unwrap();
+}
+
+// Host-only benchmark of video FEC encoding and FECQueue reassembly. Linux only.
+pub fn bench_fec() {
+    let bench_exe = build_fec_bench();
+    command::run(&format!(
+        "set -o pipefail && {} | tee {}",
+        bench_exe.to_string_lossy(),
+        build_dir().join("fec_bench.jsonl").to_string_lossy()
+    ))
+    .unwrap();
+}
+
+// Fails if the FEC send path allocates in steady state, at 90 and 120 Hz, with one and with the
+// most slices per frame, and with packet pacing. Linux only.
+pub fn test_fec_allocations() {
+    let bench_exe = build_fec_bench();
+    for args in &["", "--slices 8", "--pacing 50"] {
+        command::run(&format!(
+            "{} --check-allocations {}",
+            bench_exe.to_string_lossy(),
+            args
+        ))
+        .unwrap();
+    }
+}
+
+// Host-only comparison of keyframe and intra refresh loss recovery with the software encoder.
+// Linux only.
+pub fn bench_intra_refresh() {
+    let client_dir = workspace_dir().join("alvr/client/android");
+    let common_dir = client_dir.join("ALVR-common");
+    let client_cpp_dir = client_dir.join("app/src/main/cpp");
+    let server_cpp_dir = workspace_dir().join("alvr/server/cpp");
+    let out_dir = target_dir().join("intra_refresh_bench");
+    fs::create_dir_all(&out_dir).unwrap();
+    fs::create_dir_all(build_dir()).unwrap();
+
+    let cc = env::var("CC").unwrap_or_else(|_| "cc".to_owned());
+    let cxx = env::var("CXX").unwrap_or_else(|_| "c++".to_owned());
+    let rs_obj = out_dir.join("rs.o");
+    let bench_exe = out_dir.join("intra_refresh_bench");
+
+    command::run(&format!(
+        "{} -O2 -c {} -o {}",
+        cc,
+        common_dir.join("reedsolomon/rs.c").to_string_lossy(),
+        rs_obj.to_string_lossy()
+    ))
+    .unwrap();
+    command::run(&format!(
+        "{} -std=c++17 -O2 -I{} -I{} -I{} {} {} {} {} {} -o {} -lpthread $(pkg-config --cflags --libs libavcodec libavutil)",
+        cxx,
+        common_dir.to_string_lossy(),
+        client_cpp_dir.to_string_lossy(),
+        server_cpp_dir.to_string_lossy(),
+        server_cpp_dir
+            .join("tools/intra_refresh_bench/intra_refresh_bench.cpp")
+            .to_string_lossy(),
+        server_cpp_dir
+            .join("alvr_server/VideoFrameBuffer.cpp")
+            .to_string_lossy(),
+        common_dir
+            .join("reedsolomon/rs_cache.cpp")
+            .to_string_lossy(),
+        client_cpp_dir.join("fec.cpp").to_string_lossy(),
+        rs_obj.to_string_lossy(),
+        bench_exe.to_string_lossy()
+    ))
+    .unwrap();
+    command::run(&format!(
+        "set -o pipefail && {} | tee {}",
+        bench_exe.to_string_lossy(),
+        build_dir()
+            .join("intra_refresh_bench.jsonl")
+            .to_string_lossy()
+    ))
+    .unwrap();
+}
+
+// Host-only simulation of the bandwidth estimation over a bottleneck link. Fails if the target
+// bitrate does not follow the capacity. Linux only.
+pub fn test_bandwidth_estimator() {
+    let client_dir = workspace_dir().join("alvr/client/android");
+    let common_dir = client_dir.join("ALVR-common");
+    let client_cpp_dir = client_dir.join("app/src/main/cpp");
+    let server_cpp_dir = workspace_dir().join("alvr/server/cpp");
+    let out_dir = target_dir().join("bandwidth_sim");
+    fs::create_dir_all(&out_dir).unwrap();
+
+    let cxx = env::var("CXX").unwrap_or_else(|_| "c++".to_owned());
+    let sim_exe = out_dir.join("bandwidth_sim");
+
+    command::run(&format!(
+        "{} -std=c++17 -O2 -I{} -I{} -I{} {} {} {} -o {}",
+        cxx,
+        common_dir.to_string_lossy(),
+        client_cpp_dir.to_string_lossy(),
+        server_cpp_dir.to_string_lossy(),
+        server_cpp_dir
+            .join("tools/bandwidth_sim/bandwidth_sim.cpp")
+            .to_string_lossy(),
+        server_cpp_dir
+            .join("alvr_server/BandwidthEstimator.cpp")
+            .to_string_lossy(),
+        client_cpp_dir.join("arrival_report.cpp").to_string_lossy(),
+        sim_exe.to_string_lossy()
+    ))
+    .unwrap();
+    command::run(&sim_exe.to_string_lossy()).unwrap();
+}
+
+// Host-only simulation of the FEC policies over lossy links. Fails if the adaptive policy does not
+// follow the losses. Linux only.
+pub fn test_fec_policy() {
+    let server_cpp_dir = workspace_dir().join("alvr/server/cpp");
+    let out_dir = target_dir().join("fec_policy_sim");
+    fs::create_dir_all(&out_dir).unwrap();
+
+    let cxx = env::var("CXX").unwrap_or_else(|_| "c++".to_owned());
+    let sim_exe = out_dir.join("fec_policy_sim");
+
+    command::run(&format!(
+        "{} -std=c++17 -O2 -I{} -I{} {} {} -o {}",
+        cxx,
+        server_cpp_dir.join("ALVR-common").to_string_lossy(),
+        server_cpp_dir.to_string_lossy(),
+        server_cpp_dir
+            .join("tools/fec_policy_sim/fec_policy_sim.cpp")
+            .to_string_lossy(),
+        server_cpp_dir
+            .join("alvr_server/FecPolicy.cpp")
+            .to_string_lossy(),
+        sim_exe.to_string_lossy()
+    ))
+    .unwrap();
+    command::run(&sim_exe.to_string_lossy()).unwrap();
+}
+
+// Host-only simulation of the packet pacer. Fails if a packet is sent twice, out of order or
+// outside of its window, or if an urgent batch waits behind a frame.
+pub fn test_packet_pacer() {
+    let server_cpp_dir = workspace_dir().join("alvr/server/cpp");
+    let out_dir = target_dir().join("pacer_sim");
+    fs::create_dir_all(&out_dir).unwrap();
+
+    let cxx = env::var("CXX").unwrap_or_else(|_| "c++".to_owned());
+    let sim_exe = out_dir.join("pacer_sim");
+
+    command::run(&format!(
+        "{} -std=c++17 -O2 -I{} -I{} -I{} {} {} -o {}",
+        cxx,
+        server_cpp_dir.join("ALVR-common").to_string_lossy(),
+        server_cpp_dir.to_string_lossy(),
+        server_cpp_dir.join("alvr_server").to_string_lossy(),
+        server_cpp_dir
+            .join("tools/pacer_sim/pacer_sim.cpp")
+            .to_string_lossy(),
+        server_cpp_dir
+            .join("alvr_server/PacketPacer.cpp")
+            .to_string_lossy(),
+        sim_exe.to_string_lossy()
+    ))
+    .unwrap();
+    command::run(&sim_exe.to_string_lossy()).unwrap();
+}
+
+// Two process stress test of present_shm, the shared memory between the vulkan layer and CEncoder.
+// Fails if the producer wrote into an image owned by the consumer or if an image got lost.
+pub fn bench_present_shm() {
+    let server_cpp_dir = workspace_dir().join("alvr/server/cpp");
+    let out_dir = target_dir().join("present_shm_bench");
+    fs::create_dir_all(&out_dir).unwrap();
+    fs::create_dir_all(build_dir()).unwrap();
+
+    let cxx = env::var("CXX").unwrap_or_else(|_| "c++".to_owned());
+    let bench_exe = out_dir.join("present_shm_bench");
+
+    command::run(&format!(
+        "{} -std=c++17 -O2 -I{} $(pkg-config --cflags vulkan) {} -o {} -lpthread",
+        cxx,
+        server_cpp_dir.to_string_lossy(),
+        server_cpp_dir
+            .join("tools/present_shm_bench/present_shm_bench.cpp")
+            .to_string_lossy(),
+        bench_exe.to_string_lossy()
+    ))
+    .unwrap();
+    command::run(&format!(
+        "set -o pipefail && {} | tee {}",
+        bench_exe.to_string_lossy(),
+        build_dir()
+            .join("present_shm_bench.jsonl")
+            .to_string_lossy()
+    ))
+    .unwrap();
+}
+
+pub fn bench_annexb() {
+    let common_dir = workspace_dir().join("alvr/client/android/ALVR-common");
+    let server_cpp_dir = workspace_dir().join("alvr/server/cpp");
+    let out_dir = target_dir().join("annexb_bench");
+    fs::create_dir_all(&out_dir).unwrap();
+    fs::create_dir_all(build_dir()).unwrap();
+
+    let cxx = env::var("CXX").unwrap_or_else(|_| "c++".to_owned());
+    let bench_exe = out_dir.join("annexb_bench");
+
+    command::run(&format!(
+        "{} -std=c++17 -O2 -I{} {} {} -o {}",
+        cxx,
+        common_dir.to_string_lossy(),
+        server_cpp_dir
+            .join("tools/annexb_bench/annexb_bench.cpp")
+            .to_string_lossy(),
+        common_dir.join("annexb.cpp").to_string_lossy(),
+        bench_exe.to_string_lossy()
+    ))
+    .unwrap();
+    command::run(&format!(
+        "set -o pipefail && {} | tee {}",
+        bench_exe.to_string_lossy(),
+        build_dir().join("annexb_bench.jsonl").to_string_lossy()
+    ))
+    .unwrap();
+}
+
+// Host-only check of split eye encoding, from the halves of the frame given to the encoders to the
+// composite rendered by the client. Fails on any mismatch.
+pub fn test_split_eye() {
+    let common_dir = workspace_dir().join("alvr/client/android/ALVR-common");
+    let server_cpp_dir = workspace_dir().join("alvr/server/cpp");
+    let out_dir = target_dir().join("split_eye_check");
+    fs::create_dir_all(&out_dir).unwrap();
+
+    let cxx = env::var("CXX").unwrap_or_else(|_| "c++".to_owned());
+    let check_exe = out_dir.join("split_eye_check");
+
+    command::run(&format!(
+        "{} -std=c++17 -O2 -I{} {} {} -o {}",
+        cxx,
+        common_dir.to_string_lossy(),
+        server_cpp_dir
+            .join("tools/split_eye_check/split_eye_check.cpp")
+            .to_string_lossy(),
+        common_dir.join("annexb.cpp").to_string_lossy(),
+        check_exe.to_string_lossy()
+    ))
+    .unwrap();
+    command::run(&check_exe.to_string_lossy()).unwrap();
+}
+
+pub fn bench_color_convert() {
+    let server_cpp_dir = workspace_dir().join("alvr/server/cpp");
+    let out_dir = target_dir().join("color_convert_bench");
+    fs::create_dir_all(&out_dir).unwrap();
+    fs::create_dir_all(build_dir()).unwrap();
+
+    let cxx = env::var("CXX").unwrap_or_else(|_| "c++".to_owned());
+    let bench_exe = out_dir.join("color_convert_bench");
+
+    command::run(&format!(
+        "{} -std=c++17 -O2 -I{} {} {} -o {} -lpthread $(pkg-config --cflags --libs libswscale libavutil)",
+        cxx,
+        server_cpp_dir.to_string_lossy(),
+        server_cpp_dir
+            .join("tools/color_convert_bench/color_convert_bench.cpp")
+            .to_string_lossy(),
+        server_cpp_dir
+            .join("platform/linux/ColorConverter.cpp")
+            .to_string_lossy(),
+        bench_exe.to_string_lossy()
+    ))
+    .unwrap();
+    command::run(&format!(
+        "set -o pipefail && {} | tee {}",
+        bench_exe.to_string_lossy(),
+        build_dir()
+            .join("color_convert_bench.jsonl")
+            .to_string_lossy()
+    ))
+    .unwrap();
+}
+
 fn clippy() {
     command::run(&format!(
         "cargo clippy {} -- {} {} {} {} {} {} {} {} {} {} {}",
@@ -549,6 +961,17 @@ fn main() {
                 "kill-oculus" => kill_oculus_processes(),
                 "bump-versions" => version::bump_version(version, is_nightly),
                 "clippy" => clippy(),
+                "bench-fec" => bench_fec(),
+                "test-fec-queue" => test_fec_queue(),
+                "test-fec-allocations" => test_fec_allocations(),
+                "bench-intra-refresh" => bench_intra_refresh(),
+                "test-bandwidth-estimator" => test_bandwidth_estimator(),
+                "test-fec-policy" => test_fec_policy(),
+                "test-packet-pacer" => test_packet_pacer(),
+                "bench-present-shm" => bench_present_shm(),
+                "bench-annexb" => bench_annexb(),
+                "bench-color-convert" => bench_color_convert(),
+                "test-split-eye" => test_split_eye(),
                 _ => {
                     println!("\nUnrecognized subcommand.");
                     println!("{}", HELP_STR);